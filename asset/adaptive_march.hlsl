@@ -0,0 +1,83 @@
+#ifndef ADAPTIVE_MARCH_HLSL
+#define ADAPTIVE_MARCH_HLSL
+
+// error-driven step counts, the shader counterpart of AdaptiveRayMarch in
+// src/cpu/adaptive_march.h.
+//
+// a heap of cells doesn't fit a pixel or a thread, so instead of halving
+// the worst cell until the tolerance is met, every pilot cell is estimated
+// once and split into as many uniform midpoint cells as its error asks for.
+// the error of a cell is measured as on the CPU, and falls with the square
+// of the split count, so ceil(sqrt(error / tolerance)) cells suffice. the
+// split counts are scaled down when their sum exceeds the budget.
+
+// a cell is split at most as finely as AdaptiveRayMarch::MAX_DEPTH halvings
+#define MAX_ADAPTIVE_SPLIT_COUNT 256
+
+// estimates are { sigmaT, source }, see AdaptiveRayMarch::place
+struct AdaptiveCell
+{
+    float2 f0, fm, f1;
+    float  len;
+    float  depth0;
+};
+
+// extinction integral over the cell
+float integrateAdaptiveDensity(AdaptiveCell cell)
+{
+    return cell.len / 6 * (cell.f0.x + 4 * cell.fm.x + cell.f1.x);
+}
+
+// in-scattering at the start, the midpoint and the end of the cell
+float3 evalAdaptiveInScatter(AdaptiveCell cell)
+{
+    float depthM = cell.depth0 + cell.len / 24 * (5 * cell.f0.x + 8 * cell.fm.x - cell.f1.x);
+    float depth1 = cell.depth0 + integrateAdaptiveDensity(cell);
+    return float3(
+        cell.f0.y * exp(-cell.depth0),
+        cell.fm.y * exp(-depthM),
+        cell.f1.y * exp(-depth1));
+}
+
+// Simpson integrals of the extinction and of the in-scattering
+float2 integrateAdaptiveCell(AdaptiveCell cell)
+{
+    float3 g = evalAdaptiveInScatter(cell);
+    return float2(
+        integrateAdaptiveDensity(cell),
+        cell.len / 6 * (g.x + 4 * g.y + g.z));
+}
+
+// midpoint cells to split the cell into, given the integrals over the
+// whole segment of length totalLength
+int getAdaptiveSplitCount(
+    AdaptiveCell cell, float2 integral, float totalLength, float tolerance)
+{
+    if(cell.len <= 0)
+        return 1;
+
+    float3 g = evalAdaptiveInScatter(cell);
+
+    float densityError   = abs(cell.f0.x - 2 * cell.fm.x + cell.f1.x);
+    float inScatterError = abs(g.x - 2 * g.y + g.z);
+
+    // see AdaptiveRayMarch::evalError
+    float rel = max(
+        integral.x > 0 ? densityError   / integral.x : 0,
+        integral.y > 0 ? inScatterError / integral.y : 0);
+    float error = rel * totalLength / 6;
+
+    return clamp(
+        (int)ceil(sqrt(error / tolerance)), 1, MAX_ADAPTIVE_SPLIT_COUNT);
+}
+
+// split count of a cell after fitting the counts of all cellCount cells,
+// which sum to total, into budget. every cell keeps at least one sample.
+int fitAdaptiveSplitCount(int count, int total, int cellCount, int budget)
+{
+    if(total <= max(budget, cellCount))
+        return count;
+    return 1 + (count - 1) * max(0, budget - cellCount) / (total - cellCount);
+}
+
+#endif // #ifndef ADAPTIVE_MARCH_HLSL
@@ -1,8 +1,10 @@
 #define THREAD_GROUP_SIZE_X 16
 #define THREAD_GROUP_SIZE_Y 16
 
+#include "./adaptive_march.hlsl"
 #include "./intersection.hlsl"
 #include "./medium.hlsl"
+#include "./quadrature.hlsl"
 
 cbuffer CSParams
 {
@@ -13,6 +15,14 @@ cbuffer CSParams
     float3 FrustumD;          float AtmosEyeHeight;
     float3 EyePosition;       int   EnableShadow;
     float4x4 ShadowViewProj;  float WorldScale;
+                              int   RowOffset;
+                              int   EnableTemporal;
+                              float TemporalBlend;
+    float4x4 PrevViewProj;
+    float3 PrevEyePosition;   float JitterOffset;
+    float  SliceExponent;     int   QuadratureScheme;
+    int    EnableAdaptive;    float AdaptiveTolerance;
+    int    MaxAdaptiveStepCount;
 }
 
 Texture2D<float3> MultiScattering;
@@ -22,16 +32,190 @@ SamplerState      MTSampler;
 Texture2D<float> ShadowMap;
 SamplerState     ShadowSampler;
 
+Texture3D<float4> History;
+
 RWTexture3D<float4> AerialPerspectiveLUT;
+RWTexture2D<uint>   SampleCounts;
 
 float relativeLuminance(float3 c)
 {
     return 0.2126 * c.r + 0.7152 * c.g + 0.0722 * c.b;
 }
 
+// distance of the froxel centers of slice z, see AerialPerspectiveLUT::setSliceDistribution
+float getSliceDistance(int z, int depth)
+{
+    return MaxDistance * pow((z + 0.5) / depth, SliceExponent);
+}
+
+// value blended with the previous volume at distance t along dir
+float4 blendHistory(float3 dir, float t, float4 value)
+{
+    float3 position = EyePosition + dir * t / WorldScale;
+    float4 clip     = mul(float4(position, 1), PrevViewProj);
+    if(clip.w <= 0)
+        return value;
+
+    float3 uvw = float3(
+        0.5 + float2(0.5, -0.5) * clip.xy / clip.w,
+        pow(WorldScale * distance(position, PrevEyePosition) / MaxDistance,
+            1 / SliceExponent));
+    if(any(uvw.xy != saturate(uvw.xy)) || uvw.z > 1)
+        return value;
+
+    float4 history = History.SampleLevel(MTSampler, uvw, 0);
+    return lerp(history, value, TemporalBlend);
+}
+
+// whether the shadow map hides the sun at distance t along dir
+bool isInShadow(float3 dir, float t)
+{
+    float3 shadowPos  = EyePosition + dir * t / WorldScale;
+    float4 shadowClip = mul(float4(shadowPos, 1), ShadowViewProj);
+    float2 shadowNDC  = shadowClip.xy / shadowClip.w;
+    float2 shadowUV   = 0.5 + float2(0.5, -0.5) * shadowNDC;
+
+    bool inShadow = EnableShadow;
+    if(EnableShadow && all(saturate(shadowUV) == shadowUV))
+    {
+        float rayZ = shadowClip.z;
+        float smZ = ShadowMap.SampleLevel(ShadowSampler, shadowUV, 0);
+        inShadow = rayZ >= smZ;
+    }
+    return inShadow;
+}
+
+// in-scattering per unit length at distance t along dir, reaching the eye
+// through eyeTrans
+float3 evalInScattering(float3 ori, float3 dir, float u, float t, float3 eyeTrans)
+{
+    float3 posR = float3(0, ori.y + PlanetRadius, 0) + dir * t;
+    float  h    = length(posR) - PlanetRadius;
+
+    float3 sigmaS = getSigmaS(h);
+    float3 result = float3(0, 0, 0);
+
+    if(!hasIntersectionWithSphere(posR, -SunDirection, PlanetRadius))
+    {
+        if(!isInShadow(dir, t))
+        {
+            float3 rho = evalPhaseFunction(h, u);
+            float3 sunTrans = getTransmittance(
+                Transmittance, MTSampler, h, SunTheta);
+            result += eyeTrans * sigmaS * rho * sunTrans;
+        }
+    }
+
+    if(EnableMultiScattering)
+    {
+        float tx = h / (AtmosphereRadius - PlanetRadius);
+        float ty = 0.5 + 0.5 * sin(SunTheta);
+        float3 ms = MultiScattering.SampleLevel(
+            MTSampler, float2(tx, ty), 0);
+        result += eyeTrans * sigmaS * ms;
+    }
+
+    return result;
+}
+
+// marches n cells over [tBeg, tEnd], continuing the eye optical depth sumSigmaT
+void marchCells(
+    float3 ori, float3 dir, float u, float rate, int n, float tBeg, float tEnd,
+    float jitter, inout float3 sumSigmaT, inout float3 inScatter)
+{
+    float3 planetPos = float3(0, ori.y + PlanetRadius, 0);
+    for(int i = 0; i < n; ++i)
+    {
+        float t, dt;
+        placeQuadratureCell(rate, n, i, tBeg, tEnd, jitter, t, dt);
+
+        float3 sigmaT = getSigmaT(length(planetPos + dir * t) - PlanetRadius);
+        float3 deltaSumSigmaT = dt * sigmaT;
+        float3 eyeTrans = exp(-sumSigmaT - 0.5 * deltaSumSigmaT);
+
+        inScatter += dt * evalInScattering(ori, dir, u, t, eyeTrans);
+        sumSigmaT += deltaSumSigmaT;
+    }
+}
+
+// { sigmaT, source } at distance t, see CPUAerialPerspectiveLUT::placeAdaptive
+float2 estimateAdaptive(float3 ori, float3 dir, float t)
+{
+    float3 posR = float3(0, ori.y + PlanetRadius, 0) + dir * t;
+    float  h    = length(posR) - PlanetRadius;
+
+    float source = 0;
+    if(!hasIntersectionWithSphere(posR, -SunDirection, PlanetRadius) &&
+       !isInShadow(dir, t))
+    {
+        float3 sunTrans = getTransmittance(Transmittance, MTSampler, h, SunTheta);
+        source = relativeLuminance(getSigmaS(h) * sunTrans);
+    }
+
+    return float2(relativeLuminance(getSigmaT(h)), source);
+}
+
+// pilot cell of a slice over [tBeg, tEnd], given the estimate f0 at its
+// start and the eye optical depth depth0 of the slices before it
+AdaptiveCell estimateAdaptiveSlice(
+    float3 ori, float3 dir, float tBeg, float tEnd, float2 f0, float depth0)
+{
+    AdaptiveCell cell;
+    cell.f0     = f0;
+    cell.fm     = estimateAdaptive(ori, dir, 0.5 * (tBeg + tEnd));
+    cell.f1     = estimateAdaptive(ori, dir, tEnd);
+    cell.len    = tEnd - tBeg;
+    cell.depth0 = depth0;
+    return cell;
+}
+
+// integrals over the pilot cells of all slices of a column
+float2 integrateAdaptiveColumn(float3 ori, float3 dir, int depth, float maxT)
+{
+    float2 integral = float2(0, 0);
+    float2 f0       = estimateAdaptive(ori, dir, 0);
+    float  tBeg     = 0;
+    for(int z = 0; z < depth; ++z)
+    {
+        float tEnd = min(getSliceDistance(z, depth), maxT);
+        AdaptiveCell cell = estimateAdaptiveSlice(
+            ori, dir, tBeg, tEnd, f0, integral.x);
+
+        integral += integrateAdaptiveCell(cell);
+        f0   = cell.f1;
+        tBeg = tEnd;
+    }
+    return integral;
+}
+
+// sum of the split counts of all slices of a column
+int countAdaptiveColumn(
+    float3 ori, float3 dir, int depth, float maxT, float2 integral, float totalLength)
+{
+    int    total  = 0;
+    float  depth0 = 0;
+    float2 f0     = estimateAdaptive(ori, dir, 0);
+    float  tBeg   = 0;
+    for(int z = 0; z < depth; ++z)
+    {
+        float tEnd = min(getSliceDistance(z, depth), maxT);
+        AdaptiveCell cell = estimateAdaptiveSlice(
+            ori, dir, tBeg, tEnd, f0, depth0);
+
+        total  += getAdaptiveSplitCount(cell, integral, totalLength, AdaptiveTolerance);
+        depth0 += integrateAdaptiveDensity(cell);
+        f0      = cell.f1;
+        tBeg    = tEnd;
+    }
+    return total;
+}
+
 [numthreads(THREAD_GROUP_SIZE_X, THREAD_GROUP_SIZE_Y, 1)]
-void CSMain(int3 threadIdx : SV_DispatchThreadID)
+void CSMain(int3 dispatchIdx : SV_DispatchThreadID)
 {
+    // amortized updates dispatch a band of rows at a time
+    int3 threadIdx = dispatchIdx + int3(0, RowOffset, 0);
+
     int width, height, depth;
     AerialPerspectiveLUT.GetDimensions(width, height, depth);
     if(threadIdx.x >= width || threadIdx.y >= height)
@@ -54,79 +238,104 @@ void CSMain(int3 threadIdx : SV_DispatchThreadID)
             ori + float3(0, PlanetRadius, 0), dir, AtmosphereRadius, maxT);
     }
 
-    float sliceDepth = MaxDistance / depth;
-    float halfSliceDepth = 0.5 * sliceDepth;
-    float tBeg = 0, tEnd = min(halfSliceDepth, maxT);
+    // slice z ends at its froxel center, at depth coordinate (z + 0.5) / depth
+    float tBeg = 0, tEnd = min(getSliceDistance(0, depth), maxT);
 
     float3 sumSigmaT = float3(0, 0, 0);
     float3 inScatter = float3(0, 0, 0);
 
+    // temporal mode rotates the offsets of all texels by a per-frame
+    // low-discrepancy sequence
     float rand = frac(sin(dot(
-        float2(xf, yf), float2(12.9898, 78.233) * 2.0)) * 43758.5453);
+        float2(xf, yf), float2(12.9898, 78.233) * 2.0)) * 43758.5453 + JitterOffset);
 
-    for(int z = 0; z < depth; ++z)
-    {
-        float dt = (tEnd - tBeg) / PerSliceMarchStepCount;
-        float t = tBeg;
+    float3 planetPos   = float3(0, ori.y + PlanetRadius, 0);
+    int    n           = PerSliceMarchStepCount;
+    int    sampleCount = 0;
 
-        for(int i = 0; i < PerSliceMarchStepCount; ++i)
-        {
-            float nextT = t + dt;
+    // the adaptive march replaces the quadrature, as on the CPU. the split
+    // count of a slice needs the integrals and the total count over the
+    // whole column, so the pilot cells are estimated twice more up front.
 
-            float  midT = lerp(t, nextT, rand);
-            float3 posR = float3(0, ori.y + PlanetRadius, 0) + dir * midT;
-            float  h    = length(posR) - PlanetRadius;
+    float  pilotLength   = min(getSliceDistance(depth - 1, depth), maxT);
+    float2 pilotIntegral = float2(0, 0);
+    int    pilotTotal    = 0;
+    float2 pilotF0       = float2(0, 0);
+    float  pilotDepth    = 0;
 
-            //float sunTheta = PI / 2 - acos(dot(-SunDirection, normalize(posR)));
+    if(EnableAdaptive)
+    {
+        pilotIntegral = integrateAdaptiveColumn(ori, dir, depth, maxT);
+        pilotTotal    = countAdaptiveColumn(
+            ori, dir, depth, maxT, pilotIntegral, pilotLength);
+        pilotF0       = estimateAdaptive(ori, dir, 0);
+    }
 
-            float3 sigmaS, sigmaT;
-            getSigmaST(h, sigmaS, sigmaT);
+    for(int z = 0; z < depth; ++z)
+    {
+        if(EnableAdaptive)
+        {
+            AdaptiveCell cell = estimateAdaptiveSlice(
+                ori, dir, tBeg, tEnd, pilotF0, pilotDepth);
+            pilotF0     = cell.f1;
+            pilotDepth += integrateAdaptiveDensity(cell);
 
-            float3 deltaSumSigmaT = dt * sigmaT;
-            float3 eyeTrans = exp(-sumSigmaT - 0.5 * deltaSumSigmaT);
+            int m = fitAdaptiveSplitCount(
+                getAdaptiveSplitCount(
+                    cell, pilotIntegral, pilotLength, AdaptiveTolerance),
+                pilotTotal, depth, MaxAdaptiveStepCount);
 
-            if(!hasIntersectionWithSphere(posR, -SunDirection, PlanetRadius))
+            marchCells(ori, dir, u, 0, m, tBeg, tEnd, rand, sumSigmaT, inScatter);
+            sampleCount += m;
+        }
+        else if(isFixedQuadrature(QuadratureScheme))
+        {
+            // the eye transmittance of a node integrates the extinction at
+            // all nodes of the slice through the running weights
+            float len = tEnd - tBeg;
+
+            float3 sigmaT[MAX_FIXED_QUADRATURE_SAMPLE_COUNT];
+            for(int i = 0; i < n; ++i)
             {
-                float3 shadowPos  = EyePosition + dir * midT / WorldScale;
-                float4 shadowClip = mul(float4(shadowPos, 1), ShadowViewProj);
-                float2 shadowNDC  = shadowClip.xy / shadowClip.w;
-                float2 shadowUV   = 0.5 + float2(0.5, -0.5) * shadowNDC;
-
-                bool inShadow = EnableShadow;
-                if(EnableShadow && all(saturate(shadowUV) == shadowUV))
-                {
-                    float rayZ = shadowClip.z;
-                    float smZ = ShadowMap.SampleLevel(ShadowSampler, shadowUV, 0);
-                    inShadow = rayZ >= smZ;
-                }
-
-                if(!inShadow)
-                {
-                    float3 rho = evalPhaseFunction(h, u);
-                    float3 sunTrans = getTransmittance(
-                        Transmittance, MTSampler, h, SunTheta);
-                    inScatter += dt * eyeTrans * sigmaS * rho * sunTrans;
-                }
+                float t = tBeg + len * getQuadratureNode(n, i);
+                sigmaT[i] = getSigmaT(length(planetPos + dir * t) - PlanetRadius);
             }
 
-            if(EnableMultiScattering)
+            float3 sliceSigmaT = float3(0, 0, 0);
+            for(int i = 0; i < n; ++i)
             {
-                float tx = h / (AtmosphereRadius - PlanetRadius);
-                float ty = 0.5 + 0.5 * sin(SunTheta);
-                float3 ms = MultiScattering.SampleLevel(
-                    MTSampler, float2(tx, ty), 0);
-                inScatter += dt * eyeTrans * sigmaS * ms;
+                float3 opticalDepth = float3(0, 0, 0);
+                for(int j = 0; j < n; ++j)
+                    opticalDepth += getQuadratureRunningWeight(n, i, j) * sigmaT[j];
+
+                float t  = tBeg + len * getQuadratureNode(n, i);
+                float dt = len * getQuadratureWeight(n, i);
+                float3 eyeTrans = exp(-sumSigmaT - len * opticalDepth);
+
+                inScatter   += dt * evalInScattering(ori, dir, u, t, eyeTrans);
+                sliceSigmaT += dt * sigmaT[i];
             }
+            sumSigmaT   += sliceSigmaT;
+            sampleCount += n;
+        }
+        else
+        {
+            float rate = getQuadratureRate(
+                QuadratureScheme, planetPos, dir, tBeg, tEnd);
 
-            sumSigmaT += deltaSumSigmaT;
-            t = nextT;
+            marchCells(ori, dir, u, rate, n, tBeg, tEnd, rand, sumSigmaT, inScatter);
+            sampleCount += n;
         }
 
-        float transmittance = relativeLuminance(exp(-sumSigmaT));
-        AerialPerspectiveLUT[int3(threadIdx.xy, z)] =
-            float4(inScatter, transmittance);
+        float  transmittance = relativeLuminance(exp(-sumSigmaT));
+        float4 value         = float4(inScatter, transmittance);
+        if(EnableTemporal)
+            value = blendHistory(dir, getSliceDistance(z, depth), value);
+        AerialPerspectiveLUT[int3(threadIdx.xy, z)] = value;
 
         tBeg = tEnd;
-        tEnd = min(tEnd + sliceDepth, maxT);
+        tEnd = min(getSliceDistance(z + 1, depth), maxT);
     }
+
+    SampleCounts[threadIdx.xy] = sampleCount;
 }
@@ -19,6 +19,9 @@ cbuffer AtmosphereParams
     float OzoneThickness;
     float PlanetRadius;
     float AtmosphereRadius;
+    int   TransmittanceParam;
+
+    float2 TransmittanceRes;
 }
 
 float3 getSigmaS(float h)
@@ -71,12 +74,109 @@ float3 evalPhaseFunction(float h, float u)
     return result;
 }
 
+// see TransmittanceParameterization in src/medium.h
+#define TRANSMITTANCE_PARAM_LINEAR  0
+#define TRANSMITTANCE_PARAM_HORIZON 1
+
+// maps [0, 1] to the centers of the first and last of n texels
+float toTexelCenters(float x, float n)
+{
+    return n > 1 ? 0.5 / n + x * (1 - 1 / n) : 0.5;
+}
+
+float fromTexelCenters(float u, float n)
+{
+    return n > 1 ? (u - 0.5 / n) / (1 - 1 / n) : 0.5;
+}
+
+// see HORIZON_EPSILON in src/cpu/transmittance.cpp
+#define TRANSMITTANCE_HORIZON_EPSILON 1e-3
+
+// same as encodeTransmittanceUV in src/cpu/transmittance.cpp
+float2 encodeTransmittanceUV(float2 res, float h, float sinTheta)
+{
+    // a real branch, the Horizon mapping costs far more than the Linear one
+    [branch]
+    if(TransmittanceParam == TRANSMITTANCE_PARAM_LINEAR)
+        return float2(h / (AtmosphereRadius - PlanetRadius), 0.5 + 0.5 * sinTheta);
+
+    float Rg = PlanetRadius;
+    float Rt = AtmosphereRadius;
+    float H  = sqrt((Rt - Rg) * (Rt + Rg));
+
+    float hc  = clamp(h, 0, Rt - Rg);
+    float r   = Rg + hc;
+    float mu  = clamp(sinTheta, -1, 1);
+    float rho = sqrt(hc * (r + Rg));
+
+    float u = toTexelCenters(rho / H, res.x);
+
+    float halfResY = max(floor(res.y / 2), 1);
+    float rmu      = r * mu;
+    float discG    = rmu * rmu - rho * rho;
+
+    if(mu < 0 && discG >= 0)
+    {
+        float q    = -rmu + sqrt(discG);
+        float d    = q > 0 ? rho * rho / q : 0;
+        float dMin = hc;
+        float dMax = rho;
+        float x    = dMax > dMin ? (d - dMin) / (dMax - dMin) : 0;
+        return float2(u, 0.5 * toTexelCenters(x, halfResY));
+    }
+
+    float top2  = (Rt - r) * (Rt + r);
+    float discT = rmu * rmu + top2;
+    float d     = mu > 0 ? top2 / (rmu + sqrt(discT)) : -rmu + sqrt(discT);
+    float dMin  = Rt - r;
+    float dMax  = rho + H;
+    float x     = saturate((d - dMin) / (dMax - dMin));
+    return float2(u, 0.5 + 0.5 * toTexelCenters(1 - x, halfResY));
+}
+
+// inverse of encodeTransmittanceUV, returns (h, sinTheta)
+float2 decodeTransmittanceUV(float2 res, float2 uv)
+{
+    if(TransmittanceParam == TRANSMITTANCE_PARAM_LINEAR)
+        return float2((AtmosphereRadius - PlanetRadius) * uv.x, -1 + 2 * uv.y);
+
+    float Rg = PlanetRadius;
+    float Rt = AtmosphereRadius;
+    float H  = sqrt((Rt - Rg) * (Rt + Rg));
+
+    float rho = H * saturate(fromTexelCenters(uv.x, res.x));
+    float r   = sqrt(rho * rho + Rg * Rg);
+    float h   = rho * rho / (r + Rg);
+
+    float halfResY = max(floor(res.y / 2), 1);
+
+    if(uv.y < 0.5)
+    {
+        float x = clamp(
+            fromTexelCenters(2 * uv.y, halfResY), 0, 1 - TRANSMITTANCE_HORIZON_EPSILON);
+        float dMin = h;
+        float dMax = rho;
+        float d    = dMin + x * (dMax - dMin);
+        float mu   = d > 0 ? -(rho * rho + d * d) / (2 * r * d) : -1;
+        return float2(h, clamp(mu, -1, 1));
+    }
+
+    float x = 1 - clamp(
+        fromTexelCenters(2 * uv.y - 1, halfResY), TRANSMITTANCE_HORIZON_EPSILON, 1);
+    float dMin = Rt - r;
+    float dMax = rho + H;
+    float d    = dMin + x * (dMax - dMin);
+    float top2 = (Rt - r) * (Rt + r);
+    float mu   = d > 0 ? (top2 - d * d) / (2 * r * d) : 1;
+    return float2(h, clamp(mu, -1, 1));
+}
+
+// T must have the resolution TransmittanceRes
 float3 getTransmittance(
     Texture2D<float3> T, SamplerState S, float h, float theta)
 {
-    float u = h / (AtmosphereRadius - PlanetRadius);
-    float v = 0.5 + 0.5 * sin(theta);
-    return T.SampleLevel(S, float2(u, v), 0);
+    float2 uv = encodeTransmittanceUV(TransmittanceRes, h, sin(theta));
+    return T.SampleLevel(S, uv, 0);
 }
 
 #endif // #ifndef MEDIUM_HLSL
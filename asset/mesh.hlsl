@@ -41,6 +41,7 @@ cbuffer PSParams
     float3   EyePos;         float WorldScale;
     float4x4 ShadowViewProj;
     float2   JitterFactor;   float2 BlueNoiseUVFactor;
+    float    InvAerialSliceExponent;
 }
 
 Texture2D<float3> Transmittance;
@@ -66,9 +67,12 @@ float4 PSMain(VSOutput input) : SV_TARGET
     float2 offset =
         JitterFactor * bn.x * float2(cos(2 * PI * bn.y), sin(2 * PI * bn.y));
     
-    float apZ = WorldScale * distance(position, EyePos) / MaxAerialDistance;
+    // inverse of the slice distribution of the aerial perspective LUT
+    float apZ = pow(
+        saturate(WorldScale * distance(position, EyePos) / MaxAerialDistance),
+        InvAerialSliceExponent);
     float4 ap = AerialPerspective.SampleLevel(
-        TASampler, float3(scrPos + offset, saturate(apZ)), 0);
+        TASampler, float3(scrPos + offset, apZ), 0);
     float3 inScatter = ap.xyz;
 
     float eyeTrans = ap.w;
@@ -3,6 +3,7 @@
 
 #include "./intersection.hlsl"
 #include "./medium.hlsl"
+#include "./quadrature.hlsl"
 
 cbuffer CSParams
 {
@@ -11,6 +12,8 @@ cbuffer CSParams
 
     float3 SunIntensity;
     int RayMarchStepCount;
+
+    int RayMarchQuadratureScheme;
 }
 
 StructuredBuffer<float2> RawDirSamples;
@@ -28,6 +31,26 @@ float3 uniformOnUnitSphere(float u1, float u2)
     return float3(r * cos(phi), r * sin(phi), z);
 }
 
+// adds the sample at worldPos, h above the ground, standing for a length dt
+// of the ray and seen through eyeTrans
+void integrateStep(
+    float3 worldPos, float h, float u, float sunTheta, float3 toSunDir,
+    float dt, float3 sigmaS, float3 eyeTrans,
+    inout float3 sumL2, inout float3 sumF)
+{
+    if(!hasIntersectionWithSphere(worldPos, toSunDir, PlanetRadius))
+    {
+        float3 rho = evalPhaseFunction(h, u);
+        float3 sunTransmittance = getTransmittance(
+            Transmittance, TransmittanceSampler, h, sunTheta);
+
+        sumL2 += dt * eyeTrans * sunTransmittance * sigmaS *
+                 rho * SunIntensity;
+    }
+
+    sumF += dt * eyeTrans * sigmaS;
+}
+
 void integrate(
     float3 worldOri, float3 worldDir, float sunTheta, float3 toSunDir,
     out float3 innerL2, out float3 innerF)
@@ -43,39 +66,63 @@ void integrate(
             worldOri, worldDir, AtmosphereRadius, endT);
     }
 
-    float dt = endT / RayMarchStepCount;
-    float halfDt = 0.5 * dt;
-    float t = 0;
-
     float3 sumSigmaT = float3(0, 0, 0);
 
     float3 sumL2 = float3(0, 0, 0), sumF = float3(0, 0, 0);
-    for(int i = 0; i < RayMarchStepCount; ++i)
+    if(isFixedQuadrature(RayMarchQuadratureScheme))
     {
-        float midT = t + halfDt;
-        t += dt;
+        // the eye transmittance of a node integrates the extinction at all
+        // nodes through the running weights, as in asset/sky_lut.hlsl
+        int n = RayMarchStepCount;
+
+        float3 sigmaT[MAX_FIXED_QUADRATURE_SAMPLE_COUNT];
+        for(int i = 0; i < n; ++i)
+        {
+            float3 worldPos = worldOri + endT * getQuadratureNode(n, i) * worldDir;
+            sigmaT[i] = getSigmaT(length(worldPos) - PlanetRadius);
+            sumSigmaT += endT * getQuadratureWeight(n, i) * sigmaT[i];
+        }
 
-        float3 worldPos = worldOri + midT * worldDir;
-        float h = length(worldPos) - PlanetRadius;
+        for(int i = 0; i < n; ++i)
+        {
+            float3 opticalDepth = float3(0, 0, 0);
+            for(int j = 0; j < n; ++j)
+                opticalDepth += getQuadratureRunningWeight(n, i, j) * sigmaT[j];
 
-        float3 sigmaS, sigmaT;
-        getSigmaST(h, sigmaS, sigmaT);
+            float3 worldPos = worldOri + endT * getQuadratureNode(n, i) * worldDir;
+            float h = length(worldPos) - PlanetRadius;
 
-        float3 deltaSumSigmaT = dt * sigmaT;
-        float3 transmittance = exp(-sumSigmaT - 0.5 * deltaSumSigmaT);
+            integrateStep(
+                worldPos, h, u, sunTheta, toSunDir,
+                endT * getQuadratureWeight(n, i), getSigmaS(h),
+                exp(-endT * opticalDepth), sumL2, sumF);
+        }
+    }
+    else
+    {
+        float rate = getQuadratureRate(
+            RayMarchQuadratureScheme, worldOri, worldDir, 0, endT);
 
-        if(!hasIntersectionWithSphere(worldPos, toSunDir, PlanetRadius))
+        for(int i = 0; i < RayMarchStepCount; ++i)
         {
-            float3 rho = evalPhaseFunction(h, u);
-            float3 sunTransmittance = getTransmittance(
-                Transmittance, TransmittanceSampler, h, sunTheta);
+            float t, dt;
+            placeQuadratureCell(rate, RayMarchStepCount, i, 0, endT, 0.5, t, dt);
 
-            sumL2 += dt * transmittance * sunTransmittance * sigmaS *
-                     rho * SunIntensity;
-        }
+            float3 worldPos = worldOri + t * worldDir;
+            float h = length(worldPos) - PlanetRadius;
+
+            float3 sigmaS, sigmaT;
+            getSigmaST(h, sigmaS, sigmaT);
+
+            float3 deltaSumSigmaT = dt * sigmaT;
+            float3 transmittance = exp(-sumSigmaT - 0.5 * deltaSumSigmaT);
 
-        sumF      += dt * transmittance * sigmaS;
-        sumSigmaT += deltaSumSigmaT;
+            integrateStep(
+                worldPos, h, u, sunTheta, toSunDir,
+                dt, sigmaS, transmittance, sumL2, sumF);
+
+            sumSigmaT += deltaSumSigmaT;
+        }
     }
 
     if(groundInct)
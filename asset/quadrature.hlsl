@@ -0,0 +1,94 @@
+#ifndef QUADRATURE_HLSL
+#define QUADRATURE_HLSL
+
+#include "./medium.hlsl"
+
+// sample placement along a segment of a ray, see RayQuadrature in
+// src/cpu/quadrature.h and QuadratureRule in src/quadrature_rule.h
+
+#define QUADRATURE_MIDPOINT       0
+#define QUADRATURE_SIMPSON        1
+#define QUADRATURE_GAUSS_LEGENDRE 2
+#define QUADRATURE_EXPONENTIAL    3
+
+// same as QuadratureRule::MAX_FIXED_SAMPLE_COUNT
+#define MAX_FIXED_QUADRATURE_SAMPLE_COUNT 64
+
+// larger density ratios between the segment ends don't move the
+// exponential samples any further
+#define MAX_QUADRATURE_EXPONENT 20
+
+// fixed rules on [0, 1]: n nodes, n weights, then n rows of n running
+// weights, row i integrating from 0 to node i
+StructuredBuffer<float> QuadratureRule;
+
+bool isFixedQuadrature(int scheme)
+{
+    return scheme == QUADRATURE_SIMPSON || scheme == QUADRATURE_GAUSS_LEGENDRE;
+}
+
+float getQuadratureNode(int n, int i)
+{
+    return QuadratureRule[i];
+}
+
+float getQuadratureWeight(int n, int i)
+{
+    return QuadratureRule[n + i];
+}
+
+float getQuadratureRunningWeight(int n, int i, int j)
+{
+    return QuadratureRule[2 * n + i * n + j];
+}
+
+// mean extinction at distance t from the planet-centered position ori
+float getQuadratureDensity(float3 ori, float3 dir, float t)
+{
+    float  h      = max(0, length(ori + dir * t) - PlanetRadius);
+    float3 sigmaT = getSigmaT(h);
+    return (sigmaT.x + sigmaT.y + sigmaT.z) / 3;
+}
+
+// rate of the exponential fitted to the density at both ends of the
+// segment for QUADRATURE_EXPONENTIAL, 0 for uniform cells
+float getQuadratureRate(
+    int scheme, float3 ori, float3 dir, float tBeg, float tEnd)
+{
+    if(scheme != QUADRATURE_EXPONENTIAL)
+        return 0;
+
+    float d0 = getQuadratureDensity(ori, dir, tBeg);
+    float d1 = getQuadratureDensity(ori, dir, tEnd);
+    if(d0 <= 0 || d1 <= 0)
+        return 0;
+    return clamp(log(d0 / d1), -MAX_QUADRATURE_EXPONENT, MAX_QUADRATURE_EXPONENT);
+}
+
+// sample i of n cells over [tBeg, tEnd], following exp(-rate * s / length)
+// and placed at jitter within its cell. w is the length the sample stands for.
+void placeQuadratureCell(
+    float rate, int n, int i, float tBeg, float tEnd, float jitter,
+    out float t, out float w)
+{
+    float len = tEnd - tBeg;
+    if(abs(rate) < 1e-3)
+    {
+        t = tBeg + (i + jitter) * len / n;
+        w = len / n;
+        return;
+    }
+
+    float absA = abs(rate);
+    float e    = 1 - exp(-absA);
+
+    float u  = (i + jitter) / n;
+    float uf = rate > 0 ? u : 1 - u;
+    float q  = 1 - uf * e;
+    float s  = -log(q) / absA;
+
+    t = tBeg + len * (rate > 0 ? s : 1 - s);
+    w = len * e / (absA * q * n);
+}
+
+#endif // #ifndef QUADRATURE_HLSL
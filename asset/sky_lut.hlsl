@@ -1,11 +1,19 @@
+#include "./adaptive_march.hlsl"
 #include "./intersection.hlsl"
 #include "./medium.hlsl"
+#include "./quadrature.hlsl"
+
+// same as ADAPTIVE_INITIAL_CELL_COUNT in src/cpu/sky_lut.cpp
+#define ADAPTIVE_PILOT_CELL_COUNT 4
 
 Texture2D<float3> Transmittance;
 Texture2D<float3> MultiScattering;
 
 SamplerState MTSampler;
 
+// samples per texel, bound after the single color buffer
+RWTexture2D<uint> SampleCounts : register(u1);
+
 struct VSOutput
 {
     float4 position : SV_POSITION;
@@ -29,21 +37,26 @@ cbuffer PSParams
     int    EnableMultiScattering;
 
     float3 SunIntensity;
+    float  VOffset;
+
+    float  VScale;
+    int    QuadratureScheme;
+    int    EnableAdaptive;
+    float  AdaptiveTolerance;
+
+    int    MaxAdaptiveStepCount;
 }
 
+// adds the in-scattering of the sample at distance t, standing for a length
+// dt of the ray and seen through eyeTrans
 void marchStep(
-    float phaseU, float3 ori, float3 dir, float thisT, float nextT,
-    inout float3 sumSigmaT, inout float3 inScattering)
+    float phaseU, float3 ori, float3 dir, float t, float dt, float3 eyeTrans,
+    inout float3 inScattering)
 {
-    float  midT = 0.5 * (thisT + nextT);
-    float3 posR = float3(0, ori.y + PlanetRadius, 0) + dir * midT;
+    float3 posR = float3(0, ori.y + PlanetRadius, 0) + dir * t;
     float  h    = length(posR) - PlanetRadius;
 
-    float3 sigmaS, sigmaT;
-    getSigmaST(h, sigmaS, sigmaT);
-
-    float3 deltaSumSigmaT = (nextT - thisT) * sigmaT;
-    float3 eyeTrans = exp(-sumSigmaT - 0.5 * deltaSumSigmaT);
+    float3 sigmaS = getSigmaS(h);
 
     float sunTheta = PI / 2 - acos(dot(-SunDirection, normalize(posR)));
 
@@ -54,7 +67,7 @@ void marchStep(
         float3 sunTrans = getTransmittance(
             Transmittance, MTSampler, h, sunTheta);
 
-        inScattering += (nextT - thisT) * eyeTrans * sigmaS * rho * sunTrans;
+        inScattering += dt * eyeTrans * sigmaS * rho * sunTrans;
     }
 
     if(EnableMultiScattering)
@@ -64,16 +77,53 @@ void marchStep(
         float3 ms = MultiScattering.SampleLevel(
             MTSampler, float2(tx, ty), 0);
 
-        inScattering += (nextT - thisT) * eyeTrans * sigmaS * ms;
+        inScattering += dt * eyeTrans * sigmaS * ms;
+    }
+}
+
+// marches n cells over [tBeg, tEnd], continuing the eye optical depth sumSigmaT
+void marchCells(
+    float phaseU, float3 ori, float3 dir, float rate, int n, float tBeg, float tEnd,
+    inout float3 sumSigmaT, inout float3 inScattering)
+{
+    float3 planetPos = float3(0, ori.y + PlanetRadius, 0);
+    for(int i = 0; i < n; ++i)
+    {
+        float t, dt;
+        placeQuadratureCell(rate, n, i, tBeg, tEnd, 0.5, t, dt);
+
+        float3 sigmaT = getSigmaT(length(planetPos + dir * t) - PlanetRadius);
+        float3 deltaSumSigmaT = dt * sigmaT;
+        float3 eyeTrans = exp(-sumSigmaT - 0.5 * deltaSumSigmaT);
+
+        marchStep(phaseU, ori, dir, t, dt, eyeTrans, inScattering);
+        sumSigmaT += deltaSumSigmaT;
+    }
+}
+
+// { sigmaT, source } at distance t, see CPUSkyLUT::placeAdaptive
+float2 estimateAdaptive(float3 ori, float3 dir, float t)
+{
+    float3 posR = float3(0, ori.y + PlanetRadius, 0) + dir * t;
+    float  h    = length(posR) - PlanetRadius;
+
+    float source = 0;
+    if(!hasIntersectionWithSphere(posR, -SunDirection, PlanetRadius))
+    {
+        float  sunTheta = PI / 2 - acos(dot(-SunDirection, normalize(posR)));
+        float3 sunTrans = getTransmittance(Transmittance, MTSampler, h, sunTheta);
+        float3 sigmaS   = getSigmaS(h) * sunTrans;
+        source = (sigmaS.x + sigmaS.y + sigmaS.z) / 3;
     }
 
-    sumSigmaT += deltaSumSigmaT;
+    float3 sigmaT = getSigmaT(h);
+    return float2((sigmaT.x + sigmaT.y + sigmaT.z) / 3, source);
 }
 
 float4 PSMain(VSOutput input) : SV_TARGET
 {
     float phi = 2 * PI * input.texCoord.x;
-    float vm = 2 * input.texCoord.y - 1;
+    float vm = 2 * (VOffset + VScale * input.texCoord.y) - 1;
     float theta = sign(vm) * (PI / 2) * vm * vm;
     float sinTheta = sin(theta), cosTheta = cos(theta);
 
@@ -99,17 +149,88 @@ float4 PSMain(VSOutput input) : SV_TARGET
 
     // ray march
 
-    float t = 0;
-    float3 inScatter = float3(0, 0, 0);
-    float3 sumSigmaT = float3(0, 0, 0);
+    float3 planetPos   = float3(0, ori.y + PlanetRadius, 0);
+    float3 inScatter   = float3(0, 0, 0);
+    int    sampleCount = MarchStepCount;
 
-    float dt = (endT - t) / MarchStepCount;
-    for(int i = 0; i < MarchStepCount; ++i)
+    // the adaptive march replaces the quadrature, as on the CPU
+
+    if(EnableAdaptive)
+    {
+        // pilot cells, with the eye optical depth chained through them
+
+        AdaptiveCell cells[ADAPTIVE_PILOT_CELL_COUNT];
+        float2       integral = float2(0, 0);
+
+        float  len = endT / ADAPTIVE_PILOT_CELL_COUNT;
+        float2 f0  = estimateAdaptive(ori, dir, 0);
+        for(int i = 0; i < ADAPTIVE_PILOT_CELL_COUNT; ++i)
+        {
+            cells[i].f0     = f0;
+            cells[i].fm     = estimateAdaptive(ori, dir, len * (i + 0.5));
+            cells[i].f1     = estimateAdaptive(ori, dir, len * (i + 1));
+            cells[i].len    = len;
+            cells[i].depth0 = integral.x;
+
+            integral += integrateAdaptiveCell(cells[i]);
+            f0 = cells[i].f1;
+        }
+
+        int counts[ADAPTIVE_PILOT_CELL_COUNT];
+        int total = 0;
+        for(int i = 0; i < ADAPTIVE_PILOT_CELL_COUNT; ++i)
+        {
+            counts[i] = getAdaptiveSplitCount(
+                cells[i], integral, endT, AdaptiveTolerance);
+            total += counts[i];
+        }
+
+        float3 sumSigmaT = float3(0, 0, 0);
+        sampleCount = 0;
+        for(int i = 0; i < ADAPTIVE_PILOT_CELL_COUNT; ++i)
+        {
+            int n = fitAdaptiveSplitCount(
+                counts[i], total, ADAPTIVE_PILOT_CELL_COUNT, MaxAdaptiveStepCount);
+            marchCells(
+                phaseU, ori, dir, 0, n, len * i, len * (i + 1),
+                sumSigmaT, inScatter);
+            sampleCount += n;
+        }
+    }
+    else if(isFixedQuadrature(QuadratureScheme))
     {
-        float nextT = t + dt;
-        marchStep(phaseU, ori, dir, t, nextT, sumSigmaT, inScatter);
-        t = nextT;
+        // the eye transmittance of a node integrates the extinction at all
+        // nodes through the running weights
+        float3 sigmaT[MAX_FIXED_QUADRATURE_SAMPLE_COUNT];
+        for(int i = 0; i < MarchStepCount; ++i)
+        {
+            float t = endT * getQuadratureNode(MarchStepCount, i);
+            sigmaT[i] = getSigmaT(length(planetPos + dir * t) - PlanetRadius);
+        }
+
+        for(int i = 0; i < MarchStepCount; ++i)
+        {
+            float3 opticalDepth = float3(0, 0, 0);
+            for(int j = 0; j < MarchStepCount; ++j)
+                opticalDepth += getQuadratureRunningWeight(MarchStepCount, i, j) * sigmaT[j];
+
+            marchStep(
+                phaseU, ori, dir,
+                endT * getQuadratureNode(MarchStepCount, i),
+                endT * getQuadratureWeight(MarchStepCount, i),
+                exp(-endT * opticalDepth), inScatter);
+        }
     }
+    else
+    {
+        float rate = getQuadratureRate(QuadratureScheme, planetPos, dir, 0, endT);
+
+        float3 sumSigmaT = float3(0, 0, 0);
+        marchCells(
+            phaseU, ori, dir, rate, MarchStepCount, 0, endT, sumSigmaT, inScatter);
+    }
+
+    SampleCounts[uint2(input.position.xy)] = sampleCount;
 
     return float4(inScatter * SunIntensity, 1);
 }
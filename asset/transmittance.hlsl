@@ -1,10 +1,15 @@
 #define THREAD_GROUP_SIZE_X 16
 #define THREAD_GROUP_SIZE_Y 16
 
-#define STEP_COUNT 1000
-
 #include "./intersection.hlsl"
 #include "./medium.hlsl"
+#include "./quadrature.hlsl"
+
+cbuffer CSParams
+{
+    int StepCount;
+    int QuadratureScheme;
+}
 
 RWTexture2D<float4> Transmittance;
 
@@ -16,28 +21,44 @@ void CSMain(int3 threadIdx : SV_DispatchThreadID)
     if(threadIdx.x >= width || threadIdx.y >= height)
         return;
 
-    float theta = asin(lerp(-1.0, 1.0, (threadIdx.y + 0.5) / height));
-    float h = lerp(
-        0.0, AtmosphereRadius - PlanetRadius, (threadIdx.x + 0.5) / width);
+    float2 res = float2(width, height);
+    float2 hs  = decodeTransmittanceUV(res, (threadIdx.xy + 0.5) / res);
+
+    float h        = hs.x;
+    float sinTheta = hs.y;
 
     float2 o = float2(0, PlanetRadius + h);
-    float2 d = float2(cos(theta), sin(theta));
+    float2 d = float2(sqrt(max(0, 1 - sinTheta * sinTheta)), sinTheta);
     
     float t = 0;
     if(!findClosestIntersectionWithCircle(o, d, PlanetRadius, t))
         findClosestIntersectionWithCircle(o, d, AtmosphereRadius, t);
 
-    float2 end = o + t * d;
-
-    float3 sum;
-    for(int i = 0; i < STEP_COUNT; ++i)
+    float3 sum = float3(0, 0, 0);
+    if(isFixedQuadrature(QuadratureScheme))
+    {
+        for(int i = 0; i < StepCount; ++i)
+        {
+            float2 pi = o + t * getQuadratureNode(StepCount, i) * d;
+            float hi = length(pi) - PlanetRadius;
+            sum += t * getQuadratureWeight(StepCount, i) * getSigmaT(hi);
+        }
+    }
+    else
     {
-        float2 pi = lerp(o, end, (i + 0.5) / STEP_COUNT);
-        float hi = length(pi) - PlanetRadius;
-        float3 sigma = getSigmaT(hi);
-        sum += sigma;
+        float rate = getQuadratureRate(
+            QuadratureScheme, float3(o, 0), float3(d, 0), 0, t);
+        for(int i = 0; i < StepCount; ++i)
+        {
+            float ti, dt;
+            placeQuadratureCell(rate, StepCount, i, 0, t, 0.5, ti, dt);
+
+            float2 pi = o + ti * d;
+            float hi = length(pi) - PlanetRadius;
+            sum += dt * getSigmaT(hi);
+        }
     }
 
-    float3 result = exp(-sum * (t / STEP_COUNT));
+    float3 result = exp(-sum);
     Transmittance[threadIdx.xy] = float4(result, 1);
 }
@@ -0,0 +1,414 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/cpu/aerial_lut.h"
+#include "../src/cpu/dir_samples.h"
+#include "../src/cpu/multiscatter.h"
+#include "../src/cpu/sky_lut.h"
+#include "../src/cpu/transmittance.h"
+
+namespace
+{
+
+    using Clock = std::chrono::steady_clock;
+
+    // fixed step and sample counts of the demo's GPU passes, see
+    // TransmittanceLUT and MultiScatteringLUT
+    constexpr int TRANSMITTANCE_STEP_COUNT = 1000;
+    constexpr int MS_RAY_MARCH_STEP_COUNT  = 256;
+    constexpr int MS_DIR_SAMPLE_COUNT      = 64;
+
+    struct Options
+    {
+        bool             quick       = false;
+        int              repeatCount = 5;
+        double           budgetMs    = 10000;
+        std::vector<int> threadCounts;
+        std::string      outFilename;
+    };
+
+    struct Timing
+    {
+        int    runCount = 0;
+        double coldMs   = 0;
+        double minMs    = 0;
+        double medianMs = 0;
+        double meanMs   = 0;
+    };
+
+    void printUsage()
+    {
+        std::fprintf(stderr,
+            "usage: AtmosphereBenchmark [options]\n"
+            "  --quick            only the demo's default settings\n"
+            "  --repeat N         warm runs per configuration (default 5)\n"
+            "  --budget MS        stop repeating a configuration once its runs\n"
+            "                     took this long in total (default 10000)\n"
+            "  --threads A,B,...  thread counts (default 1 and all hardware threads)\n"
+            "  --out FILE         write the json report to FILE instead of stdout\n");
+    }
+
+    bool parseOptions(int argc, char *argv[], Options &options)
+    {
+        for(int i = 1; i < argc; ++i)
+        {
+            const char *arg   = argv[i];
+            const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+            if(!std::strcmp(arg, "--quick"))
+                options.quick = true;
+            else if(!std::strcmp(arg, "--repeat") && value)
+            {
+                options.repeatCount = (std::max)(std::atoi(value), 1);
+                ++i;
+            }
+            else if(!std::strcmp(arg, "--budget") && value)
+            {
+                options.budgetMs = std::atof(value);
+                ++i;
+            }
+            else if(!std::strcmp(arg, "--threads") && value)
+            {
+                for(const char *p = value; *p; )
+                {
+                    options.threadCounts.push_back((std::max)(std::atoi(p), 1));
+                    p = std::strchr(p, ',');
+                    if(!p)
+                        break;
+                    ++p;
+                }
+                ++i;
+            }
+            else if(!std::strcmp(arg, "--out") && value)
+            {
+                options.outFilename = value;
+                ++i;
+            }
+            else
+                return false;
+        }
+
+        if(options.threadCounts.empty())
+        {
+            const int hardwareThreads =
+                static_cast<int>((std::max)(std::thread::hardware_concurrency(), 1u));
+            options.threadCounts.push_back(1);
+            if(hardwareThreads > 1)
+                options.threadCounts.push_back(hardwareThreads);
+        }
+
+        return true;
+    }
+
+    // one cold run, then warm runs until repeatCount or the time budget is
+    // reached. the cold run counts against the budget but not the stats.
+    template<typename Func>
+    Timing measure(const Options &options, Func &&func)
+    {
+        auto run = [&]
+        {
+            const auto start = Clock::now();
+            func();
+            const auto end = Clock::now();
+            return std::chrono::duration<double, std::milli>(end - start).count();
+        };
+
+        Timing timing;
+        timing.coldMs = run();
+
+        double totalMs = timing.coldMs;
+        std::vector<double> warmMs;
+        while(static_cast<int>(warmMs.size()) < options.repeatCount &&
+              totalMs < options.budgetMs)
+        {
+            warmMs.push_back(run());
+            totalMs += warmMs.back();
+        }
+
+        // a cold run longer than the budget is the only measurement
+        if(warmMs.empty())
+            warmMs.push_back(timing.coldMs);
+
+        std::sort(warmMs.begin(), warmMs.end());
+
+        const size_t n = warmMs.size();
+        timing.runCount = static_cast<int>(n);
+        timing.minMs    = warmMs.front();
+        timing.medianMs = n % 2 ? warmMs[n / 2]
+                                : 0.5 * (warmMs[n / 2 - 1] + warmMs[n / 2]);
+        for(double ms : warmMs)
+            timing.meanMs += ms;
+        timing.meanMs /= n;
+
+        return timing;
+    }
+
+    // results are collected as json objects, one per configuration
+    class Report
+    {
+    public:
+
+        void add(
+            const char        *stage,
+            int                threadCount,
+            const std::string &params,
+            const Timing      &timing)
+        {
+            char buf[512];
+            std::snprintf(
+                buf, sizeof(buf),
+                "    { \"stage\": \"%s\", \"threads\": %d, %s, \"runs\": %d, "
+                "\"coldMs\": %.4f, \"minMs\": %.4f, \"medianMs\": %.4f, "
+                "\"meanMs\": %.4f }",
+                stage, threadCount, params.c_str(), timing.runCount,
+                timing.coldMs, timing.minMs, timing.medianMs, timing.meanMs);
+            entries_.emplace_back(buf);
+
+            std::fprintf(
+                stderr, "%-14s threads %2d  %-70s median %10.3f ms\n",
+                stage, threadCount, params.c_str(), timing.medianMs);
+        }
+
+        bool write(const Options &options) const
+        {
+            FILE *file = stdout;
+            if(!options.outFilename.empty())
+            {
+                file = std::fopen(options.outFilename.c_str(), "w");
+                if(!file)
+                {
+                    std::fprintf(
+                        stderr, "failed to open %s\n", options.outFilename.c_str());
+                    return false;
+                }
+            }
+
+            std::fprintf(file, "{\n");
+            std::fprintf(file, "  \"benchmark\": \"atmosphere\",\n");
+            std::fprintf(file, "  \"version\": 1,\n");
+            std::fprintf(
+                file, "  \"hardwareConcurrency\": %u,\n",
+                std::thread::hardware_concurrency());
+            std::fprintf(file, "  \"quick\": %s,\n", options.quick ? "true" : "false");
+            std::fprintf(file, "  \"repeat\": %d,\n", options.repeatCount);
+            std::fprintf(file, "  \"budgetMs\": %.1f,\n", options.budgetMs);
+            std::fprintf(file, "  \"results\": [\n");
+            for(size_t i = 0; i < entries_.size(); ++i)
+            {
+                std::fprintf(
+                    file, "%s%s\n", entries_[i].c_str(),
+                    i + 1 < entries_.size() ? "," : "");
+            }
+            std::fprintf(file, "  ]\n");
+            std::fprintf(file, "}\n");
+
+            if(file != stdout)
+                std::fclose(file);
+            return true;
+        }
+
+    private:
+
+        std::vector<std::string> entries_;
+    };
+
+    std::string formatRes(const Int2 &res)
+    {
+        return "\"resolution\": [" + std::to_string(res.x) + ", " +
+               std::to_string(res.y) + "]";
+    }
+
+    std::string formatRes(const Int3 &res)
+    {
+        return "\"resolution\": [" + std::to_string(res.x) + ", " +
+               std::to_string(res.y) + ", " + std::to_string(res.z) + "]";
+    }
+
+} // namespace anonymous
+
+// usage: AtmosphereBenchmark [options], see printUsage
+// times the CPU transmittance, multi-scattering, sky view and aerial
+// perspective stages over the resolutions and step counts exposed by the
+// demo, for every thread count, and writes the results as json. inputs are
+// fixed, so runs on the same machine are comparable.
+int main(int argc, char *argv[])
+{
+    Options options;
+    if(!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    const AtmosphereProperties atmos = AtmosphereProperties().toStdUnit();
+
+    // demo defaults come first in every list, and are all --quick runs
+
+    const std::vector<Int2> transRes = options.quick ?
+        std::vector<Int2>{ { 256, 256 } } :
+        std::vector<Int2>{ { 256, 256 }, { 64, 64 }, { 128, 128 }, { 512, 512 } };
+
+    const std::vector<Int2> msRes = options.quick ?
+        std::vector<Int2>{ { 256, 256 } } :
+        std::vector<Int2>{ { 256, 256 }, { 32, 32 }, { 64, 64 }, { 128, 128 } };
+    const std::vector<int> msSteps = options.quick ?
+        std::vector<int>{ MS_RAY_MARCH_STEP_COUNT } :
+        std::vector<int>{ MS_RAY_MARCH_STEP_COUNT, 64 };
+
+    const std::vector<Int2> skyRes = options.quick ?
+        std::vector<Int2>{ { 64, 64 } } :
+        std::vector<Int2>{ { 64, 64 }, { 32, 32 }, { 128, 128 }, { 256, 128 } };
+    const std::vector<int> skySteps = options.quick ?
+        std::vector<int>{ 40 } : std::vector<int>{ 40, 10, 20, 80 };
+
+    const std::vector<Int3> aerialRes = options.quick ?
+        std::vector<Int3>{ { 200, 150, 32 } } :
+        std::vector<Int3>{ { 200, 150, 32 }, { 100, 75, 32 }, { 400, 300, 32 },
+                           { 200, 150, 64 } };
+    const std::vector<int> aerialSteps = options.quick ?
+        std::vector<int>{ 1 } : std::vector<int>{ 1, 2, 4 };
+
+    Report report;
+
+    // transmittance
+
+    for(int threadCount : options.threadCounts)
+    {
+        for(auto mode : { TransmittanceMode::RayMarch, TransmittanceMode::Analytic })
+        {
+            const bool rayMarch = mode == TransmittanceMode::RayMarch;
+            for(const Int2 &res : transRes)
+            {
+                CPUTransmittanceLUT lut;
+                lut.setThreadCount(threadCount);
+                lut.setMode(mode);
+                lut.setStepCount(TRANSMITTANCE_STEP_COUNT);
+
+                const Timing timing = measure(options, [&]
+                {
+                    lut.generate(res, atmos);
+                });
+
+                const std::string params =
+                    formatRes(res) + ", \"mode\": \"" +
+                    (rayMarch ? "raymarch" : "analytic") + "\", \"steps\": " +
+                    std::to_string(rayMarch ? TRANSMITTANCE_STEP_COUNT : 0);
+                report.add("transmittance", threadCount, params, timing);
+            }
+        }
+    }
+
+    // the later stages only look these tables up, so their content doesn't
+    // matter for timing, only their resolution. both match the demo's.
+
+    CPUTransmittanceLUT transmittance;
+    transmittance.setMode(TransmittanceMode::Analytic);
+    transmittance.generate({ 256, 256 }, atmos);
+
+    const Table2D<Float4> multiScattering({ 256, 256 }, Float4(0.01f));
+
+    // multi-scattering
+
+    const auto dirSamples = generatePoissonDiskSamples(
+        MS_DIR_SAMPLE_COUNT, 0);
+
+    for(int threadCount : options.threadCounts)
+    {
+        for(int stepCount : msSteps)
+        {
+            for(const Int2 &res : msRes)
+            {
+                CPUMultiScatteringLUT lut;
+                lut.setThreadCount(threadCount);
+                lut.setRayMarchStepCount(stepCount);
+
+                const Timing timing = measure(options, [&]
+                {
+                    lut.generate(
+                        res, transmittance.getTable(), Float3(0.3f),
+                        atmos, dirSamples);
+                });
+
+                const std::string params =
+                    formatRes(res) + ", \"steps\": " + std::to_string(stepCount) +
+                    ", \"dirSamples\": " + std::to_string(dirSamples.size());
+                report.add("multiscatter", threadCount, params, timing);
+            }
+        }
+    }
+
+    const Float3 sunDirection = Float3(0.3f, -0.5f, 0.2f).normalize();
+
+    // sky view
+
+    for(int threadCount : options.threadCounts)
+    {
+        for(int stepCount : skySteps)
+        {
+            for(const Int2 &res : skyRes)
+            {
+                CPUSkyLUT lut;
+                lut.setThreadCount(threadCount);
+                lut.setAtmosphere(atmos);
+                lut.setCamera({ 0, 500, 0 });
+                lut.setSun(sunDirection, Float3(10));
+                lut.setRayMarching(stepCount);
+                lut.setTransmittance(&transmittance.getTable());
+                lut.setMultiScattering(true, &multiScattering);
+
+                const Timing timing = measure(options, [&]
+                {
+                    lut.generate(res);
+                });
+
+                const std::string params =
+                    formatRes(res) + ", \"steps\": " + std::to_string(stepCount);
+                report.add("sky", threadCount, params, timing);
+            }
+        }
+    }
+
+    // aerial perspective
+
+    const Camera::FrustumDirections frustumDirs = {
+        Float3(-1, 0.5f, 1).normalize(), Float3(1, 0.5f, 1).normalize(),
+        Float3(-1, -0.5f, 1).normalize(), Float3(1, -0.5f, 1).normalize()
+    };
+
+    for(int threadCount : options.threadCounts)
+    {
+        for(int stepsPerSlice : aerialSteps)
+        {
+            for(const Int3 &res : aerialRes)
+            {
+                CPUAerialPerspectiveLUT lut;
+                lut.setThreadCount(threadCount);
+                lut.setAtmosphere(atmos);
+                lut.setCamera({ 0, 1, 0 }, 200, frustumDirs);
+                lut.setSun(sunDirection);
+                lut.setWorldScale(200);
+                lut.setMarchingParams(2000, stepsPerSlice);
+                lut.setTransmittanceLUT(&transmittance.getTable());
+                lut.setMultiScatterLUT(true, &multiScattering);
+
+                const Timing timing = measure(options, [&]
+                {
+                    lut.generate(res);
+                });
+
+                const std::string params =
+                    formatRes(res) + ", \"stepsPerSlice\": " +
+                    std::to_string(stepsPerSlice);
+                report.add("aerial", threadCount, params, timing);
+            }
+        }
+    }
+
+    return report.write(options) ? 0 : 1;
+}
@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "../src/cpu/aerial_lut.h"
+#include "../src/cpu/dir_samples.h"
+#include "../src/cpu/multiscatter.h"
+#include "../src/cpu/optical_depth.h"
+#include "../src/cpu/sky_lut.h"
+#include "../src/cpu/transmittance.h"
+
+namespace
+{
+
+    using Clock = std::chrono::steady_clock;
+
+    // bakes that only run once are timed cold, the per-frame ones warm
+    template<typename Func>
+    double measureMs(int repeatCount, Func &&func)
+    {
+        if(repeatCount > 1)
+            func();
+
+        const auto start = Clock::now();
+        for(int i = 0; i < repeatCount; ++i)
+            func();
+        const auto end = Clock::now();
+
+        return std::chrono::duration<double, std::milli>(end - start).count()
+             / repeatCount;
+    }
+
+    void report(const char *name, const char *res, double ms)
+    {
+        std::printf("%-20s %-12s %10.3f ms\n", name, res, ms);
+    }
+
+    void reportError(
+        const char            *name,
+        const Table2D<Float4> &reference,
+        const Table2D<Float4> &actual)
+    {
+        double maxErr = 0, sumErr = 0;
+        for(size_t i = 0; i < reference.getTexelCount(); ++i)
+        {
+            for(int c = 0; c < 3; ++c)
+            {
+                const double err = std::abs(
+                    double(actual.data()[i][c]) - reference.data()[i][c]);
+                maxErr = (std::max)(maxErr, err);
+                sumErr += err;
+            }
+        }
+
+        const double count = 3.0 * reference.getTexelCount();
+        std::printf(
+            "%-20s max abs err %.3g  mean abs err %.3g\n",
+            name, maxErr, sumErr / count);
+    }
+
+    // error of bilinear lookups into T against the closed-form
+    // transmittance, on a grid of heights and elevations that doesn't line
+    // up with the texels of either parameterization
+    void reportLookupError(
+        const char                 *name,
+        const char                 *res,
+        const Table2D<Float4>      &T,
+        const AtmosphereProperties &atmos)
+    {
+        constexpr int GRID_SIZE_H     = 256;
+        constexpr int GRID_SIZE_THETA = 512;
+
+        const float heightRange = atmos.atmosphereRadius - atmos.planetRadius;
+
+        double maxErr = 0, sumErr = 0;
+        for(int y = 0; y < GRID_SIZE_THETA; ++y)
+        {
+            const float theta = PI * ((y + 0.37f) / GRID_SIZE_THETA - 0.5f);
+            for(int x = 0; x < GRID_SIZE_H; ++x)
+            {
+                const float h = heightRange * (x + 0.37f) / GRID_SIZE_H;
+
+                const Float3 reference = computeTransmittance(atmos, h, theta);
+                const Float3 actual    = sampleTransmittance(T, atmos, h, theta);
+                for(int c = 0; c < 3; ++c)
+                {
+                    const double err = std::abs(double(actual[c]) - reference[c]);
+                    maxErr = (std::max)(maxErr, err);
+                    sumErr += err;
+                }
+            }
+        }
+
+        const double count = 3.0 * GRID_SIZE_H * GRID_SIZE_THETA;
+        std::printf(
+            "%-20s %-12s max abs err %.3g  mean abs err %.3g\n",
+            name, res, maxErr, sumErr / count);
+    }
+
+} // namespace anonymous
+
+// usage: LUTBenchmark [threadCount]
+// times every CPU LUT integrator at the resolutions used by the demo
+int main(int argc, char *argv[])
+{
+    const int threadCount = argc > 1 ? std::atoi(argv[1]) : 0;
+
+    const AtmosphereProperties atmos = AtmosphereProperties().toStdUnit();
+
+    CPUTransmittanceLUT transmittance;
+    transmittance.setThreadCount(threadCount);
+    report("transmittance", "256x256", measureMs(1, [&]
+    {
+        transmittance.generate({ 256, 256 }, atmos);
+    }));
+
+    CPUTransmittanceLUT analyticTransmittance;
+    analyticTransmittance.setThreadCount(threadCount);
+    analyticTransmittance.setMode(TransmittanceMode::Analytic);
+    report("transmittance (cf)", "256x256", measureMs(5, [&]
+    {
+        analyticTransmittance.generate({ 256, 256 }, atmos);
+    }));
+    reportError(
+        "  vs 1000 steps", transmittance.getTable(),
+        analyticTransmittance.getTable());
+
+    // lookup error of both parameterizations at shrinking resolutions
+
+    for(auto param : { TransmittanceParameterization::Linear,
+                       TransmittanceParameterization::Horizon })
+    {
+        AtmosphereProperties paramAtmos = atmos;
+        paramAtmos.transmittanceParam = param;
+
+        const char *name = param == TransmittanceParameterization::Linear ?
+                           "  linear uv" : "  horizon uv";
+
+        for(const Int2 &res : { Int2(256, 256), Int2(128, 128), Int2(128, 64),
+                                Int2(64, 64), Int2(64, 32), Int2(32, 32) })
+        {
+            CPUTransmittanceLUT lut;
+            lut.setThreadCount(threadCount);
+            lut.setMode(TransmittanceMode::Analytic);
+            lut.generate(res, paramAtmos);
+
+            char resName[32];
+            std::snprintf(resName, sizeof(resName), "%dx%d", res.x, res.y);
+            reportLookupError(name, resName, lut.getTable(), paramAtmos);
+        }
+    }
+
+    const auto dirSamples = generatePoissonDiskSamples(64, 0);
+
+    CPUMultiScatteringLUT multiScattering;
+    multiScattering.setThreadCount(threadCount);
+    report("multiscatter", "256x256", measureMs(1, [&]
+    {
+        multiScattering.generate(
+            { 256, 256 }, transmittance.getTable(), Float3(0.3f),
+            atmos, dirSamples);
+    }));
+
+    const Float3 sunDirection = Float3(0.3f, -0.5f, 0.2f).normalize();
+
+    CPUSkyLUT sky;
+    sky.setThreadCount(threadCount);
+    sky.setAtmosphere(atmos);
+    sky.setCamera({ 0, 0.5f, 0 });
+    sky.setSun(sunDirection, Float3(10));
+    sky.setRayMarching(40);
+    sky.setTransmittance(&transmittance.getTable());
+    sky.setMultiScattering(true, &multiScattering.getTable());
+    report("sky", "64x64", measureMs(20, [&]
+    {
+        sky.generate({ 64, 64 });
+    }));
+
+    const Camera::FrustumDirections frustumDirs = {
+        Float3(-1, 0.5f, 1).normalize(), Float3(1, 0.5f, 1).normalize(),
+        Float3(-1, -0.5f, 1).normalize(), Float3(1, -0.5f, 1).normalize()
+    };
+
+    CPUAerialPerspectiveLUT aerial;
+    aerial.setThreadCount(threadCount);
+    aerial.setAtmosphere(atmos);
+    aerial.setCamera({ 0, 1, 0 }, 0.2f, frustumDirs);
+    aerial.setSun(sunDirection);
+    aerial.setWorldScale(200);
+    aerial.setMarchingParams(2000, 1);
+    aerial.setTransmittanceLUT(&transmittance.getTable());
+    aerial.setMultiScatterLUT(true, &multiScattering.getTable());
+    report("aerial", "200x150x32", measureMs(5, [&]
+    {
+        aerial.generate({ 200, 150, 32 });
+    }));
+}
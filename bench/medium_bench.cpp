@@ -0,0 +1,124 @@
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+#include "../src/medium.h"
+
+namespace
+{
+
+    using Clock = std::chrono::steady_clock;
+
+    constexpr int SAMPLE_COUNT = 1 << 16;
+    constexpr int REPEAT_COUNT = 64;
+
+    template<typename Func>
+    double measureNsPerSample(Func &&func)
+    {
+        func();
+
+        const auto start = Clock::now();
+        for(int i = 0; i < REPEAT_COUNT; ++i)
+            func();
+        const auto end = Clock::now();
+
+        const double ns = std::chrono::duration<double, std::nano>(
+            end - start).count();
+        return ns / (double(REPEAT_COUNT) * SAMPLE_COUNT);
+    }
+
+    float maxRelativeError(
+        const std::vector<Float3> &expected,
+        const std::vector<float>  (&actual)[3])
+    {
+        float result = 0;
+        for(size_t i = 0; i < expected.size(); ++i)
+        {
+            for(int c = 0; c < 3; ++c)
+            {
+                const float e = expected[i][c];
+                const float a = actual[c][i];
+                if(e != 0)
+                    result = (std::max)(result, std::abs(a - e) / std::abs(e));
+            }
+        }
+        return result;
+    }
+
+    void report(
+        const char *name, double scalarNs, double batchNs, float maxRelErr)
+    {
+        std::printf(
+            "%-20s scalar %7.3f ns/sample  batched %7.3f ns/sample  "
+            "speedup %5.2fx  max rel err %.3g\n",
+            name, scalarNs, batchNs, scalarNs / batchNs, maxRelErr);
+    }
+
+} // namespace anonymous
+
+int main()
+{
+    const AtmosphereProperties atmos = AtmosphereProperties().toStdUnit();
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> disH(
+        0, atmos.atmosphereRadius - atmos.planetRadius);
+    std::uniform_real_distribution<float> disU(-1, 1);
+
+    std::vector<float> h(SAMPLE_COUNT), u(SAMPLE_COUNT);
+    for(int i = 0; i < SAMPLE_COUNT; ++i)
+    {
+        h[i] = disH(rng);
+        u[i] = disU(rng);
+    }
+
+    std::vector<Float3> scalarOut(SAMPLE_COUNT);
+    std::vector<float>  batchOut[3];
+    for(auto &b : batchOut)
+        b.resize(SAMPLE_COUNT);
+    const Float3Batch batch = {
+        batchOut[0].data(), batchOut[1].data(), batchOut[2].data()
+    };
+
+    {
+        const double scalarNs = measureNsPerSample([&]
+        {
+            for(int i = 0; i < SAMPLE_COUNT; ++i)
+                scalarOut[i] = atmos.getSigmaS(h[i]);
+        });
+        const double batchNs = measureNsPerSample([&]
+        {
+            atmos.getSigmaS(SAMPLE_COUNT, h.data(), batch);
+        });
+        report("getSigmaS", scalarNs, batchNs,
+               maxRelativeError(scalarOut, batchOut));
+    }
+
+    {
+        const double scalarNs = measureNsPerSample([&]
+        {
+            for(int i = 0; i < SAMPLE_COUNT; ++i)
+                scalarOut[i] = atmos.getSigmaT(h[i]);
+        });
+        const double batchNs = measureNsPerSample([&]
+        {
+            atmos.getSigmaT(SAMPLE_COUNT, h.data(), batch);
+        });
+        report("getSigmaT", scalarNs, batchNs,
+               maxRelativeError(scalarOut, batchOut));
+    }
+
+    {
+        const double scalarNs = measureNsPerSample([&]
+        {
+            for(int i = 0; i < SAMPLE_COUNT; ++i)
+                scalarOut[i] = atmos.evalPhaseFunction(h[i], u[i]);
+        });
+        const double batchNs = measureNsPerSample([&]
+        {
+            atmos.evalPhaseFunction(SAMPLE_COUNT, h.data(), u.data(), batch);
+        });
+        report("evalPhaseFunction", scalarNs, batchNs,
+               maxRelativeError(scalarOut, batchOut));
+    }
+}
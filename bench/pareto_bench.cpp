@@ -0,0 +1,685 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../src/cpu/dir_samples.h"
+#include "../src/cpu/multiscatter.h"
+#include "../src/cpu/optical_depth.h"
+#include "../src/cpu/sampler.h"
+#include "../src/cpu/sky_lut.h"
+#include "../src/cpu/texel_format.h"
+#include "../src/cpu/transmittance.h"
+
+namespace
+{
+
+    using Clock = std::chrono::steady_clock;
+
+    // demo defaults, see TransmittanceLUT, MultiScatteringLUT and main.cpp
+    constexpr int TRANSMITTANCE_STEP_COUNT = 1000;
+    constexpr int MS_RAY_MARCH_STEP_COUNT  = 256;
+    constexpr int MS_DIR_SAMPLE_COUNT      = 64;
+    constexpr int SKY_STEP_COUNT           = 40;
+
+    const Int2 TRANSMITTANCE_RES = { 256, 256 };
+    const Int2 MS_RES            = { 256, 256 };
+    const Int2 SKY_RES           = { 64, 64 };
+
+    // references. the probe grids of the multi-scattering and sky view
+    // references are odd, so that their texel centers never coincide with
+    // those of a swept resolution
+    const Int2 TRANSMITTANCE_PROBE_RES  = { 256, 512 };
+    const Int2 MS_REFERENCE_RES         = { 37, 37 };
+    constexpr int MS_REFERENCE_STEPS    = 512;
+    constexpr int MS_REFERENCE_DIRS     = 512;
+    const Int2 SKY_REFERENCE_RES        = { 127, 127 };
+    constexpr int SKY_REFERENCE_STEPS   = 4096;
+
+    // relative errors are taken against max(|reference|, floor), with floor
+    // this fraction of the largest reference value of the channel. texels
+    // that are practically black don't drown out the rest.
+    constexpr double REL_ERROR_FLOOR = 1e-2;
+
+    constexpr LUTTexelFormat FORMATS[] = {
+        LUTTexelFormat::RGBA32F,
+        LUTTexelFormat::RGBA16F,
+        LUTTexelFormat::RGB9E5
+    };
+
+    constexpr QuadratureScheme SCHEMES[] = {
+        QuadratureScheme::Midpoint,
+        QuadratureScheme::Simpson,
+        QuadratureScheme::GaussLegendre,
+        QuadratureScheme::Exponential,
+        QuadratureScheme::HeightAdaptive
+    };
+
+    // RayQuadrature clamps a single Gauss-Legendre panel, so larger step
+    // counts would only repeat its largest one
+    bool isSwept(QuadratureScheme scheme, int stepCount)
+    {
+        return scheme != QuadratureScheme::GaussLegendre ||
+               stepCount <= MAX_GAUSS_LEGENDRE_SAMPLE_COUNT;
+    }
+
+    struct Options
+    {
+        bool   quick       = false;
+        int    threadCount = 0;
+        int    rankCount   = 1;
+        double rmsBudget   = 0;
+        double maxBudget   = 0;
+    };
+
+    void printUsage()
+    {
+        std::fprintf(stderr,
+            "usage: ParetoBenchmark [options]\n"
+            "  --quick      a reduced sweep around the demo's defaults\n"
+            "  --threads N  integrator threads (default all hardware threads)\n"
+            "  --ranks N    print the first N pareto ranks (default 1)\n"
+            "  --rms E      also report the cheapest configuration with a\n"
+            "               relative rms error of at most E\n"
+            "  --max E      same for the largest relative error\n");
+    }
+
+    bool parseOptions(int argc, char *argv[], Options &options)
+    {
+        for(int i = 1; i < argc; ++i)
+        {
+            const char *arg   = argv[i];
+            const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+            if(!std::strcmp(arg, "--quick"))
+                options.quick = true;
+            else if(!std::strcmp(arg, "--threads") && value)
+            {
+                options.threadCount = (std::max)(std::atoi(value), 0);
+                ++i;
+            }
+            else if(!std::strcmp(arg, "--ranks") && value)
+            {
+                options.rankCount = (std::max)(std::atoi(value), 1);
+                ++i;
+            }
+            else if(!std::strcmp(arg, "--rms") && value)
+            {
+                options.rmsBudget = std::atof(value);
+                ++i;
+            }
+            else if(!std::strcmp(arg, "--max") && value)
+            {
+                options.maxBudget = std::atof(value);
+                ++i;
+            }
+            else
+                return false;
+        }
+        return true;
+    }
+
+    // fastest of up to three runs, fewer when a run is slow
+    template<typename Func>
+    double measureMs(Func &&func)
+    {
+        double minMs = 0, totalMs = 0;
+        for(int i = 0; i < 3 && totalMs < 200; ++i)
+        {
+            const auto start = Clock::now();
+            func();
+            const auto end = Clock::now();
+
+            const double ms = std::chrono::duration<double, std::milli>(end - start).count();
+            minMs    = i ? (std::min)(minMs, ms) : ms;
+            totalMs += ms;
+        }
+        return minMs;
+    }
+
+    // the table as it reads back after storing it in format
+    Table2D<Float4> quantize(const Table2D<Float4> &table, LUTTexelFormat format)
+    {
+        if(format == LUTTexelFormat::RGBA32F)
+            return table;
+
+        const size_t count = table.getTexelCount();
+        std::vector<unsigned char> payload(count * getTexelSize(format));
+        encodeTexels(format, table.data(), count, payload.data());
+
+        Table2D<Float4> result(table.getResolution());
+        for(size_t i = 0; i < count; ++i)
+            result.data()[i] = decodeTexel(format, payload.data(), i);
+        return result;
+    }
+
+    // reference values at a fixed set of probes, against which every
+    // configuration of a stage is compared
+    class Reference
+    {
+    public:
+
+        explicit Reference(std::vector<Float3> values)
+            : values_(std::move(values))
+        {
+            for(auto &v : values_)
+            {
+                for(int c = 0; c < 3; ++c)
+                    floor_[c] = (std::max)(floor_[c], std::abs(double(v[c])));
+            }
+            for(int c = 0; c < 3; ++c)
+                floor_[c] *= REL_ERROR_FLOOR;
+        }
+
+        // lookup(i) returns the value of the configuration at probe i
+        template<typename Func>
+        void evalError(Func &&lookup, double &rms, double &max) const
+        {
+            double sum = 0;
+            max = 0;
+            for(size_t i = 0; i < values_.size(); ++i)
+            {
+                const Float3 actual = lookup(i);
+                for(int c = 0; c < 3; ++c)
+                {
+                    const double ref = values_[i][c];
+                    const double err = std::abs(double(actual[c]) - ref)
+                                     / (std::max)(std::abs(ref), floor_[c]);
+                    sum += err * err;
+                    max  = (std::max)(max, err);
+                }
+            }
+            rms = std::sqrt(sum / (3.0 * values_.size()));
+        }
+
+    private:
+
+        std::vector<Float3> values_;
+        double              floor_[3] = { 0, 0, 0 };
+    };
+
+    // texels of a reference table, probed at their centers
+    std::vector<Float3> getTexels(const Table2D<Float4> &table)
+    {
+        std::vector<Float3> texels;
+        texels.reserve(table.getTexelCount());
+        for(size_t i = 0; i < table.getTexelCount(); ++i)
+            texels.push_back(table.data()[i].xyz());
+        return texels;
+    }
+
+    Float2 getTexelCenter(const Int2 &res, size_t index)
+    {
+        const int x = static_cast<int>(index % res.x);
+        const int y = static_cast<int>(index / res.x);
+        return { (x + 0.5f) / res.x, (y + 0.5f) / res.y };
+    }
+
+    struct Config
+    {
+        std::string    name;
+        LUTTexelFormat format;
+        double         ms;
+        size_t         bytes;
+        double         rmsError;
+        double         maxError;
+        bool           isDefault;
+        int            rank = 0;
+    };
+
+    // errors this close count as equal, so that a wider texel format with a
+    // practically identical error doesn't join the frontier
+    constexpr double ERROR_TIE = 0.02;
+
+    bool dominates(const Config &a, const Config &b)
+    {
+        const double tie = 1 + ERROR_TIE;
+        const bool noWorse = a.ms       <= b.ms             && a.bytes    <= b.bytes &&
+                             a.rmsError <= b.rmsError * tie && a.maxError <= b.maxError * tie;
+        const bool better  = a.ms             <  b.ms       || a.bytes          <  b.bytes ||
+                             a.rmsError * tie <  b.rmsError || a.maxError * tie <  b.maxError;
+        return noWorse && better;
+    }
+
+    // non-dominated sorting over time, memory, rms and max error. rank 1 is
+    // the pareto frontier, rank 2 the frontier once rank 1 is removed, and
+    // so on
+    void rankConfigs(std::vector<Config> &configs)
+    {
+        size_t ranked = 0;
+        for(int rank = 1; ranked < configs.size(); ++rank)
+        {
+            std::vector<size_t> front;
+            for(size_t i = 0; i < configs.size(); ++i)
+            {
+                if(configs[i].rank)
+                    continue;
+
+                bool isDominated = false;
+                for(size_t j = 0; j < configs.size() && !isDominated; ++j)
+                {
+                    if(j != i && !configs[j].rank &&
+                       dominates(configs[j], configs[i]))
+                        isDominated = true;
+                }
+                if(!isDominated)
+                    front.push_back(i);
+            }
+
+            // the error tie can make a few configurations dominate each
+            // other in a cycle, which then share the rank
+            if(front.empty())
+            {
+                for(size_t i = 0; i < configs.size(); ++i)
+                {
+                    if(!configs[i].rank)
+                        front.push_back(i);
+                }
+            }
+
+            for(size_t i : front)
+                configs[i].rank = rank;
+            ranked += front.size();
+        }
+    }
+
+    // every configuration of a stage, evaluated in all texel formats
+    class Stage
+    {
+    public:
+
+        Stage(const char *name, const char *reference, const Options &options)
+            : name_(name), reference_(reference), options_(options)
+        {
+
+        }
+
+        // lookup(table, i) samples the (quantized) table at probe i
+        template<typename Lookup>
+        void add(
+            const std::string     &name,
+            bool                   isDefault,
+            double                 ms,
+            const Table2D<Float4> &table,
+            const Reference       &reference,
+            Lookup               &&lookup)
+        {
+            for(auto format : FORMATS)
+            {
+                const Table2D<Float4> stored = quantize(table, format);
+
+                Config config;
+                config.name      = name;
+                config.format    = format;
+                config.ms        = ms;
+                config.bytes     = table.getTexelCount() * getTexelSize(format);
+                config.isDefault = isDefault && format == LUTTexelFormat::RGBA32F;
+                reference.evalError(
+                    [&](size_t i) { return lookup(stored, i); },
+                    config.rmsError, config.maxError);
+                configs_.push_back(config);
+            }
+
+            std::fprintf(stderr, "%-14s %-44s %10.3f ms\n", name_, name.c_str(), ms);
+        }
+
+        void print()
+        {
+            rankConfigs(configs_);
+
+            std::vector<const Config*> sorted;
+            for(auto &c : configs_)
+            {
+                if(c.rank <= options_.rankCount || c.isDefault)
+                    sorted.push_back(&c);
+            }
+            std::sort(sorted.begin(), sorted.end(), [](const Config *a, const Config *b)
+            {
+                if(a->rank != b->rank)
+                    return a->rank < b->rank;
+                if(a->ms != b->ms)
+                    return a->ms < b->ms;
+                return a->bytes < b->bytes;
+            });
+
+            std::printf(
+                "\n%s, relative error against %s, %zu configurations\n",
+                name_, reference_, configs_.size());
+            std::printf(
+                "%4s  %-44s %-7s %10s %10s %12s %12s\n",
+                "rank", "configuration", "format", "ms", "KB", "rms err", "max err");
+            for(auto c : sorted)
+                printRow(*c);
+
+            printCheapest();
+        }
+
+    private:
+
+        void printRow(const Config &c, const char *note = "") const
+        {
+            std::printf(
+                "%4d%c %-44s %-7s %10.3f %10.1f %12.3e %12.3e%s\n",
+                c.rank, c.isDefault ? '*' : ' ', c.name.c_str(),
+                getTexelFormatName(c.format), c.ms, c.bytes / 1024.0,
+                c.rmsError, c.maxError, note);
+        }
+
+        // the fastest configuration within the error budgets, smallest on ties.
+        // it is on the frontier, as anything dominating it would meet the
+        // budgets too.
+        void printCheapest() const
+        {
+            if(options_.rmsBudget <= 0 && options_.maxBudget <= 0)
+                return;
+
+            const Config *cheapest = nullptr;
+            for(auto &c : configs_)
+            {
+                if(options_.rmsBudget > 0 && c.rmsError > options_.rmsBudget)
+                    continue;
+                if(options_.maxBudget > 0 && c.maxError > options_.maxBudget)
+                    continue;
+                if(!cheapest || c.ms < cheapest->ms ||
+                   (c.ms == cheapest->ms && c.bytes < cheapest->bytes))
+                    cheapest = &c;
+            }
+
+            if(cheapest)
+                printRow(*cheapest, "   <- cheapest within budget");
+            else
+                std::printf("no configuration is within the error budget\n");
+        }
+
+        const char    *name_;
+        const char    *reference_;
+        const Options &options_;
+
+        std::vector<Config> configs_;
+    };
+
+    bool isSameRes(const Int2 &a, const Int2 &b)
+    {
+        return a.x == b.x && a.y == b.y;
+    }
+
+    std::string formatConfig(
+        const Int2 &res, const char *method, int steps, const char *extra = "")
+    {
+        char buf[128];
+        if(steps > 0)
+        {
+            std::snprintf(
+                buf, sizeof(buf), "%dx%d %s %d%s",
+                res.x, res.y, method, steps, extra);
+        }
+        else
+            std::snprintf(buf, sizeof(buf), "%dx%d %s%s", res.x, res.y, method, extra);
+        return buf;
+    }
+
+} // namespace anonymous
+
+// usage: ParetoBenchmark [options], see printUsage
+// accuracy against cost of the transmittance, multi-scattering and sky view
+// LUTs. every stage bakes a high-sample reference, then sweeps resolution,
+// step count, quadrature and texel format, and prints the pareto frontier
+// over time, memory, rms and max relative error. lookups are bilinear at
+// the probes, so the error includes the interpolation error of the
+// resolution. stages read the reference tables of the stages before them,
+// so each error is the stage's own. the demo defaults are marked with *.
+int main(int argc, char *argv[])
+{
+    Options options;
+    if(!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    const AtmosphereProperties linearAtmos = AtmosphereProperties().toStdUnit();
+
+    AtmosphereProperties horizonAtmos = linearAtmos;
+    horizonAtmos.transmittanceParam = TransmittanceParameterization::Horizon;
+
+    // transmittance, against the closed form at a grid of heights and angles
+
+    {
+        const float heightRange = linearAtmos.atmosphereRadius - linearAtmos.planetRadius;
+
+        std::vector<Float2> probes;
+        std::vector<Float3> values;
+        for(int y = 0; y < TRANSMITTANCE_PROBE_RES.y; ++y)
+        {
+            const float theta = PI * ((y + 0.37f) / TRANSMITTANCE_PROBE_RES.y - 0.5f);
+            for(int x = 0; x < TRANSMITTANCE_PROBE_RES.x; ++x)
+            {
+                const float h = heightRange * (x + 0.37f) / TRANSMITTANCE_PROBE_RES.x;
+                probes.push_back({ h, theta });
+                values.push_back(computeTransmittance(linearAtmos, h, theta));
+            }
+        }
+        const Reference reference(std::move(values));
+
+        Stage stage("transmittance", "the closed form", options);
+
+        const std::vector<Int2> resolutions = options.quick ?
+            std::vector<Int2>{ { 64, 64 }, { 128, 128 }, { 256, 256 } } :
+            std::vector<Int2>{ { 32, 32 }, { 64, 64 }, { 128, 128 }, { 256, 256 }, { 512, 512 } };
+        const std::vector<int> stepCounts = options.quick ?
+            std::vector<int>{ 64, TRANSMITTANCE_STEP_COUNT } :
+            std::vector<int>{ 16, 64, 256, TRANSMITTANCE_STEP_COUNT };
+
+        const AtmosphereProperties *atmospheres[] = { &linearAtmos, &horizonAtmos };
+        for(auto atmos : atmospheres)
+        {
+            const bool  isLinear = atmos == &linearAtmos;
+            const char *param    = isLinear ? " linear" : " horizon";
+
+            auto lookup = [&](const Table2D<Float4> &T, size_t i)
+            {
+                return sampleTransmittance(T, *atmos, probes[i].x, probes[i].y);
+            };
+
+            for(auto &res : resolutions)
+            {
+                CPUTransmittanceLUT lut;
+                lut.setThreadCount(options.threadCount);
+                lut.setMode(TransmittanceMode::Analytic);
+                const double ms = measureMs([&] { lut.generate(res, *atmos); });
+                stage.add(
+                    formatConfig(res, "closed form", 0, param), false, ms,
+                    lut.getTable(), reference, lookup);
+
+                for(auto scheme : SCHEMES)
+                {
+                    for(int n : stepCounts)
+                    {
+                        if(!isSwept(scheme, n))
+                            continue;
+
+                        lut.setMode(TransmittanceMode::RayMarch);
+                        lut.setQuadrature(scheme);
+                        lut.setStepCount(n);
+                        const double msMarch = measureMs([&] { lut.generate(res, *atmos); });
+
+                        const bool isDefault = isLinear &&
+                                               scheme == QuadratureScheme::Midpoint &&
+                                               n == TRANSMITTANCE_STEP_COUNT &&
+                                               isSameRes(res, TRANSMITTANCE_RES);
+                        stage.add(
+                            formatConfig(res, getQuadratureSchemeName(scheme), n, param),
+                            isDefault, msMarch, lut.getTable(), reference, lookup);
+                    }
+                }
+            }
+        }
+
+        stage.print();
+    }
+
+    // later stages read an accurate transmittance table and, for the sky
+    // view, the multi-scattering reference
+
+    CPUTransmittanceLUT transmittance;
+    transmittance.setThreadCount(options.threadCount);
+    transmittance.setMode(TransmittanceMode::Analytic);
+    transmittance.generate({ 512, 512 }, linearAtmos);
+    const auto &T = transmittance.getTable();
+
+    const Float3 terrainAlbedo = Float3(0.3f);
+
+    // multi-scattering, against a reference with many more directions and
+    // steps at odd texel centers
+
+    CPUMultiScatteringLUT msReference;
+    msReference.setThreadCount(options.threadCount);
+    msReference.setRayMarchStepCount(MS_REFERENCE_STEPS);
+
+    {
+        std::fprintf(stderr, "baking multi-scattering reference\n");
+        msReference.generate(
+            MS_REFERENCE_RES, T, terrainAlbedo, linearAtmos,
+            generatePoissonDiskSamples(MS_REFERENCE_DIRS, 0));
+        const Reference reference(getTexels(msReference.getTable()));
+
+        auto lookup = [&](const Table2D<Float4> &M, size_t i)
+        {
+            return sampleBilinear(M, getTexelCenter(MS_REFERENCE_RES, i)).xyz();
+        };
+
+        Stage stage("multiscatter", "512 dirs, 512 midpoint steps", options);
+
+        const std::vector<Int2> resolutions = options.quick ?
+            std::vector<Int2>{ { 16, 16 }, { 32, 32 }, { 64, 64 } } :
+            std::vector<Int2>{ { 16, 16 }, { 32, 32 }, { 64, 64 }, { 128, 128 }, { 256, 256 } };
+        const std::vector<int> stepCounts = options.quick ?
+            std::vector<int>{ 16, 64 } :
+            std::vector<int>{ 16, 64, MS_RAY_MARCH_STEP_COUNT };
+        const std::vector<int> dirCounts = options.quick ?
+            std::vector<int>{ 16, MS_DIR_SAMPLE_COUNT } :
+            std::vector<int>{ 16, MS_DIR_SAMPLE_COUNT, 256 };
+        const std::vector<QuadratureScheme> schemes = {
+            QuadratureScheme::Midpoint, QuadratureScheme::GaussLegendre
+        };
+
+        for(int dirCount : dirCounts)
+        {
+            const auto dirSamples = generatePoissonDiskSamples(dirCount, 0);
+            for(auto &res : resolutions)
+            {
+                for(auto scheme : schemes)
+                {
+                    for(int n : stepCounts)
+                    {
+                        if(!isSwept(scheme, n))
+                            continue;
+
+                        CPUMultiScatteringLUT lut;
+                        lut.setThreadCount(options.threadCount);
+                        lut.setRayMarchQuadrature(scheme);
+                        lut.setRayMarchStepCount(n);
+                        const double ms = measureMs([&]
+                        {
+                            lut.generate(res, T, terrainAlbedo, linearAtmos, dirSamples);
+                        });
+
+                        const bool isDefault = scheme == QuadratureScheme::Midpoint &&
+                                               n == MS_RAY_MARCH_STEP_COUNT &&
+                                               dirCount == MS_DIR_SAMPLE_COUNT &&
+                                               isSameRes(res, MS_RES);
+                        const std::string dirs = ", " + std::to_string(dirCount) + " dirs";
+                        stage.add(
+                            formatConfig(
+                                res, getQuadratureSchemeName(scheme), n, dirs.c_str()),
+                            isDefault, ms, lut.getTable(), reference, lookup);
+                    }
+                }
+            }
+        }
+
+        stage.print();
+    }
+
+    // sky view, against a fine midpoint march at odd texel centers
+
+    {
+        const Float3 sunDirection = Float3(0.3f, -0.2f, 0.2f).normalize();
+
+        auto setup = [&](CPUSkyLUT &lut)
+        {
+            lut.setThreadCount(options.threadCount);
+            lut.setAtmosphere(linearAtmos);
+            lut.setCamera({ 0, 500, 0 });
+            lut.setSun(sunDirection, Float3(10));
+            lut.setTransmittance(&T);
+            lut.setMultiScattering(true, &msReference.getTable());
+        };
+
+        std::fprintf(stderr, "baking sky view reference\n");
+        CPUSkyLUT skyReference;
+        setup(skyReference);
+        skyReference.setRayMarching(SKY_REFERENCE_STEPS);
+        skyReference.generate(SKY_REFERENCE_RES);
+        const Reference reference(getTexels(skyReference.getTable()));
+
+        auto lookup = [&](const Table2D<Float4> &S, size_t i)
+        {
+            return sampleBilinear(S, getTexelCenter(SKY_REFERENCE_RES, i)).xyz();
+        };
+
+        Stage stage("sky", "4096 midpoint steps", options);
+
+        const std::vector<Int2> resolutions = options.quick ?
+            std::vector<Int2>{ { 32, 32 }, { 64, 64 }, { 128, 128 } } :
+            std::vector<Int2>{ { 32, 32 }, { 64, 64 }, { 128, 64 }, { 128, 128 }, { 256, 128 } };
+        const std::vector<int> stepCounts = options.quick ?
+            std::vector<int>{ 10, 20, SKY_STEP_COUNT } :
+            std::vector<int>{ 10, 20, SKY_STEP_COUNT, 80 };
+        const std::vector<float> tolerances = { 1e-2f, 3e-3f, 1e-3f };
+
+        for(auto &res : resolutions)
+        {
+            for(auto scheme : SCHEMES)
+            {
+                for(int n : stepCounts)
+                {
+                    if(!isSwept(scheme, n))
+                        continue;
+
+                    CPUSkyLUT lut;
+                    setup(lut);
+                    lut.setQuadrature(scheme);
+                    lut.setRayMarching(n);
+                    const double ms = measureMs([&] { lut.generate(res); });
+
+                    const bool isDefault = scheme == QuadratureScheme::Midpoint &&
+                                           n == SKY_STEP_COUNT && isSameRes(res, SKY_RES);
+                    stage.add(
+                        formatConfig(res, getQuadratureSchemeName(scheme), n),
+                        isDefault, ms, lut.getTable(), reference, lookup);
+                }
+            }
+
+            for(float tolerance : tolerances)
+            {
+                CPUSkyLUT lut;
+                setup(lut);
+                lut.setAdaptiveRayMarching(true, tolerance, 64);
+                const double ms = measureMs([&] { lut.generate(res); });
+
+                char method[32];
+                std::snprintf(method, sizeof(method), "adaptive %.0e", tolerance);
+                stage.add(
+                    formatConfig(res, method, 0), false, ms,
+                    lut.getTable(), reference, lookup);
+            }
+        }
+
+        stage.print();
+    }
+}
@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "../src/cpu/aerial_lut.h"
+#include "../src/cpu/dir_samples.h"
+#include "../src/cpu/multiscatter.h"
+#include "../src/cpu/sky_lut.h"
+#include "../src/cpu/transmittance.h"
+
+namespace
+{
+
+    using Clock = std::chrono::steady_clock;
+
+    constexpr QuadratureScheme SCHEMES[] = {
+        QuadratureScheme::Midpoint,
+        QuadratureScheme::Simpson,
+        QuadratureScheme::GaussLegendre,
+        QuadratureScheme::Exponential,
+        QuadratureScheme::HeightAdaptive
+    };
+
+    template<typename Func>
+    double measureMs(Func &&func)
+    {
+        const auto start = Clock::now();
+        func();
+        const auto end = Clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    // rms of the rgb difference over rms of the reference
+    template<typename Texel>
+    double relativeRMSError(
+        const Texel *reference, const Texel *actual, size_t count)
+    {
+        double sumDiff = 0, sumRef = 0;
+        for(size_t i = 0; i < count; ++i)
+        {
+            for(int c = 0; c < 3; ++c)
+            {
+                const double diff = double(actual[i][c]) - reference[i][c];
+                sumDiff += diff * diff;
+                sumRef  += double(reference[i][c]) * reference[i][c];
+            }
+        }
+        return sumRef > 0 ? std::sqrt(sumDiff / sumRef) : 0.0;
+    }
+
+    void printHeader(const char *name, const char *reference)
+    {
+        std::printf("\n%s, relative rms error against %s\n", name, reference);
+        std::printf("%-16s %7s %12s %10s\n", "scheme", "samples", "error", "ms");
+    }
+
+    void report(QuadratureScheme scheme, int sampleCount, double err, double ms)
+    {
+        std::printf(
+            "%-16s %7d %12.3e %10.3f\n",
+            getQuadratureSchemeName(scheme), sampleCount, err, ms);
+    }
+
+    constexpr float TOLERANCES[] = { 1e-2f, 3e-3f, 1e-3f, 3e-4f };
+
+    // adaptive marches list their tolerance and the mean and largest sample
+    // count per ray in place of the scheme and sample count
+    void reportAdaptive(
+        float tolerance, const Table2D<int> &sampleCounts, double err, double ms)
+    {
+        const int *counts = sampleCounts.data();
+        const size_t n    = sampleCounts.getTexelCount();
+
+        double sum = 0;
+        int    max = 0;
+        for(size_t i = 0; i < n; ++i)
+        {
+            sum += counts[i];
+            max  = (std::max)(max, counts[i]);
+        }
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "adaptive %.0e", tolerance);
+        std::printf(
+            "%-16s %7.1f %12.3e %10.3f   (max %d samples)\n",
+            name, sum / n, err, ms, max);
+    }
+
+} // namespace anonymous
+
+// usage: QuadratureBenchmark [threadCount]
+// convergence of every quadrature scheme in every CPU integrator, and of
+// the adaptive marches of the sky view and aerial perspective LUTs
+int main(int argc, char *argv[])
+{
+    const int threadCount = argc > 1 ? std::atoi(argv[1]) : 0;
+
+    const AtmosphereProperties atmos = AtmosphereProperties().toStdUnit();
+
+    // transmittance, against the closed-form optical depth
+
+    {
+        printHeader("transmittance 64x64", "closed form");
+
+        CPUTransmittanceLUT reference;
+        reference.setMode(TransmittanceMode::Analytic);
+        reference.generate({ 64, 64 }, atmos);
+        const auto &ref = reference.getTable();
+
+        for(auto scheme : SCHEMES)
+        {
+            for(int n : { 4, 8, 16, 32, 64 })
+            {
+                CPUTransmittanceLUT lut;
+                lut.setThreadCount(threadCount);
+                lut.setQuadrature(scheme);
+                lut.setStepCount(n);
+                const double ms = measureMs([&] { lut.generate({ 64, 64 }, atmos); });
+                report(
+                    scheme, n,
+                    relativeRMSError(ref.data(), lut.getTable().data(), ref.getTexelCount()),
+                    ms);
+            }
+        }
+    }
+
+    CPUTransmittanceLUT transmittance;
+    transmittance.setThreadCount(threadCount);
+    transmittance.setMode(TransmittanceMode::Analytic);
+    transmittance.generate({ 256, 256 }, atmos);
+
+    // multi-scattering, against a 1024-step midpoint march
+
+    const auto dirSamples = generatePoissonDiskSamples(16, 0);
+
+    CPUMultiScatteringLUT multiScattering;
+    {
+        printHeader("multiscatter 32x32, 16 dirs", "1024 midpoint steps");
+
+        auto generate = [&](CPUMultiScatteringLUT &lut)
+        {
+            lut.setThreadCount(threadCount);
+            lut.generate(
+                { 32, 32 }, transmittance.getTable(), Float3(0.3f),
+                atmos, dirSamples);
+        };
+
+        multiScattering.setRayMarchStepCount(1024);
+        generate(multiScattering);
+        const auto &ref = multiScattering.getTable();
+
+        for(auto scheme : SCHEMES)
+        {
+            for(int n : { 4, 8, 16, 32, 64 })
+            {
+                CPUMultiScatteringLUT lut;
+                lut.setRayMarchQuadrature(scheme);
+                lut.setRayMarchStepCount(n);
+                const double ms = measureMs([&] { generate(lut); });
+                report(
+                    scheme, n,
+                    relativeRMSError(ref.data(), lut.getTable().data(), ref.getTexelCount()),
+                    ms);
+            }
+        }
+    }
+
+    const Float3 sunDirection = Float3(0.3f, -0.2f, 0.2f).normalize();
+
+    // sky view, against a 2048-step midpoint march
+
+    {
+        printHeader("sky 64x64", "2048 midpoint steps");
+
+        auto generate = [&](
+            CPUSkyLUT &lut, QuadratureScheme scheme, int n, float tolerance = 0)
+        {
+            lut.setThreadCount(threadCount);
+            lut.setAtmosphere(atmos);
+            lut.setCamera({ 0, 500, 0 });
+            lut.setSun(sunDirection, Float3(10));
+            lut.setQuadrature(scheme);
+            lut.setRayMarching(n);
+            lut.setAdaptiveRayMarching(tolerance > 0, tolerance, 64);
+            lut.setTransmittance(&transmittance.getTable());
+            lut.setMultiScattering(true, &multiScattering.getTable());
+            lut.generate({ 64, 64 });
+        };
+
+        CPUSkyLUT reference;
+        generate(reference, QuadratureScheme::Midpoint, 2048);
+        const auto &ref = reference.getTable();
+
+        for(auto scheme : SCHEMES)
+        {
+            for(int n : { 4, 8, 16, 32, 64 })
+            {
+                CPUSkyLUT lut;
+                const double ms = measureMs([&] { generate(lut, scheme, n); });
+                report(
+                    scheme, n,
+                    relativeRMSError(ref.data(), lut.getTable().data(), ref.getTexelCount()),
+                    ms);
+            }
+        }
+
+        for(float tolerance : TOLERANCES)
+        {
+            CPUSkyLUT lut;
+            const double ms = measureMs([&]
+            {
+                generate(lut, QuadratureScheme::Midpoint, 1, tolerance);
+            });
+            reportAdaptive(
+                tolerance, lut.getSampleCounts(),
+                relativeRMSError(ref.data(), lut.getTable().data(), ref.getTexelCount()),
+                ms);
+        }
+    }
+
+    // aerial perspective, against 64 midpoint steps per slice
+
+    {
+        printHeader("aerial 64x32x32", "64 midpoint steps per slice");
+
+        const Camera::FrustumDirections frustumDirs = {
+            Float3(-1, 0.5f, 1).normalize(), Float3(1, 0.5f, 1).normalize(),
+            Float3(-1, -0.5f, 1).normalize(), Float3(1, -0.5f, 1).normalize()
+        };
+
+        auto generate = [&](
+            CPUAerialPerspectiveLUT &lut, QuadratureScheme scheme, int n,
+            float tolerance = 0)
+        {
+            lut.setThreadCount(threadCount);
+            lut.setAtmosphere(atmos);
+            lut.setCamera({ 0, 1, 0 }, 200, frustumDirs);
+            lut.setSun(sunDirection);
+            lut.setWorldScale(200);
+            lut.setMarchingParams(32000, n);
+            lut.setQuadrature(scheme);
+            lut.setAdaptiveMarching(tolerance > 0, tolerance, 256);
+            lut.setTransmittanceLUT(&transmittance.getTable());
+            lut.setMultiScatterLUT(true, &multiScattering.getTable());
+            lut.generate({ 64, 32, 32 });
+        };
+
+        CPUAerialPerspectiveLUT reference;
+        generate(reference, QuadratureScheme::Midpoint, 64);
+        const auto &ref = reference.getVolume();
+
+        for(auto scheme : SCHEMES)
+        {
+            for(int n : { 1, 2, 4, 8 })
+            {
+                CPUAerialPerspectiveLUT lut;
+                const double ms = measureMs([&] { generate(lut, scheme, n); });
+                report(
+                    scheme, n,
+                    relativeRMSError(ref.data(), lut.getVolume().data(), ref.getTexelCount()),
+                    ms);
+            }
+        }
+
+        for(float tolerance : TOLERANCES)
+        {
+            CPUAerialPerspectiveLUT lut;
+            const double ms = measureMs([&]
+            {
+                generate(lut, QuadratureScheme::Midpoint, 1, tolerance);
+            });
+            reportAdaptive(
+                tolerance, lut.getSampleCounts(),
+                relativeRMSError(ref.data(), lut.getVolume().data(), ref.getTexelCount()),
+                ms);
+        }
+    }
+}
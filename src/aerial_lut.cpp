@@ -1,5 +1,20 @@
+#include <algorithm>
+#include <cmath>
+
 #include "./aerial_lut.h"
 
+namespace
+{
+
+    // additive recurrence of the per-frame jitter offsets
+    constexpr double GOLDEN_RATIO_CONJUGATE = 0.6180339887498949;
+
+    // temporal mode has converged once the frames before the last input
+    // change weigh less than this in the history
+    constexpr float TEMPORAL_CONVERGENCE_WEIGHT = 0.01f;
+
+} // namespace anonymous
+
 void AerialPerspectiveLUT::initialize(const Int3 &res)
 {
     shader_.initializeStageFromFile<CS>(
@@ -12,9 +27,15 @@ void AerialPerspectiveLUT::initialize(const Int3 &res)
         shaderRscs_.getShaderResourceViewSlot<CS>("MultiScattering");
     transmittanceSlot_ =
         shaderRscs_.getShaderResourceViewSlot<CS>("Transmittance");
+    historySlot_ =
+        shaderRscs_.getShaderResourceViewSlot<CS>("History");
+    quadratureSlot_ =
+        shaderRscs_.getShaderResourceViewSlot<CS>("QuadratureRule");
 
     resize(res);
     
+    csParamsData_.sliceExponent = 1;
+
     csParams_.initialize();
     shaderRscs_.getConstantBufferSlot<CS>("CSParams")->setBuffer(csParams_);
 
@@ -36,6 +57,8 @@ void AerialPerspectiveLUT::initialize(const Int3 &res)
         D3D11_TEXTURE_ADDRESS_CLAMP);
     shaderRscs_.getSamplerSlot<CS>("ShadowSampler")
         ->setSampler(shadowSampler);
+
+    updateQuadrature();
 }
 
 void AerialPerspectiveLUT::resize(const Int3 &res)
@@ -50,7 +73,6 @@ void AerialPerspectiveLUT::resize(const Int3 &res)
     texDesc.BindFlags      = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
     texDesc.CPUAccessFlags = 0;
     texDesc.MiscFlags      = 0;
-    auto tex = device.createTex3D(texDesc);
 
     D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
     uavDesc.Format                = DXGI_FORMAT_R32G32B32A32_FLOAT;
@@ -58,21 +80,30 @@ void AerialPerspectiveLUT::resize(const Int3 &res)
     uavDesc.Texture3D.FirstWSlice = 0;
     uavDesc.Texture3D.WSize       = static_cast<UINT>(res.z);
     uavDesc.Texture3D.MipSlice    = 0;
-    auto uav = device.createUAV(tex, uavDesc);
 
     D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
     srvDesc.Format                    = DXGI_FORMAT_R32G32B32A32_FLOAT;
     srvDesc.ViewDimension             = D3D11_SRV_DIMENSION_TEXTURE3D;
     srvDesc.Texture3D.MipLevels       = 1;
     srvDesc.Texture3D.MostDetailedMip = 0;
-    auto srv = device.createSRV(tex, srvDesc);
 
-    res_ = res;
-    srv_ = std::move(srv);
-    uav_ = std::move(uav);
+    for(auto &volume : volumes_)
+    {
+        auto tex = device.createTex3D(texDesc);
+        volume.uav = device.createUAV(tex, uavDesc);
+        volume.srv = device.createSRV(tex, srvDesc);
+    }
 
-    shaderRscs_.getUnorderedAccessViewSlot<CS>("AerialPerspectiveLUT")
-        ->setUnorderedAccessView(std::move(uav_));
+    sampleCounts_ = createUIntTexture2D({ res.x, res.y });
+    shaderRscs_.getUnorderedAccessViewSlot<CS>("SampleCounts")
+        ->setUnorderedAccessView(sampleCounts_.uav);
+
+    res_    = res;
+    output_ = 0;
+
+    // the new volume holds nothing to amortize or accumulate against
+    schedule_.reset(0);
+    hasHistory_ = false;
 }
 
 void AerialPerspectiveLUT::setCamera(
@@ -86,22 +117,27 @@ void AerialPerspectiveLUT::setCamera(
     csParamsData_.frustumB          = frustumDirs.frustumB;
     csParamsData_.frustumC          = frustumDirs.frustumC;
     csParamsData_.frustumD          = frustumDirs.frustumD;
+
+    inputsChanged_ = true;
 }
 
 void AerialPerspectiveLUT::setSun(const Float3 &sunDirection)
 {
     csParamsData_.sunDirection = sunDirection.normalize();
     csParamsData_.sunTheta = std::asin(-csParamsData_.sunDirection.y);
+    inputsChanged_ = true;
 }
 
 void AerialPerspectiveLUT::setWorldScale(float worldScale)
 {
     csParamsData_.worldScale = worldScale;
+    inputsChanged_ = true;
 }
 
 void AerialPerspectiveLUT::setAtmosphere(const AtmosphereProperties &atmos)
 {
     atmos_.update(atmos);
+    inputsChanged_ = true;
 }
 
 void AerialPerspectiveLUT::setShadow(
@@ -112,13 +148,46 @@ void AerialPerspectiveLUT::setShadow(
     csParamsData_.enableShadow   = enableShadow;
     csParamsData_.shadowViewProj = shadowViewProj;
     shadowMapSlot_->setShaderResourceView(std::move(shadowMap));
+
+    inputsChanged_ = true;
 }
 
 void AerialPerspectiveLUT::setMarchingParams(
     float maxDistance, int stepsPerSlice)
 {
-    csParamsData_.maxDistance       = maxDistance;
-    csParamsData_.perSliceStepCount = stepsPerSlice;
+    csParamsData_.maxDistance = maxDistance;
+    stepsPerSlice_            = stepsPerSlice;
+    updateQuadrature();
+
+    inputsChanged_ = true;
+}
+
+void AerialPerspectiveLUT::setQuadrature(QuadratureScheme scheme)
+{
+    scheme_ = scheme;
+    updateQuadrature();
+    inputsChanged_ = true;
+}
+
+void AerialPerspectiveLUT::setAdaptiveMarching(
+    bool enabled, float tolerance, int maxStepCount)
+{
+    csParamsData_.enableAdaptive       = enabled;
+    csParamsData_.adaptiveTolerance    = (std::max)(tolerance, 1e-6f);
+    csParamsData_.maxAdaptiveStepCount = (std::max)(maxStepCount, 1);
+    inputsChanged_ = true;
+}
+
+void AerialPerspectiveLUT::setSliceDistribution(float sliceExponent)
+{
+    sliceExponent = (std::max)(sliceExponent, 1.0f);
+
+    // the history was sliced differently
+    if(sliceExponent != csParamsData_.sliceExponent)
+        hasHistory_ = false;
+
+    csParamsData_.sliceExponent = sliceExponent;
+    inputsChanged_ = true;
 }
 
 void AerialPerspectiveLUT::setMultiScatterLUT(
@@ -126,35 +195,142 @@ void AerialPerspectiveLUT::setMultiScatterLUT(
 {
     csParamsData_.enableMultiScattering = enableMultiScattering;
     multiScatterSlot_->setShaderResourceView(std::move(M));
+    inputsChanged_ = true;
 }
 
 void AerialPerspectiveLUT::setTransmittanceLUT(
     ComPtr<ID3D11ShaderResourceView> T)
 {
     transmittanceSlot_->setShaderResourceView(std::move(T));
+    inputsChanged_ = true;
+}
+
+void AerialPerspectiveLUT::setTemporal(
+    bool enabled, float blend, const Mat4 &viewProj)
+{
+    enableTemporal_ = enabled;
+    temporalBlend_  = (std::clamp)(blend, 0.0f, 1.0f);
+    viewProj_       = viewProj;
+
+    inputsChanged_ = true;
+}
+
+bool AerialPerspectiveLUT::isTemporalConverged() const
+{
+    if(!enableTemporal_)
+        return true;
+    const float oldWeight = std::pow(
+        1 - temporalBlend_, static_cast<float>(accumulatedFrameCount_));
+    return oldWeight < TEMPORAL_CONVERGENCE_WEIGHT;
 }
 
 void AerialPerspectiveLUT::render()
 {
+    csParamsData_.enableTemporal = enableTemporal_ && hasHistory_;
+    csParamsData_.temporalBlend  = temporalBlend_;
+    csParamsData_.jitterOffset   = enableTemporal_ ? static_cast<float>(
+        std::fmod(temporalFrameIndex_ * GOLDEN_RATIO_CONJUGATE, 1.0)) : 0.0f;
+
+    if(enableTemporal_)
+        output_ = 1 - output_;
+
+    renderBands(0, getBandCount());
+
+    if(enableTemporal_)
+    {
+        csParamsData_.prevViewProj    = viewProj_;
+        csParamsData_.prevEyePosition = csParamsData_.shadowEyePosition;
+        ++temporalFrameIndex_;
+
+        accumulatedFrameCount_ = inputsChanged_ ? 1 : accumulatedFrameCount_ + 1;
+    }
+    hasHistory_ = enableTemporal_;
+
+    inputsChanged_ = false;
+    schedule_.reset(getBandCount());
+}
+
+void AerialPerspectiveLUT::update(const AmortizedUpdateSettings &settings)
+{
+    // bands rendered apart would blend with a mix of old and new history
+    if(schedule_.getUnitCount() != getBandCount() || enableTemporal_)
+    {
+        render();
+        return;
+    }
+
+    if(inputsChanged_)
+    {
+        schedule_.markAllStale();
+        inputsChanged_ = false;
+    }
+
+    // the gpu time of a band isn't known here, so only the required bands
+    // are dispatched, as runs of adjacent bands
+    const std::vector<int> &order = schedule_.plan(settings);
+    std::vector<int> bands(
+        order.begin(), order.begin() + schedule_.getRequiredCount());
+    std::sort(bands.begin(), bands.end());
+
+    for(size_t i = 0; i < bands.size();)
+    {
+        size_t j = i + 1;
+        while(j < bands.size() && bands[j] == bands[j - 1] + 1)
+            ++j;
+        renderBands(bands[i], bands[j - 1] + 1);
+        i = j;
+    }
+
+    for(int band : bands)
+        schedule_.markFresh(band);
+    schedule_.advance();
+}
+
+const AmortizedSchedule &AerialPerspectiveLUT::getSchedule() const
+{
+    return schedule_;
+}
+
+void AerialPerspectiveLUT::renderBands(int bandBeg, int bandEnd)
+{
+    csParamsData_.rowOffset = bandBeg * THREAD_GROUP_SIZE_Y;
     csParams_.update(csParamsData_);
 
+    historySlot_->setShaderResourceView(volumes_[1 - output_].srv);
+    shaderRscs_.getUnorderedAccessViewSlot<CS>("AerialPerspectiveLUT")
+        ->setUnorderedAccessView(volumes_[output_].uav);
+
     shader_.bind();
     shaderRscs_.bind();
 
-    constexpr int THREAD_GROUP_SIZE_X = 16;
-    constexpr int THREAD_GROUP_SIZE_Y = 16;
     const int threadGroupCountX =
         (res_.x + THREAD_GROUP_SIZE_X - 1) / THREAD_GROUP_SIZE_X;
-    const int threadGroupCountY =
-        (res_.y + THREAD_GROUP_SIZE_Y - 1) / THREAD_GROUP_SIZE_Y;
 
-    deviceContext.dispatch(threadGroupCountX, threadGroupCountY);
+    deviceContext.dispatch(threadGroupCountX, bandEnd - bandBeg);
 
     shaderRscs_.unbind();
     shader_.unbind();
 }
 
+int AerialPerspectiveLUT::getBandCount() const
+{
+    return (res_.y + THREAD_GROUP_SIZE_Y - 1) / THREAD_GROUP_SIZE_Y;
+}
+
+void AerialPerspectiveLUT::updateQuadrature()
+{
+    quadrature_.set(scheme_, stepsPerSlice_);
+    csParamsData_.perSliceStepCount = quadrature_.getSampleCount();
+    csParamsData_.quadratureScheme  = quadrature_.getShaderScheme();
+    quadratureSlot_->setShaderResourceView(quadrature_.getSRV());
+}
+
 ComPtr<ID3D11ShaderResourceView> AerialPerspectiveLUT::getOutput() const
 {
-    return srv_;
+    return volumes_[output_].srv;
+}
+
+ComPtr<ID3D11ShaderResourceView> AerialPerspectiveLUT::getSampleCounts() const
+{
+    return sampleCounts_.srv;
 }
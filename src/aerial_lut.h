@@ -1,7 +1,11 @@
 #pragma once
 
 #include "./camera.h"
+#include "./common.h"
+#include "./cpu/amortized_update.h"
 #include "./medium.h"
+#include "./quadrature_rule.h"
+#include "./texture_io.h"
 
 class AerialPerspectiveLUT
 {
@@ -29,17 +33,67 @@ public:
 
     void setMarchingParams(float maxDistance, int stepsPerSlice);
 
+    // sample placement within every slice, Midpoint by default. see
+    // QuadratureRule for the schemes the shader supports.
+    void setQuadrature(QuadratureScheme scheme);
+
+    // replaces the fixed steps per slice and the quadrature with up to
+    // maxStepCount samples per column, but at least one per slice, split
+    // among the slices by their estimated error, see
+    // asset/adaptive_march.hlsl. the GPU counterpart of
+    // CPUAerialPerspectiveLUT::setAdaptiveMarching.
+    void setAdaptiveMarching(bool enabled, float tolerance, int maxStepCount);
+
+    // slice z is centered maxDistance * ((z + 0.5) / depth)^sliceExponent
+    // away from the eye, so exponents above 1 spend more slices near it.
+    // the mesh renderer must decode depth with the same exponent. 1 by
+    // default, clamped to at least 1.
+    void setSliceDistribution(float sliceExponent);
+
     void setMultiScatterLUT(
         bool enableMultiScattering, ComPtr<ID3D11ShaderResourceView> M);
 
     void setTransmittanceLUT(ComPtr<ID3D11ShaderResourceView> T);
 
+    // when enabled, every render() jitters the march with a new offset of a
+    // low-discrepancy sequence and blends the result, by blend, with the
+    // previous volume reprojected from the view-projection of its camera.
+    // render() must then be called every frame, see isTemporalConverged.
+    void setTemporal(bool enabled, float blend, const Mat4 &viewProj);
+
+    // whether the history of temporal mode has settled since the last
+    // setter call, so that further renders change little
+    bool isTemporalConverged() const;
+
     ComPtr<ID3D11ShaderResourceView> getOutput() const;
 
     void render();
 
+    // amortized alternative to render(): dispatches only the bands of 16
+    // froxel rows, one thread group high, an AmortizedSchedule requires for
+    // settings.maxStaleFrames. any setter call since the last update marks
+    // all bands stale. renders the whole volume after a resize and in
+    // temporal mode.
+    void update(const AmortizedUpdateSettings &settings);
+
+    const AmortizedSchedule &getSchedule() const;
+
+    // R32_UINT texture with the samples each froxel column took when its
+    // band was last rendered, see readbackUIntTexture2D
+    ComPtr<ID3D11ShaderResourceView> getSampleCounts() const;
+
 private:
 
+    static constexpr int THREAD_GROUP_SIZE_X = 16;
+    static constexpr int THREAD_GROUP_SIZE_Y = 16;
+
+    // bands [bandBeg, bandEnd) of THREAD_GROUP_SIZE_Y rows
+    void renderBands(int bandBeg, int bandEnd);
+
+    int getBandCount() const;
+
+    void updateQuadrature();
+
     struct CSParams
     {
         Float3 sunDirection;      float sunTheta;
@@ -49,10 +103,24 @@ private:
         Float3 frustumD;          float eyePositionY;
         Float3 shadowEyePosition; int   enableShadow;
         Mat4   shadowViewProj;
-        float worldScale;
-        float pad0;
-        float pad1;
-        float pad2;
+        float  worldScale;
+        int    rowOffset;
+        int    enableTemporal;
+        float  temporalBlend;
+        Mat4   prevViewProj;
+        Float3 prevEyePosition;   float jitterOffset;
+        float  sliceExponent;     int   quadratureScheme;
+        int    enableAdaptive;    float adaptiveTolerance;
+        int    maxAdaptiveStepCount;
+        float  pad0;
+        float  pad1;
+        float  pad2;
+    };
+
+    struct Volume
+    {
+        ComPtr<ID3D11ShaderResourceView>  srv;
+        ComPtr<ID3D11UnorderedAccessView> uav;
     };
 
     Shader<CS>         shader_;
@@ -61,13 +129,33 @@ private:
     ShaderResourceViewSlot<CS> *shadowMapSlot_     = nullptr;
     ShaderResourceViewSlot<CS> *multiScatterSlot_  = nullptr;
     ShaderResourceViewSlot<CS> *transmittanceSlot_ = nullptr;
+    ShaderResourceViewSlot<CS> *historySlot_       = nullptr;
+    ShaderResourceViewSlot<CS> *quadratureSlot_    = nullptr;
 
-    Int3                              res_;
-    ComPtr<ID3D11ShaderResourceView>  srv_;
-    ComPtr<ID3D11UnorderedAccessView> uav_;
+    // temporal mode renders into the volume output_ doesn't point to, and
+    // reads the other one as history
+    Int3   res_;
+    Volume volumes_[2];
+    int    output_ = 0;
+
+    UIntTexture2D sampleCounts_;
 
     CSParams                 csParamsData_ = {};
     ConstantBuffer<CSParams> csParams_;
 
+    int              stepsPerSlice_ = 1;
+    QuadratureScheme scheme_        = QuadratureScheme::Midpoint;
+    QuadratureRule   quadrature_;
+
     ConstantBuffer<AtmosphereProperties> atmos_;
+
+    bool              inputsChanged_ = true;
+    AmortizedSchedule schedule_;
+
+    bool  enableTemporal_        = false;
+    float temporalBlend_         = 0.1f;
+    Mat4  viewProj_;
+    bool  hasHistory_            = false;
+    int   temporalFrameIndex_    = 0;
+    int   accumulatedFrameCount_ = 0;
 };
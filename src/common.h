@@ -2,7 +2,7 @@
 
 #include <agz-utils/graphics_api.h>
 
-constexpr float PI = agz::math::PI_f;
+#include "./common_math.h"
 
 using namespace agz::d3d11;
 
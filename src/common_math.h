@@ -0,0 +1,19 @@
+#pragma once
+
+#include <agz-utils/math.h>
+
+// math types shared with the renderer, without pulling in graphics_api.h.
+// these name the same types as the aliases in agz::d3d11, so both can be
+// visible at once.
+
+constexpr float PI = agz::math::PI_f;
+
+using Float2 = agz::math::vec2f;
+using Float3 = agz::math::vec3f;
+using Float4 = agz::math::vec4f;
+
+using Int2 = agz::math::vec2i;
+using Int3 = agz::math::vec3i;
+
+using Mat4   = agz::math::mat4f_c;
+using Trans4 = Mat4::left_transform;
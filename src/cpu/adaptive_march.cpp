@@ -0,0 +1,35 @@
+#include "./adaptive_march.h"
+
+AdaptiveRayMarch::AdaptiveRayMarch(float tolerance, int maxSampleCount)
+    : tolerance_((std::max)(tolerance, 0.0f)),
+      maxSampleCount_((std::max)(maxSampleCount, 1))
+{
+    
+}
+
+float AdaptiveRayMarch::getTolerance() const
+{
+    return tolerance_;
+}
+
+int AdaptiveRayMarch::getMaxSampleCount() const
+{
+    return maxSampleCount_;
+}
+
+float AdaptiveRayMarch::accumulate(
+    int          sampleCount,
+    const float *w,
+    const float *sigma,
+    float        depthBeg,
+    float       *depth)
+{
+    float sum = depthBeg;
+    for(int i = 0; i < sampleCount; ++i)
+    {
+        const float delta = w[i] * sigma[i];
+        depth[i] = sum + 0.5f * delta;
+        sum += delta;
+    }
+    return sum;
+}
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "../common_math.h"
+
+// error-controlled placement of midpoint cells along a ray segment.
+//
+// the segment starts as the given cells, and the cell with the largest
+// estimated error is halved until every cell is within its share of the
+// tolerance or the sample budget is spent. the error of a cell is the
+// difference between its midpoint and Simpson estimates, relative to the
+// integral over the whole segment, and is tracked for two quantities:
+//
+//   density    the extinction along the ray
+//   inScatter  the scattering source times the eye transmittance
+//
+// the eye transmittance is derived from the density estimates of the cells
+// themselves, so the estimator only has to provide local quantities. cheap
+// upper-atmosphere cells stay coarse, while cells near the ground or along
+// the horizon, where either quantity bends, get split.
+class AdaptiveRayMarch
+{
+public:
+
+    struct Cell
+    {
+        float  t0, t1;
+        Float2 f0, fm, f1;
+        float  depth0;
+        float  error;
+        int    initialCell;
+        int    depth;
+    };
+
+    struct Scratch
+    {
+        std::vector<Cell>                   cells;
+        std::vector<std::pair<float, int>> queue;
+    };
+
+    AdaptiveRayMarch() = default;
+
+    // tolerance is relative to the integrals over the whole segment.
+    // maxSampleCount is the budget of a segment, but never less than its
+    // initial cell count.
+    AdaptiveRayMarch(float tolerance, int maxSampleCount);
+
+    float getTolerance() const;
+
+    int getMaxSampleCount() const;
+
+    // bounds holds the cellCount + 1 increasing ends of the initial cells.
+    // estimate(t) returns { sigmaT, source } at distance t, with sigmaT the
+    // extinction and source the in-scattering per unit length that reaches
+    // t from outside the ray. writes the midpoints of the final cells to t
+    // and their lengths to w, both with room for
+    // max(cellCount, getMaxSampleCount()) values, and returns the sample
+    // count. cells are never merged, so the samples of initial cell i are
+    // contiguous; their counts go to cellSampleCounts unless it is null.
+    template<typename Func>
+    int place(
+        const float *bounds,
+        int          cellCount,
+        Func       &&estimate,
+        Scratch     &scratch,
+        float       *t,
+        float       *w,
+        int         *cellSampleCounts = nullptr) const;
+
+    // depth[i] = depthBeg + integral of sigma up to the midpoint t[i], given
+    // sigma at the samples and the cell lengths written by place(). returns
+    // the integral over all cells.
+    static float accumulate(
+        int          sampleCount,
+        const float *w,
+        const float *sigma,
+        float        depthBeg,
+        float       *depth);
+
+private:
+
+    static float integrateHalf(const Cell &cell);
+
+    static Float2 evalInScatter(const Cell &cell);
+
+    float evalError(
+        const Cell &cell, const Float2 &integral, float totalLength) const;
+
+    // a cell halved this often isn't split any further. this bounds the
+    // work spent on discontinuities such as shadow edges, where the error
+    // estimate doesn't shrink with the cell.
+    static constexpr int MAX_DEPTH = 8;
+
+    float tolerance_      = 1e-3f;
+    int   maxSampleCount_ = 64;
+};
+
+inline float AdaptiveRayMarch::integrateHalf(const Cell &cell)
+{
+    // integral of the quadratic through f0, fm, f1 over the first half
+    return (cell.t1 - cell.t0) / 24 * (5 * cell.f0.x + 8 * cell.fm.x - cell.f1.x);
+}
+
+inline Float2 AdaptiveRayMarch::evalInScatter(const Cell &cell)
+{
+    // in-scattering at the midpoint and at the end of the cell
+    const float len    = cell.t1 - cell.t0;
+    const float depthM = cell.depth0 + integrateHalf(cell);
+    const float depth1 = cell.depth0 + len / 6 * (cell.f0.x + 4 * cell.fm.x + cell.f1.x);
+    return { cell.fm.y * std::exp(-depthM), cell.f1.y * std::exp(-depth1) };
+}
+
+inline float AdaptiveRayMarch::evalError(
+    const Cell &cell, const Float2 &integral, float totalLength) const
+{
+    const float len = cell.t1 - cell.t0;
+    if(len <= 0)
+        return 0;
+
+    const Float2 inScatter = evalInScatter(cell);
+    const float  g0        = cell.f0.y * std::exp(-cell.depth0);
+
+    const float densityError   = std::abs(cell.f0.x - 2 * cell.fm.x + cell.f1.x);
+    const float inScatterError = std::abs(g0 - 2 * inScatter.x + inScatter.y);
+
+    // the midpoint and Simpson estimates differ by len / 6 * |f0 - 2fm + f1|.
+    // a cell may use the share len / totalLength of the tolerance, so len
+    // cancels when comparing against the plain tolerance
+    const float rel = (std::max)(
+        integral.x > 0 ? densityError   / integral.x : 0.0f,
+        integral.y > 0 ? inScatterError / integral.y : 0.0f);
+    return rel * totalLength / 6;
+}
+
+template<typename Func>
+int AdaptiveRayMarch::place(
+    const float *bounds,
+    int          cellCount,
+    Func       &&estimate,
+    Scratch     &scratch,
+    float       *t,
+    float       *w,
+    int         *cellSampleCounts) const
+{
+    auto &cells = scratch.cells;
+    auto &queue = scratch.queue;
+    cells.clear();
+    queue.clear();
+
+    // initial cells, with the eye optical depth chained through them
+
+    Float2 integral;
+    float  depth = 0;
+    Float2 f0    = estimate(bounds[0]);
+    for(int i = 0; i < cellCount; ++i)
+    {
+        Cell cell;
+        cell.t0          = bounds[i];
+        cell.t1          = bounds[i + 1];
+        cell.f0          = f0;
+        cell.fm          = estimate(0.5f * (cell.t0 + cell.t1));
+        cell.f1          = estimate(cell.t1);
+        cell.depth0      = depth;
+        cell.error       = 0;
+        cell.initialCell = i;
+        cell.depth       = 0;
+
+        const float len = cell.t1 - cell.t0;
+        const float g0  = cell.f0.y * std::exp(-depth);
+        const Float2 g  = evalInScatter(cell);
+
+        integral.x += len / 6 * (cell.f0.x + 4 * cell.fm.x + cell.f1.x);
+        integral.y += len / 6 * (g0 + 4 * g.x + g.y);
+        depth      += len / 6 * (cell.f0.x + 4 * cell.fm.x + cell.f1.x);
+
+        f0 = cell.f1;
+        cells.push_back(cell);
+    }
+
+    const float totalLength = bounds[cellCount] - bounds[0];
+
+    auto enqueue = [&](int index)
+    {
+        Cell &cell = cells[index];
+        cell.error = evalError(cell, integral, totalLength);
+        if(cell.error > tolerance_ && cell.depth < MAX_DEPTH)
+        {
+            queue.emplace_back(cell.error, index);
+            std::push_heap(queue.begin(), queue.end());
+        }
+    };
+
+    for(int i = 0; i < cellCount; ++i)
+        enqueue(i);
+
+    // halve the worst cell until all are within tolerance
+
+    const int maxCellCount = (std::max)(cellCount, maxSampleCount_);
+    while(!queue.empty() && static_cast<int>(cells.size()) < maxCellCount)
+    {
+        std::pop_heap(queue.begin(), queue.end());
+        const int index = queue.back().second;
+        queue.pop_back();
+
+        const Cell parent = cells[index];
+        const float tm    = 0.5f * (parent.t0 + parent.t1);
+
+        Cell left = parent;
+        left.t1    = tm;
+        left.fm    = estimate(0.5f * (parent.t0 + tm));
+        left.f1    = parent.fm;
+        left.depth = parent.depth + 1;
+
+        Cell right = parent;
+        right.depth  = parent.depth + 1;
+        right.t0     = tm;
+        right.f0     = parent.fm;
+        right.fm     = estimate(0.5f * (tm + parent.t1));
+        right.depth0 = parent.depth0 + integrateHalf(parent);
+
+        cells[index] = left;
+        cells.push_back(right);
+
+        enqueue(index);
+        enqueue(static_cast<int>(cells.size()) - 1);
+    }
+
+    // initial cells may be empty, so they order the samples before t does
+    std::sort(cells.begin(), cells.end(), [](const Cell &a, const Cell &b)
+    {
+        if(a.initialCell != b.initialCell)
+            return a.initialCell < b.initialCell;
+        return a.t0 < b.t0;
+    });
+
+    if(cellSampleCounts)
+        std::fill_n(cellSampleCounts, cellCount, 0);
+
+    const int sampleCount = static_cast<int>(cells.size());
+
+    for(int i = 0; i < sampleCount; ++i)
+    {
+        const Cell &cell = cells[i];
+        t[i] = 0.5f * (cell.t0 + cell.t1);
+        w[i] = cell.t1 - cell.t0;
+
+        if(cellSampleCounts)
+            ++cellSampleCounts[cell.initialCell];
+    }
+
+    return sampleCount;
+}
@@ -0,0 +1,571 @@
+#include "./aerial_lut.h"
+#include "./intersection.h"
+#include "./parallel.h"
+#include "./profiler.h"
+#include "./sampler.h"
+#include "./transmittance.h"
+
+namespace
+{
+
+    float relativeLuminance(const Float3 &c)
+    {
+        return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+    }
+
+    float frac(float x)
+    {
+        return x - std::floor(x);
+    }
+
+    // additive recurrence of the per-frame jitter offsets
+    constexpr double GOLDEN_RATIO_CONJUGATE = 0.6180339887498949;
+
+    // an 8x8 tile writes 64 columns of res.z float4 texels, which stays
+    // within L1/L2 for the usual 32 slices. amortized updates refresh whole
+    // tiles, numbered row by row.
+    constexpr int TILE_SIZE_X = 8;
+    constexpr int TILE_SIZE_Y = 8;
+
+} // namespace anonymous
+
+float decodeAerialSliceDistance(float w, float maxDistance, float sliceExponent)
+{
+    return maxDistance * std::pow((std::max)(w, 0.0f), sliceExponent);
+}
+
+float encodeAerialSliceDepth(float distance, float maxDistance, float sliceExponent)
+{
+    return std::pow((std::max)(distance / maxDistance, 0.0f), 1 / sliceExponent);
+}
+
+void CPUAerialPerspectiveLUT::setCamera(
+    const Float3                    &eyePos,
+    float                            atmosEyeHeight,
+    const Camera::FrustumDirections &frustumDirs)
+{
+    eyePos_         = eyePos;
+    atmosEyeHeight_ = atmosEyeHeight;
+    frustumDirs_    = frustumDirs;
+
+    inputsChanged_ = true;
+}
+
+void CPUAerialPerspectiveLUT::setSun(const Float3 &sunDirection)
+{
+    sunDirection_ = sunDirection.normalize();
+    sunTheta_     = std::asin(-sunDirection_.y);
+
+    inputsChanged_ = true;
+}
+
+void CPUAerialPerspectiveLUT::setWorldScale(float worldScale)
+{
+    worldScale_ = worldScale;
+    inputsChanged_ = true;
+}
+
+void CPUAerialPerspectiveLUT::setAtmosphere(const AtmosphereProperties &atmos)
+{
+    atmos_ = atmos;
+    inputsChanged_ = true;
+}
+
+void CPUAerialPerspectiveLUT::setShadow(
+    bool                  enableShadow,
+    const Mat4           &shadowViewProj,
+    const Table2D<float> *shadowMap)
+{
+    enableShadow_   = enableShadow && shadowMap;
+    shadowViewProj_ = shadowViewProj;
+    shadowMap_      = shadowMap;
+
+    inputsChanged_ = true;
+}
+
+void CPUAerialPerspectiveLUT::setMarchingParams(float maxDistance, int stepsPerSlice)
+{
+    maxDistance_   = maxDistance;
+    stepsPerSlice_ = (std::max)(stepsPerSlice, 1);
+
+    inputsChanged_ = true;
+}
+
+void CPUAerialPerspectiveLUT::setSliceDistribution(float sliceExponent)
+{
+    sliceExponent = (std::max)(sliceExponent, 1.0f);
+
+    // the history was sliced differently
+    if(sliceExponent != sliceExponent_)
+        hasHistory_ = false;
+
+    sliceExponent_ = sliceExponent;
+    inputsChanged_ = true;
+}
+
+void CPUAerialPerspectiveLUT::setQuadrature(QuadratureScheme scheme)
+{
+    scheme_ = scheme;
+    inputsChanged_ = true;
+}
+
+void CPUAerialPerspectiveLUT::setAdaptiveMarching(
+    bool enabled, float tolerance, int maxStepCount)
+{
+    enableAdaptive_ = enabled;
+    adaptive_       = AdaptiveRayMarch(tolerance, maxStepCount);
+
+    inputsChanged_ = true;
+}
+
+void CPUAerialPerspectiveLUT::setMultiScatterLUT(
+    bool enableMultiScattering, const Table2D<Float4> *M)
+{
+    enableMultiScattering_ = enableMultiScattering && M;
+    M_ = M;
+
+    inputsChanged_ = true;
+}
+
+void CPUAerialPerspectiveLUT::setTransmittanceLUT(const Table2D<Float4> *T)
+{
+    T_ = T;
+    inputsChanged_ = true;
+}
+
+void CPUAerialPerspectiveLUT::setThreadCount(int threadCount)
+{
+    threadCount_ = threadCount;
+}
+
+void CPUAerialPerspectiveLUT::setTemporal(
+    bool enabled, float blend, const Mat4 &viewProj)
+{
+    enableTemporal_ = enabled;
+    temporalBlend_  = (std::clamp)(blend, 0.0f, 1.0f);
+    viewProj_       = viewProj;
+
+    inputsChanged_ = true;
+}
+
+void CPUAerialPerspectiveLUT::generate(const Int3 &res)
+{
+    ProfileZone zone("CPUAerialPerspectiveLUT::generate");
+
+    Table3D<Float4> volume(res);
+    Table2D<int>    sampleCounts({ res.x, res.y });
+
+    const int stepCount = prepareMarching(res);
+
+    const Int3 &oldRes = volume_.getResolution();
+    useHistory_ = enableTemporal_ && hasHistory_ &&
+                  oldRes.x == res.x && oldRes.y == res.y && oldRes.z == res.z;
+    jitterOffset_ = enableTemporal_ ? static_cast<float>(
+        std::fmod(temporalFrameIndex_ * GOLDEN_RATIO_CONJUGATE, 1.0)) : 0.0f;
+
+    parallelForTiles(
+        { res.x, res.y }, { TILE_SIZE_X, TILE_SIZE_Y }, threadCount_,
+        [&](int, const Int2 &beg, const Int2 &end)
+    {
+        Scratch scratch = createScratch(res, stepCount);
+        for(int y = beg.y; y < end.y; ++y)
+        {
+            for(int x = beg.x; x < end.x; ++x)
+                sampleCounts(x, y) = computeColumn(res, x, y, volume, scratch);
+        }
+    });
+
+    volume_       = std::move(volume);
+    sampleCounts_ = std::move(sampleCounts);
+
+    hasHistory_ = enableTemporal_;
+    if(enableTemporal_)
+    {
+        prevViewProj_ = viewProj_;
+        prevEyePos_   = eyePos_;
+        ++temporalFrameIndex_;
+    }
+
+    inputsChanged_ = false;
+    const Int2 tileCount = getTileCount(res);
+    schedule_.reset(tileCount.x * tileCount.y);
+}
+
+void CPUAerialPerspectiveLUT::update(
+    const Int3 &res, const AmortizedUpdateSettings &settings)
+{
+    ProfileZone zone("CPUAerialPerspectiveLUT::update");
+
+    const Int3 &oldRes = volume_.getResolution();
+    if(oldRes.x != res.x || oldRes.y != res.y || oldRes.z != res.z ||
+       enableTemporal_)
+    {
+        generate(res);
+        return;
+    }
+
+    // columns are rewritten in place, over a mix of old and new froxels
+    useHistory_   = false;
+    jitterOffset_ = 0;
+
+    if(inputsChanged_)
+    {
+        schedule_.markAllStale();
+        inputsChanged_ = false;
+    }
+
+    const int stepCount = prepareMarching(res);
+
+    const int tileCountX = getTileCount(res).x;
+
+    schedule_.run(settings, threadCount_, [&](int tile)
+    {
+        Scratch scratch = createScratch(res, stepCount);
+
+        const int xBeg = tile % tileCountX * TILE_SIZE_X;
+        const int yBeg = tile / tileCountX * TILE_SIZE_Y;
+        const int xEnd = (std::min)(xBeg + TILE_SIZE_X, res.x);
+        const int yEnd = (std::min)(yBeg + TILE_SIZE_Y, res.y);
+        for(int y = yBeg; y < yEnd; ++y)
+        {
+            for(int x = xBeg; x < xEnd; ++x)
+                sampleCounts_(x, y) = computeColumn(res, x, y, volume_, scratch);
+        }
+    });
+}
+
+const AmortizedSchedule &CPUAerialPerspectiveLUT::getSchedule() const
+{
+    return schedule_;
+}
+
+const Table3D<Float4> &CPUAerialPerspectiveLUT::getVolume() const
+{
+    return volume_;
+}
+
+const Table2D<int> &CPUAerialPerspectiveLUT::getSampleCounts() const
+{
+    return sampleCounts_;
+}
+
+Int2 CPUAerialPerspectiveLUT::getTileCount(const Int3 &res)
+{
+    return {
+        (res.x + TILE_SIZE_X - 1) / TILE_SIZE_X,
+        (res.y + TILE_SIZE_Y - 1) / TILE_SIZE_Y
+    };
+}
+
+int CPUAerialPerspectiveLUT::prepareMarching(const Int3 &res)
+{
+    quadrature_ = RayQuadrature(scheme_, stepsPerSlice_, atmos_);
+
+    sliceDistances_.resize(res.z);
+    for(int z = 0; z < res.z; ++z)
+    {
+        sliceDistances_[z] = decodeAerialSliceDistance(
+            (z + 0.5f) / res.z, maxDistance_, sliceExponent_);
+    }
+
+    return enableAdaptive_ ?
+        (std::max)(res.z, adaptive_.getMaxSampleCount()) :
+        res.z * quadrature_.getSampleCount();
+}
+
+CPUAerialPerspectiveLUT::Scratch CPUAerialPerspectiveLUT::createScratch(
+    const Int3 &res, int stepCount)
+{
+    Scratch scratch;
+    scratch.t           .resize(stepCount);
+    scratch.dt          .resize(stepCount);
+    scratch.h           .resize(stepCount);
+    scratch.u           .resize(stepCount);
+    scratch.sunVisible  .resize(stepCount);
+    scratch.opticalDepth.resize(stepCount);
+
+    scratch.sliceBounds      .resize(res.z + 1);
+    scratch.sliceSampleCounts.resize(res.z);
+    for(int c = 0; c < 3; ++c)
+    {
+        scratch.sigmaS[c]  .resize(stepCount);
+        scratch.eyeTrans[c].resize(stepCount);
+        scratch.rho[c]     .resize(stepCount);
+
+        scratch.sliceOpticalDepth[c].resize(res.z);
+    }
+    return scratch;
+}
+
+int CPUAerialPerspectiveLUT::computeColumn(
+    const Int3      &res,
+    int              x,
+    int              y,
+    Table3D<Float4> &volume,
+    Scratch         &scratch) const
+{
+    const float xf = (x + 0.5f) / res.x;
+    const float yf = (y + 0.5f) / res.y;
+
+    auto lerp = [](const Float3 &a, const Float3 &b, float t)
+    {
+        return a + t * (b - a);
+    };
+
+    const Float3 dir = lerp(
+        lerp(frustumDirs_.frustumA, frustumDirs_.frustumB, xf),
+        lerp(frustumDirs_.frustumC, frustumDirs_.frustumD, xf), yf).normalize();
+
+    const float u = dot(sunDirection_, -dir);
+
+    const Float3 oriR = { 0, atmosEyeHeight_ + atmos_.planetRadius, 0 };
+
+    float maxT = 0;
+    if(!findClosestIntersectionWithSphere(oriR, dir, atmos_.planetRadius, maxT))
+        findClosestIntersectionWithSphere(oriR, dir, atmos_.atmosphereRadius, maxT);
+
+    const float rand = frac(std::sin(
+        xf * 12.9898f * 2.0f + yf * 78.233f * 2.0f) * 43758.5453f + jitterOffset_);
+
+    // lay out all sample points of the column, slice after slice. slice z
+    // ends at the froxel center.
+
+    scratch.sliceBounds[0] = 0;
+    for(int z = 0; z < res.z; ++z)
+        scratch.sliceBounds[z + 1] = (std::min)(sliceDistances_[z], maxT);
+
+    int stepCount = 0;
+    if(enableAdaptive_)
+        stepCount = placeAdaptive(oriR, dir, res.z, scratch);
+    else
+    {
+        const int sliceSteps = quadrature_.getSampleCount();
+        for(int z = 0; z < res.z; ++z)
+        {
+            quadrature_.place(
+                oriR.y, dir.y, scratch.sliceBounds[z], scratch.sliceBounds[z + 1],
+                &scratch.t[stepCount], &scratch.dt[stepCount], rand);
+            scratch.sliceSampleCounts[z] = sliceSteps;
+            stepCount += sliceSteps;
+        }
+    }
+
+    for(int step = 0; step < stepCount; ++step)
+    {
+        const float  t    = scratch.t[step];
+        const Float3 posR = oriR + dir * t;
+
+        scratch.h[step]  = posR.length() - atmos_.planetRadius;
+        scratch.u[step]  = u;
+
+        bool visible = !hasIntersectionWithSphere(
+            posR, -sunDirection_, atmos_.planetRadius);
+        if(visible && enableShadow_)
+            visible = !isInShadow(eyePos_ + dir * t / worldScale_);
+        scratch.sunVisible[step] = visible ? 1.0f : 0.0f;
+    }
+
+    const Float3Batch sigmaS = {
+        scratch.sigmaS[0].data(), scratch.sigmaS[1].data(), scratch.sigmaS[2].data()
+    };
+    const Float3Batch eyeTrans = {
+        scratch.eyeTrans[0].data(), scratch.eyeTrans[1].data(), scratch.eyeTrans[2].data()
+    };
+    const Float3Batch rho = {
+        scratch.rho[0].data(), scratch.rho[1].data(), scratch.rho[2].data()
+    };
+
+    atmos_.getSigmaST(stepCount, scratch.h.data(), sigmaS, eyeTrans);
+    atmos_.evalPhaseFunction(stepCount, scratch.h.data(), scratch.u.data(), rho);
+
+    // turn sigmaT into eye transmittance to each sample in place, keeping
+    // the optical depth at the end of every slice for the output alpha
+
+    for(int c = 0; c < 3; ++c)
+    {
+        float *sT    = scratch.eyeTrans[c].data();
+        float *depth = scratch.opticalDepth.data();
+
+        float sumSigmaT = 0;
+        int   beg       = 0;
+        for(int z = 0; z < res.z; ++z)
+        {
+            if(enableAdaptive_)
+            {
+                sumSigmaT = AdaptiveRayMarch::accumulate(
+                    scratch.sliceSampleCounts[z],
+                    &scratch.dt[beg], &sT[beg], sumSigmaT, &depth[beg]);
+            }
+            else
+            {
+                sumSigmaT = quadrature_.accumulate(
+                    &scratch.dt[beg], &sT[beg], sumSigmaT, &depth[beg]);
+            }
+            scratch.sliceOpticalDepth[c][z] = sumSigmaT;
+            beg += scratch.sliceSampleCounts[z];
+        }
+
+        for(int i = 0; i < stepCount; ++i)
+            depth[i] = -depth[i];
+
+        expBatch(stepCount, depth, sT);
+    }
+
+    // march, see CSMain in asset/aerial_lut.hlsl
+
+    const float heightRange = atmos_.atmosphereRadius - atmos_.planetRadius;
+    const float sinSunTheta = std::sin(sunTheta_);
+
+    // see CPUSkyLUT::computeTexel
+    const bool linearT = atmos_.transmittanceParam ==
+                         TransmittanceParameterization::Linear;
+
+    const bool sameRes = enableMultiScattering_ && linearT &&
+                         M_->getWidth()  == T_->getWidth() &&
+                         M_->getHeight() == T_->getHeight();
+
+    const HistoryRay historyRay = useHistory_ ? getHistoryRay(dir) : HistoryRay{};
+
+    Float3 inScatter;
+
+    int step = 0;
+    for(int z = 0; z < res.z; ++z)
+    {
+        for(int i = 0; i < scratch.sliceSampleCounts[z]; ++i, ++step)
+        {
+            const float  dt = scratch.dt[step];
+            const Float3 sS = {
+                scratch.sigmaS[0][step], scratch.sigmaS[1][step], scratch.sigmaS[2][step]
+            };
+            const Float3 eT = {
+                eyeTrans.r[step], eyeTrans.g[step], eyeTrans.b[step]
+            };
+
+            const Float2 uv = {
+                scratch.h[step] / heightRange, 0.5f + 0.5f * sinSunTheta
+            };
+            const Float2 uvT = linearT ? uv : encodeTransmittanceUV(
+                atmos_, T_->getResolution(), scratch.h[step], sinSunTheta);
+            const BilinearFootprint fpT =
+                computeBilinearFootprint(T_->getResolution(), uvT);
+
+            if(scratch.sunVisible[step] != 0)
+            {
+                const Float3 r        = { rho.r[step], rho.g[step], rho.b[step] };
+                const Float3 sunTrans = fetchBilinear(*T_, fpT).xyz();
+                inScatter += dt * eT * sS * r * sunTrans;
+            }
+
+            if(enableMultiScattering_)
+            {
+                const Float3 ms = sameRes ?
+                    fetchBilinear(*M_, fpT).xyz() : sampleBilinear(*M_, uv).xyz();
+                inScatter += dt * eT * sS * ms;
+            }
+        }
+
+        const Float3 T = {
+            std::exp(-scratch.sliceOpticalDepth[0][z]),
+            std::exp(-scratch.sliceOpticalDepth[1][z]),
+            std::exp(-scratch.sliceOpticalDepth[2][z])
+        };
+        const Float4 value = Float4(
+            inScatter.x, inScatter.y, inScatter.z, relativeLuminance(T));
+        volume(x, y, z) = useHistory_ ?
+            blendHistory(historyRay, sliceDistances_[z], value) : value;
+    }
+
+    return stepCount;
+}
+
+int CPUAerialPerspectiveLUT::placeAdaptive(
+    const Float3 &oriR,
+    const Float3 &dir,
+    int           sliceCount,
+    Scratch      &scratch) const
+{
+    const float sinSunTheta = std::sin(sunTheta_);
+
+    auto estimate = [&](float t)
+    {
+        const Float3 posR = oriR + dir * t;
+        const float  h    = posR.length() - atmos_.planetRadius;
+
+        bool visible = !hasIntersectionWithSphere(
+            posR, -sunDirection_, atmos_.planetRadius);
+        if(visible && enableShadow_)
+            visible = !isInShadow(eyePos_ + dir * t / worldScale_);
+
+        float source = 0;
+        if(visible)
+        {
+            const Float2 uvT = encodeTransmittanceUV(
+                atmos_, T_->getResolution(), h, sinSunTheta);
+            const Float3 sunTrans = sampleBilinear(*T_, uvT).xyz();
+            source = relativeLuminance(atmos_.getSigmaS(h) * sunTrans);
+        }
+
+        return Float2(relativeLuminance(atmos_.getSigmaT(h)), source);
+    };
+
+    return adaptive_.place(
+        scratch.sliceBounds.data(), sliceCount, estimate, scratch.adaptive,
+        scratch.t.data(), scratch.dt.data(), scratch.sliceSampleCounts.data());
+}
+
+CPUAerialPerspectiveLUT::HistoryRay CPUAerialPerspectiveLUT::getHistoryRay(
+    const Float3 &dir) const
+{
+    // t is in km, world positions in world units
+    const Float3 worldDir = dir / worldScale_;
+
+    HistoryRay ray;
+    ray.clipOri   = Float4(eyePos_.x, eyePos_.y, eyePos_.z, 1) * prevViewProj_;
+    ray.clipDir   = Float4(worldDir.x, worldDir.y, worldDir.z, 0) * prevViewProj_;
+    ray.offsetOri = worldScale_ * (eyePos_ - prevEyePos_);
+    ray.offsetDir = dir;
+    return ray;
+}
+
+Float4 CPUAerialPerspectiveLUT::blendHistory(
+    const HistoryRay &ray, float t, const Float4 &current) const
+{
+    const Float4 clip = ray.clipOri + t * ray.clipDir;
+    if(clip.w <= 0)
+        return current;
+
+    const Float3 uvw = {
+        0.5f + 0.5f * clip.x / clip.w,
+        0.5f - 0.5f * clip.y / clip.w,
+        encodeAerialSliceDepth(
+            (ray.offsetOri + t * ray.offsetDir).length(), maxDistance_, sliceExponent_)
+    };
+    if(uvw.x < 0 || uvw.x > 1 || uvw.y < 0 || uvw.y > 1 || uvw.z > 1)
+        return current;
+
+    const Float4 history = sampleTrilinear(volume_, uvw);
+    return history + temporalBlend_ * (current - history);
+}
+
+bool CPUAerialPerspectiveLUT::isInShadow(const Float3 &shadowPos) const
+{
+    const Float4 shadowClip =
+        Float4(shadowPos.x, shadowPos.y, shadowPos.z, 1) * shadowViewProj_;
+    const Float2 shadowNDC = {
+        shadowClip.x / shadowClip.w, shadowClip.y / shadowClip.w
+    };
+    const Float2 shadowUV = {
+        0.5f + 0.5f * shadowNDC.x, 0.5f - 0.5f * shadowNDC.y
+    };
+
+    // outside of the shadow map counts as shadowed, as in the shader
+    if(shadowUV.x < 0 || shadowUV.x > 1 || shadowUV.y < 0 || shadowUV.y > 1)
+        return true;
+
+    const int w = shadowMap_->getWidth();
+    const int h = shadowMap_->getHeight();
+    const int sx = (std::min)(static_cast<int>(shadowUV.x * w), w - 1);
+    const int sy = (std::min)(static_cast<int>(shadowUV.y * h), h - 1);
+
+    return shadowClip.z >= (*shadowMap_)(sx, sy);
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include "../camera.h"
+#include "../medium.h"
+#include "./adaptive_march.h"
+#include "./amortized_update.h"
+#include "./quadrature.h"
+#include "./table.h"
+
+// the depth coordinate w in [0, 1] of an aerial perspective volume maps to
+// the distance maxDistance * w^sliceExponent from the eye. exponent 1 gives
+// linear slices, larger ones make the slices near the eye thinner, where
+// aerial perspective changes fastest on screen, and the far ones thicker.
+float decodeAerialSliceDistance(float w, float maxDistance, float sliceExponent);
+
+float encodeAerialSliceDepth(float distance, float maxDistance, float sliceExponent);
+
+// CPU backend of AerialPerspectiveLUT, port of asset/aerial_lut.hlsl.
+// Writes the same (inScatter, luminance transmittance) froxel volume. Each
+// froxel column marches all slices in order, and columns are scheduled in
+// small screen-space tiles so that a tile's output stays in cache.
+//
+// the per-column jitter uses the same hash as the shader, but GPU sin() is
+// not exact, so jittered samples only match the GPU output approximately.
+class CPUAerialPerspectiveLUT
+{
+public:
+
+    void setCamera(
+        const Float3                    &eyePos,
+        float                            atmosEyeHeight,
+        const Camera::FrustumDirections &frustumDirs);
+
+    void setSun(const Float3 &sunDirection);
+
+    void setWorldScale(float worldScale);
+
+    void setAtmosphere(const AtmosphereProperties &atmos);
+
+    // shadowMap holds post-projection depth and is sampled with point
+    // filtering. it must stay alive until generate() returns.
+    void setShadow(
+        bool                  enableShadow,
+        const Mat4           &shadowViewProj,
+        const Table2D<float> *shadowMap);
+
+    void setMarchingParams(float maxDistance, int stepsPerSlice);
+
+    // see decodeAerialSliceDistance. 1 by default, clamped to at least 1.
+    void setSliceDistribution(float sliceExponent);
+
+    // sample placement within each slice, Midpoint by default as on the
+    // GPU. the per-column jitter only moves samples of the cell rules.
+    void setQuadrature(QuadratureScheme scheme);
+
+    // replaces the fixed steps per slice with an AdaptiveRayMarch over the
+    // whole column, which starts from one cell per slice and may place up
+    // to maxStepCount samples, but at least one per slice
+    void setAdaptiveMarching(bool enabled, float tolerance, int maxStepCount);
+
+    void setMultiScatterLUT(
+        bool enableMultiScattering, const Table2D<Float4> *M);
+
+    void setTransmittanceLUT(const Table2D<Float4> *T);
+
+    void setThreadCount(int threadCount);
+
+    // temporal mode: the jitter of every froxel column moves along a golden
+    // ratio sequence from one generate() to the next, and each volume is
+    // blended into the previous one, reprojected through the previous
+    // camera, as lerp(history, current, blend). froxels reprojected outside
+    // the previous frustum start over from the current value. a static view
+    // with one step per slice then converges towards many steps per slice
+    // within a few times 1 / blend frames. viewProj is the camera's.
+    void setTemporal(bool enabled, float blend, const Mat4 &viewProj);
+
+    void generate(const Int3 &res);
+
+    // amortized alternative to generate(): refreshes the tiles of 8x8
+    // froxel columns that an AmortizedSchedule picks within
+    // settings.budgetUs, and leaves the others at the values of previous
+    // calls. tiles are equally important, so both orders sweep the volume
+    // round-robin. any setter call since the last update marks all tiles
+    // stale. falls back to
+    // generate() when the volume has another resolution, or in temporal
+    // mode, which already spreads the march over frames.
+    void update(const Int3 &res, const AmortizedUpdateSettings &settings);
+
+    const AmortizedSchedule &getSchedule() const;
+
+    const Table3D<Float4> &getVolume() const;
+
+    // samples along every froxel column in the last generate()
+    const Table2D<int> &getSampleCounts() const;
+
+private:
+
+    struct Scratch
+    {
+        std::vector<float> t;
+        std::vector<float> dt;
+        std::vector<float> h;
+        std::vector<float> u;
+        std::vector<float> sunVisible;
+        std::vector<float> sigmaS[3];
+        std::vector<float> eyeTrans[3];
+        std::vector<float> rho[3];
+        std::vector<float> sliceOpticalDepth[3];
+        std::vector<float> opticalDepth;
+        std::vector<float> sliceBounds;
+        std::vector<int>   sliceSampleCounts;
+
+        AdaptiveRayMarch::Scratch adaptive;
+    };
+
+    // tiles of the volume in x and y, the units of amortized updates
+    static Int2 getTileCount(const Int3 &res);
+
+    // quadrature_ and sliceDistances_ for this pass, returns the sample
+    // capacity of a Scratch
+    int prepareMarching(const Int3 &res);
+
+    static Scratch createScratch(const Int3 &res, int stepCount);
+
+    // returns the sample count of the column
+    int computeColumn(
+        const Int3      &res,
+        int              x,
+        int              y,
+        Table3D<Float4> &volume,
+        Scratch         &scratch) const;
+
+    // places the samples of a column ray to scratch.t and scratch.dt, and
+    // their counts per slice to scratch.sliceSampleCounts
+    int placeAdaptive(
+        const Float3 &oriR,
+        const Float3 &dir,
+        int           sliceCount,
+        Scratch      &scratch) const;
+
+    bool isInShadow(const Float3 &shadowPos) const;
+
+    // clip position in the previous frame and offset from the previous eye
+    // of the points along a froxel column, both linear in the distance
+    struct HistoryRay
+    {
+        Float4 clipOri;
+        Float4 clipDir;
+        Float3 offsetOri;
+        Float3 offsetDir;
+    };
+
+    HistoryRay getHistoryRay(const Float3 &dir) const;
+
+    // current blended with the previous volume at distance t along the ray
+    Float4 blendHistory(const HistoryRay &ray, float t, const Float4 &current) const;
+
+    Float3 eyePos_;
+    float  atmosEyeHeight_ = 0;
+
+    Camera::FrustumDirections frustumDirs_ = {};
+
+    Float3 sunDirection_ = { 0, -1, 0 };
+    float  sunTheta_     = PI / 2;
+
+    float worldScale_ = 1;
+
+    AtmosphereProperties atmos_;
+
+    bool                  enableShadow_ = false;
+    Mat4                  shadowViewProj_;
+    const Table2D<float> *shadowMap_ = nullptr;
+
+    float maxDistance_   = 2000;
+    int   stepsPerSlice_ = 1;
+    float sliceExponent_ = 1;
+
+    // distance of the froxel centers of every slice
+    std::vector<float> sliceDistances_;
+
+    QuadratureScheme scheme_ = QuadratureScheme::Midpoint;
+    RayQuadrature    quadrature_;
+
+    bool             enableAdaptive_ = false;
+    AdaptiveRayMarch adaptive_;
+
+    bool                   enableMultiScattering_ = false;
+    const Table2D<Float4> *M_ = nullptr;
+    const Table2D<Float4> *T_ = nullptr;
+
+    int threadCount_ = 0;
+
+    bool   enableTemporal_ = false;
+    float  temporalBlend_  = 0.1f;
+    Mat4   viewProj_;
+    Mat4   prevViewProj_;
+    Float3 prevEyePos_;
+    int    temporalFrameIndex_ = 0;
+    bool   hasHistory_         = false;
+
+    // frac(temporalFrameIndex_ * golden ratio) in temporal mode, else 0
+    float jitterOffset_ = 0;
+    bool  useHistory_   = false;
+
+    Table3D<Float4> volume_;
+    Table2D<int>    sampleCounts_;
+
+    bool              inputsChanged_ = true;
+    AmortizedSchedule schedule_;
+};
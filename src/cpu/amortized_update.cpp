@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#include <agz-utils/thread.h>
+
+#include "./amortized_update.h"
+
+void AmortizedSchedule::reset(int unitCount, std::vector<float> weights)
+{
+    units_.assign(unitCount, Unit{});
+    for(int i = 0; i < unitCount && i < static_cast<int>(weights.size()); ++i)
+        units_[i].weight = weights[i];
+
+    order_.clear();
+    requiredCount_ = 0;
+}
+
+int AmortizedSchedule::getUnitCount() const
+{
+    return static_cast<int>(units_.size());
+}
+
+void AmortizedSchedule::markAllStale()
+{
+    for(auto &unit : units_)
+        unit.stale = true;
+}
+
+const std::vector<int> &AmortizedSchedule::plan(
+    const AmortizedUpdateSettings &settings)
+{
+    const int maxStaleFrames = (std::max)(settings.maxStaleFrames, 1);
+
+    order_.clear();
+    int overdueCount = 0;
+    for(int i = 0; i < getUnitCount(); ++i)
+    {
+        if(units_[i].stale)
+        {
+            order_.push_back(i);
+            if(units_[i].age >= maxStaleFrames - 1)
+                ++overdueCount;
+        }
+    }
+
+    auto getScore = [&](int i)
+    {
+        const Unit &unit = units_[i];
+        return settings.order == AmortizedOrder::Priority ?
+            (unit.age + 1) * unit.weight : static_cast<float>(unit.age);
+    };
+
+    // overdue units first, then by score. ties go to the lower index, which
+    // makes a uniform schedule sweep the table in order.
+    std::stable_sort(order_.begin(), order_.end(), [&](int a, int b)
+    {
+        const bool overdueA = units_[a].age >= maxStaleFrames - 1;
+        const bool overdueB = units_[b].age >= maxStaleFrames - 1;
+        if(overdueA != overdueB)
+            return overdueA;
+        return getScore(a) > getScore(b);
+    });
+
+    const int minCount = (getUnitCount() + maxStaleFrames - 1) / maxStaleFrames;
+    requiredCount_ = (std::min)(
+        (std::max)(overdueCount, minCount), static_cast<int>(order_.size()));
+
+    return order_;
+}
+
+int AmortizedSchedule::getRequiredCount() const
+{
+    return requiredCount_;
+}
+
+void AmortizedSchedule::markFresh(int unit)
+{
+    units_[unit].stale = false;
+    units_[unit].age   = 0;
+}
+
+void AmortizedSchedule::advance()
+{
+    for(auto &unit : units_)
+    {
+        if(unit.stale)
+            ++unit.age;
+    }
+}
+
+bool AmortizedSchedule::isConverged() const
+{
+    return std::none_of(
+        units_.begin(), units_.end(), [](const Unit &u) { return u.stale; });
+}
+
+int AmortizedSchedule::getMaxStaleness() const
+{
+    int result = 0;
+    for(auto &unit : units_)
+    {
+        if(unit.stale)
+            result = (std::max)(result, unit.age);
+    }
+    return result;
+}
+
+int AmortizedSchedule::run(
+    const AmortizedUpdateSettings &settings,
+    int                            threadCount,
+    const RefreshFunc             &refresh)
+{
+    using Clock = std::chrono::steady_clock;
+
+    auto getUs = [](const Clock::time_point &start)
+    {
+        return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    };
+
+    const std::vector<int> &order = plan(settings);
+    const int orderCount  = static_cast<int>(order.size());
+    const int workerCount = (std::min)(
+        agz::thread::actual_worker_count(threadCount), orderCount);
+
+    const auto start = Clock::now();
+
+    std::atomic<int>  nextIndex = 0;
+    std::atomic<bool> outOfTime = false;
+    std::vector<char> refreshed(orderCount, 0);
+
+    std::atomic<int>    refreshedCount = 0;
+    std::atomic<double> refreshedUs    = 0;
+
+    if(workerCount > 0)
+    {
+        // one task per worker, so threads are started once per update
+        agz::thread::parallel_forrange(0, workerCount, [&](int, int)
+        {
+            while(!outOfTime)
+            {
+                const int i = nextIndex++;
+                if(i >= orderCount)
+                    return;
+
+                if(i >= requiredCount_ &&
+                   getUs(start) + unitUs_ > settings.budgetUs)
+                {
+                    outOfTime = true;
+                    return;
+                }
+
+                const auto unitStart = Clock::now();
+                refresh(order[i]);
+                refreshed[i] = 1;
+
+                ++refreshedCount;
+                double us = refreshedUs;
+                while(!refreshedUs.compare_exchange_weak(us, us + getUs(unitStart)))
+                    ;
+            }
+        }, workerCount);
+    }
+
+    if(refreshedCount > 0)
+        unitUs_ = refreshedUs / refreshedCount;
+
+    for(int i = 0; i < orderCount; ++i)
+    {
+        if(refreshed[i])
+            markFresh(order[i]);
+    }
+    advance();
+
+    return refreshedCount;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+enum class AmortizedOrder
+{
+    RoundRobin, // stalest units first
+    Priority    // stalest units first, scaled by a weight per unit
+};
+
+struct AmortizedUpdateSettings
+{
+    AmortizedOrder order = AmortizedOrder::RoundRobin;
+
+    // a unit is refreshed at most this many updates after its inputs changed
+    int maxStaleFrames = 4;
+
+    // CPU backends keep refreshing units while the update takes less than
+    // this. units required by maxStaleFrames are refreshed regardless.
+    float budgetUs = 2000;
+};
+
+// picks the units of a table, e.g. rows of a sky view LUT, that an
+// amortized update refreshes. all units become stale when the inputs of
+// the table change, and stay stale until refreshed. every update refreshes
+// at least 1 / maxStaleFrames of the units, stalest first, plus any that
+// would exceed maxStaleFrames otherwise, so that no texel lags behind its
+// inputs by more than maxStaleFrames updates.
+class AmortizedSchedule
+{
+public:
+
+    // weights are used by AmortizedOrder::Priority, 1 for every unit by
+    // default. all units start fresh.
+    void reset(int unitCount, std::vector<float> weights = {});
+
+    int getUnitCount() const;
+
+    // units already stale keep their age
+    void markAllStale();
+
+    // stale units in refresh order. the first getRequiredCount() ones must
+    // be refreshed by this update.
+    const std::vector<int> &plan(const AmortizedUpdateSettings &settings);
+
+    int getRequiredCount() const;
+
+    void markFresh(int unit);
+
+    // ends an update, aging the units that are still stale
+    void advance();
+
+    bool isConverged() const;
+
+    // updates the stalest unit has been stale for
+    int getMaxStaleness() const;
+
+    // refreshes a single unit. called concurrently from worker threads.
+    using RefreshFunc = std::function<void(int unit)>;
+
+    // a whole CPU update as a single parallel dispatch: plans, then every
+    // worker claims units in refresh order, the required ones regardless of
+    // time and any further one as long as the elapsed time plus the
+    // duration of a unit still fits into settings.budgetUs, and advances.
+    // returns the number of refreshed units.
+    int run(
+        const AmortizedUpdateSettings &settings,
+        int                            threadCount,
+        const RefreshFunc             &refresh);
+
+private:
+
+    struct Unit
+    {
+        bool  stale  = false;
+        int   age    = 0;
+        float weight = 1;
+    };
+
+    std::vector<Unit> units_;
+    std::vector<int>  order_;
+    int               requiredCount_ = 0;
+
+    // mean duration of a unit in the last run(), predicts the next ones
+    double unitUs_ = 0;
+};
@@ -0,0 +1,172 @@
+#include "./async_lut_builder.h"
+#include "./dir_samples.h"
+#include "./multiscatter.h"
+#include "./profiler.h"
+#include "./transmittance.h"
+
+AsyncLUTBuilder::AsyncLUTBuilder(int threadCount)
+    : threadCount_(threadCount)
+{
+    worker_ = std::thread([this] { run(); });
+}
+
+AsyncLUTBuilder::~AsyncLUTBuilder()
+{
+    {
+        std::lock_guard lk(mutex_);
+        stop_ = true;
+        cancel_ = true;
+    }
+    requestCond_.notify_all();
+    worker_.join();
+}
+
+uint64_t AsyncLUTBuilder::request(LUTBuildRequest request)
+{
+    uint64_t generation;
+    {
+        std::lock_guard lk(mutex_);
+        generation = nextGeneration_++;
+        pending_ = std::move(request);
+        pendingGeneration_ = generation;
+        if(building_)
+            cancel_ = true;
+    }
+    requestCond_.notify_one();
+    return generation;
+}
+
+void AsyncLUTBuilder::cancel()
+{
+    {
+        std::lock_guard lk(mutex_);
+        pending_.reset();
+        if(building_)
+            cancel_ = true;
+    }
+    idleCond_.notify_all();
+}
+
+std::shared_ptr<const LUTSet> AsyncLUTBuilder::getLatest() const
+{
+    std::lock_guard lk(mutex_);
+    return latest_;
+}
+
+bool AsyncLUTBuilder::isBuilding() const
+{
+    std::lock_guard lk(mutex_);
+    return building_ || pending_.has_value();
+}
+
+uint64_t AsyncLUTBuilder::getBuildingGeneration() const
+{
+    std::lock_guard lk(mutex_);
+    return building_ ? buildingGeneration_ : 0;
+}
+
+uint64_t AsyncLUTBuilder::getCanceledCount() const
+{
+    std::lock_guard lk(mutex_);
+    return canceledCount_;
+}
+
+void AsyncLUTBuilder::wait()
+{
+    std::unique_lock lk(mutex_);
+    idleCond_.wait(lk, [&] { return !building_ && !pending_; });
+}
+
+void AsyncLUTBuilder::run()
+{
+    for(;;)
+    {
+        LUTBuildRequest request;
+        uint64_t generation;
+        {
+            std::unique_lock lk(mutex_);
+            requestCond_.wait(lk, [&] { return stop_ || pending_; });
+            if(stop_)
+                return;
+
+            request = std::move(*pending_);
+            generation = pendingGeneration_;
+            pending_.reset();
+            building_ = true;
+            buildingGeneration_ = generation;
+            cancel_ = false;
+        }
+
+        auto output = std::make_shared<LUTSet>();
+        output->generation = generation;
+        const bool completed = build(request, *output);
+
+        {
+            std::lock_guard lk(mutex_);
+            // a set superseded right after its last tile is dropped as well
+            if(completed && !cancel_)
+                latest_ = std::move(output);
+            else
+                ++canceledCount_;
+            building_ = false;
+        }
+        idleCond_.notify_all();
+    }
+}
+
+bool AsyncLUTBuilder::build(const LUTBuildRequest &request, LUTSet &output)
+{
+    ProfileZone zone("AsyncLUTBuilder::build");
+
+    if(request.transmittance)
+        output.transmittance = *request.transmittance;
+    else
+    {
+        CPUTransmittanceLUT transmittance;
+        transmittance.setMode(request.transmittanceMode);
+        transmittance.setStepCount(request.transmittanceStepCount);
+        transmittance.setQuadrature(request.transmittanceQuadrature);
+        transmittance.setThreadCount(threadCount_);
+        transmittance.setCancelFlag(&cancel_);
+        if(!transmittance.generate(request.transmittanceRes, request.atmos))
+            return false;
+        output.transmittance = transmittance.getTable();
+    }
+
+    if(request.multiScattering)
+        output.multiScattering = *request.multiScattering;
+    else
+    {
+        const auto dirSamples = generatePoissonDiskSamples(
+            request.dirSampleCount, request.dirSampleSeed);
+
+        // persist a newly eliminated set here rather than on the render thread
+        PoissonDiskSampleCache::getInstance().flush();
+
+        CPUMultiScatteringLUT multiScattering;
+        multiScattering.setRayMarchStepCount(request.multiScatteringRayMarchStepCount);
+        multiScattering.setRayMarchQuadrature(request.multiScatteringRayMarchQuadrature);
+        multiScattering.setThreadCount(threadCount_);
+        multiScattering.setCancelFlag(&cancel_);
+        if(!multiScattering.generate(
+            request.multiScatteringRes, output.transmittance,
+            request.terrainAlbedo, request.atmos, dirSamples))
+            return false;
+        output.multiScattering = multiScattering.getTable();
+    }
+
+    if(request.skyAtlas)
+    {
+        output.skyAtlas.setAtmosphere(request.atmos);
+        output.skyAtlas.setRayMarching(request.skyAtlasStepCount);
+        output.skyAtlas.setTransmittance(&output.transmittance);
+        output.skyAtlas.setMultiScattering(
+            request.skyAtlasEnableMultiScattering, &output.multiScattering);
+        output.skyAtlas.setThreadCount(threadCount_);
+        output.skyAtlas.setCancelFlag(&cancel_);
+        if(!output.skyAtlas.bake(request.skyAtlasRes))
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#include "../medium.h"
+#include "./sky_atlas.h"
+#include "./table.h"
+#include "./transmittance.h"
+
+struct LUTBuildRequest
+{
+    // std units (see AtmosphereProperties::toStdUnit)
+    AtmosphereProperties atmos;
+
+    Int2              transmittanceRes        = { 256, 256 };
+    TransmittanceMode transmittanceMode       = TransmittanceMode::RayMarch;
+    int               transmittanceStepCount  = 1000;
+    QuadratureScheme  transmittanceQuadrature = QuadratureScheme::Midpoint;
+
+    Int2             multiScatteringRes                = { 256, 256 };
+    int              multiScatteringRayMarchStepCount  = 256;
+    QuadratureScheme multiScatteringRayMarchQuadrature = QuadratureScheme::Midpoint;
+    int              dirSampleCount                    = 64;
+    uint32_t         dirSampleSeed                     = 0;
+    Float3           terrainAlbedo                     = Float3(0.3f);
+
+    // when set, the transmittance bake is skipped and this table is used
+    std::shared_ptr<const Table2D<Float4>> transmittance;
+
+    // likewise for the multi-scattering bake
+    std::shared_ptr<const Table2D<Float4>> multiScattering;
+
+    // bake a CPUSkyViewAtlas from both tables as well
+    bool skyAtlas                      = false;
+    Int2 skyAtlasRes                   = { 64, 64 };
+    int  skyAtlasStepCount             = 40;
+    bool skyAtlasEnableMultiScattering = true;
+};
+
+struct LUTSet
+{
+    uint64_t        generation = 0;
+    Table2D<Float4> transmittance;
+    Table2D<Float4> multiScattering;
+
+    // unavailable unless requested
+    CPUSkyViewAtlas skyAtlas;
+};
+
+// builds transmittance and multi-scattering tables, and optionally a sky
+// view atlas from them, on a background thread.
+// completed sets are published as immutable shared_ptrs, so readers keep
+// whatever set they hold while a newer one is being built. a new request
+// supersedes the pending one and cancels the one being built.
+class AsyncLUTBuilder
+{
+public:
+
+    // threadCount is the number of bake workers, 0 means all cores
+    explicit AsyncLUTBuilder(int threadCount = 0);
+
+    AsyncLUTBuilder(const AsyncLUTBuilder &) = delete;
+
+    AsyncLUTBuilder &operator=(const AsyncLUTBuilder &) = delete;
+
+    ~AsyncLUTBuilder();
+
+    // returns the generation of the set that will be published for it
+    uint64_t request(LUTBuildRequest request);
+
+    // drops the pending request and cancels the one being built
+    void cancel();
+
+    // latest completed set, nullptr before the first one
+    std::shared_ptr<const LUTSet> getLatest() const;
+
+    bool isBuilding() const;
+
+    // generation of the set being built, 0 when the worker is idle
+    uint64_t getBuildingGeneration() const;
+
+    // builds that were canceled or superseded before their set was published
+    uint64_t getCanceledCount() const;
+
+    // blocks until the latest request is published or canceled
+    void wait();
+
+private:
+
+    void run();
+
+    bool build(const LUTBuildRequest &request, LUTSet &output);
+
+    int threadCount_;
+
+    mutable std::mutex      mutex_;
+    std::condition_variable requestCond_;
+    std::condition_variable idleCond_;
+
+    std::optional<LUTBuildRequest> pending_;
+    uint64_t                       pendingGeneration_  = 0;
+    uint64_t                       nextGeneration_     = 1;
+    uint64_t                       buildingGeneration_ = 0;
+    uint64_t                       canceledCount_      = 0;
+    bool                           building_           = false;
+    bool                           stop_               = false;
+
+    std::atomic<bool> cancel_ = false;
+
+    std::shared_ptr<const LUTSet> latest_;
+
+    std::thread worker_;
+};
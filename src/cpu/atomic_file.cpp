@@ -0,0 +1,69 @@
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <filesystem>
+
+#include "./atomic_file.h"
+
+namespace
+{
+
+    unsigned long getProcessID()
+    {
+#ifdef _WIN32
+        return static_cast<unsigned long>(GetCurrentProcessId());
+#else
+        return static_cast<unsigned long>(getpid());
+#endif
+    }
+
+#ifdef _WIN32
+    constexpr int   REPLACE_RETRY_COUNT    = 8;
+    constexpr DWORD REPLACE_RETRY_DELAY_MS = 25;
+#endif
+
+} // namespace anonymous
+
+std::string makeTempFilename(const std::string &filename)
+{
+    static std::atomic<unsigned long> counter = 0;
+    return filename + "." + std::to_string(getProcessID()) + "." +
+           std::to_string(counter++) + ".tmp";
+}
+
+bool replaceFile(const std::string &tempFilename, const std::string &filename)
+{
+#ifdef _WIN32
+    const std::wstring wtemp     = std::filesystem::path(tempFilename).wstring();
+    const std::wstring wfilename = std::filesystem::path(filename).wstring();
+    for(int i = 0; i < REPLACE_RETRY_COUNT; ++i)
+    {
+        if(MoveFileExW(
+            wtemp.c_str(), wfilename.c_str(),
+            MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+            return true;
+        Sleep(REPLACE_RETRY_DELAY_MS);
+    }
+    DeleteFileW(wtemp.c_str());
+    return false;
+#else
+    std::error_code ec;
+    std::filesystem::rename(tempFilename, filename, ec);
+    if(ec)
+    {
+        std::filesystem::remove(tempFilename, ec);
+        return false;
+    }
+    return true;
+#endif
+}
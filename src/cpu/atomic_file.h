@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+// name of a temporary file next to filename, unique to this process and
+// call, so that concurrent writers of the same file, threads or processes
+// such as the demo and OfflineRenderer sharing a cache, never share one
+std::string makeTempFilename(const std::string &filename);
+
+// moves tempFilename over filename, replacing any existing file atomically,
+// and removes tempFilename on failure. on Windows a target that is mapped
+// or open without FILE_SHARE_DELETE can't be replaced, so the move is
+// retried for a short while before giving up.
+bool replaceFile(const std::string &tempFilename, const std::string &filename);
@@ -0,0 +1,288 @@
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+#include <cyPoint.h>
+#include <cySampleElim.h>
+
+#include "./atomic_file.h"
+#include "./dir_samples.h"
+
+namespace
+{
+
+    constexpr uint32_t FILE_MAGIC   = 0x43534450; // "PDSC"
+    constexpr uint32_t FILE_VERSION = 1;
+
+    // std::uniform_real_distribution is implementation-defined, so build
+    // the float from the top 24 bits of the fully specified mt19937 output
+    float toUnitFloat(uint32_t bits)
+    {
+        return static_cast<float>(bits >> 8) * (1.0f / 16777216.0f);
+    }
+
+    template<typename PointType, int Dim>
+    std::vector<float> eliminate(int count, uint32_t seed)
+    {
+        std::mt19937 rng(seed);
+
+        std::vector<PointType> rawPoints(static_cast<size_t>(count) * 10);
+        for(auto &p : rawPoints)
+        {
+            for(int d = 0; d < Dim; ++d)
+                p[d] = toUnitFloat(rng());
+        }
+
+        std::vector<PointType> outputPoints(count);
+
+        cy::WeightedSampleElimination<PointType, float, Dim> wse;
+        wse.SetTiling(true);
+        wse.Eliminate(
+            rawPoints.data(),    rawPoints.size(),
+            outputPoints.data(), outputPoints.size());
+
+        std::vector<float> result;
+        result.reserve(static_cast<size_t>(count) * Dim);
+        for(auto &p : outputPoints)
+        {
+            for(int d = 0; d < Dim; ++d)
+                result.push_back(p[d]);
+        }
+
+        return result;
+    }
+
+    template<typename T>
+    void writePOD(std::ofstream &fout, const T &value)
+    {
+        fout.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    bool readPOD(std::ifstream &fin, T &value)
+    {
+        fin.read(reinterpret_cast<char *>(&value), sizeof(T));
+        return static_cast<bool>(fin);
+    }
+
+} // namespace anonymous
+
+std::vector<float> eliminatePoissonDiskSamples(
+    int count, int dimension, uint32_t seed)
+{
+    if(count <= 0)
+        return {};
+    if(dimension == 2)
+        return eliminate<cy::Point2f, 2>(count, seed);
+    if(dimension == 3)
+        return eliminate<cy::Point3f, 3>(count, seed);
+    throw std::invalid_argument(
+        "unsupported poisson disk sample dimension: " +
+        std::to_string(dimension));
+}
+
+PoissonDiskSampleCache &PoissonDiskSampleCache::getInstance()
+{
+    static PoissonDiskSampleCache cache;
+    return cache;
+}
+
+PoissonDiskSampleCache::~PoissonDiskSampleCache()
+{
+    flush();
+}
+
+void PoissonDiskSampleCache::setPersistentFile(std::string filename)
+{
+    loadFromFile(filename);
+
+    std::lock_guard lock(mutex_);
+    filename_ = std::move(filename);
+}
+
+std::vector<float> PoissonDiskSampleCache::getSamples(
+    int count, int dimension, uint32_t seed)
+{
+    const Key key = { count, dimension, seed };
+
+    {
+        std::lock_guard lock(mutex_);
+        if(auto it = sets_.find(key); it != sets_.end())
+        {
+            ++hitCount_;
+            return it->second;
+        }
+    }
+
+    // eliminate outside the lock. concurrent misses on the same key compute
+    // identical sets, so whichever gets inserted first is fine
+    auto samples = eliminatePoissonDiskSamples(count, dimension, seed);
+
+    std::lock_guard lock(mutex_);
+    ++missCount_;
+    if(sets_.insert({ key, samples }).second)
+        dirty_ = true;
+
+    return samples;
+}
+
+bool PoissonDiskSampleCache::flush()
+{
+    std::string filename;
+    Sets sets;
+    {
+        std::lock_guard lock(mutex_);
+        if(!dirty_ || filename_.empty())
+            return true;
+        filename = filename_;
+        sets     = sets_;
+        dirty_   = false;
+    }
+
+    if(writeSets(filename, sets))
+        return true;
+
+    std::lock_guard lock(mutex_);
+    dirty_ = true;
+    return false;
+}
+
+bool PoissonDiskSampleCache::loadFromFile(const std::string &filename)
+{
+    std::ifstream fin(filename, std::ios::in | std::ios::binary);
+    if(!fin)
+        return false;
+
+    fin.seekg(0, std::ios::end);
+    const uint64_t fileSize = static_cast<uint64_t>(fin.tellg());
+    fin.seekg(0, std::ios::beg);
+
+    uint32_t magic = 0, version = 0, setCount = 0;
+    if(!readPOD(fin, magic) || !readPOD(fin, version) || !readPOD(fin, setCount))
+        return false;
+    if(magic != FILE_MAGIC || version != FILE_VERSION)
+        return false;
+
+    Sets sets;
+    for(uint32_t i = 0; i < setCount; ++i)
+    {
+        int32_t count = 0, dimension = 0;
+        uint32_t seed = 0;
+        if(!readPOD(fin, count) || !readPOD(fin, dimension) ||
+           !readPOD(fin, seed) || count < 0 || dimension <= 0 || dimension > 3)
+            return false;
+
+        // a corrupt count must not allocate more than the file can hold
+        const uint64_t byteCount =
+            static_cast<uint64_t>(count) * dimension * sizeof(float);
+        const uint64_t remaining = fileSize - static_cast<uint64_t>(fin.tellg());
+        if(byteCount > remaining)
+            return false;
+
+        std::vector<float> samples(static_cast<size_t>(count) * dimension);
+        fin.read(
+            reinterpret_cast<char *>(samples.data()),
+            static_cast<std::streamsize>(samples.size() * sizeof(float)));
+        if(!fin)
+            return false;
+
+        sets[{ count, dimension, seed }] = std::move(samples);
+    }
+
+    // a set whose count disagrees with its payload leaves bytes over
+    if(static_cast<uint64_t>(fin.tellg()) != fileSize)
+        return false;
+
+    std::lock_guard lock(mutex_);
+    for(auto &[key, samples] : sets)
+        sets_.insert({ key, std::move(samples) });
+
+    return true;
+}
+
+bool PoissonDiskSampleCache::saveToFile(const std::string &filename) const
+{
+    Sets sets;
+    {
+        std::lock_guard lock(mutex_);
+        sets = sets_;
+    }
+    return writeSets(filename, sets);
+}
+
+void PoissonDiskSampleCache::clear()
+{
+    std::lock_guard lock(mutex_);
+    sets_.clear();
+    hitCount_  = 0;
+    missCount_ = 0;
+}
+
+size_t PoissonDiskSampleCache::getHitCount() const
+{
+    std::lock_guard lock(mutex_);
+    return hitCount_;
+}
+
+size_t PoissonDiskSampleCache::getMissCount() const
+{
+    std::lock_guard lock(mutex_);
+    return missCount_;
+}
+
+bool PoissonDiskSampleCache::writeSets(
+    const std::string &filename, const Sets &sets)
+{
+    const auto parent = std::filesystem::path(filename).parent_path();
+    if(!parent.empty())
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(parent, ec);
+    }
+
+    const std::string tmpFilename = makeTempFilename(filename);
+    {
+        std::ofstream fout(
+            tmpFilename, std::ios::out | std::ios::binary | std::ios::trunc);
+        if(!fout)
+            return false;
+
+        writePOD(fout, FILE_MAGIC);
+        writePOD(fout, FILE_VERSION);
+        writePOD(fout, static_cast<uint32_t>(sets.size()));
+
+        for(auto &[key, samples] : sets)
+        {
+            writePOD(fout, static_cast<int32_t>(std::get<0>(key)));
+            writePOD(fout, static_cast<int32_t>(std::get<1>(key)));
+            writePOD(fout, std::get<2>(key));
+            fout.write(
+                reinterpret_cast<const char *>(samples.data()),
+                static_cast<std::streamsize>(samples.size() * sizeof(float)));
+        }
+
+        if(!fout)
+        {
+            fout.close();
+            std::error_code ec;
+            std::filesystem::remove(tmpFilename, ec);
+            return false;
+        }
+    }
+
+    return replaceFile(tmpFilename, filename);
+}
+
+std::vector<Float2> generatePoissonDiskSamples(int count, uint32_t seed)
+{
+    const auto flat = PoissonDiskSampleCache::getInstance().getSamples(
+        count, 2, seed);
+
+    std::vector<Float2> result;
+    result.reserve(count);
+    for(int i = 0; i < count; ++i)
+        result.push_back({ flat[2 * i], flat[2 * i + 1] });
+
+    return result;
+}
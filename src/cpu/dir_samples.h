@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "../common_math.h"
+
+// Poisson-disk distributed points in [0, 1]^dimension obtained by weighted
+// sample elimination. The random input only depends on the arguments, so two
+// calls with the same arguments yield bit-identical sets within one build.
+// The elimination itself is float math (std::sqrt, possibly contracted into
+// FMAs), so other compilers, flags or platforms may give slightly different
+// sets.
+// dimension must be 2 or 3. points are returned flattened.
+std::vector<float> eliminatePoissonDiskSamples(
+    int count, int dimension, uint32_t seed);
+
+// keyed cache of eliminated sample sets, so that repeated bakes skip the
+// elimination and the kd-tree construction entirely. Optionally mirrored to
+// a binary file, which flush() rewrites once new sets were inserted, e.g.
+// after a batch of bakes, and the destructor on shutdown. thread-safe. file
+// I/O happens outside the lock, so it never stalls concurrent lookups.
+class PoissonDiskSampleCache
+{
+public:
+
+    static PoissonDiskSampleCache &getInstance();
+
+    ~PoissonDiskSampleCache();
+
+    // load existing sets from filename (if any) and persist new ones there
+    void setPersistentFile(std::string filename);
+
+    std::vector<float> getSamples(int count, int dimension, uint32_t seed);
+
+    // writes all sets to the persistent file if any were inserted since the
+    // last flush
+    bool flush();
+
+    bool loadFromFile(const std::string &filename);
+
+    bool saveToFile(const std::string &filename) const;
+
+    void clear();
+
+    size_t getHitCount() const;
+
+    size_t getMissCount() const;
+
+private:
+
+    using Key  = std::tuple<int, int, uint32_t>;
+    using Sets = std::map<Key, std::vector<float>>;
+
+    // through a unique temporary file replacing filename
+    static bool writeSets(const std::string &filename, const Sets &sets);
+
+    mutable std::mutex mutex_;
+
+    Sets        sets_;
+    std::string filename_;
+    bool        dirty_ = false;
+
+    size_t hitCount_  = 0;
+    size_t missCount_ = 0;
+};
+
+// 2d sets through PoissonDiskSampleCache::getInstance()
+std::vector<Float2> generatePoissonDiskSamples(int count, uint32_t seed);
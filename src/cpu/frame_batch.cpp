@@ -0,0 +1,171 @@
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include <agz-utils/thread.h>
+
+#include "./frame_batch.h"
+#include "./profiler.h"
+
+namespace
+{
+
+    enum class Stage
+    {
+        ShadowMap,
+        SkyLUT,
+        AerialLUT,
+        Shade,
+        Output
+    };
+
+    struct Job
+    {
+        int   frame;
+        int   slot;
+        Stage stage;
+    };
+
+    // older frames first, then the stages on the longer path
+    struct RunsLater
+    {
+        bool operator()(const Job &a, const Job &b) const
+        {
+            if(a.frame != b.frame)
+                return a.frame > b.frame;
+            return a.stage > b.stage;
+        }
+    };
+
+    struct Slot
+    {
+        CPUFrameRenderer renderer;
+
+        // stages left before the frame can be shaded
+        int shadeDependencyCount = 0;
+    };
+
+} // namespace anonymous
+
+void CPUFrameBatchRenderer::setThreadCount(int threadCount)
+{
+    threadCount_ = threadCount;
+}
+
+void CPUFrameBatchRenderer::setSlotCount(int slotCount)
+{
+    slotCount_ = slotCount;
+}
+
+void CPUFrameBatchRenderer::render(
+    const CPUFrameRenderer &prototype,
+    int                     frameCount,
+    const SetupFunc        &setup,
+    const OutputFunc       &output)
+{
+    ProfileZone zone("CPUFrameBatchRenderer::render");
+
+    if(frameCount <= 0)
+        return;
+
+    const int threadCount = agz::thread::actual_worker_count(threadCount_);
+    const int slotCount   = (std::min)(
+        slotCount_ > 0 ? slotCount_ : threadCount, frameCount);
+
+    std::vector<std::unique_ptr<Slot>> slots;
+    for(int i = 0; i < slotCount; ++i)
+    {
+        auto slot = std::make_unique<Slot>();
+        slot->renderer = prototype;
+        slot->renderer.setThreadCount(1);
+        slots.push_back(std::move(slot));
+    }
+
+    std::mutex              mutex;
+    std::condition_variable readyCond;
+
+    std::priority_queue<Job, std::vector<Job>, RunsLater> readyJobs;
+
+    int outputCount = 0;
+
+    // the caller must hold the lock
+    auto pushFrame = [&](int slotIndex, int frame)
+    {
+        slots[slotIndex]->shadeDependencyCount = 2;
+        readyJobs.push({ frame, slotIndex, Stage::ShadowMap });
+        readyJobs.push({ frame, slotIndex, Stage::SkyLUT });
+    };
+
+    for(int i = 0; i < slotCount; ++i)
+    {
+        setup(i, slots[i]->renderer);
+        pushFrame(i, i);
+    }
+
+    auto worker = [&]
+    {
+        std::unique_lock lk(mutex);
+        for(;;)
+        {
+            readyCond.wait(lk, [&]
+            {
+                return !readyJobs.empty() || outputCount == frameCount;
+            });
+            if(readyJobs.empty())
+                return;
+
+            const Job job = readyJobs.top();
+            readyJobs.pop();
+            lk.unlock();
+
+            Slot &slot = *slots[job.slot];
+            switch(job.stage)
+            {
+            case Stage::ShadowMap: slot.renderer.renderShadowMap(); break;
+            case Stage::SkyLUT:    slot.renderer.renderSkyLUT();    break;
+            case Stage::AerialLUT: slot.renderer.renderAerialLUT(); break;
+            case Stage::Shade:     slot.renderer.shade();           break;
+            case Stage::Output:
+                output(job.frame, slot.renderer.getImage());
+                break;
+            }
+
+            lk.lock();
+            switch(job.stage)
+            {
+            case Stage::ShadowMap:
+                readyJobs.push({ job.frame, job.slot, Stage::AerialLUT });
+                break;
+            case Stage::SkyLUT:
+            case Stage::AerialLUT:
+                if(!--slot.shadeDependencyCount)
+                    readyJobs.push({ job.frame, job.slot, Stage::Shade });
+                break;
+            case Stage::Shade:
+                readyJobs.push({ job.frame, job.slot, Stage::Output });
+                break;
+            case Stage::Output:
+                ++outputCount;
+                if(const int frame = job.frame + slotCount; frame < frameCount)
+                {
+                    // the slot is free now, reuse it for its next frame
+                    lk.unlock();
+                    setup(frame, slot.renderer);
+                    lk.lock();
+                    pushFrame(job.slot, frame);
+                }
+                break;
+            }
+            readyCond.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for(int i = 0; i < threadCount; ++i)
+        workers.emplace_back(worker);
+    for(auto &w : workers)
+        w.join();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <functional>
+
+#include "./frame_renderer.h"
+
+// renders one view under many suns, e.g. a time-of-day cycle. the
+// transmittance and multi-scattering LUTs and the primary visibility don't
+// depend on the sun, so all frames share the ones of the prototype
+// renderer, and only the per-sun stages of CPUFrameRenderer run per frame.
+// they form a job graph
+//
+//     shadow map -> aerial perspective -> shade -> output
+//     sky view   ------------------------^
+//
+// executed by a pool of workers. every stage runs single-threaded, and
+// frames are pipelined through a fixed number of slots that own the tables
+// of one frame in flight each. stages of different frames overlap, instead
+// of every frame forking and joining all threads once per stage. ready
+// jobs of older frames go first, so that slots are recycled quickly.
+//
+// frame i always runs in slot i % slotCount, and every slot runs its
+// frames in order, so state a slot's renderer carries from frame to frame,
+// e.g. amortized or temporal LUTs, sees frames i and i + slotCount in
+// sequence, independent of thread timing.
+class CPUFrameBatchRenderer
+{
+public:
+
+    // called on a worker before the stages of a frame run, with the
+    // renderer of its slot. typically sets the sun.
+    using SetupFunc = std::function<void(int frameIndex, CPUFrameRenderer &renderer)>;
+
+    // called on a worker once a frame is shaded. frames complete roughly,
+    // but not strictly, in order.
+    using OutputFunc = std::function<void(int frameIndex, const Table2D<Float3> &image)>;
+
+    // threadCount <= 0 means hardware_concurrency + threadCount
+    void setThreadCount(int threadCount);
+
+    // frames in flight, the thread count by default. every slot holds a
+    // shadow map, an aerial perspective volume and an image.
+    void setSlotCount(int slotCount);
+
+    // every slot starts as a copy of prototype, which should share its
+    // visibility through setVisibility(). its tables, scene and visibility
+    // must stay alive until render() returns.
+    void render(
+        const CPUFrameRenderer &prototype,
+        int                     frameCount,
+        const SetupFunc        &setup,
+        const OutputFunc       &output);
+
+private:
+
+    int threadCount_ = 0;
+    int slotCount_   = 0;
+};
@@ -0,0 +1,415 @@
+#include <cmath>
+
+#include "./frame_renderer.h"
+#include "./parallel.h"
+#include "./profiler.h"
+#include "./sampler.h"
+#include "./transmittance.h"
+
+namespace
+{
+
+    // world-space point of ndc through the inverse of a view-projection
+    Float3 unproject(const Mat4 &invViewProj, float ndcX, float ndcY, float ndcZ)
+    {
+        const Float4 p = Float4(ndcX, ndcY, ndcZ, 1) * invViewProj;
+        return p.xyz() / p.w;
+    }
+
+    // bilinear lookup with wrap addressing on u and clamp on v, matching the
+    // sky view sampler in sky.cpp
+    Float3 sampleSkyView(const Table2D<Float4> &table, const Float2 &uv)
+    {
+        const int w = table.getWidth();
+        const int h = table.getHeight();
+
+        const float fx = uv.x * w - 0.5f;
+        const float fy = uv.y * h - 0.5f;
+
+        const float x0f = std::floor(fx);
+        const float y0f = std::floor(fy);
+
+        const int x0 = static_cast<int>(x0f);
+        const int y0 = static_cast<int>(y0f);
+
+        const int xa = ((x0 % w) + w) % w;
+        const int xb = (xa + 1) % w;
+        const int ya = (std::clamp)(y0,     0, h - 1);
+        const int yb = (std::clamp)(y0 + 1, 0, h - 1);
+
+        const float tx = fx - x0f;
+        const float ty = fy - y0f;
+
+        const Float4 top    = (1 - tx) * table(xa, ya) + tx * table(xb, ya);
+        const Float4 bottom = (1 - tx) * table(xa, yb) + tx * table(xb, yb);
+        return ((1 - ty) * top + ty * bottom).xyz();
+    }
+
+} // namespace anonymous
+
+Float3 computeSunDirection(float angleXDeg, float angleYDeg)
+{
+    const float sunRadX = agz::math::deg2rad(angleXDeg);
+    const float sunRadY = agz::math::deg2rad(-angleYDeg);
+    return Float3(
+        std::cos(sunRadX) * std::cos(sunRadY),
+        std::sin(sunRadY),
+        std::sin(sunRadX) * std::cos(sunRadY)).normalize();
+}
+
+Mat4 computeSunViewProj(const Float3 &sunDirection)
+{
+    return Trans4::look_at(-sunDirection * 20, { 0, 0, 0 }, { 0, 1, 0 }) *
+           Trans4::orthographic(-10, 10, 10, -10, 0.1f, 80);
+}
+
+void CPUFrameRenderer::setThreadCount(int threadCount)
+{
+    threadCount_ = threadCount;
+}
+
+void CPUFrameRenderer::setAtmosphere(const AtmosphereProperties &atmos)
+{
+    atmos_ = atmos;
+}
+
+void CPUFrameRenderer::setLUTs(
+    const Table2D<Float4> *T,
+    bool                   enableMultiScattering,
+    const Table2D<Float4> *M)
+{
+    T_                     = T;
+    enableMultiScattering_ = enableMultiScattering;
+    M_                     = M;
+}
+
+void CPUFrameRenderer::setCamera(const Camera &camera)
+{
+    camera_ = camera;
+}
+
+void CPUFrameRenderer::setWorldScale(float worldScale)
+{
+    worldScale_ = worldScale;
+}
+
+void CPUFrameRenderer::setSun(
+    const Float3 &direction, const Float3 &radiance, float diskSize)
+{
+    sunDirection_ = direction;
+    sunRadiance_  = radiance;
+    sunDiskSize_  = diskSize;
+}
+
+void CPUFrameRenderer::setShadow(
+    bool enableShadow, const Mat4 &sunViewProj, const Int2 &res)
+{
+    enableShadow_ = enableShadow;
+    sunViewProj_  = sunViewProj;
+    shadowMapRes_ = res;
+}
+
+void CPUFrameRenderer::setSkyLUT(const Int2 &res, int stepCount)
+{
+    skyLUTRes_       = res;
+    skyLUTStepCount_ = stepCount;
+}
+
+void CPUFrameRenderer::setAmortizedLUTs(
+    bool enabled, const AmortizedUpdateSettings &settings)
+{
+    enableAmortizedLUTs_  = enabled;
+    amortizedLUTSettings_ = settings;
+}
+
+void CPUFrameRenderer::setTemporalAerial(bool enabled, float blend)
+{
+    enableTemporalAerial_ = enabled;
+    temporalAerialBlend_  = blend;
+}
+
+void CPUFrameRenderer::setSkyAtlas(const CPUSkyViewAtlas *atlas)
+{
+    skyAtlas_ = atlas;
+}
+
+void CPUFrameRenderer::setAerialLUT(
+    const Int3 &res, float maxDistance, int stepsPerSlice, float sliceExponent)
+{
+    aerialLUTRes_        = res;
+    maxAerialDistance_   = maxDistance;
+    aerialStepsPerSlice_ = stepsPerSlice;
+    aerialSliceExponent_ = (std::max)(sliceExponent, 1.0f);
+}
+
+void CPUFrameRenderer::setScene(const CPUMeshScene *scene)
+{
+    scene_ = scene;
+}
+
+void CPUFrameRenderer::setVisibility(const Visibility *visibility)
+{
+    visibility_ = visibility;
+}
+
+void CPUFrameRenderer::render(const Int2 &res)
+{
+    ProfileZone zone("CPUFrameRenderer::render");
+
+    if(!visibility_)
+        traceVisibility(res, ownVisibility_);
+
+    renderShadowMap();
+    renderSkyLUT();
+    renderAerialLUT();
+    shade();
+}
+
+const Table2D<Float3> &CPUFrameRenderer::getImage() const
+{
+    return image_;
+}
+
+void CPUFrameRenderer::renderShadowMap()
+{
+    ProfileZone zone("CPUFrameRenderer::renderShadowMap");
+
+    if(!enableShadow_)
+        return;
+
+    // the sun projection is orthographic, so the post-projection depth of a
+    // hit is its parameter along the ray from the near to the far plane
+    const Mat4 invSunViewProj = sunViewProj_.inv();
+
+    shadowMap_ = Table2D<float>(shadowMapRes_, 1.0f);
+    parallelForTiles(
+        shadowMapRes_, { 64, 64 }, threadCount_,
+        [&](int, const Int2 &beg, const Int2 &end)
+    {
+        for(int y = beg.y; y < end.y; ++y)
+        {
+            const float ndcY = 1 - 2 * (y + 0.5f) / shadowMapRes_.y;
+            for(int x = beg.x; x < end.x; ++x)
+            {
+                const float ndcX = 2 * (x + 0.5f) / shadowMapRes_.x - 1;
+
+                const Float3 nearPos = unproject(invSunViewProj, ndcX, ndcY, 0);
+                const Float3 farPos  = unproject(invSunViewProj, ndcX, ndcY, 1);
+
+                CPUMeshScene::Hit hit;
+                if(scene_ && scene_->intersect(nearPos, farPos - nearPos, 1, hit))
+                    shadowMap_(x, y) = hit.t;
+            }
+        }
+    });
+}
+
+void CPUFrameRenderer::renderSkyLUT()
+{
+    ProfileZone zone("CPUFrameRenderer::renderSkyLUT");
+
+    if(skyAtlas_)
+    {
+        skyAtlas_->sample(
+            worldScale_ * camera_.getPosition().y, sunDirection_, sunRadiance_,
+            skyAtlasTable_);
+        return;
+    }
+
+    skyLUT_.setAtmosphere(atmos_);
+    skyLUT_.setSun(sunDirection_, sunRadiance_);
+    skyLUT_.setTransmittance(T_);
+    skyLUT_.setMultiScattering(enableMultiScattering_, M_);
+    skyLUT_.setRayMarching(skyLUTStepCount_);
+    skyLUT_.setCamera(worldScale_ * camera_.getPosition());
+    skyLUT_.setThreadCount(threadCount_);
+
+    if(enableAmortizedLUTs_)
+        skyLUT_.update(skyLUTRes_, amortizedLUTSettings_);
+    else
+        skyLUT_.generate(skyLUTRes_);
+}
+
+void CPUFrameRenderer::renderAerialLUT()
+{
+    ProfileZone zone("CPUFrameRenderer::renderAerialLUT");
+
+    const float atmosEyeHeight = worldScale_ * camera_.getPosition().y;
+    aerialLUT_.setCamera(
+        camera_.getPosition(), atmosEyeHeight,
+        camera_.getFrustumDirections());
+    aerialLUT_.setWorldScale(worldScale_);
+    aerialLUT_.setAtmosphere(atmos_);
+
+    aerialLUT_.setSun(sunDirection_);
+    aerialLUT_.setShadow(enableShadow_, sunViewProj_, &shadowMap_);
+
+    aerialLUT_.setMarchingParams(maxAerialDistance_, aerialStepsPerSlice_);
+    aerialLUT_.setSliceDistribution(aerialSliceExponent_);
+
+    aerialLUT_.setMultiScatterLUT(enableMultiScattering_, M_);
+    aerialLUT_.setTransmittanceLUT(T_);
+    aerialLUT_.setTemporal(
+        enableTemporalAerial_, temporalAerialBlend_, camera_.getViewProj());
+    aerialLUT_.setThreadCount(threadCount_);
+
+    if(enableAmortizedLUTs_)
+        aerialLUT_.update(aerialLUTRes_, amortizedLUTSettings_);
+    else
+        aerialLUT_.generate(aerialLUTRes_);
+}
+
+void CPUFrameRenderer::traceVisibility(const Int2 &res, Visibility &output) const
+{
+    ProfileZone zone("CPUFrameRenderer::traceVisibility");
+
+    const Mat4 invViewProj = camera_.getViewProj().inv();
+
+    output = Visibility(res);
+    if(!scene_)
+        return;
+
+    parallelForTiles(
+        res, { 16, 16 }, threadCount_,
+        [&](int, const Int2 &beg, const Int2 &end)
+    {
+        for(int y = beg.y; y < end.y; ++y)
+        {
+            const float ndcY = 1 - 2 * (y + 0.5f) / res.y;
+            for(int x = beg.x; x < end.x; ++x)
+            {
+                const float ndcX = 2 * (x + 0.5f) / res.x - 1;
+
+                const Float3 nearPos = unproject(invViewProj, ndcX, ndcY, 0);
+                const Float3 farPos  = unproject(invViewProj, ndcX, ndcY, 1);
+
+                CPUMeshScene::Hit hit;
+                if(scene_->intersect(nearPos, farPos - nearPos, 1, hit))
+                    output(x, y) = hit;
+            }
+        }
+    });
+}
+
+void CPUFrameRenderer::shade()
+{
+    ProfileZone zone("CPUFrameRenderer::shade");
+
+    const Visibility &visibility  = getVisibility();
+    const Int2        res         = visibility.getResolution();
+    const auto        frustumDirs = camera_.getFrustumDirections();
+
+    auto lerp = [](const Float3 &a, const Float3 &b, float t)
+    {
+        return a + t * (b - a);
+    };
+
+    image_ = Table2D<Float3>(res);
+    parallelForTiles(
+        res, { 16, 16 }, threadCount_,
+        [&](int, const Int2 &beg, const Int2 &end)
+    {
+        for(int y = beg.y; y < end.y; ++y)
+        {
+            const float v = (y + 0.5f) / res.y;
+            for(int x = beg.x; x < end.x; ++x)
+            {
+                const float u = (x + 0.5f) / res.x;
+
+                const CPUMeshScene::Hit &hit = visibility(x, y);
+                if(hit.t > 0)
+                {
+                    image_(x, y) = shadeMesh(hit, { u, v });
+                    continue;
+                }
+
+                const Float3 dir = lerp(
+                    lerp(frustumDirs.frustumA, frustumDirs.frustumB, u),
+                    lerp(frustumDirs.frustumC, frustumDirs.frustumD, u), v).normalize();
+                image_(x, y) = shadeSky(dir);
+            }
+        }
+    });
+}
+
+Float3 CPUFrameRenderer::shadeMesh(
+    const CPUMeshScene::Hit &hit, const Float2 &scrPos) const
+{
+    const float apZ = encodeAerialSliceDepth(
+        worldScale_ * (hit.position - camera_.getPosition()).length(),
+        maxAerialDistance_, aerialSliceExponent_);
+    const Float4 ap = sampleTrilinear(
+        aerialLUT_.getVolume(),
+        Float3(scrPos.x, scrPos.y, (std::clamp)(apZ, 0.0f, 1.0f)));
+
+    const Float3 inScatter = ap.xyz();
+    const float  eyeTrans  = ap.w;
+
+    const Float3 sunTrans = sampleTransmittance(
+        *T_, atmos_, worldScale_ * hit.position.y, std::asin(-sunDirection_.y));
+    const Float3 sunRadiance =
+        hit.color * (std::max)(0.0f, dot(hit.normal, -sunDirection_));
+
+    const float shadowFactor =
+        !enableShadow_ || isLit(hit.position, hit.normal) ? 1.0f : 0.0f;
+
+    return sunRadiance_ *
+        (shadowFactor * sunRadiance * sunTrans * eyeTrans + inScatter);
+}
+
+Float3 CPUFrameRenderer::shadeSky(const Float3 &dir) const
+{
+    const float phi   = std::atan2(dir.z, dir.x);
+    const float theta = std::asin((std::clamp)(dir.y, -1.0f, 1.0f));
+
+    const float u = phi / (2 * PI);
+    const float v = 0.5f + 0.5f * (theta < 0 ? -1.0f : 1.0f)
+                         * std::sqrt(std::abs(theta) / (PI / 2));
+
+    Float3 color = sampleSkyView(getSkyTable(), { u, v });
+
+    // the sun disk is drawn over the sky at the far plane, so terrain
+    // always hides it
+    const float cosSun = dot(dir, -sunDirection_);
+    if(cosSun > 0 && (dir / cosSun + sunDirection_).length() <= sunDiskSize_)
+    {
+        const Float3 sunTrans = sampleTransmittance(
+            *T_, atmos_, worldScale_ * camera_.getPosition().y,
+            std::asin(-sunDirection_.y));
+        color = sunTrans * sunRadiance_;
+    }
+
+    return color;
+}
+
+const CPUFrameRenderer::Visibility &CPUFrameRenderer::getVisibility() const
+{
+    return visibility_ ? *visibility_ : ownVisibility_;
+}
+
+const Table2D<Float4> &CPUFrameRenderer::getSkyTable() const
+{
+    return skyAtlas_ ? skyAtlasTable_ : skyLUT_.getTable();
+}
+
+bool CPUFrameRenderer::isLit(const Float3 &position, const Float3 &normal) const
+{
+    const Float3 biased = position + 0.03f * normal;
+    const Float4 shadowClip =
+        Float4(biased.x, biased.y, biased.z, 1) * sunViewProj_;
+    const Float2 shadowUV = {
+        0.5f + 0.5f * shadowClip.x / shadowClip.w,
+        0.5f - 0.5f * shadowClip.y / shadowClip.w
+    };
+
+    // outside of the shadow map counts as lit, as in asset/mesh.hlsl
+    if(shadowUV.x < 0 || shadowUV.x > 1 || shadowUV.y < 0 || shadowUV.y > 1)
+        return true;
+
+    const int w = shadowMap_.getWidth();
+    const int h = shadowMap_.getHeight();
+    const int sx = (std::min)(static_cast<int>(shadowUV.x * w), w - 1);
+    const int sy = (std::min)(static_cast<int>(shadowUV.y * h), h - 1);
+
+    return shadowClip.z <= shadowMap_(sx, sy);
+}
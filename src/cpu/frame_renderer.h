@@ -0,0 +1,162 @@
+#pragma once
+
+#include "../camera.h"
+#include "../medium.h"
+#include "./aerial_lut.h"
+#include "./mesh_scene.h"
+#include "./sky_atlas.h"
+#include "./sky_lut.h"
+#include "./table.h"
+
+// direction the sunlight travels in for the sun angles of the demo, in
+// degrees. angleY is the elevation above the horizon.
+Float3 computeSunDirection(float angleXDeg, float angleYDeg);
+
+// orthographic view-projection of the demo's shadow map
+Mat4 computeSunViewProj(const Float3 &sunDirection);
+
+// CPU counterpart of AtmosphereRendererDemo::frame, producing a linear HDR
+// image without touching the GPU. the shadow map and the primary visibility
+// are ray cast against a CPUMeshScene instead of rasterized, the sky and
+// aerial perspective LUTs come from their CPU backends, and every pixel is
+// then shaded as in asset/mesh.hlsl, asset/sky.hlsl and asset/sun.hlsl,
+// minus postProcessColor.
+//
+// all stages are parallelized over tiles, the final one over 16x16 pixel
+// tiles, so the cost of a frame scales with the thread count.
+class CPUFrameRenderer
+{
+public:
+
+    void setThreadCount(int threadCount);
+
+    // std units (see AtmosphereProperties::toStdUnit)
+    void setAtmosphere(const AtmosphereProperties &atmos);
+
+    // both tables must stay alive until render() returns
+    void setLUTs(
+        const Table2D<Float4> *T,
+        bool                   enableMultiScattering,
+        const Table2D<Float4> *M);
+
+    // the camera matrices must be up to date, with the aspect ratio of the
+    // image passed to render()
+    void setCamera(const Camera &camera);
+
+    void setWorldScale(float worldScale);
+
+    void setSun(const Float3 &direction, const Float3 &radiance, float diskSize);
+
+    void setShadow(bool enableShadow, const Mat4 &sunViewProj, const Int2 &res);
+
+    void setSkyLUT(const Int2 &res, int stepCount);
+
+    // when set, the sky view is interpolated from atlas, baked for the same
+    // atmosphere and LUTs, in place of ray marching it. the resolution
+    // passed to setSkyLUT() is ignored then. must stay alive until
+    // render() returns.
+    void setSkyAtlas(const CPUSkyViewAtlas *atlas);
+
+    // see CPUAerialPerspectiveLUT::setSliceDistribution for sliceExponent
+    void setAerialLUT(
+        const Int3 &res, float maxDistance, int stepsPerSlice, float sliceExponent);
+
+    // refresh the sky view and aerial perspective LUTs of consecutive frames
+    // through their amortized update() in place of generate(), so that a
+    // sequence of frames spreads the cost. the first frame generates both.
+    void setAmortizedLUTs(bool enabled, const AmortizedUpdateSettings &settings);
+
+    // accumulate the aerial perspective volume over consecutive frames, see
+    // CPUAerialPerspectiveLUT::setTemporal
+    void setTemporalAerial(bool enabled, float blend);
+
+    // must stay alive until render() returns
+    void setScene(const CPUMeshScene *scene);
+
+    // primary hit of every pixel, with t = 0 where the sky is visible
+    using Visibility = Table2D<CPUMeshScene::Hit>;
+
+    // casts the primary rays of the camera against the scene. the result
+    // doesn't depend on the sun, so frames that differ in the sun alone can
+    // share it through setVisibility().
+    void traceVisibility(const Int2 &res, Visibility &output) const;
+
+    // used by render() and shade() in place of their own primary rays when
+    // set. must stay alive until they return.
+    void setVisibility(const Visibility *visibility);
+
+    void render(const Int2 &res);
+
+    // the stages of render(), which may also be driven one by one.
+    // renderAerialLUT() reads the shadow map, and shade() the outputs of
+    // all other stages at the resolution of the visibility.
+    void renderShadowMap();
+
+    void renderSkyLUT();
+
+    void renderAerialLUT();
+
+    void shade();
+
+    const Table2D<Float3> &getImage() const;
+
+private:
+
+    const Visibility &getVisibility() const;
+
+    const Table2D<Float4> &getSkyTable() const;
+
+    Float3 shadeMesh(const CPUMeshScene::Hit &hit, const Float2 &scrPos) const;
+
+    Float3 shadeSky(const Float3 &dir) const;
+
+    bool isLit(const Float3 &position, const Float3 &normal) const;
+
+    int threadCount_ = 0;
+
+    AtmosphereProperties atmos_;
+
+    const Table2D<Float4> *T_ = nullptr;
+    const Table2D<Float4> *M_ = nullptr;
+
+    bool enableMultiScattering_ = true;
+
+    Camera camera_;
+    float  worldScale_ = 200;
+
+    Float3 sunDirection_ = { 0, -1, 0 };
+    Float3 sunRadiance_  = Float3(10);
+    float  sunDiskSize_  = 0.004649f;
+
+    bool           enableShadow_ = true;
+    Mat4           sunViewProj_;
+    Int2           shadowMapRes_ = { 2048, 2048 };
+    Table2D<float> shadowMap_;
+
+    Int2 skyLUTRes_       = { 64, 64 };
+    int  skyLUTStepCount_ = 40;
+
+    Int3  aerialLUTRes_        = { 200, 150, 32 };
+    float maxAerialDistance_   = 2000;
+    int   aerialStepsPerSlice_ = 1;
+    float aerialSliceExponent_ = 1;
+
+    bool  enableTemporalAerial_ = false;
+    float temporalAerialBlend_  = 0.1f;
+
+    bool                    enableAmortizedLUTs_ = false;
+    AmortizedUpdateSettings amortizedLUTSettings_;
+
+    const CPUSkyViewAtlas *skyAtlas_ = nullptr;
+    Table2D<Float4>        skyAtlasTable_;
+
+    const CPUMeshScene *scene_ = nullptr;
+
+    const Visibility *visibility_ = nullptr;
+    Visibility        ownVisibility_;
+
+    CPUSkyLUT               skyLUT_;
+    CPUAerialPerspectiveLUT aerialLUT_;
+
+    Table2D<Float3> image_;
+};
@@ -0,0 +1,37 @@
+#include <cstdio>
+#include <filesystem>
+
+#include "./image_io.h"
+
+bool savePFM(const std::string &filename, const Table2D<Float3> &image)
+{
+    if(auto parent = std::filesystem::path(filename).parent_path(); !parent.empty())
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(parent, ec);
+    }
+
+    FILE *file = std::fopen(filename.c_str(), "wb");
+    if(!file)
+        return false;
+
+    // a negative scale marks little-endian floats
+    std::fprintf(
+        file, "PF\n%d %d\n-1.0\n", image.getWidth(), image.getHeight());
+
+    std::vector<float> row(static_cast<size_t>(image.getWidth()) * 3);
+    bool ok = true;
+    for(int y = image.getHeight() - 1; y >= 0 && ok; --y)
+    {
+        for(int x = 0; x < image.getWidth(); ++x)
+        {
+            const Float3 &texel = image(x, y);
+            row[3 * x + 0] = texel.x;
+            row[3 * x + 1] = texel.y;
+            row[3 * x + 2] = texel.z;
+        }
+        ok = std::fwrite(row.data(), sizeof(float), row.size(), file) == row.size();
+    }
+
+    return std::fclose(file) == 0 && ok;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string>
+
+#include "./table.h"
+
+// little-endian color PFM, rows stored bottom to top as the format requires.
+// returns false when the file couldn't be written.
+bool savePFM(const std::string &filename, const Table2D<Float3> &image);
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "../common_math.h"
+
+// CPU counterparts of asset/intersection.hlsl
+
+inline bool hasIntersectionWithCircle(
+    const Float2 &o, const Float2 &d, float R)
+{
+    const float A = dot(d, d);
+    const float B = 2 * dot(o, d);
+    const float C = dot(o, o) - R * R;
+    const float delta = B * B - 4 * A * C;
+    return (delta >= 0) && ((C <= 0) | (B <= 0));
+}
+
+inline bool hasIntersectionWithSphere(
+    const Float3 &o, const Float3 &d, float R)
+{
+    const float A = dot(d, d);
+    const float B = 2 * dot(o, d);
+    const float C = dot(o, o) - R * R;
+    const float delta = B * B - 4 * A * C;
+    return (delta >= 0) && ((C <= 0) | (B <= 0));
+}
+
+inline bool findClosestIntersectionWithCircle(
+    const Float2 &o, const Float2 &d, float R, float &t)
+{
+    const float A = dot(d, d);
+    const float B = 2 * dot(o, d);
+    const float C = dot(o, o) - R * R;
+    const float delta = B * B - 4 * A * C;
+    if(delta < 0)
+        return false;
+    t = (-B + (C <= 0 ? std::sqrt(delta) : -std::sqrt(delta))) / (2 * A);
+    return (C <= 0) | (B <= 0);
+}
+
+inline bool findClosestIntersectionWithSphere(
+    const Float3 &o, const Float3 &d, float R, float &t)
+{
+    const float A = dot(d, d);
+    const float B = 2 * dot(o, d);
+    const float C = dot(o, o) - R * R;
+    const float delta = B * B - 4 * A * C;
+    if(delta < 0)
+        return false;
+    t = (-B + (C <= 0 ? std::sqrt(delta) : -std::sqrt(delta))) / (2 * A);
+    return (C <= 0) | (B <= 0);
+}
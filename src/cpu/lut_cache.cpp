@@ -0,0 +1,149 @@
+#include <cstdio>
+#include <filesystem>
+
+#include "./lut_cache.h"
+#include "./profiler.h"
+
+void LUTHasher::addBytes(const void *data, size_t size)
+{
+    auto bytes = static_cast<const unsigned char *>(data);
+    for(size_t i = 0; i < size; ++i)
+    {
+        hash_ ^= bytes[i];
+        hash_ *= 0x100000001b3ull;
+    }
+}
+
+void LUTHasher::add(const AtmosphereProperties &atmos)
+{
+    // field by field so that padding never leaks into the hash
+    add(atmos.scatterRayleigh.x);
+    add(atmos.scatterRayleigh.y);
+    add(atmos.scatterRayleigh.z);
+    add(atmos.hDensityRayleigh);
+    add(atmos.scatterMie);
+    add(atmos.asymmetryMie);
+    add(atmos.absorbMie);
+    add(atmos.hDensityMie);
+    add(atmos.absorbOzone.x);
+    add(atmos.absorbOzone.y);
+    add(atmos.absorbOzone.z);
+    add(atmos.ozoneCenterHeight);
+    add(atmos.ozoneThickness);
+    add(atmos.planetRadius);
+    add(atmos.atmosphereRadius);
+    add(atmos.transmittanceParam);
+}
+
+uint64_t LUTHasher::getHash() const
+{
+    return hash_;
+}
+
+uint64_t hashTransmittanceInputs(
+    const AtmosphereProperties &atmos,
+    const Int2                 &res,
+    TransmittanceMode           mode,
+    int                         stepCount,
+    QuadratureScheme            scheme)
+{
+    LUTHasher hasher;
+    hasher.add(LUT_CACHE_VERSION);
+    hasher.add(LUTKind::Transmittance);
+    hasher.add(atmos);
+    hasher.add(res.x);
+    hasher.add(res.y);
+    hasher.add(mode);
+    if(mode == TransmittanceMode::RayMarch)
+    {
+        hasher.add(stepCount);
+        hasher.add(scheme);
+    }
+    return hasher.getHash();
+}
+
+uint64_t hashMultiScatteringInputs(
+    const AtmosphereProperties &atmos,
+    const Int2                 &res,
+    int                         rayMarchStepCount,
+    QuadratureScheme            rayMarchScheme,
+    int                         dirSampleCount,
+    uint32_t                    dirSampleSeed,
+    const Float3               &terrainAlbedo,
+    uint64_t                    transmittanceHash)
+{
+    LUTHasher hasher;
+    hasher.add(LUT_CACHE_VERSION);
+    hasher.add(LUTKind::MultiScattering);
+    hasher.add(atmos);
+    hasher.add(res.x);
+    hasher.add(res.y);
+    hasher.add(rayMarchStepCount);
+    hasher.add(rayMarchScheme);
+    hasher.add(dirSampleCount);
+    hasher.add(dirSampleSeed);
+    hasher.add(terrainAlbedo.x);
+    hasher.add(terrainAlbedo.y);
+    hasher.add(terrainAlbedo.z);
+    hasher.add(transmittanceHash);
+    return hasher.getHash();
+}
+
+LUTCache::LUTCache(std::string directory, LUTTexelFormat format)
+    : directory_(std::move(directory)), format_(format)
+{
+    
+}
+
+LUTTexelFormat LUTCache::getFormat() const
+{
+    return format_;
+}
+
+std::unique_ptr<LUTFile> LUTCache::load(
+    LUTKind kind, uint64_t hash, const Int2 &res) const
+{
+    ProfileZone zone("LUTCache::load");
+
+    auto file = std::make_unique<LUTFile>();
+    if(!file->open(getFilename(kind, hash)))
+        return nullptr;
+
+    // a file written with another format is treated as a miss and replaced
+    auto table = file->findTable(kind);
+    if(file->getTableCount() != 1 || !table ||
+       table->getHash()       != hash ||
+       table->getFormat()     != format_ ||
+       table->getResolution().x != res.x ||
+       table->getResolution().y != res.y ||
+       table->getResolution().z != 1)
+        return nullptr;
+
+    return file;
+}
+
+bool LUTCache::store(
+    LUTKind kind, uint64_t hash, const Table2D<Float4> &table) const
+{
+    ProfileZone zone("LUTCache::store");
+
+    LUTFileWriter writer;
+    writer.addTable(kind, hash, table, format_);
+    if(writer.write(getFilename(kind, hash)))
+        return true;
+
+    // on Windows a file mapped by another reader, e.g. another process
+    // sharing the cache, can't be replaced. it holds the same table then.
+    return load(kind, hash, table.getResolution()) != nullptr;
+}
+
+std::string LUTCache::getFilename(LUTKind kind, uint64_t hash) const
+{
+    char hashStr[17];
+    std::snprintf(
+        hashStr, sizeof(hashStr), "%016llx",
+        static_cast<unsigned long long>(hash));
+
+    return (std::filesystem::path(directory_) /
+            (std::string(getLUTKindName(kind)) + "_" + hashStr + ".lut")).string();
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "../medium.h"
+#include "./lut_file.h"
+#include "./quadrature.h"
+#include "./transmittance.h"
+
+// bump whenever an integrator changes its output for the same inputs.
+//
+//   2  multi-scattering marches through RayQuadrature
+constexpr uint32_t LUT_CACHE_VERSION = 2;
+
+// 64-bit FNV-1a over the raw bytes of the added values
+class LUTHasher
+{
+public:
+
+    void addBytes(const void *data, size_t size);
+
+    template<typename T>
+    void add(const T &value)
+    {
+        addBytes(&value, sizeof(T));
+    }
+
+    void add(const AtmosphereProperties &atmos);
+
+    uint64_t getHash() const;
+
+private:
+
+    uint64_t hash_ = 0xcbf29ce484222325ull;
+};
+
+// atmos must be in std units (see AtmosphereProperties::toStdUnit).
+// stepCount and scheme don't take part for the analytic mode.
+uint64_t hashTransmittanceInputs(
+    const AtmosphereProperties &atmos,
+    const Int2                 &res,
+    TransmittanceMode           mode,
+    int                         stepCount,
+    QuadratureScheme            scheme);
+
+uint64_t hashMultiScatteringInputs(
+    const AtmosphereProperties &atmos,
+    const Int2                 &res,
+    int                         rayMarchStepCount,
+    QuadratureScheme            rayMarchScheme,
+    int                         dirSampleCount,
+    uint32_t                    dirSampleSeed,
+    const Float3               &terrainAlbedo,
+    uint64_t                    transmittanceHash);
+
+// content-addressed on-disk cache of baked LUTs. each table lives in its own
+// file named after its kind and input hash, so identical inputs always map
+// to the same file and stale files are never read. tables are stored in the
+// given texel format and read back zero-copy through LUTFile.
+class LUTCache
+{
+public:
+
+    explicit LUTCache(
+        std::string    directory,
+        LUTTexelFormat format = LUTTexelFormat::RGBA32F);
+
+    LUTTexelFormat getFormat() const;
+
+    // returns nullptr on miss or when the file doesn't match the key.
+    // the table is the only one in the returned file.
+    std::unique_ptr<LUTFile> load(
+        LUTKind kind, uint64_t hash, const Int2 &res) const;
+
+    bool store(LUTKind kind, uint64_t hash, const Table2D<Float4> &table) const;
+
+    std::string getFilename(LUTKind kind, uint64_t hash) const;
+
+private:
+
+    std::string    directory_;
+    LUTTexelFormat format_;
+};
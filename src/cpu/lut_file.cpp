@@ -0,0 +1,471 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include "./atomic_file.h"
+#include "./lut_file.h"
+
+namespace
+{
+
+    constexpr uint32_t FILE_MAGIC = 0x54554c41; // "ALUT"
+
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t tableCount;
+        uint32_t descOffset;
+        uint64_t fileSize;
+    };
+
+    struct TableDesc
+    {
+        uint32_t kind;
+        uint32_t format;
+        uint64_t hash;
+        int32_t  width;
+        int32_t  height;
+        int32_t  depth;
+        uint32_t mipLevels;
+        uint64_t payloadOffset;
+        uint64_t payloadSize;
+    };
+
+    static_assert(sizeof(FileHeader) <= LUT_FILE_ALIGNMENT);
+    static_assert(sizeof(TableDesc)  <= LUT_FILE_ALIGNMENT);
+
+    uint64_t alignUp(uint64_t offset)
+    {
+        return (offset + LUT_FILE_ALIGNMENT - 1) & ~uint64_t(LUT_FILE_ALIGNMENT - 1);
+    }
+
+    Int3 getMipResolution(const Int3 &res, int level)
+    {
+        return {
+            (std::max)(res.x >> level, 1),
+            (std::max)(res.y >> level, 1),
+            (std::max)(res.z >> level, 1)
+        };
+    }
+
+    int getFullMipLevels(const Int3 &res)
+    {
+        const int maxDim = (std::max)((std::max)(res.x, res.y), res.z);
+        int levels = 1;
+        while((maxDim >> levels) > 0)
+            ++levels;
+        return levels;
+    }
+
+    size_t getTexelCount(const Int3 &res)
+    {
+        return static_cast<size_t>(res.x) * res.y * res.z;
+    }
+
+    // every mip level is aligned independently; the payload is the range
+    // from the first level to the end of the last one
+    uint64_t getMipOffset(
+        const Int3 &res, LUTTexelFormat format, int level)
+    {
+        uint64_t offset = 0;
+        for(int i = 0; i < level; ++i)
+        {
+            offset += getTexelSize(format) * getTexelCount(getMipResolution(res, i));
+            offset = alignUp(offset);
+        }
+        return offset;
+    }
+
+    // box filter with clamped footprint, so odd sizes don't read out of range
+    std::vector<Float4> downsample(const std::vector<Float4> &src, const Int3 &srcRes)
+    {
+        const Int3 dstRes = getMipResolution(srcRes, 1);
+        std::vector<Float4> dst(getTexelCount(dstRes));
+
+        for(int z = 0; z < dstRes.z; ++z)
+        {
+            const int z0 = (std::min)(2 * z, srcRes.z - 1);
+            const int z1 = (std::min)(2 * z + 1, srcRes.z - 1);
+
+            for(int y = 0; y < dstRes.y; ++y)
+            {
+                const int y0 = (std::min)(2 * y, srcRes.y - 1);
+                const int y1 = (std::min)(2 * y + 1, srcRes.y - 1);
+
+                for(int x = 0; x < dstRes.x; ++x)
+                {
+                    const int x0 = (std::min)(2 * x, srcRes.x - 1);
+                    const int x1 = (std::min)(2 * x + 1, srcRes.x - 1);
+
+                    auto at = [&](int sx, int sy, int sz)
+                    {
+                        return src[(static_cast<size_t>(sz) * srcRes.y + sy) * srcRes.x + sx];
+                    };
+
+                    const Float4 sum =
+                        at(x0, y0, z0) + at(x1, y0, z0) +
+                        at(x0, y1, z0) + at(x1, y1, z0) +
+                        at(x0, y0, z1) + at(x1, y0, z1) +
+                        at(x0, y1, z1) + at(x1, y1, z1);
+
+                    dst[(static_cast<size_t>(z) * dstRes.y + y) * dstRes.x + x] =
+                        0.125f * sum;
+                }
+            }
+        }
+
+        return dst;
+    }
+
+} // namespace anonymous
+
+const char *getLUTKindName(LUTKind kind)
+{
+    switch(kind)
+    {
+    case LUTKind::Transmittance:     return "transmittance";
+    case LUTKind::MultiScattering:   return "multiscatter";
+    case LUTKind::SkyView:           return "skyview";
+    case LUTKind::AerialPerspective: return "aerial";
+    }
+    return "unknown";
+}
+
+bool hasLUTAlpha(LUTKind kind)
+{
+    return kind == LUTKind::AerialPerspective;
+}
+
+LUTKind LUTTableView::getKind() const
+{
+    return kind_;
+}
+
+LUTTexelFormat LUTTableView::getFormat() const
+{
+    return format_;
+}
+
+uint64_t LUTTableView::getHash() const
+{
+    return hash_;
+}
+
+const Int3 &LUTTableView::getResolution() const
+{
+    return res_;
+}
+
+int LUTTableView::getMipLevels() const
+{
+    return mipLevels_;
+}
+
+Int3 LUTTableView::getMipResolution(int level) const
+{
+    return ::getMipResolution(res_, level);
+}
+
+const void *LUTTableView::getMipData(int level) const
+{
+    return mipData_[level];
+}
+
+size_t LUTTableView::getMipRowPitch(int level) const
+{
+    return getTexelSize(format_) * getMipResolution(level).x;
+}
+
+size_t LUTTableView::getMipSlicePitch(int level) const
+{
+    return getMipRowPitch(level) * getMipResolution(level).y;
+}
+
+Float4 LUTTableView::getTexel(int level, int x, int y, int z) const
+{
+    const Int3 res = getMipResolution(level);
+    const size_t index = (static_cast<size_t>(z) * res.y + y) * res.x + x;
+    return decodeTexel(format_, mipData_[level], index);
+}
+
+Table2D<Float4> LUTTableView::decode(int level, int z) const
+{
+    const Int3 res = getMipResolution(level);
+    Table2D<Float4> result({ res.x, res.y });
+
+    const size_t sliceOffset = static_cast<size_t>(z) * res.x * res.y;
+    for(size_t i = 0; i < result.getTexelCount(); ++i)
+        result.data()[i] = decodeTexel(format_, mipData_[level], sliceOffset + i);
+
+    return result;
+}
+
+bool LUTFile::open(const std::string &filename)
+{
+    close();
+
+    MappedFile file;
+    if(!file.open(filename) || file.getSize() < LUT_FILE_ALIGNMENT)
+        return false;
+
+    auto bytes = static_cast<const char *>(file.getData());
+
+    FileHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+
+    if(header.magic      != FILE_MAGIC         ||
+       header.version    != LUT_FILE_VERSION   ||
+       header.descOffset != LUT_FILE_ALIGNMENT ||
+       header.fileSize   != file.getSize())
+        return false;
+
+    const uint64_t descEnd =
+        header.descOffset + uint64_t(LUT_FILE_ALIGNMENT) * header.tableCount;
+    if(descEnd > file.getSize())
+        return false;
+
+    std::vector<LUTTableView> tables(header.tableCount);
+    for(uint32_t i = 0; i < header.tableCount; ++i)
+    {
+        TableDesc desc;
+        std::memcpy(
+            &desc, bytes + header.descOffset + LUT_FILE_ALIGNMENT * i,
+            sizeof(desc));
+
+        const auto format = static_cast<LUTTexelFormat>(desc.format);
+        const Int3 res = { desc.width, desc.height, desc.depth };
+
+        if(getTexelSize(format) == 0 ||
+           res.x <= 0 || res.y <= 0 || res.z <= 0 ||
+           desc.mipLevels == 0 ||
+           desc.mipLevels > static_cast<uint32_t>(LUT_FILE_MAX_MIP_LEVELS) ||
+           desc.mipLevels > static_cast<uint32_t>(getFullMipLevels(res)) ||
+           desc.payloadOffset % LUT_FILE_ALIGNMENT != 0 ||
+           desc.payloadOffset < descEnd ||
+           desc.payloadOffset > file.getSize())
+            return false;
+
+        // the first level must fit the file on its own, which also keeps
+        // the mip offsets below from overflowing
+        const uint64_t maxTexelCount = file.getSize() / getTexelSize(format);
+        if(static_cast<uint64_t>(res.x) > maxTexelCount / res.y / res.z)
+            return false;
+
+        const int mipLevels = static_cast<int>(desc.mipLevels);
+        const uint64_t lastMipEnd =
+            getMipOffset(res, format, mipLevels - 1) +
+            getTexelSize(format) * getTexelCount(getMipResolution(res, mipLevels - 1));
+
+        if(desc.payloadSize != lastMipEnd ||
+           desc.payloadSize > file.getSize() - desc.payloadOffset)
+            return false;
+
+        LUTTableView &view = tables[i];
+        view.kind_      = static_cast<LUTKind>(desc.kind);
+        view.format_    = format;
+        view.hash_      = desc.hash;
+        view.res_       = res;
+        view.mipLevels_ = mipLevels;
+        for(int level = 0; level < mipLevels; ++level)
+        {
+            view.mipData_[level] =
+                bytes + desc.payloadOffset + getMipOffset(res, format, level);
+        }
+    }
+
+    file_   = std::move(file);
+    tables_ = std::move(tables);
+    return true;
+}
+
+void LUTFile::close()
+{
+    tables_.clear();
+    file_.close();
+}
+
+bool LUTFile::isOpen() const
+{
+    return file_.isOpen();
+}
+
+int LUTFile::getTableCount() const
+{
+    return static_cast<int>(tables_.size());
+}
+
+const LUTTableView &LUTFile::getTable(int index) const
+{
+    return tables_[index];
+}
+
+const LUTTableView *LUTFile::findTable(LUTKind kind) const
+{
+    for(auto &table : tables_)
+    {
+        if(table.getKind() == kind)
+            return &table;
+    }
+    return nullptr;
+}
+
+void LUTFileWriter::addTable(
+    LUTKind         kind,
+    uint64_t        hash,
+    const Int3     &res,
+    const Float4   *texels,
+    LUTTexelFormat  format,
+    int             mipLevels)
+{
+    if(res.x <= 0 || res.y <= 0 || res.z <= 0)
+        throw std::invalid_argument("invalid lut resolution");
+    if(hasLUTAlpha(kind) && !hasTexelAlpha(format))
+        throw std::invalid_argument("lut texel format drops the alpha of this kind");
+
+    const int fullMipLevels = getFullMipLevels(res);
+    if(mipLevels <= 0)
+        mipLevels = (std::min)(fullMipLevels, LUT_FILE_MAX_MIP_LEVELS);
+    if(mipLevels > fullMipLevels || mipLevels > LUT_FILE_MAX_MIP_LEVELS)
+        throw std::invalid_argument("too many lut mip levels");
+
+    Table table;
+    table.kind   = kind;
+    table.format = format;
+    table.hash   = hash;
+    table.res    = res;
+
+    std::vector<Float4> level(texels, texels + getTexelCount(res));
+    Int3 levelRes = res;
+
+    for(int i = 0; i < mipLevels; ++i)
+    {
+        if(i > 0)
+        {
+            level = downsample(level, levelRes);
+            levelRes = getMipResolution(res, i);
+        }
+
+        Bytes &bytes = table.mips.emplace_back(
+            getTexelSize(format) * level.size());
+        encodeTexels(format, level.data(), level.size(), bytes.data());
+    }
+
+    tables_.push_back(std::move(table));
+}
+
+void LUTFileWriter::addTable(
+    LUTKind                kind,
+    uint64_t               hash,
+    const Table2D<Float4> &table,
+    LUTTexelFormat         format,
+    int                    mipLevels)
+{
+    addTable(
+        kind, hash, { table.getWidth(), table.getHeight(), 1 },
+        table.data(), format, mipLevels);
+}
+
+bool LUTFileWriter::write(const std::string &filename) const
+{
+    const uint64_t descEnd =
+        LUT_FILE_ALIGNMENT + uint64_t(LUT_FILE_ALIGNMENT) * tables_.size();
+
+    std::vector<TableDesc> descs;
+    uint64_t offset = descEnd;
+    for(auto &table : tables_)
+    {
+        const int mipLevels = static_cast<int>(table.mips.size());
+
+        TableDesc desc = {};
+        desc.kind          = static_cast<uint32_t>(table.kind);
+        desc.format        = static_cast<uint32_t>(table.format);
+        desc.hash          = table.hash;
+        desc.width         = table.res.x;
+        desc.height        = table.res.y;
+        desc.depth         = table.res.z;
+        desc.mipLevels     = static_cast<uint32_t>(mipLevels);
+        desc.payloadOffset = offset;
+        desc.payloadSize   =
+            getMipOffset(table.res, table.format, mipLevels - 1) +
+            table.mips.back().size();
+        descs.push_back(desc);
+
+        offset = alignUp(offset + desc.payloadSize);
+    }
+
+    FileHeader header = {};
+    header.magic      = FILE_MAGIC;
+    header.version    = LUT_FILE_VERSION;
+    header.tableCount = static_cast<uint32_t>(tables_.size());
+    header.descOffset = LUT_FILE_ALIGNMENT;
+    header.fileSize   = offset;
+
+    if(auto parent = std::filesystem::path(filename).parent_path(); !parent.empty())
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(parent, ec);
+    }
+
+    const std::string tmpFilename = makeTempFilename(filename);
+    {
+        std::ofstream fout(
+            tmpFilename, std::ios::out | std::ios::binary | std::ios::trunc);
+        if(!fout)
+            return false;
+
+        uint64_t written = 0;
+        auto writeBlock = [&](const void *data, size_t size)
+        {
+            fout.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+            written += size;
+        };
+        auto padTo = [&](uint64_t target)
+        {
+            static const char zeros[LUT_FILE_ALIGNMENT] = {};
+            while(written < target)
+            {
+                writeBlock(
+                    zeros, static_cast<size_t>(
+                        (std::min)(target - written, uint64_t(LUT_FILE_ALIGNMENT))));
+            }
+        };
+
+        writeBlock(&header, sizeof(header));
+        padTo(LUT_FILE_ALIGNMENT);
+
+        for(auto &desc : descs)
+        {
+            writeBlock(&desc, sizeof(desc));
+            padTo(alignUp(written));
+        }
+
+        for(size_t i = 0; i < tables_.size(); ++i)
+        {
+            auto &table = tables_[i];
+            for(size_t level = 0; level < table.mips.size(); ++level)
+            {
+                padTo(descs[i].payloadOffset + getMipOffset(
+                    table.res, table.format, static_cast<int>(level)));
+                writeBlock(table.mips[level].data(), table.mips[level].size());
+            }
+        }
+        padTo(header.fileSize);
+
+        if(!fout)
+        {
+            fout.close();
+            std::error_code ec;
+            std::filesystem::remove(tmpFilename, ec);
+            return false;
+        }
+    }
+
+    return replaceFile(tmpFilename, filename);
+}
+
+void LUTFileWriter::clear()
+{
+    tables_.clear();
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./mapped_file.h"
+#include "./table.h"
+#include "./texel_format.h"
+
+enum class LUTKind : uint32_t
+{
+    Transmittance     = 1,
+    MultiScattering   = 2,
+    SkyView           = 3,
+    AerialPerspective = 4,
+};
+
+const char *getLUTKindName(LUTKind kind);
+
+// whether tables of this kind keep data in alpha, as the aerial perspective
+// volume keeps the transmittance there
+bool hasLUTAlpha(LUTKind kind);
+
+// layout of a lut file:
+//
+//   header      (64 bytes)
+//   descriptors (64 bytes per table)
+//   payloads    (every mip level starts at a 64-byte aligned offset)
+//
+// a mip level is stored as tightly packed rows, slice after slice, so it can
+// be handed to the gpu as initial data without any repacking.
+constexpr uint32_t LUT_FILE_VERSION = 2;
+constexpr uint32_t LUT_FILE_ALIGNMENT = 64;
+constexpr int      LUT_FILE_MAX_MIP_LEVELS = 16;
+
+// zero-copy view of a table stored in a mapped lut file
+class LUTTableView
+{
+public:
+
+    LUTKind getKind() const;
+
+    LUTTexelFormat getFormat() const;
+
+    uint64_t getHash() const;
+
+    // depth is 1 for 2d tables
+    const Int3 &getResolution() const;
+
+    int getMipLevels() const;
+
+    Int3 getMipResolution(int level) const;
+
+    const void *getMipData(int level) const;
+
+    size_t getMipRowPitch(int level) const;
+
+    size_t getMipSlicePitch(int level) const;
+
+    Float4 getTexel(int level, int x, int y, int z = 0) const;
+
+    // decode a slice of a mip level into float4
+    Table2D<Float4> decode(int level = 0, int z = 0) const;
+
+private:
+
+    friend class LUTFile;
+
+    LUTKind        kind_   = LUTKind::Transmittance;
+    LUTTexelFormat format_ = LUTTexelFormat::RGBA32F;
+    uint64_t       hash_   = 0;
+    Int3           res_;
+    int            mipLevels_ = 0;
+
+    const char *mipData_[LUT_FILE_MAX_MIP_LEVELS] = {};
+};
+
+// read-only lut file. all tables reference the mapped memory directly, so
+// the file must outlive any view obtained from it.
+class LUTFile
+{
+public:
+
+    // returns false when the file is missing, truncated or malformed
+    bool open(const std::string &filename);
+
+    void close();
+
+    bool isOpen() const;
+
+    int getTableCount() const;
+
+    const LUTTableView &getTable(int index) const;
+
+    // returns nullptr when the file contains no table of this kind
+    const LUTTableView *findTable(LUTKind kind) const;
+
+private:
+
+    MappedFile                file_;
+    std::vector<LUTTableView> tables_;
+};
+
+// collects tables in memory and writes them as a single lut file
+class LUTFileWriter
+{
+public:
+
+    // mipLevels = 0 builds the full chain down to 1x1(x1), but at most
+    // LUT_FILE_MAX_MIP_LEVELS levels. lower levels are box filtered from
+    // the float4 source before encoding. throws when format drops the alpha
+    // a kind keeps data in, see hasLUTAlpha.
+    void addTable(
+        LUTKind         kind,
+        uint64_t        hash,
+        const Int3     &res,
+        const Float4   *texels,
+        LUTTexelFormat  format,
+        int             mipLevels = 1);
+
+    void addTable(
+        LUTKind                kind,
+        uint64_t               hash,
+        const Table2D<Float4> &table,
+        LUTTexelFormat         format,
+        int                    mipLevels = 1);
+
+    // writes to a temporary file with a unique name first and renames it
+    // over filename, so that readers never observe a partially written file
+    // and concurrent writers never interleave. see replaceFile
+    bool write(const std::string &filename) const;
+
+    void clear();
+
+private:
+
+    using Bytes = std::vector<unsigned char>;
+
+    struct Table
+    {
+        LUTKind            kind;
+        LUTTexelFormat     format;
+        uint64_t           hash;
+        Int3               res;
+        std::vector<Bytes> mips;
+    };
+
+    std::vector<Table> tables_;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+
+    MappedFile() = default;
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&other) noexcept;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    ~MappedFile();
+
+    bool open(const std::string &filename);
+
+    void close();
+
+    bool isOpen() const;
+
+    const void *getData() const;
+
+    size_t getSize() const;
+
+private:
+
+    void swap(MappedFile &other) noexcept;
+
+    const void *data_ = nullptr;
+    size_t      size_ = 0;
+
+#ifdef _WIN32
+    void *file_    = nullptr;
+    void *mapping_ = nullptr;
+#endif
+};
@@ -0,0 +1,207 @@
+#include <cmath>
+
+#include <cyBVH.h>
+
+#include "./mesh_scene.h"
+
+class CPUMeshScene::TriangleBVH : public cy::BVH
+{
+public:
+
+    explicit TriangleBVH(const std::vector<Vertex> &vertices)
+        : vertices_(vertices)
+    {
+        Build(static_cast<unsigned int>(vertices.size() / 3));
+    }
+
+protected:
+
+    void GetElementBounds(unsigned int i, float box[6]) const override
+    {
+        const Float3 &a = vertices_[3 * i + 0].position;
+        const Float3 &b = vertices_[3 * i + 1].position;
+        const Float3 &c = vertices_[3 * i + 2].position;
+        for(int k = 0; k < 3; ++k)
+        {
+            box[k]     = (std::min)((std::min)(a[k], b[k]), c[k]);
+            box[k + 3] = (std::max)((std::max)(a[k], b[k]), c[k]);
+        }
+    }
+
+    float GetElementCenter(unsigned int i, int dimension) const override
+    {
+        return (vertices_[3 * i + 0].position[dimension] +
+                vertices_[3 * i + 1].position[dimension] +
+                vertices_[3 * i + 2].position[dimension]) / 3;
+    }
+
+private:
+
+    const std::vector<Vertex> &vertices_;
+};
+
+namespace
+{
+
+    // slab test, returns the entry distance or tMax when the box is missed
+    float intersectBox(
+        const float  *box,
+        const Float3 &ori,
+        const Float3 &invDir,
+        float         tMax)
+    {
+        float t0 = 0, t1 = tMax;
+        for(int k = 0; k < 3; ++k)
+        {
+            float tNear = (box[k]     - ori[k]) * invDir[k];
+            float tFar  = (box[k + 3] - ori[k]) * invDir[k];
+            if(tNear > tFar)
+                std::swap(tNear, tFar);
+            t0 = (std::max)(t0, tNear);
+            t1 = (std::min)(t1, tFar);
+            if(t0 > t1)
+                return tMax;
+        }
+        return t0;
+    }
+
+    // Moller-Trumbore, writes the barycentrics of b and c
+    bool intersectTriangle(
+        const Float3 &ori,
+        const Float3 &dir,
+        const Float3 &a,
+        const Float3 &b,
+        const Float3 &c,
+        float         tMax,
+        float        &t,
+        float        &u,
+        float        &v)
+    {
+        const Float3 ab = b - a;
+        const Float3 ac = c - a;
+        const Float3 p  = cross(dir, ac);
+        const float det = dot(ab, p);
+        if(std::abs(det) < 1e-12f)
+            return false;
+
+        const float  invDet = 1 / det;
+        const Float3 ao     = ori - a;
+        u = dot(ao, p) * invDet;
+        if(u < 0 || u > 1)
+            return false;
+
+        const Float3 q = cross(ao, ab);
+        v = dot(dir, q) * invDet;
+        if(v < 0 || u + v > 1)
+            return false;
+
+        t = dot(ac, q) * invDet;
+        return t > 0 && t < tMax;
+    }
+
+} // namespace anonymous
+
+CPUMeshScene::CPUMeshScene() = default;
+
+CPUMeshScene::~CPUMeshScene() = default;
+
+void CPUMeshScene::addMesh(const std::vector<Vertex> &vertices, const Mat4 &world)
+{
+    for(auto &vertex : vertices)
+    {
+        const Float4 position =
+            Float4(vertex.position.x, vertex.position.y, vertex.position.z, 1) * world;
+        const Float4 normal =
+            Float4(vertex.normal.x, vertex.normal.y, vertex.normal.z, 0) * world;
+
+        vertices_.push_back({
+            position.xyz(), normal.xyz().normalize(), vertex.color
+        });
+    }
+}
+
+void CPUMeshScene::build()
+{
+    bvh_ = std::make_unique<TriangleBVH>(vertices_);
+}
+
+size_t CPUMeshScene::getTriangleCount() const
+{
+    return vertices_.size() / 3;
+}
+
+bool CPUMeshScene::intersect(
+    const Float3 &ori, const Float3 &dir, float tMax, Hit &hit) const
+{
+    if(vertices_.empty())
+        return false;
+
+    const Float3 invDir = {
+        1 / dir.x, 1 / dir.y, 1 / dir.z
+    };
+
+    unsigned int stack[64];
+    int          stackSize = 0;
+    stack[stackSize++] = bvh_->GetRootNodeID();
+
+    int   hitTriangle = -1;
+    float hitU = 0, hitV = 0;
+
+    while(stackSize)
+    {
+        const unsigned int node = stack[--stackSize];
+        if(intersectBox(bvh_->GetNodeBounds(node), ori, invDir, tMax) >= tMax)
+            continue;
+
+        if(bvh_->IsLeafNode(node))
+        {
+            const unsigned int *elements = bvh_->GetNodeElements(node);
+            const unsigned int  count    = bvh_->GetNodeElementCount(node);
+            for(unsigned int i = 0; i < count; ++i)
+            {
+                const unsigned int tri = elements[i];
+
+                float t, u, v;
+                if(intersectTriangle(
+                    ori, dir,
+                    vertices_[3 * tri + 0].position,
+                    vertices_[3 * tri + 1].position,
+                    vertices_[3 * tri + 2].position,
+                    tMax, t, u, v))
+                {
+                    tMax        = t;
+                    hitTriangle = static_cast<int>(tri);
+                    hitU        = u;
+                    hitV        = v;
+                }
+            }
+            continue;
+        }
+
+        // the nearer child is popped first
+        unsigned int child0, child1;
+        bvh_->GetChildNodes(node, child0, child1);
+
+        const float t0 = intersectBox(bvh_->GetNodeBounds(child0), ori, invDir, tMax);
+        const float t1 = intersectBox(bvh_->GetNodeBounds(child1), ori, invDir, tMax);
+        if(t0 < t1)
+            std::swap(child0, child1);
+
+        stack[stackSize++] = child0;
+        stack[stackSize++] = child1;
+    }
+
+    if(hitTriangle < 0)
+        return false;
+
+    const Vertex &a = vertices_[3 * hitTriangle + 0];
+    const Vertex &b = vertices_[3 * hitTriangle + 1];
+    const Vertex &c = vertices_[3 * hitTriangle + 2];
+    const float   w = 1 - hitU - hitV;
+
+    hit.t        = tMax;
+    hit.position = ori + tMax * dir;
+    hit.normal   = (w * a.normal + hitU * b.normal + hitV * c.normal).normalize();
+    hit.color    = w * a.color + hitU * b.color + hitV * c.color;
+    return true;
+}
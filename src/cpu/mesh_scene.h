@@ -0,0 +1,55 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "../common_math.h"
+
+// world-space triangles of the demo meshes with a BVH for ray casts, the
+// CPU stand-in for rasterizing them. vertices carry the same attributes as
+// Vertex in mesh.h.
+class CPUMeshScene
+{
+public:
+
+    struct Vertex
+    {
+        Float3 position;
+        Float3 normal;
+        Float3 color;
+    };
+
+    struct Hit
+    {
+        float  t;
+        Float3 position;
+        Float3 normal;
+        Float3 color;
+    };
+
+    CPUMeshScene();
+
+    ~CPUMeshScene();
+
+    // vertices form a triangle list. positions and normals are transformed
+    // by world as in asset/mesh.hlsl.
+    void addMesh(const std::vector<Vertex> &vertices, const Mat4 &world);
+
+    // must be called after the last addMesh() and before any intersect()
+    void build();
+
+    size_t getTriangleCount() const;
+
+    // closest hit with t in (0, tMax). dir needn't be normalized, t is in
+    // units of its length. thread-safe.
+    bool intersect(
+        const Float3 &ori, const Float3 &dir, float tMax, Hit &hit) const;
+
+private:
+
+    class TriangleBVH;
+
+    std::vector<Vertex> vertices_;
+
+    std::unique_ptr<TriangleBVH> bvh_;
+};
@@ -0,0 +1,249 @@
+#include "./intersection.h"
+#include "./multiscatter.h"
+#include "./parallel.h"
+#include "./profiler.h"
+#include "./transmittance.h"
+
+namespace
+{
+
+    Float3 uniformOnUnitSphere(float u1, float u2)
+    {
+        const float z   = 1 - 2 * u1;
+        const float r   = std::sqrt((std::max)(0.0f, 1 - z * z));
+        const float phi = 2 * PI * u2;
+        return { r * std::cos(phi), r * std::sin(phi), z };
+    }
+
+    Float3 exp3(const Float3 &v)
+    {
+        return { std::exp(v.x), std::exp(v.y), std::exp(v.z) };
+    }
+
+} // namespace anonymous
+
+void CPUMultiScatteringLUT::setRayMarchStepCount(int stepCount)
+{
+    rayMarchStepCount_ = (std::max)(stepCount, 1);
+}
+
+void CPUMultiScatteringLUT::setRayMarchQuadrature(QuadratureScheme scheme)
+{
+    scheme_ = scheme;
+}
+
+void CPUMultiScatteringLUT::setThreadCount(int threadCount)
+{
+    threadCount_ = threadCount;
+}
+
+void CPUMultiScatteringLUT::setCancelFlag(const std::atomic<bool> *cancel)
+{
+    cancel_ = cancel;
+}
+
+bool CPUMultiScatteringLUT::isCanceled() const
+{
+    return cancel_ && cancel_->load(std::memory_order_relaxed);
+}
+
+bool CPUMultiScatteringLUT::generate(
+    const Int2                 &res,
+    const Table2D<Float4>      &transmittance,
+    const Float3               &terrainAlbedo,
+    const AtmosphereProperties &atmos,
+    const std::vector<Float2>  &dirSamples)
+{
+    ProfileZone zone("CPUMultiScatteringLUT::generate");
+
+    Table2D<Float4> table(res);
+    const Context ctx = { &transmittance, &atmos, terrainAlbedo };
+
+    quadrature_ = RayQuadrature(scheme_, rayMarchStepCount_, atmos);
+    const int sampleCount = quadrature_.getSampleCount();
+
+    // small tiles keep the shared queue busy until the end: texel cost
+    // varies a lot between ground-hitting and grazing directions
+    constexpr int TILE_SIZE_X = 8;
+    constexpr int TILE_SIZE_Y = 8;
+
+    parallelForTiles(
+        res, { TILE_SIZE_X, TILE_SIZE_Y }, threadCount_,
+        [&](int, const Int2 &beg, const Int2 &end)
+    {
+        if(isCanceled())
+            return;
+
+        Scratch scratch;
+        scratch.t           .resize(sampleCount);
+        scratch.w           .resize(sampleCount);
+        scratch.h           .resize(sampleCount);
+        scratch.insideShadow.resize(sampleCount);
+        scratch.u           .resize(sampleCount);
+        for(int c = 0; c < 3; ++c)
+        {
+            scratch.sigmaS[c]      .resize(sampleCount);
+            scratch.sigmaT[c]      .resize(sampleCount);
+            scratch.opticalDepth[c].resize(sampleCount);
+            scratch.rho[c]         .resize(sampleCount);
+        }
+
+        for(int y = beg.y; y < end.y; ++y)
+        {
+            const float sinSunTheta = -1 + 2 * (y + 0.5f) / res.y;
+            const float sunTheta    = std::asin(sinSunTheta);
+
+            for(int x = beg.x; x < end.x; ++x)
+            {
+                const float h = (atmos.atmosphereRadius - atmos.planetRadius)
+                              * (x + 0.5f) / res.x;
+
+                const Float3 M = computeM(
+                    ctx, dirSamples, h, sunTheta, scratch);
+                table(x, y) = Float4(M.x, M.y, M.z, 1);
+            }
+        }
+    });
+
+    if(isCanceled())
+        return false;
+
+    table_ = std::move(table);
+    return true;
+}
+
+const Table2D<Float4> &CPUMultiScatteringLUT::getTable() const
+{
+    return table_;
+}
+
+Float3 CPUMultiScatteringLUT::computeM(
+    const Context             &ctx,
+    const std::vector<Float2> &dirSamples,
+    float                      h,
+    float                      sunTheta,
+    Scratch                   &scratch) const
+{
+    const Float3 worldOri = { 0, h + ctx.atmos->planetRadius, 0 };
+    const Float3 toSunDir = { std::cos(sunTheta), std::sin(sunTheta), 0 };
+
+    Float3 sumL2, sumF;
+    for(auto &rawSample : dirSamples)
+    {
+        const Float3 worldDir = uniformOnUnitSphere(rawSample.x, rawSample.y);
+
+        Float3 innerL2, innerF;
+        integrate(
+            ctx, worldOri, worldDir, sunTheta, toSunDir,
+            innerL2, innerF, scratch);
+
+        // phase function is canceled by pdf
+
+        sumL2 += innerL2;
+        sumF  += innerF;
+    }
+
+    const float invCount = 1.0f / static_cast<float>(dirSamples.size());
+    const Float3 l2 = sumL2 * invCount;
+    const Float3 f  = sumF  * invCount;
+    return l2 / (Float3(1) - f);
+}
+
+void CPUMultiScatteringLUT::integrate(
+    const Context &ctx,
+    const Float3  &worldOri,
+    const Float3  &worldDir,
+    float          sunTheta,
+    const Float3  &toSunDir,
+    Float3        &innerL2,
+    Float3        &innerF,
+    Scratch       &scratch) const
+{
+    const AtmosphereProperties &atmos = *ctx.atmos;
+    const int stepCount = quadrature_.getSampleCount();
+
+    const float u = dot(worldDir, toSunDir);
+
+    float endT = 0;
+    const bool groundInct = findClosestIntersectionWithSphere(
+        worldOri, worldDir, atmos.planetRadius, endT);
+    if(!groundInct)
+    {
+        findClosestIntersectionWithSphere(
+            worldOri, worldDir, atmos.atmosphereRadius, endT);
+    }
+
+    // gather sample heights first so that the medium can be evaluated in
+    // batches
+
+    quadrature_.place(
+        worldOri.y, worldDir.y, 0, endT, scratch.t.data(), scratch.w.data());
+
+    for(int i = 0; i < stepCount; ++i)
+    {
+        const Float3 worldPos = worldOri + scratch.t[i] * worldDir;
+        scratch.h[i] = worldPos.length() - atmos.planetRadius;
+        scratch.u[i] = u;
+        scratch.insideShadow[i] = hasIntersectionWithSphere(
+            worldPos, toSunDir, atmos.planetRadius) ? 1.0f : 0.0f;
+    }
+
+    const Float3Batch sigmaS = {
+        scratch.sigmaS[0].data(), scratch.sigmaS[1].data(), scratch.sigmaS[2].data()
+    };
+    const Float3Batch sigmaT = {
+        scratch.sigmaT[0].data(), scratch.sigmaT[1].data(), scratch.sigmaT[2].data()
+    };
+    const Float3Batch rho = {
+        scratch.rho[0].data(), scratch.rho[1].data(), scratch.rho[2].data()
+    };
+
+    atmos.getSigmaST(stepCount, scratch.h.data(), sigmaS, sigmaT);
+    atmos.evalPhaseFunction(
+        stepCount, scratch.h.data(), scratch.u.data(), rho);
+
+    Float3 sumSigmaT;
+    for(int c = 0; c < 3; ++c)
+    {
+        sumSigmaT[c] = quadrature_.accumulate(
+            scratch.w.data(), scratch.sigmaT[c].data(), 0,
+            scratch.opticalDepth[c].data());
+    }
+
+    Float3 sumL2, sumF;
+    for(int i = 0; i < stepCount; ++i)
+    {
+        const float  dt = scratch.w[i];
+        const Float3 sS = { sigmaS.r[i], sigmaS.g[i], sigmaS.b[i] };
+
+        const Float3 transmittance = exp3({
+            -scratch.opticalDepth[0][i],
+            -scratch.opticalDepth[1][i],
+            -scratch.opticalDepth[2][i]
+        });
+
+        if(scratch.insideShadow[i] == 0)
+        {
+            const Float3 r        = { rho.r[i], rho.g[i], rho.b[i] };
+            const Float3 sunTrans = sampleTransmittance(
+                *ctx.transmittance, atmos, scratch.h[i], sunTheta);
+
+            // sun intensity is 1
+            sumL2 += dt * transmittance * sunTrans * sS * r;
+        }
+
+        sumF += dt * transmittance * sS;
+    }
+
+    if(groundInct)
+    {
+        const Float3 transmittance = exp3(-sumSigmaT);
+        const Float3 sunTrans = sampleTransmittance(
+            *ctx.transmittance, atmos, 0, sunTheta);
+        sumL2 += transmittance * sunTrans * (std::max)(0.0f, toSunDir.y) *
+                 (ctx.terrainAlbedo / PI);
+    }
+
+    innerL2 = sumL2;
+    innerF  = sumF;
+}
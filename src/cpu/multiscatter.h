@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+
+#include "../medium.h"
+#include "./quadrature.h"
+#include "./table.h"
+
+// CPU backend of MultiScatteringLUT, port of asset/multiscatter.hlsl.
+// Texels are independent and evaluated in a fixed order by a single thread
+// each, so within one build the same inputs always give a bit-identical
+// table regardless of the thread count.
+class CPUMultiScatteringLUT
+{
+public:
+
+    void setRayMarchStepCount(int stepCount);
+
+    // sample placement of the ray march, Midpoint by default
+    void setRayMarchQuadrature(QuadratureScheme scheme);
+
+    void setThreadCount(int threadCount);
+
+    // generate() polls this flag between tiles and gives up once it's set
+    void setCancelFlag(const std::atomic<bool> *cancel);
+
+    // returns false when canceled, in which case the table is left unchanged
+    bool generate(
+        const Int2                 &res,
+        const Table2D<Float4>      &transmittance,
+        const Float3               &terrainAlbedo,
+        const AtmosphereProperties &atmos,
+        const std::vector<Float2>  &dirSamples);
+
+    const Table2D<Float4> &getTable() const;
+
+private:
+
+    bool isCanceled() const;
+
+    struct Scratch
+    {
+        std::vector<float> t;
+        std::vector<float> w;
+        std::vector<float> h;
+        std::vector<float> insideShadow;
+        std::vector<float> sigmaS[3];
+        std::vector<float> sigmaT[3];
+        std::vector<float> opticalDepth[3];
+        std::vector<float> rho[3];
+        std::vector<float> u;
+    };
+
+    struct Context
+    {
+        const Table2D<Float4>      *transmittance;
+        const AtmosphereProperties *atmos;
+        Float3                      terrainAlbedo;
+    };
+
+    Float3 computeM(
+        const Context             &ctx,
+        const std::vector<Float2> &dirSamples,
+        float                      h,
+        float                      sunTheta,
+        Scratch                   &scratch) const;
+
+    void integrate(
+        const Context &ctx,
+        const Float3  &worldOri,
+        const Float3  &worldDir,
+        float          sunTheta,
+        const Float3  &toSunDir,
+        Float3        &innerL2,
+        Float3        &innerF,
+        Scratch       &scratch) const;
+
+    int rayMarchStepCount_ = 256;
+    int threadCount_       = 0;
+
+    QuadratureScheme scheme_ = QuadratureScheme::Midpoint;
+    RayQuadrature    quadrature_;
+
+    const std::atomic<bool> *cancel_ = nullptr;
+
+    Table2D<Float4> table_;
+};
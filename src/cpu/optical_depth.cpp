@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "./optical_depth.h"
+
+namespace
+{
+
+    constexpr double SQRT_PI = 1.77245385090551602729;
+
+    // a straight ray segment. u = s + r0 * mu0 is the signed distance from
+    // the point closest to the planet center, which lies at radius rt.
+    struct RaySegment
+    {
+        double r0, mu0;
+        double r1, mu1;
+        double rt;
+        double u0, u1;
+    };
+
+    RaySegment makeSegment(double r0, double mu0, double t)
+    {
+        RaySegment seg;
+        seg.r0  = r0;
+        seg.mu0 = mu0;
+        seg.rt  = r0 * std::sqrt((std::max)(0.0, 1 - mu0 * mu0));
+        seg.u0  = r0 * mu0;
+        seg.u1  = seg.u0 + t;
+        seg.r1  = std::sqrt(seg.rt * seg.rt + seg.u1 * seg.u1);
+        seg.mu1 = seg.r1 > 0 ? seg.u1 / seg.r1 : 1;
+        return seg;
+    }
+
+    double findBoundaryDistance(double r0, double mu, double R, double Ra)
+    {
+        const double rt2 = r0 * r0 * (1 - mu * mu);
+        if(mu < 0 && rt2 <= R * R)
+            return -r0 * mu - std::sqrt(R * R - rt2);
+        return (std::max)(0.0, -r0 * mu + std::sqrt((std::max)(0.0, Ra * Ra - rt2)));
+    }
+
+    // exp(z^2) * erfc(z) for z >= 0. erfc underflows around z = 26, where
+    // the asymptotic series is already accurate to ~1e-11.
+    double erfcx(double z)
+    {
+        if(z < 25)
+            return std::exp(z * z) * std::erfc(z);
+        const double a = 0.5 / (z * z);
+        return (1 - a * (1 - 3 * a * (1 - 5 * a * (1 - 7 * a)))) / (z * SQRT_PI);
+    }
+
+    // integral of exp(-(r(s) - R) / H) over s in [0, inf) along the ray
+    // leaving radius r with zenith cosine mu >= 0.
+    //
+    // with w = (r(s) - r) / H this becomes
+    //   sqrt(H) exp(-(r - R) / H) int_0^inf exp(-w) g(w) / sqrt(w + c) dw
+    // where g(w) = r(w) / sqrt(r(w) + rt), rt is the tangent radius and
+    // c = (r - rt) / H. g varies by ~H / r per unit w, so its quadratic
+    // Taylor expansion leaves integrals of w^k exp(-w) / sqrt(w + c) that
+    // are closed forms in erfcx(sqrt(c)).
+    double chapmanDepth(double r, double mu, double R, double H)
+    {
+        const double sinTheta = std::sqrt((std::max)(0.0, 1 - mu * mu));
+        const double rt       = r * sinTheta;
+        const double c        = r * mu * mu / ((1 + sinTheta) * H);
+
+        const double sc = std::sqrt(c);
+        const double J0 = SQRT_PI * erfcx(sc);
+        const double K1 = sc + 0.5 * J0;
+        const double K3 = c * sc + 1.5 * K1;
+        const double J1 = K1 - c * J0;
+        const double J2 = K3 - 2 * c * K1 + c * c * J0;
+
+        const double q  = r + rt;
+        const double sq = std::sqrt(q);
+        const double g0 = r / sq;
+        const double g1 = H * (0.5 * r + rt) / (q * sq);
+        const double g2 = -0.5 * H * H * (0.25 * r + rt) / (q * q * sq);
+
+        return std::exp(-(r - R) / H) * std::sqrt(H)
+             * (g0 * J0 + g1 * J1 + g2 * J2);
+    }
+
+    // integral of exp(-(r(s) - R) / H) over the segment, as the difference
+    // of two rays to infinity. a segment passing its tangent point is split
+    // there so that every ray points away from the planet.
+    double exponentialDepth(const RaySegment &seg, double R, double H)
+    {
+        double result;
+        if(seg.mu0 >= 0)
+        {
+            result = chapmanDepth(seg.r0, seg.mu0, R, H)
+                   - chapmanDepth(seg.r1, seg.mu1, R, H);
+        }
+        else if(seg.mu1 <= 0)
+        {
+            result = chapmanDepth(seg.r1, -seg.mu1, R, H)
+                   - chapmanDepth(seg.r0, -seg.mu0, R, H);
+        }
+        else
+        {
+            result = 2 * chapmanDepth(seg.rt, 0, R, H)
+                   - chapmanDepth(seg.r0, -seg.mu0, R, H)
+                   - chapmanDepth(seg.r1, seg.mu1, R, H);
+        }
+        return (std::max)(result, 0.0);
+    }
+
+    // integral of max(0, 1 - 0.5 * |r(s) - R - center| / thickness) over
+    // the segment. the density is linear in r between the tent kinks, and
+    // int r du = (u * r + rt^2 * asinh(u / rt)) / 2, so splitting the
+    // segment where r crosses a kink or turns around makes it exact.
+    double ozoneDepth(
+        const RaySegment &seg, double R, double center, double thickness)
+    {
+        if(thickness <= 0)
+            return 0;
+
+        const double rt2 = seg.rt * seg.rt;
+        auto integrateR = [&](double u)
+        {
+            const double r = std::sqrt(rt2 + u * u);
+            const double a = seg.rt > 0 ? rt2 * std::asinh(u / seg.rt) : 0.0;
+            return 0.5 * (u * r + a);
+        };
+
+        // at most the two ends, the turning point and two crossings per kink
+        double splits[9];
+        int splitCount = 0;
+
+        auto addSplit = [&](double u)
+        {
+            if(u <= seg.u0 || seg.u1 <= u)
+                return;
+            int i = splitCount++;
+            for(; splits[i - 1] > u; --i)
+                splits[i] = splits[i - 1];
+            splits[i] = u;
+        };
+
+        splits[splitCount++] = seg.u0;
+        addSplit(0);
+        const double rc = R + center;
+        for(double kink : { rc - 2 * thickness, rc, rc + 2 * thickness })
+        {
+            if(kink > seg.rt)
+            {
+                const double u = std::sqrt(kink * kink - rt2);
+                addSplit(-u);
+                addSplit(u);
+            }
+        }
+        splits[splitCount++] = seg.u1;
+
+        double result = 0;
+        for(int i = 0; i + 1 < splitCount; ++i)
+        {
+            const double ua = splits[i];
+            const double ub = splits[i + 1];
+            const double um = 0.5 * (ua + ub);
+
+            const double offset = std::sqrt(rt2 + um * um) - rc;
+            if(std::abs(offset) >= 2 * thickness)
+                continue;
+
+            const double sign = offset > 0 ? 1 : -1;
+            const double du   = ub - ua;
+            const double dr   = integrateR(ub) - integrateR(ua) - rc * du;
+            result += du - 0.5 * sign * dr / thickness;
+        }
+
+        return (std::max)(result, 0.0);
+    }
+
+    Float3 computeSegmentOpticalDepth(
+        const AtmosphereProperties &atmos, const RaySegment &seg)
+    {
+        const double R = atmos.planetRadius;
+
+        const double rayleigh = exponentialDepth(seg, R, atmos.hDensityRayleigh);
+        const double mie      = exponentialDepth(seg, R, atmos.hDensityMie);
+        const double ozone    = ozoneDepth(
+            seg, R, atmos.ozoneCenterHeight, atmos.ozoneThickness);
+
+        return atmos.scatterRayleigh * static_cast<float>(rayleigh)
+             + Float3(static_cast<float>(
+                   (atmos.scatterMie + atmos.absorbMie) * mie))
+             + atmos.absorbOzone * static_cast<float>(ozone);
+    }
+
+} // namespace anonymous
+
+Float3 computeOpticalDepth(
+    const AtmosphereProperties &atmos, float h, float sinTheta)
+{
+    return computeOpticalDepth(
+        atmos, h, sinTheta, std::numeric_limits<float>::infinity());
+}
+
+Float3 computeOpticalDepth(
+    const AtmosphereProperties &atmos, float h, float sinTheta, float distance)
+{
+    const double r0 = atmos.planetRadius + (std::max)(h, 0.0f);
+    const double mu = (std::clamp)(sinTheta, -1.0f, 1.0f);
+
+    const double boundary = findBoundaryDistance(
+        r0, mu, atmos.planetRadius, atmos.atmosphereRadius);
+    const double t = (std::clamp)(double(distance), 0.0, boundary);
+
+    return computeSegmentOpticalDepth(atmos, makeSegment(r0, mu, t));
+}
+
+Float3 computeTransmittance(
+    const AtmosphereProperties &atmos, float h, float theta)
+{
+    const Float3 opticalDepth = computeOpticalDepth(atmos, h, std::sin(theta));
+    return {
+        std::exp(-opticalDepth.x),
+        std::exp(-opticalDepth.y),
+        std::exp(-opticalDepth.z)
+    };
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "../medium.h"
+
+// closed-form optical depth of AtmosphereProperties along straight rays.
+//
+// the two exponential terms go through a Chapman-function evaluation that
+// is exact up to a quadratic fit of a slowly varying geometric factor
+// (relative error ~ (h / R)^3), and the ozone tent is integrated exactly
+// piece by piece between the points where the ray crosses its kinks. the
+// cost is a handful of exp/erfc calls per ray, independent of its length.
+//
+// h is the height above the ground, sinTheta the sine of the elevation
+// angle of the ray, in the same units as atmos.
+
+// optical depth from h along sinTheta to the ground or the top of the
+// atmosphere, whichever comes first. this is the ray of a transmittance
+// LUT texel.
+Float3 computeOpticalDepth(
+    const AtmosphereProperties &atmos, float h, float sinTheta);
+
+// optical depth of the first distance units of the same ray. distance is
+// clamped to the ground or atmosphere boundary.
+Float3 computeOpticalDepth(
+    const AtmosphereProperties &atmos, float h, float sinTheta, float distance);
+
+// LUT-free counterpart of sampleTransmittance
+Float3 computeTransmittance(
+    const AtmosphereProperties &atmos, float h, float theta);
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <agz-utils/thread.h>
+
+#include "../common_math.h"
+
+// split a 2d domain into tiles and distribute them over worker threads.
+// func is called as func(threadIndex, tileBeg, tileEnd), with tileEnd
+// exclusive. threadCount <= 0 means hardware_concurrency + threadCount.
+template<typename Func>
+void parallelForTiles(
+    const Int2 &res, const Int2 &tileSize, int threadCount, Func &&func)
+{
+    const int tileCountX = (res.x + tileSize.x - 1) / tileSize.x;
+    const int tileCountY = (res.y + tileSize.y - 1) / tileSize.y;
+
+    agz::thread::parallel_forrange(
+        0, tileCountX * tileCountY, [&](int threadIndex, int tileIndex)
+    {
+        const int tileX = tileIndex % tileCountX;
+        const int tileY = tileIndex / tileCountX;
+
+        const Int2 beg = { tileX * tileSize.x, tileY * tileSize.y };
+        const Int2 end = {
+            (std::min)(beg.x + tileSize.x, res.x),
+            (std::min)(beg.y + tileSize.y, res.y)
+        };
+
+        func(threadIndex, beg, end);
+    }, threadCount);
+}
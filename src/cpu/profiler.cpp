@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "./profiler.h"
+
+struct Profiler::RingHandle
+{
+    Ring *ring = nullptr;
+
+    ~RingHandle()
+    {
+        if(ring)
+            ring->inUse.store(false, std::memory_order_release);
+    }
+};
+
+namespace
+{
+
+    void writeJSONString(FILE *file, const char *str)
+    {
+        std::fputc('"', file);
+        for(const char *p = str; *p; ++p)
+        {
+            if(*p == '"' || *p == '\\')
+                std::fputc('\\', file);
+            std::fputc(*p, file);
+        }
+        std::fputc('"', file);
+    }
+
+} // namespace anonymous
+
+Profiler &Profiler::getInstance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler()
+    : epoch_(Clock::now())
+{
+
+}
+
+void Profiler::setEnabled(bool enabled)
+{
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+void Profiler::record(const char *name, uint64_t begNs, uint64_t endNs)
+{
+    thread_local RingHandle handle;
+    if(!handle.ring)
+        handle.ring = &acquireRing();
+
+    Ring &ring = *handle.ring;
+    const uint64_t head = ring.head.load(std::memory_order_relaxed);
+
+    ring.reserved.store(head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Event &event = ring.events[head & (RING_CAPACITY - 1)];
+    event.name .store(name,  std::memory_order_relaxed);
+    event.begNs.store(begNs, std::memory_order_relaxed);
+    event.endNs.store(endNs, std::memory_order_relaxed);
+
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+Profiler::Ring &Profiler::acquireRing()
+{
+    std::lock_guard lock(ringMutex_);
+
+    for(auto &ring : rings_)
+    {
+        bool expected = false;
+        if(ring->inUse.compare_exchange_strong(
+            expected, true, std::memory_order_acquire))
+            return *ring;
+    }
+
+    auto ring = std::make_unique<Ring>();
+    ring->index  = static_cast<int>(rings_.size());
+    ring->inUse  = true;
+    ring->events = std::make_unique<Event[]>(RING_CAPACITY);
+    rings_.push_back(std::move(ring));
+    return *rings_.back();
+}
+
+uint64_t Profiler::copyEvents(
+    const Ring &ring, uint64_t from, std::vector<EventCopy> &output)
+{
+    const uint64_t head = ring.head.load(std::memory_order_acquire);
+    const uint64_t beg  = (std::max)(from, head > RING_CAPACITY ? head - RING_CAPACITY : 0);
+
+    const size_t outputBeg = output.size();
+    for(uint64_t i = beg; i < head; ++i)
+    {
+        const Event &event = ring.events[i & (RING_CAPACITY - 1)];
+        output.push_back({
+            event.name .load(std::memory_order_relaxed),
+            event.begNs.load(std::memory_order_relaxed),
+            event.endNs.load(std::memory_order_relaxed)
+        });
+    }
+
+    // the writer may have lapped the copy meanwhile. event i is gone once
+    // event i + RING_CAPACITY is reserved.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t reserved = ring.reserved.load(std::memory_order_relaxed);
+    if(reserved > beg + RING_CAPACITY)
+    {
+        const size_t dropCount = static_cast<size_t>(
+            (std::min)(reserved - RING_CAPACITY - beg, head - beg));
+        output.erase(
+            output.begin() + outputBeg,
+            output.begin() + outputBeg + dropCount);
+    }
+
+    return head;
+}
+
+void Profiler::update()
+{
+    std::vector<Ring *> rings;
+    {
+        std::lock_guard lock(ringMutex_);
+        for(auto &ring : rings_)
+            rings.push_back(ring.get());
+    }
+
+    std::vector<EventCopy> events;
+    for(Ring *ring : rings)
+        ring->statsCursor = copyEvents(*ring, ring->statsCursor, events);
+
+    std::sort(events.begin(), events.end(), [](const EventCopy &a, const EventCopy &b)
+    {
+        return a.endNs < b.endNs;
+    });
+
+    std::lock_guard lock(statsMutex_);
+    for(auto &event : events)
+    {
+        StatsWindow &window = stats_[event.name];
+
+        const double ms = 1e-6 * static_cast<double>(event.endNs - event.begNs);
+        window.durationsMs[window.next] = ms;
+        window.next   = (window.next + 1) % STATS_WINDOW;
+        window.count  = (std::min)(window.count + 1, STATS_WINDOW);
+        window.lastMs = ms;
+    }
+}
+
+std::vector<std::pair<std::string, Profiler::ZoneStats>> Profiler::getStats() const
+{
+    std::lock_guard lock(statsMutex_);
+
+    std::vector<std::pair<std::string, ZoneStats>> result;
+    for(auto &[name, window] : stats_)
+    {
+        ZoneStats stats;
+        stats.count  = window.count;
+        stats.lastMs = window.lastMs;
+        stats.minMs  = window.durationsMs[0];
+        stats.maxMs  = window.durationsMs[0];
+        for(int i = 0; i < window.count; ++i)
+        {
+            const double ms = window.durationsMs[i];
+            stats.meanMs += ms;
+            stats.minMs   = (std::min)(stats.minMs, ms);
+            stats.maxMs   = (std::max)(stats.maxMs, ms);
+        }
+        stats.meanMs /= (std::max)(window.count, 1);
+        result.emplace_back(name, stats);
+    }
+    return result;
+}
+
+bool Profiler::exportChromeTrace(const std::string &filename) const
+{
+    std::vector<std::pair<int, std::vector<EventCopy>>> threads;
+    {
+        std::lock_guard lock(ringMutex_);
+        for(auto &ring : rings_)
+        {
+            threads.emplace_back(ring->index, std::vector<EventCopy>());
+            copyEvents(*ring, 0, threads.back().second);
+        }
+    }
+
+    FILE *file = std::fopen(filename.c_str(), "w");
+    if(!file)
+        return false;
+
+    std::fprintf(file, "{\n\"displayTimeUnit\": \"ms\",\n\"traceEvents\": [\n");
+
+    bool first = true;
+    for(auto &[tid, events] : threads)
+    {
+        std::fprintf(
+            file,
+            "%s{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, "
+            "\"args\": { \"name\": \"thread %d\" } }",
+            first ? "" : ",\n", tid, tid);
+        first = false;
+
+        // complete events, in microseconds
+        for(auto &event : events)
+        {
+            std::fprintf(file, ",\n{ \"name\": ");
+            writeJSONString(file, event.name);
+            std::fprintf(
+                file, ", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, "
+                "\"ts\": %.3f, \"dur\": %.3f }",
+                tid, 1e-3 * static_cast<double>(event.begNs),
+                1e-3 * static_cast<double>(event.endNs - event.begNs));
+        }
+    }
+
+    std::fprintf(file, "\n]\n}\n");
+    return std::fclose(file) == 0;
+}
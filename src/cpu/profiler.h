@@ -0,0 +1,174 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// scoped timing zones for the frame and the LUT bakes.
+//
+// every thread records its zones into a ring buffer of its own, without
+// locks: the owning thread is the only writer, and readers discard slots
+// that were overwritten while they copied them. the main thread folds new
+// zones into rolling per-name statistics once per frame, and can export
+// the zones still held by the rings as a chrome trace (chrome://tracing or
+// ui.perfetto.dev).
+//
+// a ring is taken by a thread on its first zone and handed back when the
+// thread exits, so the short-lived bake workers reuse a bounded set of
+// rings. rings double as trace threads, so workers that never overlapped
+// may share one.
+class Profiler
+{
+public:
+
+    // of the last STATS_WINDOW zones of a name
+    struct ZoneStats
+    {
+        int    count  = 0;
+        double lastMs = 0;
+        double meanMs = 0;
+        double minMs  = 0;
+        double maxMs  = 0;
+    };
+
+    static constexpr int RING_CAPACITY = 1 << 14;
+    static constexpr int STATS_WINDOW  = 128;
+
+    static Profiler &getInstance();
+
+    Profiler(const Profiler &) = delete;
+
+    Profiler &operator=(const Profiler &) = delete;
+
+    // zones opened while disabled record nothing
+    void setEnabled(bool enabled);
+
+    bool isEnabled() const;
+
+    // nanoseconds since the profiler was created
+    uint64_t now() const;
+
+    // name must outlive the profiler, in practice a string literal
+    void record(const char *name, uint64_t begNs, uint64_t endNs);
+
+    // folds the zones recorded since the last call into the statistics.
+    // not thread-safe, call from one thread only.
+    void update();
+
+    // sorted by name
+    std::vector<std::pair<std::string, ZoneStats>> getStats() const;
+
+    // thread-safe, but a zone that is still open isn't in the trace yet
+    bool exportChromeTrace(const std::string &filename) const;
+
+private:
+
+    struct Event
+    {
+        std::atomic<const char *> name;
+        std::atomic<uint64_t>     begNs;
+        std::atomic<uint64_t>     endNs;
+    };
+
+    // event i lives in slot i % RING_CAPACITY. reserved is bumped before
+    // a slot is written and head once it's complete.
+    struct Ring
+    {
+        int                      index = 0;
+        std::atomic<bool>        inUse    = false;
+        std::atomic<uint64_t>    reserved = 0;
+        std::atomic<uint64_t>    head     = 0;
+        uint64_t                 statsCursor = 0;
+        std::unique_ptr<Event[]> events;
+    };
+
+    struct EventCopy
+    {
+        const char *name;
+        uint64_t    begNs;
+        uint64_t    endNs;
+    };
+
+    struct StatsWindow
+    {
+        double durationsMs[STATS_WINDOW] = {};
+        int    next  = 0;
+        int    count = 0;
+        double lastMs = 0;
+    };
+
+    // hands the ring of a thread back when the thread exits
+    struct RingHandle;
+
+    Profiler();
+
+    Ring &acquireRing();
+
+    // events [from, head) of ring that haven't been overwritten. returns
+    // the head the copy went up to.
+    static uint64_t copyEvents(
+        const Ring &ring, uint64_t from, std::vector<EventCopy> &output);
+
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point epoch_;
+
+    std::atomic<bool> enabled_ = true;
+
+    mutable std::mutex                 ringMutex_;
+    std::vector<std::unique_ptr<Ring>> rings_;
+
+    mutable std::mutex                 statsMutex_;
+    std::map<std::string, StatsWindow> stats_;
+};
+
+// records the time from its construction to its destruction as a zone
+class ProfileZone
+{
+public:
+
+    explicit ProfileZone(const char *name)
+        : name_(name), begNs_(0)
+    {
+        Profiler &profiler = Profiler::getInstance();
+        if(profiler.isEnabled())
+            begNs_ = profiler.now();
+        else
+            name_ = nullptr;
+    }
+
+    ProfileZone(const ProfileZone &) = delete;
+
+    ProfileZone &operator=(const ProfileZone &) = delete;
+
+    ~ProfileZone()
+    {
+        if(name_)
+        {
+            Profiler &profiler = Profiler::getInstance();
+            profiler.record(name_, begNs_, profiler.now());
+        }
+    }
+
+private:
+
+    const char *name_;
+    uint64_t    begNs_;
+};
+
+inline bool Profiler::isEnabled() const
+{
+    return enabled_.load(std::memory_order_relaxed);
+}
+
+inline uint64_t Profiler::now() const
+{
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - epoch_).count());
+}
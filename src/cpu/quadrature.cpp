@@ -0,0 +1,419 @@
+#include <algorithm>
+#include <cmath>
+
+#include "./quadrature.h"
+
+namespace
+{
+
+    // pilot intervals of HeightAdaptive and the share of its samples that
+    // is spread uniformly, so that nearly empty segments still get some
+    constexpr int   PILOT_COUNT    = 16;
+    constexpr float UNIFORM_WEIGHT = 0.1f;
+
+    // larger density ratios between the segment ends don't move the
+    // Exponential samples any further
+    constexpr float MAX_EXPONENT = 20;
+
+    // Gauss-Legendre nodes and weights on [0, 1], increasing
+    void computeGaussLegendre(
+        int n, std::vector<double> &nodes, std::vector<double> &weights)
+    {
+        nodes.resize(n);
+        weights.resize(n);
+
+        for(int i = 0; i < n; ++i)
+        {
+            double x = std::cos(3.14159265358979323846 * (i + 0.75) / (n + 0.5));
+            double dp = 1;
+            for(int iter = 0; iter < 100; ++iter)
+            {
+                double p0 = 1, p1 = x;
+                for(int k = 2; k <= n; ++k)
+                {
+                    const double p2 = ((2 * k - 1) * x * p1 - (k - 1) * p0) / k;
+                    p0 = p1;
+                    p1 = p2;
+                }
+                dp = n * (x * p1 - p0) / (x * x - 1);
+
+                const double dx = p1 / dp;
+                x -= dx;
+                if(std::abs(dx) < 1e-15)
+                    break;
+            }
+
+            nodes[i]   = 0.5 * (1 - x);
+            weights[i] = 1 / ((1 - x * x) * dp * dp);
+        }
+    }
+
+    // cumulative[i * n + j] = integral from 0 to nodes[i] of the Lagrange
+    // basis polynomial of node j. the basis polynomial is expanded into
+    // Legendre polynomials, which the rule integrates exactly against it,
+    // and their integrals follow from (2k + 1) P_k = P_k+1' - P_k-1', so
+    // the table costs O(n^3)
+    std::vector<double> computeGaussLegendreCumulative(
+        const std::vector<double> &nodes, const std::vector<double> &weights)
+    {
+        const int n = static_cast<int>(nodes.size());
+
+        // legendre[k * n + i] = P_k(z_i) on [-1, 1], for k in [0, n]
+        std::vector<double> legendre(static_cast<size_t>(n + 1) * n);
+        for(int i = 0; i < n; ++i)
+        {
+            const double z = 2 * nodes[i] - 1;
+            legendre[i]     = 1;
+            legendre[n + i] = z;
+            for(int k = 2; k <= n; ++k)
+            {
+                legendre[k * n + i] = ((2 * k - 1) * z * legendre[(k - 1) * n + i]
+                                     - (k - 1) * legendre[(k - 2) * n + i]) / k;
+            }
+        }
+
+        std::vector<double> result(static_cast<size_t>(n) * n);
+        for(int i = 0; i < n; ++i)
+        {
+            for(int j = 0; j < n; ++j)
+            {
+                // (2k + 1) times the integral of P_k from -1 to z_i
+                double sum = 2 * nodes[i];
+                for(int k = 1; k < n; ++k)
+                {
+                    sum += legendre[k * n + j] *
+                        (legendre[(k + 1) * n + i] - legendre[(k - 1) * n + i]);
+                }
+                result[i * n + j] = 0.5 * weights[j] * sum;
+            }
+        }
+
+        return result;
+    }
+
+    // composite Simpson on n (odd) uniform nodes
+    void computeSimpson(
+        int n, std::vector<double> &nodes, std::vector<double> &weights)
+    {
+        const double h = 1.0 / (n - 1);
+
+        nodes.resize(n);
+        weights.resize(n);
+
+        for(int k = 0; k < n; ++k)
+        {
+            nodes[k]   = k * h;
+            weights[k] = h / 3 * ((k == 0 || k == n - 1) ? 1 : (k % 2 ? 4 : 2));
+        }
+    }
+
+    // running weights of composite Simpson on n uniform nodes, laid out as
+    // by computeGaussLegendreCumulative. a running integral that ends on an
+    // odd node closes with the 3-point rule over half a panel.
+    std::vector<float> computeSimpsonCumulative(int n)
+    {
+        const double h = 1.0 / (n - 1);
+
+        std::vector<double> cumulative(static_cast<size_t>(n) * n, 0.0);
+        for(int i = 0; i < n; ++i)
+        {
+            const int end = (i % 2 == 0) ? i : i - 1;
+            double *row = &cumulative[i * n];
+            for(int k = 0; end > 0 && k <= end; ++k)
+                row[k] = h / 3 * ((k == 0 || k == end) ? 1 : (k % 2 ? 4 : 2));
+
+            if(i % 2)
+            {
+                row[i - 1] += 5 * h / 12;
+                row[i]     += 8 * h / 12;
+                row[i + 1] -= h / 12;
+            }
+        }
+
+        return std::vector<float>(cumulative.begin(), cumulative.end());
+    }
+
+} // namespace anonymous
+
+const char *getQuadratureSchemeName(QuadratureScheme scheme)
+{
+    switch(scheme)
+    {
+    case QuadratureScheme::Midpoint:       return "midpoint";
+    case QuadratureScheme::Simpson:        return "simpson";
+    case QuadratureScheme::GaussLegendre:  return "gauss-legendre";
+    case QuadratureScheme::Exponential:    return "exponential";
+    case QuadratureScheme::HeightAdaptive: return "height-adaptive";
+    }
+    return "unknown";
+}
+
+RayQuadrature::RayQuadrature()
+    : RayQuadrature(QuadratureScheme::Midpoint, 1, AtmosphereProperties{})
+{
+
+}
+
+RayQuadrature::RayQuadrature(
+    QuadratureScheme            scheme,
+    int                         sampleCount,
+    const AtmosphereProperties &atmos)
+    : scheme_(scheme), sampleCount_((std::max)(sampleCount, 1))
+{
+    planetRadius_ = atmos.planetRadius;
+
+    sigmaRayleigh_ = (atmos.scatterRayleigh.x + atmos.scatterRayleigh.y +
+                      atmos.scatterRayleigh.z) / 3;
+    hRayleigh_     = atmos.hDensityRayleigh;
+    sigmaMie_      = atmos.scatterMie + atmos.absorbMie;
+    hMie_          = atmos.hDensityMie;
+
+    sigmaOzone_     = (atmos.absorbOzone.x + atmos.absorbOzone.y +
+                       atmos.absorbOzone.z) / 3;
+    ozoneCenter_    = atmos.ozoneCenterHeight;
+    ozoneThickness_ = atmos.ozoneThickness;
+
+    std::vector<double> nodes, weights, cumulative;
+    if(scheme_ == QuadratureScheme::Simpson)
+    {
+        sampleCount_ = (std::max)(sampleCount_ | 1, 3);
+        computeSimpson(sampleCount_, nodes, weights);
+    }
+    else if(scheme_ == QuadratureScheme::GaussLegendre)
+    {
+        sampleCount_ = (std::min)(sampleCount_, MAX_GAUSS_LEGENDRE_SAMPLE_COUNT);
+        computeGaussLegendre(sampleCount_, nodes, weights);
+        cumulative = computeGaussLegendreCumulative(nodes, weights);
+    }
+
+    nodes_     .assign(nodes.begin(),      nodes.end());
+    weights_   .assign(weights.begin(),    weights.end());
+    cumulative_.assign(cumulative.begin(), cumulative.end());
+}
+
+QuadratureScheme RayQuadrature::getScheme() const
+{
+    return scheme_;
+}
+
+int RayQuadrature::getSampleCount() const
+{
+    return sampleCount_;
+}
+
+void RayQuadrature::place(
+    float  r0,
+    float  mu,
+    float  tBeg,
+    float  tEnd,
+    float *t,
+    float *w,
+    float  jitter) const
+{
+    const int   n   = sampleCount_;
+    const float len = tEnd - tBeg;
+
+    if(!isCellRule())
+    {
+        for(int i = 0; i < n; ++i)
+        {
+            t[i] = tBeg + len * nodes_[i];
+            w[i] = len * weights_[i];
+        }
+        return;
+    }
+
+    const float cellLen = len / n;
+
+    if(scheme_ == QuadratureScheme::Exponential)
+    {
+        placeExponential(r0, mu, tBeg, tEnd, n, t, w, jitter);
+        return;
+    }
+    if(scheme_ == QuadratureScheme::HeightAdaptive)
+    {
+        // pdf interpolating the density linearly between the pilot points,
+        // mixed with a uniform one, then the midpoint rule on its inverse
+        // cdf. the pdf is continuous, so the rule keeps its order.
+        float pdf[PILOT_COUNT + 1];
+        float mass = 0;
+        for(int k = 0; k <= PILOT_COUNT; ++k)
+        {
+            pdf[k] = evalDensity(r0, mu, tBeg + len * k / PILOT_COUNT);
+            if(k > 0)
+                mass += 0.5f * (pdf[k - 1] + pdf[k]) / PILOT_COUNT;
+        }
+
+        if(mass > 0)
+        {
+            for(int k = 0; k <= PILOT_COUNT; ++k)
+                pdf[k] = (1 - UNIFORM_WEIGHT) * pdf[k] / mass + UNIFORM_WEIGHT;
+
+            int   k    = 0;
+            float cdfK = 0;
+            for(int i = 0; i < n; ++i)
+            {
+                const float u = (i + jitter) / n;
+
+                float massK = 0.5f * (pdf[k] + pdf[k + 1]) / PILOT_COUNT;
+                while(k + 1 < PILOT_COUNT && cdfK + massK <= u)
+                {
+                    cdfK += massK;
+                    ++k;
+                    massK = 0.5f * (pdf[k] + pdf[k + 1]) / PILOT_COUNT;
+                }
+
+                // solve the quadratic cdf of the interval for the offset x
+                const float y     = (u - cdfK) * PILOT_COUNT;
+                const float slope = pdf[k + 1] - pdf[k];
+                const float x     = (std::min)(1.0f, 2 * y / (pdf[k] +
+                    std::sqrt((std::max)(0.0f, pdf[k] * pdf[k] + 2 * slope * y))));
+
+                t[i] = tBeg + len * (k + x) / PILOT_COUNT;
+                w[i] = cellLen / (pdf[k] + slope * x);
+            }
+            return;
+        }
+    }
+
+    for(int i = 0; i < n; ++i)
+    {
+        t[i] = tBeg + (i + jitter) * cellLen;
+        w[i] = cellLen;
+    }
+}
+
+void RayQuadrature::placeExponential(
+    float  r0,
+    float  mu,
+    float  tBeg,
+    float  tEnd,
+    int    n,
+    float *t,
+    float *w,
+    float  jitter) const
+{
+    // midpoint rule after substituting the inverse cdf of exp(-a * s / len),
+    // with a fitted to the density at both ends
+    const float len = tEnd - tBeg;
+    const float d0  = evalDensity(r0, mu, tBeg);
+    const float d1  = evalDensity(r0, mu, tEnd);
+    const float a   = (d0 > 0 && d1 > 0) ? (std::clamp)(
+        std::log(d0 / d1), -MAX_EXPONENT, MAX_EXPONENT) : 0.0f;
+
+    if(std::abs(a) < 1e-3f)
+    {
+        for(int i = 0; i < n; ++i)
+        {
+            t[i] = tBeg + (i + jitter) * len / n;
+            w[i] = len / n;
+        }
+        return;
+    }
+
+    const float absA = std::abs(a);
+    const float e    = -std::expm1(-absA);
+
+    for(int i = 0; i < n; ++i)
+    {
+        const float u  = (i + jitter) / n;
+        const float uf = a > 0 ? u : 1 - u;
+        const float q  = 1 - uf * e;
+        const float s  = -std::log(q) / absA;
+
+        t[i] = tBeg + len * (a > 0 ? s : 1 - s);
+        w[i] = len * e / (absA * q * n);
+    }
+}
+
+float RayQuadrature::accumulate(
+    const float *w,
+    const float *sigma,
+    float        depthBeg,
+    float       *depth) const
+{
+    const int n = sampleCount_;
+
+    if(isCellRule())
+    {
+        float sum = depthBeg;
+        for(int i = 0; i < n; ++i)
+        {
+            const float delta = w[i] * sigma[i];
+            depth[i] = sum + 0.5f * delta;
+            sum += delta;
+        }
+        return sum;
+    }
+
+    float len = 0, total = 0;
+    for(int j = 0; j < n; ++j)
+    {
+        len   += w[j];
+        total += w[j] * sigma[j];
+    }
+
+    if(scheme_ == QuadratureScheme::Simpson)
+    {
+        // whole panels up to every even node, closed by the 3-point rule
+        // over half a panel on odd nodes, see computeSimpsonCumulative
+        const float h = len / (n - 1);
+
+        float sum = depthBeg;
+        depth[0] = sum;
+        for(int i = 2; i < n; i += 2)
+        {
+            depth[i - 1] = sum + h / 12 * (
+                5 * sigma[i - 2] + 8 * sigma[i - 1] - sigma[i]);
+            sum += h / 3 * (sigma[i - 2] + 4 * sigma[i - 1] + sigma[i]);
+            depth[i] = sum;
+        }
+        return depthBeg + total;
+    }
+
+    for(int i = 0; i < n; ++i)
+    {
+        const float *row = &cumulative_[static_cast<size_t>(i) * n];
+
+        float sum = 0;
+        for(int j = 0; j < n; ++j)
+            sum += row[j] * sigma[j];
+        depth[i] = depthBeg + len * sum;
+    }
+
+    return depthBeg + total;
+}
+
+const std::vector<float> &RayQuadrature::getNodes() const
+{
+    return nodes_;
+}
+
+const std::vector<float> &RayQuadrature::getWeights() const
+{
+    return weights_;
+}
+
+std::vector<float> RayQuadrature::getCumulativeWeights() const
+{
+    if(scheme_ == QuadratureScheme::Simpson)
+        return computeSimpsonCumulative(sampleCount_);
+    return cumulative_;
+}
+
+bool RayQuadrature::isCellRule() const
+{
+    return scheme_ != QuadratureScheme::Simpson &&
+           scheme_ != QuadratureScheme::GaussLegendre;
+}
+
+float RayQuadrature::evalDensity(float r0, float mu, float t) const
+{
+    const float r = std::sqrt((std::max)(0.0f, r0 * r0 + 2 * r0 * mu * t + t * t));
+    const float h = (std::max)(0.0f, r - planetRadius_);
+    const float ozone = (std::max)(
+        0.0f, 1 - 0.5f * std::abs(h - ozoneCenter_) / ozoneThickness_);
+    return sigmaRayleigh_ * std::exp(-h / hRayleigh_)
+         + sigmaMie_      * std::exp(-h / hMie_)
+         + sigmaOzone_    * ozone;
+}
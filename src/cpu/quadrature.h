@@ -0,0 +1,119 @@
+#pragma once
+
+#include <vector>
+
+#include "../medium.h"
+
+enum class QuadratureScheme
+{
+    // uniform cells sampled at their centers, as in the GPU shaders
+    Midpoint       = 0,
+    // composite Simpson on uniform nodes including both ends
+    Simpson        = 1,
+    // a single Gauss-Legendre panel over the whole segment
+    GaussLegendre  = 2,
+    // cells following an exponential fitted to the density at both ends
+    Exponential    = 3,
+    // cells of equal medium mass, estimated by a coarse pilot march
+    HeightAdaptive = 4
+};
+
+constexpr int QUADRATURE_SCHEME_COUNT = 5;
+
+// a single Gauss-Legendre panel runs its integrals through an n x n table,
+// so its sample count is clamped to this, as on the GPU
+constexpr int MAX_GAUSS_LEGENDRE_SAMPLE_COUNT = 64;
+
+const char *getQuadratureSchemeName(QuadratureScheme scheme);
+
+// sample placement and weights for integrals along a segment of a ray
+// through the atmosphere, shared by the CPU integrators.
+//
+// Midpoint, Exponential and HeightAdaptive are cell rules: every sample
+// owns a cell of the segment and can be jittered within it. Simpson and
+// GaussLegendre are fixed rules with higher polynomial order; their
+// running integrals use interpolatory weights over all samples.
+class RayQuadrature
+{
+public:
+
+    RayQuadrature();
+
+    // atmos provides the extinction used to place Exponential and
+    // HeightAdaptive samples
+    RayQuadrature(
+        QuadratureScheme            scheme,
+        int                         sampleCount,
+        const AtmosphereProperties &atmos);
+
+    QuadratureScheme getScheme() const;
+
+    // Simpson rounds the requested count up to an odd one >= 3, and
+    // GaussLegendre clamps it to MAX_GAUSS_LEGENDRE_SAMPLE_COUNT
+    int getSampleCount() const;
+
+    // samples [tBeg, tEnd] of the ray leaving radius r0 (from the planet
+    // center) with zenith cosine mu. writes getSampleCount() increasing
+    // distances to t and weights to w, such that sum f(t[i]) * w[i]
+    // approximates the integral of f over the segment. jitter in [0, 1)
+    // is the sample position within its cell for the cell rules.
+    void place(
+        float  r0,
+        float  mu,
+        float  tBeg,
+        float  tEnd,
+        float *t,
+        float *w,
+        float  jitter = 0.5f) const;
+
+    // depth[i] = depthBeg + integral of sigma from tBeg to t[i], given sigma
+    // at the samples and the weights written by place(). returns the
+    // integral up to tEnd. depth must not alias sigma.
+    float accumulate(
+        const float *w,
+        const float *sigma,
+        float        depthBeg,
+        float       *depth) const;
+
+    // the fixed rules on [0, 1], e.g. for uploading them to the GPU. all
+    // are empty for cell rules. getCumulativeWeights() is row-major
+    // sampleCount^2, with row i integrating from 0 to node i; Simpson
+    // builds it on every call, since accumulate() doesn't need it.
+
+    const std::vector<float> &getNodes() const;
+
+    const std::vector<float> &getWeights() const;
+
+    std::vector<float> getCumulativeWeights() const;
+
+private:
+
+    bool isCellRule() const;
+
+    void placeExponential(
+        float  r0,
+        float  mu,
+        float  tBeg,
+        float  tEnd,
+        int    n,
+        float *t,
+        float *w,
+        float  jitter) const;
+
+    float evalDensity(float r0, float mu, float t) const;
+
+    QuadratureScheme scheme_;
+    int              sampleCount_;
+
+    float planetRadius_;
+    float sigmaRayleigh_, hRayleigh_;
+    float sigmaMie_,      hMie_;
+    float sigmaOzone_,    ozoneCenter_, ozoneThickness_;
+
+    // fixed rules on [0, 1]. cumulative_ is row-major sampleCount^2, with
+    // row i integrating from 0 to nodes_[i], and only kept for
+    // GaussLegendre.
+    std::vector<float> nodes_;
+    std::vector<float> weights_;
+    std::vector<float> cumulative_;
+};
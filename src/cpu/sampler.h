@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "./table.h"
+
+// texels and weights of one bilinear lookup. tables of the same resolution
+// sampled at the same uv can share a footprint.
+struct BilinearFootprint
+{
+    size_t i00, i10, i01, i11;
+    float  tx, ty;
+};
+
+// clamp addressing, matching a D3D11 MIN_MAG_MIP_LINEAR /
+// TEXTURE_ADDRESS_CLAMP sampler on a single mip level
+inline BilinearFootprint computeBilinearFootprint(
+    const Int2 &res, const Float2 &uv)
+{
+    const int w = res.x;
+    const int h = res.y;
+
+    const float fx = uv.x * w - 0.5f;
+    const float fy = uv.y * h - 0.5f;
+
+    const float x0f = std::floor(fx);
+    const float y0f = std::floor(fy);
+
+    const int x0 = static_cast<int>(x0f);
+    const int y0 = static_cast<int>(y0f);
+
+    const size_t xa = static_cast<size_t>((std::clamp)(x0,     0, w - 1));
+    const size_t xb = static_cast<size_t>((std::clamp)(x0 + 1, 0, w - 1));
+    const size_t ya = static_cast<size_t>((std::clamp)(y0,     0, h - 1)) * w;
+    const size_t yb = static_cast<size_t>((std::clamp)(y0 + 1, 0, h - 1)) * w;
+
+    return { ya + xa, ya + xb, yb + xa, yb + xb, fx - x0f, fy - y0f };
+}
+
+template<typename Texel>
+Texel fetchBilinear(const Table2D<Texel> &table, const BilinearFootprint &fp)
+{
+    const Texel *texels = table.data();
+    const Texel top    = (1 - fp.tx) * texels[fp.i00] + fp.tx * texels[fp.i10];
+    const Texel bottom = (1 - fp.tx) * texels[fp.i01] + fp.tx * texels[fp.i11];
+    return (1 - fp.ty) * top + fp.ty * bottom;
+}
+
+template<typename Texel>
+Texel sampleBilinear(const Table2D<Texel> &table, const Float2 &uv)
+{
+    return fetchBilinear(
+        table, computeBilinearFootprint(table.getResolution(), uv));
+}
+
+// trilinear lookup with clamp addressing, matching the same sampler on a
+// 3d texture
+template<typename Texel>
+Texel sampleTrilinear(const Table3D<Texel> &table, const Float3 &uvw)
+{
+    const Int3 &res = table.getResolution();
+
+    auto footprint = [](int size, float u, int &i0, int &i1, float &t)
+    {
+        const float f  = u * size - 0.5f;
+        const float f0 = std::floor(f);
+        const int   i  = static_cast<int>(f0);
+        i0 = (std::clamp)(i,     0, size - 1);
+        i1 = (std::clamp)(i + 1, 0, size - 1);
+        t  = f - f0;
+    };
+
+    int x0, x1, y0, y1, z0, z1;
+    float tx, ty, tz;
+    footprint(res.x, uvw.x, x0, x1, tx);
+    footprint(res.y, uvw.y, y0, y1, ty);
+    footprint(res.z, uvw.z, z0, z1, tz);
+
+    auto bilinear = [&](int z)
+    {
+        const Texel top    = (1 - tx) * table(x0, y0, z) + tx * table(x1, y0, z);
+        const Texel bottom = (1 - tx) * table(x0, y1, z) + tx * table(x1, y1, z);
+        return (1 - ty) * top + ty * bottom;
+    };
+
+    return (1 - tz) * bilinear(z0) + tz * bilinear(z1);
+}
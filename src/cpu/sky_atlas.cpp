@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <cmath>
+
+#include "./parallel.h"
+#include "./profiler.h"
+#include "./sky_atlas.h"
+#include "./sky_lut.h"
+
+namespace
+{
+
+    // position of x on a grid of count points over [0, 1]
+    void findInterval(float x, int count, int &i0, int &i1, float &t)
+    {
+        const float f = (std::clamp)(x, 0.0f, 1.0f) * (count - 1);
+        i0 = (std::min)(static_cast<int>(f), count - 1);
+        i1 = (std::min)(i0 + 1, count - 1);
+        t  = f - i0;
+    }
+
+} // namespace anonymous
+
+void CPUSkyViewAtlas::setAtmosphere(const AtmosphereProperties &atmos)
+{
+    atmos_ = atmos;
+}
+
+void CPUSkyViewAtlas::setRayMarching(int stepCount)
+{
+    stepCount_ = (std::max)(stepCount, 1);
+}
+
+void CPUSkyViewAtlas::setTransmittance(const Table2D<Float4> *T)
+{
+    T_ = T;
+}
+
+void CPUSkyViewAtlas::setMultiScattering(bool enabled, const Table2D<Float4> *M)
+{
+    enableMultiScattering_ = enabled;
+    M_ = M;
+}
+
+void CPUSkyViewAtlas::setGrid(int heightCount, int elevationCount)
+{
+    heightCount_    = (std::max)(heightCount, 2);
+    elevationCount_ = (std::max)(elevationCount, 2);
+}
+
+void CPUSkyViewAtlas::setThreadCount(int threadCount)
+{
+    threadCount_ = threadCount;
+}
+
+void CPUSkyViewAtlas::setCancelFlag(const std::atomic<bool> *cancel)
+{
+    cancel_ = cancel;
+}
+
+bool CPUSkyViewAtlas::isCanceled() const
+{
+    return cancel_ && cancel_->load(std::memory_order_relaxed);
+}
+
+bool CPUSkyViewAtlas::bake(const Int2 &res)
+{
+    ProfileZone zone("CPUSkyViewAtlas::bake");
+
+    Table3D<Float4> slices({ res.x, res.y, heightCount_ * elevationCount_ });
+
+    // one slice per task, each baked by a single thread
+    parallelForTiles(
+        { heightCount_, elevationCount_ }, { 1, 1 }, threadCount_,
+        [&](int, const Int2 &beg, const Int2 &)
+    {
+        if(isCanceled())
+            return;
+
+        const float h     = getHeight(beg.x);
+        const float alpha = getElevation(beg.y);
+
+        CPUSkyLUT lut;
+        lut.setAtmosphere(atmos_);
+        lut.setRayMarching(stepCount_);
+        lut.setTransmittance(T_);
+        lut.setMultiScattering(enableMultiScattering_, M_);
+        lut.setCamera({ 0, h, 0 });
+        lut.setSun({ std::cos(alpha), -std::sin(alpha), 0 }, Float3(1));
+        lut.setThreadCount(1);
+        lut.generate(res);
+
+        const int z = beg.y * heightCount_ + beg.x;
+        const Table2D<Float4> &table = lut.getTable();
+        std::copy(
+            table.data(), table.data() + table.getTexelCount(),
+            &slices(0, 0, z));
+    });
+
+    if(isCanceled())
+        return false;
+
+    res_    = res;
+    slices_ = std::move(slices);
+    return true;
+}
+
+bool CPUSkyViewAtlas::isAvailable() const
+{
+    return slices_.isAvailable();
+}
+
+const Int2 &CPUSkyViewAtlas::getResolution() const
+{
+    return res_;
+}
+
+void CPUSkyViewAtlas::sample(
+    float            atmosEyeHeight,
+    const Float3    &sunDirection,
+    const Float3    &sunIntensity,
+    Table2D<Float4> &output) const
+{
+    ProfileZone zone("CPUSkyViewAtlas::sample");
+
+    if(output.getWidth() != res_.x || output.getHeight() != res_.y)
+        output = Table2D<Float4>(res_);
+
+    // inverse of getHeight and getElevation
+
+    const float maxHeight = atmos_.atmosphereRadius - atmos_.planetRadius;
+    int   h0, h1;
+    float th;
+    findInterval(
+        std::sqrt((std::max)(atmosEyeHeight, 0.0f) / maxHeight),
+        heightCount_, h0, h1, th);
+
+    const float alpha = std::asin((std::clamp)(-sunDirection.y, -1.0f, 1.0f));
+    const float m     = (alpha < 0 ? -1.0f : 1.0f) * std::sqrt(std::abs(alpha) / (PI / 2));
+    int   e0, e1;
+    float te;
+    findInterval(0.5f + 0.5f * m, elevationCount_, e0, e1, te);
+
+    const int z[4] = {
+        e0 * heightCount_ + h0, e0 * heightCount_ + h1,
+        e1 * heightCount_ + h0, e1 * heightCount_ + h1
+    };
+    const float w[4] = {
+        (1 - te) * (1 - th), (1 - te) * th, te * (1 - th), te * th
+    };
+
+    // the sun azimuth turns into a shift of every row by the same number
+    // of texels, so all texels share the same pair of columns and weight
+    const float phi        = std::atan2(sunDirection.z, sunDirection.x);
+    const float shift      = -phi / (2 * PI) * res_.x;
+    const float shiftFloor = std::floor(shift);
+    const float tx         = shift - shiftFloor;
+    const int   x0         = ((static_cast<int>(shiftFloor) % res_.x) + res_.x) % res_.x;
+
+    const Float4 scale = { sunIntensity.x, sunIntensity.y, sunIntensity.z, 1 };
+
+    for(int y = 0; y < res_.y; ++y)
+    {
+        for(int x = 0; x < res_.x; ++x)
+        {
+            const int xa = (x + x0) % res_.x;
+            const int xb = (xa + 1) % res_.x;
+
+            Float4 sum;
+            for(int i = 0; i < 4; ++i)
+            {
+                sum += w[i] * ((1 - tx) * slices_(xa, y, z[i]) +
+                                    tx  * slices_(xb, y, z[i]));
+            }
+            output(x, y) = scale * sum;
+        }
+    }
+}
+
+float CPUSkyViewAtlas::getHeight(int index) const
+{
+    const float s = static_cast<float>(index) / (heightCount_ - 1);
+    return s * s * (atmos_.atmosphereRadius - atmos_.planetRadius);
+}
+
+float CPUSkyViewAtlas::getElevation(int index) const
+{
+    const float m = 2.0f * index / (elevationCount_ - 1) - 1;
+    return (m < 0 ? -1.0f : 1.0f) * (PI / 2) * m * m;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+
+#include "../medium.h"
+#include "./table.h"
+
+// sky view tables precomputed over a grid of eye heights and sun
+// elevations, once per atmosphere. a sky view LUT only depends on the eye
+// height, the sun direction and the sun intensity: the intensity is a
+// linear scale, and the table of any sun azimuth is the one baked with the
+// sun at azimuth 0 shifted in u. sample() then interpolates the four slices
+// around the eye height and sun elevation in place of CPUSkyLUT::generate,
+// replacing the ray march of every texel by a few lerps.
+//
+// heights are spaced quadratically from the ground to the top of the
+// atmosphere, and elevations with the same quadratic mapping as the v axis
+// of the sky view, so slices are dense where the sky changes fastest.
+class CPUSkyViewAtlas
+{
+public:
+
+    void setAtmosphere(const AtmosphereProperties &atmos);
+
+    void setRayMarching(int stepCount);
+
+    // T must stay alive until bake() returns
+    void setTransmittance(const Table2D<Float4> *T);
+
+    void setMultiScattering(bool enabled, const Table2D<Float4> *M);
+
+    // an odd elevation count puts a slice at the horizon
+    void setGrid(int heightCount, int elevationCount);
+
+    void setThreadCount(int threadCount);
+
+    // bake() polls this flag between slices and gives up once it's set
+    void setCancelFlag(const std::atomic<bool> *cancel);
+
+    // res is the resolution of every slice and of the sampled tables.
+    // returns false when canceled, in which case the atlas is left unchanged
+    bool bake(const Int2 &res);
+
+    bool isAvailable() const;
+
+    const Int2 &getResolution() const;
+
+    // sky view of an eye atmosEyeHeight km above the ground, in the layout
+    // of CPUSkyLUT::getTable
+    void sample(
+        float            atmosEyeHeight,
+        const Float3    &sunDirection,
+        const Float3    &sunIntensity,
+        Table2D<Float4> &output) const;
+
+private:
+
+    bool isCanceled() const;
+
+    float getHeight(int index) const;
+
+    float getElevation(int index) const;
+
+    AtmosphereProperties atmos_;
+
+    int stepCount_   = 40;
+    int threadCount_ = 0;
+
+    const std::atomic<bool> *cancel_ = nullptr;
+
+    const Table2D<Float4> *T_ = nullptr;
+    const Table2D<Float4> *M_ = nullptr;
+
+    bool enableMultiScattering_ = false;
+
+    int heightCount_    = 16;
+    int elevationCount_ = 33;
+
+    Int2 res_;
+
+    // slice (height i, elevation j) is z = j * heightCount_ + i
+    Table3D<Float4> slices_;
+};
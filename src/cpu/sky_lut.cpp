@@ -0,0 +1,399 @@
+#include "./intersection.h"
+#include "./parallel.h"
+#include "./profiler.h"
+#include "./sampler.h"
+#include "./sky_lut.h"
+#include "./transmittance.h"
+
+namespace
+{
+
+    // uniform cells an adaptive march starts from
+    constexpr int ADAPTIVE_INITIAL_CELL_COUNT = 4;
+
+} // namespace anonymous
+
+std::vector<float> computeSkyViewRowPriorities(int rowCount)
+{
+    std::vector<float> result(rowCount);
+    for(int y = 0; y < rowCount; ++y)
+    {
+        const float vm = 2 * (y + 0.5f) / rowCount - 1;
+        result[y] = 2 - std::abs(vm);
+    }
+    return result;
+}
+
+void CPUSkyLUT::setCamera(const Float3 &atmosEyePos)
+{
+    atmosEyePos_ = atmosEyePos;
+    inputsChanged_ = true;
+}
+
+void CPUSkyLUT::setRayMarching(int stepCount)
+{
+    stepCount_ = (std::max)(stepCount, 1);
+    inputsChanged_ = true;
+}
+
+void CPUSkyLUT::setQuadrature(QuadratureScheme scheme)
+{
+    scheme_ = scheme;
+    inputsChanged_ = true;
+}
+
+void CPUSkyLUT::setAdaptiveRayMarching(
+    bool enabled, float tolerance, int maxStepCount)
+{
+    enableAdaptive_ = enabled;
+    adaptive_       = AdaptiveRayMarch(tolerance, maxStepCount);
+
+    inputsChanged_ = true;
+}
+
+void CPUSkyLUT::setAtmosphere(const AtmosphereProperties &atmos)
+{
+    atmos_ = atmos;
+    inputsChanged_ = true;
+}
+
+void CPUSkyLUT::setSun(const Float3 &direction, const Float3 &intensity)
+{
+    sunDirection_ = direction;
+    sunIntensity_ = intensity;
+
+    inputsChanged_ = true;
+}
+
+void CPUSkyLUT::setTransmittance(const Table2D<Float4> *T)
+{
+    T_ = T;
+    inputsChanged_ = true;
+}
+
+void CPUSkyLUT::setMultiScattering(bool enabled, const Table2D<Float4> *M)
+{
+    enableMultiScattering_ = enabled;
+    M_ = M;
+
+    inputsChanged_ = true;
+}
+
+void CPUSkyLUT::setThreadCount(int threadCount)
+{
+    threadCount_ = threadCount;
+}
+
+void CPUSkyLUT::generate(const Int2 &res)
+{
+    ProfileZone zone("CPUSkyLUT::generate");
+
+    Table2D<Float4> table(res);
+    Table2D<int>    sampleCounts(res);
+
+    const int maxSampleCount = prepareRayMarching();
+
+    parallelForTiles(
+        res, { res.x, 1 }, threadCount_,
+        [&](int, const Int2 &beg, const Int2 &end)
+    {
+        Scratch scratch = createScratch(maxSampleCount);
+        for(int y = beg.y; y < end.y; ++y)
+        {
+            const int rowSampleCount = computeRow(res, y, table, scratch);
+            for(int x = 0; x < res.x; ++x)
+                sampleCounts(x, y) = rowSampleCount;
+        }
+    });
+
+    table_        = std::move(table);
+    sampleCounts_ = std::move(sampleCounts);
+
+    inputsChanged_ = false;
+    schedule_.reset(res.y, computeSkyViewRowPriorities(res.y));
+}
+
+void CPUSkyLUT::update(const Int2 &res, const AmortizedUpdateSettings &settings)
+{
+    ProfileZone zone("CPUSkyLUT::update");
+
+    if(table_.getWidth() != res.x || table_.getHeight() != res.y)
+    {
+        generate(res);
+        return;
+    }
+
+    if(inputsChanged_)
+    {
+        schedule_.markAllStale();
+        inputsChanged_ = false;
+    }
+
+    const int maxSampleCount = prepareRayMarching();
+
+    schedule_.run(settings, threadCount_, [&](int y)
+    {
+        Scratch scratch = createScratch(maxSampleCount);
+
+        const int rowSampleCount = computeRow(res, y, table_, scratch);
+        for(int x = 0; x < res.x; ++x)
+            sampleCounts_(x, y) = rowSampleCount;
+    });
+}
+
+const AmortizedSchedule &CPUSkyLUT::getSchedule() const
+{
+    return schedule_;
+}
+
+const Table2D<Float4> &CPUSkyLUT::getTable() const
+{
+    return table_;
+}
+
+const Table2D<int> &CPUSkyLUT::getSampleCounts() const
+{
+    return sampleCounts_;
+}
+
+int CPUSkyLUT::prepareRayMarching()
+{
+    quadrature_ = RayQuadrature(scheme_, stepCount_, atmos_);
+    return enableAdaptive_ ?
+        (std::max)(ADAPTIVE_INITIAL_CELL_COUNT, adaptive_.getMaxSampleCount()) :
+        quadrature_.getSampleCount();
+}
+
+CPUSkyLUT::Scratch CPUSkyLUT::createScratch(int maxSampleCount)
+{
+    Scratch scratch;
+    scratch.h           .resize(maxSampleCount);
+    scratch.t           .resize(maxSampleCount);
+    scratch.w           .resize(maxSampleCount);
+    scratch.u           .resize(maxSampleCount);
+    scratch.sinSunTheta .resize(maxSampleCount);
+    scratch.insideShadow.resize(maxSampleCount);
+    scratch.opticalDepth.resize(maxSampleCount);
+    for(int c = 0; c < 3; ++c)
+    {
+        scratch.sigmaS[c]  .resize(maxSampleCount);
+        scratch.eyeTrans[c].resize(maxSampleCount);
+        scratch.rho[c]     .resize(maxSampleCount);
+    }
+    return scratch;
+}
+
+int CPUSkyLUT::computeRow(
+    const Int2 &res, int y, Table2D<Float4> &table, Scratch &scratch) const
+{
+    const float v        = (y + 0.5f) / res.y;
+    const float vm       = 2 * v - 1;
+    const float theta    = (vm < 0 ? -1.0f : (vm > 0 ? 1.0f : 0.0f)) * (PI / 2) * vm * vm;
+    const float sinTheta = std::sin(theta);
+    const float cosTheta = std::cos(theta);
+
+    const Float2 planetOri = { 0, atmosEyePos_.y + atmos_.planetRadius };
+    const Float2 planetDir = { cosTheta, sinTheta };
+
+    // find end point
+
+    float endT = 0;
+    if(!findClosestIntersectionWithCircle(
+        planetOri, planetDir, atmos_.planetRadius, endT))
+    {
+        findClosestIntersectionWithCircle(
+            planetOri, planetDir, atmos_.atmosphereRadius, endT);
+    }
+
+    // sample heights, extinction and eye transmittance only depend on the
+    // elevation, so they are shared by all texels of the row
+
+    int sampleCount;
+    if(enableAdaptive_)
+        sampleCount = placeAdaptive(planetOri, planetDir, endT, scratch);
+    else
+    {
+        sampleCount = quadrature_.getSampleCount();
+        quadrature_.place(
+            planetOri.y, sinTheta, 0, endT, scratch.t.data(), scratch.w.data());
+    }
+
+    for(int i = 0; i < sampleCount; ++i)
+    {
+        const Float2 posR = planetOri + scratch.t[i] * planetDir;
+        scratch.h[i] = posR.length() - atmos_.planetRadius;
+    }
+
+    const Float3Batch sigmaS = {
+        scratch.sigmaS[0].data(), scratch.sigmaS[1].data(), scratch.sigmaS[2].data()
+    };
+    const Float3Batch eyeTrans = {
+        scratch.eyeTrans[0].data(), scratch.eyeTrans[1].data(), scratch.eyeTrans[2].data()
+    };
+
+    atmos_.getSigmaST(sampleCount, scratch.h.data(), sigmaS, eyeTrans);
+
+    // eye transmittance to each sample, evaluated in place of sigmaT once
+    // the optical depth prefix is known
+
+    for(int c = 0; c < 3; ++c)
+    {
+        float *sT    = scratch.eyeTrans[c].data();
+        float *depth = scratch.opticalDepth.data();
+
+        if(enableAdaptive_)
+            AdaptiveRayMarch::accumulate(sampleCount, scratch.w.data(), sT, 0, depth);
+        else
+            quadrature_.accumulate(scratch.w.data(), sT, 0, depth);
+        for(int i = 0; i < sampleCount; ++i)
+            depth[i] = -depth[i];
+
+        expBatch(sampleCount, depth, sT);
+    }
+
+    for(int x = 0; x < res.x; ++x)
+    {
+        const float  u = (x + 0.5f) / res.x;
+        const Float3 L = computeTexel(u, cosTheta, sinTheta, sampleCount, scratch);
+        table(x, y) = Float4(L.x, L.y, L.z, 1);
+    }
+
+    return sampleCount;
+}
+
+int CPUSkyLUT::placeAdaptive(
+    const Float2 &planetOri,
+    const Float2 &planetDir,
+    float         endT,
+    Scratch      &scratch) const
+{
+    // the row's ray turned towards the sun azimuth, in the plane spanned by
+    // the up axis and the horizontal sun direction
+    const Float3 toSun  = -sunDirection_;
+    const Float3 sunDir = {
+        std::sqrt(toSun.x * toSun.x + toSun.z * toSun.z), toSun.y, 0
+    };
+
+    auto average = [](const Float3 &c)
+    {
+        return (c.x + c.y + c.z) / 3;
+    };
+
+    auto estimate = [&](float t)
+    {
+        const Float2 pos2 = planetOri + t * planetDir;
+        const Float3 posR = { pos2.x, pos2.y, 0 };
+        const float  r    = posR.length();
+        const float  h    = r - atmos_.planetRadius;
+
+        float source = 0;
+        if(!hasIntersectionWithSphere(posR, sunDir, atmos_.planetRadius))
+        {
+            const float  cosSun   = (std::clamp)(dot(sunDir, posR) / r, -1.0f, 1.0f);
+            const Float2 uvT      = encodeTransmittanceUV(
+                atmos_, T_->getResolution(), h, cosSun);
+            const Float3 sunTrans = sampleBilinear(*T_, uvT).xyz();
+            source = average(atmos_.getSigmaS(h) * sunTrans);
+        }
+
+        return Float2(average(atmos_.getSigmaT(h)), source);
+    };
+
+    float bounds[ADAPTIVE_INITIAL_CELL_COUNT + 1];
+    for(int i = 0; i <= ADAPTIVE_INITIAL_CELL_COUNT; ++i)
+        bounds[i] = endT * i / ADAPTIVE_INITIAL_CELL_COUNT;
+
+    return adaptive_.place(
+        bounds, ADAPTIVE_INITIAL_CELL_COUNT, estimate, scratch.adaptive,
+        scratch.t.data(), scratch.w.data());
+}
+
+Float3 CPUSkyLUT::computeTexel(
+    float    u,
+    float    cosTheta,
+    float    sinTheta,
+    int      sampleCount,
+    Scratch &scratch) const
+{
+    const float phi = 2 * PI * u;
+
+    const Float3 dir = {
+        std::cos(phi) * cosTheta, sinTheta, std::sin(phi) * cosTheta
+    };
+
+    const float phaseU = dot(sunDirection_, -dir);
+
+    const Float3 oriR = { 0, atmosEyePos_.y + atmos_.planetRadius, 0 };
+
+    for(int i = 0; i < sampleCount; ++i)
+    {
+        const Float3 posR = oriR + dir * scratch.t[i];
+
+        // sunTheta = PI / 2 - acos(cosSun), so sin(sunTheta) is just cosSun
+        const float cosSun = (std::clamp)(
+            dot(-sunDirection_, posR) / (scratch.h[i] + atmos_.planetRadius),
+            -1.0f, 1.0f);
+
+        scratch.u[i]            = phaseU;
+        scratch.sinSunTheta[i]  = cosSun;
+        scratch.insideShadow[i] = hasIntersectionWithSphere(
+            posR, -sunDirection_, atmos_.planetRadius) ? 1.0f : 0.0f;
+    }
+
+    const Float3Batch rho = {
+        scratch.rho[0].data(), scratch.rho[1].data(), scratch.rho[2].data()
+    };
+
+    atmos_.evalPhaseFunction(
+        sampleCount, scratch.h.data(), scratch.u.data(), rho);
+
+    // ray march, see marchStep in asset/sky_lut.hlsl
+
+    const float heightRange = atmos_.atmosphereRadius - atmos_.planetRadius;
+
+    // transmittance and multi-scattering share the same parameterization,
+    // unless the transmittance LUT uses the Horizon one
+    const bool linearT = atmos_.transmittanceParam ==
+                         TransmittanceParameterization::Linear;
+
+    const bool enableMultiScattering = enableMultiScattering_ && M_;
+    const bool sameRes = enableMultiScattering && linearT &&
+                         M_->getWidth()  == T_->getWidth() &&
+                         M_->getHeight() == T_->getHeight();
+
+    Float3 inScatter;
+    for(int i = 0; i < sampleCount; ++i)
+    {
+        const float  dt = scratch.w[i];
+        const Float3 sS = {
+            scratch.sigmaS[0][i], scratch.sigmaS[1][i], scratch.sigmaS[2][i]
+        };
+        const Float3 eT = {
+            scratch.eyeTrans[0][i], scratch.eyeTrans[1][i], scratch.eyeTrans[2][i]
+        };
+
+        const Float2 uv = {
+            scratch.h[i] / heightRange, 0.5f + 0.5f * scratch.sinSunTheta[i]
+        };
+        const Float2 uvT = linearT ? uv : encodeTransmittanceUV(
+            atmos_, T_->getResolution(), scratch.h[i], scratch.sinSunTheta[i]);
+
+        const BilinearFootprint fpT = computeBilinearFootprint(T_->getResolution(), uvT);
+
+        if(scratch.insideShadow[i] == 0)
+        {
+            const Float3 r        = { rho.r[i], rho.g[i], rho.b[i] };
+            const Float3 sunTrans = fetchBilinear(*T_, fpT).xyz();
+            inScatter += dt * eT * sS * r * sunTrans;
+        }
+
+        if(enableMultiScattering)
+        {
+            const Float3 ms = sameRes ?
+                fetchBilinear(*M_, fpT).xyz() : sampleBilinear(*M_, uv).xyz();
+            inScatter += dt * eT * sS * ms;
+        }
+    }
+
+    return inScatter * sunIntensity_;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "../medium.h"
+#include "./adaptive_march.h"
+#include "./amortized_update.h"
+#include "./quadrature.h"
+#include "./table.h"
+
+// weights of sky view rows for AmortizedOrder::Priority. the sky changes
+// fastest around the horizon, which also covers most of the screen.
+std::vector<float> computeSkyViewRowPriorities(int rowCount);
+
+// CPU backend of SkyLUT, port of PSMain in asset/sky_lut.hlsl. Rows are
+// evaluated in parallel and the output uses the same layout as the render
+// target: row 0 looks straight down, the last row straight up.
+class CPUSkyLUT
+{
+public:
+
+    void setCamera(const Float3 &atmosEyePos);
+
+    void setRayMarching(int stepCount);
+
+    // sample placement of the ray march, Midpoint by default as on the GPU
+    void setQuadrature(QuadratureScheme scheme);
+
+    // replaces the fixed steps with an AdaptiveRayMarch of up to
+    // maxStepCount samples, which starts from a few uniform cells. the
+    // in-scattering estimate follows the sun azimuth, where it varies most.
+    void setAdaptiveRayMarching(bool enabled, float tolerance, int maxStepCount);
+
+    void setAtmosphere(const AtmosphereProperties &atmos);
+
+    void setSun(const Float3 &direction, const Float3 &intensity);
+
+    // T must stay alive until generate() returns
+    void setTransmittance(const Table2D<Float4> *T);
+
+    void setMultiScattering(bool enabled, const Table2D<Float4> *M);
+
+    void setThreadCount(int threadCount);
+
+    void generate(const Int2 &res);
+
+    // amortized alternative to generate(): refreshes the rows that an
+    // AmortizedSchedule picks within settings.budgetUs, and leaves the
+    // others at the values of previous calls. any setter call since the
+    // last update marks all rows stale. falls back to generate() when the
+    // table has another resolution.
+    void update(const Int2 &res, const AmortizedUpdateSettings &settings);
+
+    const AmortizedSchedule &getSchedule() const;
+
+    const Table2D<Float4> &getTable() const;
+
+    // samples along the ray of every texel in the last generate(). all
+    // texels of a row share theirs.
+    const Table2D<int> &getSampleCounts() const;
+
+private:
+
+    struct Scratch
+    {
+        std::vector<float> h;
+        std::vector<float> t;
+        std::vector<float> w;
+        std::vector<float> u;
+        std::vector<float> sinSunTheta;
+        std::vector<float> insideShadow;
+        std::vector<float> sigmaS[3];
+        std::vector<float> eyeTrans[3];
+        std::vector<float> rho[3];
+        std::vector<float> opticalDepth;
+
+        AdaptiveRayMarch::Scratch adaptive;
+    };
+
+    // quadrature_ for this pass, returns the sample capacity of a Scratch
+    int prepareRayMarching();
+
+    static Scratch createScratch(int maxSampleCount);
+
+    // returns the sample count of the row
+    int computeRow(
+        const Int2 &res, int y, Table2D<Float4> &table, Scratch &scratch) const;
+
+    // places the samples of a row to scratch.t and scratch.w
+    int placeAdaptive(
+        const Float2 &planetOri,
+        const Float2 &planetDir,
+        float         endT,
+        Scratch      &scratch) const;
+
+    Float3 computeTexel(
+        float    u,
+        float    cosTheta,
+        float    sinTheta,
+        int      sampleCount,
+        Scratch &scratch) const;
+
+    Float3 atmosEyePos_;
+    int    stepCount_   = 40;
+    int    threadCount_ = 0;
+
+    QuadratureScheme scheme_ = QuadratureScheme::Midpoint;
+    RayQuadrature    quadrature_;
+
+    bool             enableAdaptive_ = false;
+    AdaptiveRayMarch adaptive_;
+
+    AtmosphereProperties atmos_;
+
+    Float3 sunDirection_ = { 0, -1, 0 };
+    Float3 sunIntensity_ = Float3(1);
+
+    const Table2D<Float4> *T_ = nullptr;
+    const Table2D<Float4> *M_ = nullptr;
+
+    bool enableMultiScattering_ = false;
+
+    Table2D<Float4> table_;
+    Table2D<int>    sampleCounts_;
+
+    bool              inputsChanged_ = true;
+    AmortizedSchedule schedule_;
+};
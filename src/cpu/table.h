@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+
+#include "../common_math.h"
+
+// row-major texel storage with the same layout as a mapped D3D11 texture
+template<typename Texel>
+class Table2D
+{
+public:
+
+    Table2D() = default;
+
+    explicit Table2D(const Int2 &res, const Texel &init = Texel{})
+        : res_(res), data_(static_cast<size_t>(res.x) * res.y, init)
+    {
+        
+    }
+
+    const Int2 &getResolution() const { return res_; }
+
+    int getWidth()  const { return res_.x; }
+    int getHeight() const { return res_.y; }
+
+    bool isAvailable() const { return !data_.empty(); }
+
+    Texel &operator()(int x, int y)
+    {
+        return data_[static_cast<size_t>(y) * res_.x + x];
+    }
+
+    const Texel &operator()(int x, int y) const
+    {
+        return data_[static_cast<size_t>(y) * res_.x + x];
+    }
+
+    Texel       *data()       { return data_.data(); }
+    const Texel *data() const { return data_.data(); }
+
+    size_t getTexelCount() const { return data_.size(); }
+
+private:
+
+    Int2               res_;
+    std::vector<Texel> data_;
+};
+
+// slice-major texel storage with the same layout as a mapped D3D11 3d
+// texture: x fastest, then y, then z
+template<typename Texel>
+class Table3D
+{
+public:
+
+    Table3D() = default;
+
+    explicit Table3D(const Int3 &res, const Texel &init = Texel{})
+        : res_(res), data_(static_cast<size_t>(res.x) * res.y * res.z, init)
+    {
+        
+    }
+
+    const Int3 &getResolution() const { return res_; }
+
+    int getWidth()  const { return res_.x; }
+    int getHeight() const { return res_.y; }
+    int getDepth()  const { return res_.z; }
+
+    bool isAvailable() const { return !data_.empty(); }
+
+    Texel &operator()(int x, int y, int z)
+    {
+        return data_[(static_cast<size_t>(z) * res_.y + y) * res_.x + x];
+    }
+
+    const Texel &operator()(int x, int y, int z) const
+    {
+        return data_[(static_cast<size_t>(z) * res_.y + y) * res_.x + x];
+    }
+
+    Texel       *data()       { return data_.data(); }
+    const Texel *data() const { return data_.data(); }
+
+    size_t getTexelCount() const { return data_.size(); }
+
+private:
+
+    Int3               res_;
+    std::vector<Texel> data_;
+};
@@ -0,0 +1,204 @@
+#include <cmath>
+#include <cstring>
+
+#include "./texel_format.h"
+
+namespace
+{
+
+    uint32_t floatBits(float f)
+    {
+        uint32_t u;
+        std::memcpy(&u, &f, sizeof(u));
+        return u;
+    }
+
+    float bitsToFloat(uint32_t u)
+    {
+        float f;
+        std::memcpy(&f, &u, sizeof(f));
+        return f;
+    }
+
+    constexpr int RGB9E5_EXP_BIAS       = 15;
+    constexpr int RGB9E5_MANTISSA_BITS  = 9;
+    constexpr int RGB9E5_MAX_VALID_EXP  = 31;
+    constexpr float RGB9E5_MAX_VALUE    =
+        float(511) / 512 * float(1 << (RGB9E5_MAX_VALID_EXP - RGB9E5_EXP_BIAS));
+
+} // namespace anonymous
+
+size_t getTexelSize(LUTTexelFormat format)
+{
+    switch(format)
+    {
+    case LUTTexelFormat::RGBA32F: return 16;
+    case LUTTexelFormat::RGBA16F: return 8;
+    case LUTTexelFormat::RGB9E5:  return 4;
+    }
+    return 0;
+}
+
+const char *getTexelFormatName(LUTTexelFormat format)
+{
+    switch(format)
+    {
+    case LUTTexelFormat::RGBA32F: return "rgba32f";
+    case LUTTexelFormat::RGBA16F: return "rgba16f";
+    case LUTTexelFormat::RGB9E5:  return "rgb9e5";
+    }
+    return "unknown";
+}
+
+bool hasTexelAlpha(LUTTexelFormat format)
+{
+    return format != LUTTexelFormat::RGB9E5;
+}
+
+uint16_t floatToHalf(float f)
+{
+    const uint32_t u    = floatBits(f);
+    const uint32_t sign = (u >> 16) & 0x8000;
+    const uint32_t absU = u & 0x7fffffff;
+
+    // nan / inf
+    if(absU >= 0x7f800000)
+        return static_cast<uint16_t>(sign | 0x7c00 | (absU > 0x7f800000 ? 0x200 : 0));
+
+    // overflow to inf
+    if(absU >= 0x477ff000)
+        return static_cast<uint16_t>(sign | 0x7c00);
+
+    // subnormal half or zero
+    if(absU < 0x38800000)
+    {
+        const float absF = bitsToFloat(absU);
+        const auto m = static_cast<uint32_t>(std::nearbyint(absF * 16777216.0f));
+        return static_cast<uint16_t>(sign | m);
+    }
+
+    // normal: rebias exponent and round mantissa to nearest even
+    const uint32_t rounded = absU + 0xfff + ((absU >> 13) & 1);
+    return static_cast<uint16_t>(sign | ((rounded - 0x38000000) >> 13));
+}
+
+float halfToFloat(uint16_t h)
+{
+    const uint32_t sign = (static_cast<uint32_t>(h) & 0x8000) << 16;
+    const uint32_t exp  = (h >> 10) & 0x1f;
+    const uint32_t mant = h & 0x3ff;
+
+    if(exp == 0)
+    {
+        const float f = static_cast<float>(mant) * (1.0f / 16777216.0f);
+        return sign ? -f : f;
+    }
+    if(exp == 31)
+        return bitsToFloat(sign | 0x7f800000 | (mant << 13));
+    return bitsToFloat(sign | ((exp + 112) << 23) | (mant << 13));
+}
+
+uint32_t packRGB9E5(const Float3 &rgb)
+{
+    auto clampChannel = [](float c)
+    {
+        return (std::min)((std::max)(c, 0.0f), RGB9E5_MAX_VALUE);
+    };
+
+    const float r = clampChannel(rgb.x);
+    const float g = clampChannel(rgb.y);
+    const float b = clampChannel(rgb.z);
+
+    const float maxRGB = (std::max)((std::max)(r, g), b);
+
+    int sharedExp = (std::max)(
+        -RGB9E5_EXP_BIAS - 1,
+        static_cast<int>(std::floor(std::log2((std::max)(maxRGB, 1e-30f)))))
+        + 1 + RGB9E5_EXP_BIAS;
+
+    float denom = std::exp2(static_cast<float>(
+        sharedExp - RGB9E5_EXP_BIAS - RGB9E5_MANTISSA_BITS));
+
+    const int maxM = static_cast<int>(std::floor(maxRGB / denom + 0.5f));
+    if(maxM == (1 << RGB9E5_MANTISSA_BITS))
+    {
+        denom *= 2;
+        ++sharedExp;
+    }
+
+    const auto rm = static_cast<uint32_t>(std::floor(r / denom + 0.5f));
+    const auto gm = static_cast<uint32_t>(std::floor(g / denom + 0.5f));
+    const auto bm = static_cast<uint32_t>(std::floor(b / denom + 0.5f));
+
+    return rm | (gm << 9) | (bm << 18) |
+           (static_cast<uint32_t>(sharedExp) << 27);
+}
+
+Float3 unpackRGB9E5(uint32_t packed)
+{
+    const int sharedExp = static_cast<int>(packed >> 27);
+    const float scale = std::exp2(static_cast<float>(
+        sharedExp - RGB9E5_EXP_BIAS - RGB9E5_MANTISSA_BITS));
+    return {
+        scale * static_cast<float>(packed         & 0x1ff),
+        scale * static_cast<float>((packed >> 9)  & 0x1ff),
+        scale * static_cast<float>((packed >> 18) & 0x1ff)
+    };
+}
+
+void encodeTexels(
+    LUTTexelFormat format, const Float4 *src, size_t count, void *dst)
+{
+    switch(format)
+    {
+    case LUTTexelFormat::RGBA32F:
+        std::memcpy(dst, src, sizeof(Float4) * count);
+        break;
+    case LUTTexelFormat::RGBA16F:
+        {
+            auto out = static_cast<uint16_t *>(dst);
+            for(size_t i = 0; i < count; ++i)
+            {
+                for(int c = 0; c < 4; ++c)
+                    out[4 * i + c] = floatToHalf(src[i][c]);
+            }
+        }
+        break;
+    case LUTTexelFormat::RGB9E5:
+        {
+            auto out = static_cast<uint32_t *>(dst);
+            for(size_t i = 0; i < count; ++i)
+                out[i] = packRGB9E5(src[i].xyz());
+        }
+        break;
+    }
+}
+
+Float4 decodeTexel(LUTTexelFormat format, const void *src, size_t index)
+{
+    switch(format)
+    {
+    case LUTTexelFormat::RGBA32F:
+        {
+            Float4 result;
+            std::memcpy(
+                &result, static_cast<const Float4 *>(src) + index,
+                sizeof(Float4));
+            return result;
+        }
+    case LUTTexelFormat::RGBA16F:
+        {
+            auto in = static_cast<const uint16_t *>(src) + 4 * index;
+            return Float4(
+                halfToFloat(in[0]), halfToFloat(in[1]),
+                halfToFloat(in[2]), halfToFloat(in[3]));
+        }
+    case LUTTexelFormat::RGB9E5:
+        {
+            const Float3 rgb = unpackRGB9E5(
+                static_cast<const uint32_t *>(src)[index]);
+            return Float4(rgb.x, rgb.y, rgb.z, 1);
+        }
+    }
+    return Float4(0, 0, 0, 0);
+}
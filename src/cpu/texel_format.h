@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../common_math.h"
+
+// payload encodings of LUT files. each maps directly to a DXGI format so a
+// mapped payload can be uploaded without conversion.
+enum class LUTTexelFormat : uint32_t
+{
+    RGBA32F = 0, // DXGI_FORMAT_R32G32B32A32_FLOAT
+    RGBA16F = 1, // DXGI_FORMAT_R16G16B16A16_FLOAT
+    RGB9E5  = 2, // DXGI_FORMAT_R9G9B9E5_SHAREDEXP, alpha is dropped
+};
+
+size_t getTexelSize(LUTTexelFormat format);
+
+const char *getTexelFormatName(LUTTexelFormat format);
+
+// false when the encoding drops alpha, which then decodes as 1
+bool hasTexelAlpha(LUTTexelFormat format);
+
+uint16_t floatToHalf(float f);
+
+float halfToFloat(uint16_t h);
+
+// shared exponent encoding following the D3D11 conversion rules. negative
+// values are clamped to 0 and values above 65408 to 65408.
+uint32_t packRGB9E5(const Float3 &rgb);
+
+Float3 unpackRGB9E5(uint32_t packed);
+
+// encode count texels into dst, which must hold count * getTexelSize(format)
+void encodeTexels(
+    LUTTexelFormat format, const Float4 *src, size_t count, void *dst);
+
+Float4 decodeTexel(LUTTexelFormat format, const void *src, size_t index);
@@ -0,0 +1,292 @@
+#include "./intersection.h"
+#include "./optical_depth.h"
+#include "./parallel.h"
+#include "./profiler.h"
+#include "./sampler.h"
+#include "./transmittance.h"
+
+namespace
+{
+
+    // maps [0, 1] to the centers of the first and last of n texels
+    float toTexelCenters(float x, int n)
+    {
+        return n > 1 ? 0.5f / n + x * (1 - 1.0f / n) : 0.5f;
+    }
+
+    float fromTexelCenters(float u, int n)
+    {
+        return n > 1 ? (u - 0.5f / n) / (1 - 1.0f / n) : 0.5f;
+    }
+
+    // the texels next to the horizon decode to rays this far (in their
+    // half's x) on their own side of it, so that rounding can't make a
+    // grazing ray of the upper half hit the ground or the other way round
+    constexpr float HORIZON_EPSILON = 1e-3f;
+
+} // namespace anonymous
+
+void CPUTransmittanceLUT::setMode(TransmittanceMode mode)
+{
+    mode_ = mode;
+}
+
+void CPUTransmittanceLUT::setStepCount(int stepCount)
+{
+    stepCount_ = (std::max)(stepCount, 1);
+}
+
+void CPUTransmittanceLUT::setQuadrature(QuadratureScheme scheme)
+{
+    scheme_ = scheme;
+}
+
+void CPUTransmittanceLUT::setThreadCount(int threadCount)
+{
+    threadCount_ = threadCount;
+}
+
+void CPUTransmittanceLUT::setCancelFlag(const std::atomic<bool> *cancel)
+{
+    cancel_ = cancel;
+}
+
+bool CPUTransmittanceLUT::isCanceled() const
+{
+    return cancel_ && cancel_->load(std::memory_order_relaxed);
+}
+
+bool CPUTransmittanceLUT::generate(
+    const Int2 &res, const AtmosphereProperties &atmos)
+{
+    ProfileZone zone("CPUTransmittanceLUT::generate");
+
+    Table2D<Float4> table(res);
+
+    quadrature_ = RayQuadrature(scheme_, stepCount_, atmos);
+    const int sampleCount = quadrature_.getSampleCount();
+
+    constexpr int TILE_SIZE_X = 16;
+    constexpr int TILE_SIZE_Y = 16;
+
+    parallelForTiles(
+        res, { TILE_SIZE_X, TILE_SIZE_Y }, threadCount_,
+        [&](int, const Int2 &beg, const Int2 &end)
+    {
+        if(isCanceled())
+            return;
+
+        Scratch scratch;
+        if(mode_ == TransmittanceMode::RayMarch)
+        {
+            scratch.t.resize(sampleCount);
+            scratch.w.resize(sampleCount);
+            scratch.h.resize(sampleCount);
+            for(auto &s : scratch.sigmaT)
+                s.resize(sampleCount);
+        }
+
+        for(int y = beg.y; y < end.y; ++y)
+        {
+            for(int x = beg.x; x < end.x; ++x)
+            {
+                const Float3 T = computeTexel(atmos, res, x, y, scratch);
+                table(x, y) = Float4(T.x, T.y, T.z, 1);
+            }
+        }
+    });
+
+    if(isCanceled())
+        return false;
+
+    table_ = std::move(table);
+    return true;
+}
+
+const Table2D<Float4> &CPUTransmittanceLUT::getTable() const
+{
+    return table_;
+}
+
+Float3 CPUTransmittanceLUT::computeTexel(
+    const AtmosphereProperties &atmos,
+    const Int2                 &res,
+    int                         x,
+    int                         y,
+    Scratch                    &scratch) const
+{
+    const Float2 uv = { (x + 0.5f) / res.x, (y + 0.5f) / res.y };
+    const Float2 hs = decodeTransmittanceUV(atmos, res, uv);
+
+    const float h        = hs.x;
+    const float sinTheta = hs.y;
+
+    Float3 opticalDepth;
+    if(mode_ == TransmittanceMode::Analytic)
+        opticalDepth = computeOpticalDepth(atmos, h, sinTheta);
+    else
+        opticalDepth = rayMarchOpticalDepth(atmos, h, sinTheta, scratch);
+
+    return {
+        std::exp(-opticalDepth.x),
+        std::exp(-opticalDepth.y),
+        std::exp(-opticalDepth.z)
+    };
+}
+
+Float3 CPUTransmittanceLUT::rayMarchOpticalDepth(
+    const AtmosphereProperties &atmos,
+    float                       h,
+    float                       sinTheta,
+    Scratch                    &scratch) const
+{
+    const float theta = std::asin(sinTheta);
+
+    const Float2 o = { 0, atmos.planetRadius + h };
+    const Float2 d = { std::cos(theta), std::sin(theta) };
+
+    float t = 0;
+    if(!findClosestIntersectionWithCircle(o, d, atmos.planetRadius, t))
+        findClosestIntersectionWithCircle(o, d, atmos.atmosphereRadius, t);
+
+    const int sampleCount = quadrature_.getSampleCount();
+    quadrature_.place(
+        o.y, sinTheta, 0, t, scratch.t.data(), scratch.w.data());
+
+    for(int i = 0; i < sampleCount; ++i)
+    {
+        const Float2 pi = o + scratch.t[i] * d;
+        scratch.h[i] = pi.length() - atmos.planetRadius;
+    }
+
+    atmos.getSigmaT(
+        sampleCount, scratch.h.data(),
+        {
+            scratch.sigmaT[0].data(),
+            scratch.sigmaT[1].data(),
+            scratch.sigmaT[2].data()
+        });
+
+    Float3 sum;
+    for(int i = 0; i < sampleCount; ++i)
+    {
+        sum.x += scratch.w[i] * scratch.sigmaT[0][i];
+        sum.y += scratch.w[i] * scratch.sigmaT[1][i];
+        sum.z += scratch.w[i] * scratch.sigmaT[2][i];
+    }
+
+    return sum;
+}
+
+Float2 encodeTransmittanceUV(
+    const AtmosphereProperties &atmos,
+    const Int2                 &res,
+    float                       h,
+    float                       sinTheta)
+{
+    if(atmos.transmittanceParam == TransmittanceParameterization::Linear)
+    {
+        return {
+            h / (atmos.atmosphereRadius - atmos.planetRadius),
+            0.5f + 0.5f * sinTheta
+        };
+    }
+
+    // Bruneton, Precomputed Atmospheric Scattering: a New Implementation.
+    // rho is the distance to the horizon, d the distance to the ground or
+    // to the top of the atmosphere, and both are mapped linearly between
+    // their extremes. squared radii are only ever subtracted in factored
+    // form, and the ray distances avoid cancelling roots, so that this
+    // stays exact enough in float with radii in meters.
+
+    const float Rg = atmos.planetRadius;
+    const float Rt = atmos.atmosphereRadius;
+    const float H  = std::sqrt((Rt - Rg) * (Rt + Rg));
+
+    const float hc  = (std::clamp)(h, 0.0f, Rt - Rg);
+    const float r   = Rg + hc;
+    const float mu  = (std::clamp)(sinTheta, -1.0f, 1.0f);
+    const float rho = std::sqrt(hc * (r + Rg));
+
+    const float u = toTexelCenters(rho / H, res.x);
+
+    const int   halfResY = (std::max)(res.y / 2, 1);
+    const float rmu      = r * mu;
+    const float discG    = rmu * rmu - rho * rho;
+
+    if(mu < 0 && discG >= 0)
+    {
+        // down from the nadir in the lower half to the horizon in the middle
+        const float q    = -rmu + std::sqrt(discG);
+        const float d    = q > 0 ? rho * rho / q : 0.0f;
+        const float dMin = hc;
+        const float dMax = rho;
+        const float x    = dMax > dMin ? (d - dMin) / (dMax - dMin) : 0.0f;
+        return { u, 0.5f * toTexelCenters(x, halfResY) };
+    }
+
+    // up from the horizon in the middle to the zenith in the upper half
+    const float top2  = (Rt - r) * (Rt + r);
+    const float discT = rmu * rmu + top2;
+    const float d     = mu > 0 ? top2 / (rmu + std::sqrt(discT))
+                               : -rmu + std::sqrt(discT);
+    const float dMin  = Rt - r;
+    const float dMax  = rho + H;
+    const float x     = (std::clamp)((d - dMin) / (dMax - dMin), 0.0f, 1.0f);
+    return { u, 0.5f + 0.5f * toTexelCenters(1 - x, halfResY) };
+}
+
+Float2 decodeTransmittanceUV(
+    const AtmosphereProperties &atmos,
+    const Int2                 &res,
+    const Float2               &uv)
+{
+    if(atmos.transmittanceParam == TransmittanceParameterization::Linear)
+    {
+        return {
+            (atmos.atmosphereRadius - atmos.planetRadius) * uv.x,
+            -1 + 2 * uv.y
+        };
+    }
+
+    const float Rg = atmos.planetRadius;
+    const float Rt = atmos.atmosphereRadius;
+    const float H  = std::sqrt((Rt - Rg) * (Rt + Rg));
+
+    const float rho = H * (std::clamp)(fromTexelCenters(uv.x, res.x), 0.0f, 1.0f);
+    const float r   = std::sqrt(rho * rho + Rg * Rg);
+    const float h   = rho * rho / (r + Rg);
+
+    const int halfResY = (std::max)(res.y / 2, 1);
+
+    if(uv.y < 0.5f)
+    {
+        const float x    = (std::clamp)(
+            fromTexelCenters(2 * uv.y, halfResY), 0.0f, 1 - HORIZON_EPSILON);
+        const float dMin = h;
+        const float dMax = rho;
+        const float d    = dMin + x * (dMax - dMin);
+        const float mu   = d > 0 ? -(rho * rho + d * d) / (2 * r * d) : -1.0f;
+        return { h, (std::clamp)(mu, -1.0f, 1.0f) };
+    }
+
+    const float x    = 1 - (std::clamp)(
+        fromTexelCenters(2 * uv.y - 1, halfResY), HORIZON_EPSILON, 1.0f);
+    const float dMin = Rt - r;
+    const float dMax = rho + H;
+    const float d    = dMin + x * (dMax - dMin);
+    const float top2 = (Rt - r) * (Rt + r);
+    const float mu   = d > 0 ? (top2 - d * d) / (2 * r * d) : 1.0f;
+    return { h, (std::clamp)(mu, -1.0f, 1.0f) };
+}
+
+Float3 sampleTransmittance(
+    const Table2D<Float4>      &T,
+    const AtmosphereProperties &atmos,
+    float                       h,
+    float                       theta)
+{
+    const Float2 uv = encodeTransmittanceUV(
+        atmos, T.getResolution(), h, std::sin(theta));
+    return sampleBilinear(T, uv).xyz();
+}
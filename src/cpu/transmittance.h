@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+
+#include "../medium.h"
+#include "./quadrature.h"
+#include "./table.h"
+
+enum class TransmittanceMode
+{
+    // midpoint ray marching, same as asset/transmittance.hlsl
+    RayMarch = 0,
+    // closed-form optical depth, see optical_depth.h. ignores the step count.
+    Analytic = 1
+};
+
+// CPU backend of TransmittanceLUT. Produces the same float4 table as
+// asset/transmittance.hlsl without touching the GPU, with texels laid out
+// by atmos.transmittanceParam.
+class CPUTransmittanceLUT
+{
+public:
+
+    void setMode(TransmittanceMode mode);
+
+    void setStepCount(int stepCount);
+
+    // sample placement of the ray march, Midpoint by default
+    void setQuadrature(QuadratureScheme scheme);
+
+    void setThreadCount(int threadCount);
+
+    // generate() polls this flag between tiles and gives up once it's set
+    void setCancelFlag(const std::atomic<bool> *cancel);
+
+    // returns false when canceled, in which case the table is left unchanged
+    bool generate(const Int2 &res, const AtmosphereProperties &atmos);
+
+    const Table2D<Float4> &getTable() const;
+
+private:
+
+    bool isCanceled() const;
+
+    struct Scratch
+    {
+        std::vector<float> t;
+        std::vector<float> w;
+        std::vector<float> h;
+        std::vector<float> sigmaT[3];
+    };
+
+    Float3 computeTexel(
+        const AtmosphereProperties &atmos,
+        const Int2                 &res,
+        int                         x,
+        int                         y,
+        Scratch                    &scratch) const;
+
+    Float3 rayMarchOpticalDepth(
+        const AtmosphereProperties &atmos,
+        float                       h,
+        float                       sinTheta,
+        Scratch                    &scratch) const;
+
+    TransmittanceMode mode_ = TransmittanceMode::RayMarch;
+
+    int stepCount_   = 1000;
+    int threadCount_ = 0;
+
+    QuadratureScheme scheme_ = QuadratureScheme::Midpoint;
+    RayQuadrature    quadrature_;
+
+    const std::atomic<bool> *cancel_ = nullptr;
+
+    Table2D<Float4> table_;
+};
+
+// texture coordinates of the ray leaving height h along sinTheta in a
+// transmittance LUT of resolution res, same as encodeTransmittanceUV in
+// asset/medium.hlsl. the Horizon parameterization keeps the rays above and
+// below the horizon in separate halves of an even res.y, so that bilinear
+// lookups never blend across the horizon.
+Float2 encodeTransmittanceUV(
+    const AtmosphereProperties &atmos,
+    const Int2                 &res,
+    float                       h,
+    float                       sinTheta);
+
+// inverse of encodeTransmittanceUV, returns { h, sinTheta }
+Float2 decodeTransmittanceUV(
+    const AtmosphereProperties &atmos,
+    const Int2                 &res,
+    const Float2               &uv);
+
+// CPU counterpart of getTransmittance in asset/medium.hlsl
+Float3 sampleTransmittance(
+    const Table2D<Float4>      &T,
+    const AtmosphereProperties &atmos,
+    float                       h,
+    float                       theta);
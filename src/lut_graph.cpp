@@ -0,0 +1,123 @@
+#include <stdexcept>
+
+#include "./lut_graph.h"
+
+LUTGraph::NodeID LUTGraph::addNode(
+    std::string         name,
+    std::vector<NodeID> dependencies,
+    FingerprintFunc     fingerprint,
+    BuildFunc           build)
+{
+    const NodeID id = static_cast<NodeID>(nodes_.size());
+    for(NodeID dep : dependencies)
+    {
+        if(dep < 0 || dep >= id)
+            throw std::invalid_argument(
+                "lut graph dependency must be added before " + name);
+    }
+
+    Node node;
+    node.name         = std::move(name);
+    node.dependencies = std::move(dependencies);
+    node.fingerprint  = std::move(fingerprint);
+    node.build        = std::move(build);
+    nodes_.push_back(std::move(node));
+
+    return id;
+}
+
+void LUTGraph::invalidate(NodeID node)
+{
+    nodes_[node].valid = false;
+}
+
+void LUTGraph::invalidateAll()
+{
+    for(auto &node : nodes_)
+        node.valid = false;
+}
+
+const LUTGraph::Report &LUTGraph::update()
+{
+    lastReport_.rebuilt.clear();
+    lastReport_.skipped.clear();
+
+    std::vector<bool> rebuilt(nodes_.size(), false);
+
+    for(NodeID id = 0; id < static_cast<NodeID>(nodes_.size()); ++id)
+    {
+        Node &node = nodes_[id];
+        node.lastFingerprint = node.fingerprint();
+
+        bool stale = !node.valid || node.lastFingerprint != node.builtFingerprint;
+        for(NodeID dep : node.dependencies)
+            stale |= rebuilt[dep];
+
+        if(!stale)
+        {
+            ++node.skipCount;
+            lastReport_.skipped.push_back(id);
+            continue;
+        }
+
+        // a throwing build leaves the node invalid so it's retried next time
+        node.valid = false;
+        node.build(node.lastFingerprint);
+        node.valid            = true;
+        node.builtFingerprint = node.lastFingerprint;
+        ++node.buildCount;
+
+        rebuilt[id] = true;
+        lastReport_.rebuilt.push_back(id);
+    }
+
+    return lastReport_;
+}
+
+const LUTGraph::Report &LUTGraph::getLastReport() const
+{
+    return lastReport_;
+}
+
+int LUTGraph::getNodeCount() const
+{
+    return static_cast<int>(nodes_.size());
+}
+
+const std::string &LUTGraph::getName(NodeID node) const
+{
+    return nodes_[node].name;
+}
+
+uint64_t LUTGraph::getFingerprint(NodeID node) const
+{
+    return nodes_[node].lastFingerprint;
+}
+
+uint64_t LUTGraph::getBuildCount(NodeID node) const
+{
+    return nodes_[node].buildCount;
+}
+
+uint64_t LUTGraph::getSkipCount(NodeID node) const
+{
+    return nodes_[node].skipCount;
+}
+
+std::string LUTGraph::formatLastReport() const
+{
+    auto join = [&](const std::vector<NodeID> &ids)
+    {
+        std::string result;
+        for(NodeID id : ids)
+        {
+            if(!result.empty())
+                result += ", ";
+            result += nodes_[id].name;
+        }
+        return result.empty() ? std::string("none") : result;
+    };
+
+    return "rebuilt: " + join(lastReport_.rebuilt) +
+           "; skipped: " + join(lastReport_.skipped);
+}
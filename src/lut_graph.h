@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// dependency graph of lut stages. every node fingerprints its own inputs;
+// update() rebuilds a node only when its fingerprint changed, when it was
+// invalidated, or when one of its dependencies was rebuilt in the same pass.
+// nodes must be added after their dependencies, so insertion order is a
+// valid topological order.
+class LUTGraph
+{
+public:
+
+    using NodeID = int;
+
+    using FingerprintFunc = std::function<uint64_t()>;
+
+    // receives the fingerprint that triggered the rebuild
+    using BuildFunc = std::function<void(uint64_t)>;
+
+    struct Report
+    {
+        std::vector<NodeID> rebuilt;
+        std::vector<NodeID> skipped;
+    };
+
+    NodeID addNode(
+        std::string         name,
+        std::vector<NodeID> dependencies,
+        FingerprintFunc     fingerprint,
+        BuildFunc           build);
+
+    // force a rebuild in the next update regardless of the fingerprint
+    void invalidate(NodeID node);
+
+    void invalidateAll();
+
+    const Report &update();
+
+    const Report &getLastReport() const;
+
+    int getNodeCount() const;
+
+    const std::string &getName(NodeID node) const;
+
+    // fingerprint evaluated in the latest update. nodes may read the values
+    // of their dependencies from their own fingerprint function.
+    uint64_t getFingerprint(NodeID node) const;
+
+    uint64_t getBuildCount(NodeID node) const;
+
+    uint64_t getSkipCount(NodeID node) const;
+
+    // e.g. "rebuilt: multiscatter, sky; skipped: transmittance"
+    std::string formatLastReport() const;
+
+private:
+
+    struct Node
+    {
+        std::string         name;
+        std::vector<NodeID> dependencies;
+        FingerprintFunc     fingerprint;
+        BuildFunc           build;
+
+        bool     valid            = false;
+        uint64_t lastFingerprint  = 0;
+        uint64_t builtFingerprint = 0;
+        uint64_t buildCount       = 0;
+        uint64_t skipCount        = 0;
+    };
+
+    std::vector<Node> nodes_;
+    Report            lastReport_;
+};
+
+// holds an input at the value its node was last built with until it moves
+// further than a tolerance from there, measured as the largest change of any
+// component. fingerprinting the held value lets a node skip changes too
+// small to matter, e.g. the sky view under a camera moving by a few meters.
+// T must consist of floats only, e.g. float, Float3 or Mat4.
+template<typename T>
+class ToleranceFilter
+{
+    static_assert(std::is_trivially_copyable_v<T> && sizeof(T) % sizeof(float) == 0);
+
+public:
+
+    // a tolerance of 0 holds nothing but exact repeats
+    const T &update(const T &input, float tolerance)
+    {
+        if(!hasValue_ || measureChange(input, value_) > tolerance)
+        {
+            value_    = input;
+            hasValue_ = true;
+        }
+        return value_;
+    }
+
+    const T &get() const
+    {
+        return value_;
+    }
+
+private:
+
+    static float measureChange(const T &a, const T &b)
+    {
+        constexpr size_t COUNT = sizeof(T) / sizeof(float);
+
+        float fa[COUNT], fb[COUNT];
+        std::memcpy(fa, &a, sizeof(T));
+        std::memcpy(fb, &b, sizeof(T));
+
+        float result = 0;
+        for(size_t i = 0; i < COUNT; ++i)
+            result = (std::max)(result, std::abs(fa[i] - fb[i]));
+        return result;
+    }
+
+    bool hasValue_ = false;
+    T    value_    = {};
+};
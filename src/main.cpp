@@ -2,12 +2,19 @@
 
 #include "./aerial_lut.h"
 #include "./camera.h"
+#include "./cpu/async_lut_builder.h"
+#include "./cpu/dir_samples.h"
+#include "./cpu/frame_renderer.h"
+#include "./cpu/lut_cache.h"
+#include "./cpu/profiler.h"
+#include "./lut_graph.h"
 #include "./mesh.h"
 #include "./multiscatter.h"
 #include "./sky.h"
 #include "./sky_lut.h"
 #include "./shadow.h"
 #include "./sun.h"
+#include "./texture_io.h"
 #include "./transmittance.h"
 
 class AtmosphereRendererDemo : public Demo
@@ -27,8 +34,21 @@ private:
     float worldScale_               = 200;
     float maxAerialDistance_        = 2000;
     int   aerialPerSliceMarchCount_ = 1;
+    float aerialSliceExponent_      = 1;
     float apJitterRadius_           = 1;
 
+    QuadratureScheme aerialQuadrature_ = QuadratureScheme::Midpoint;
+
+    // error-driven step counts, see AerialPerspectiveLUT::setAdaptiveMarching
+    bool  enableAdaptiveAerial_    = false;
+    float aerialAdaptiveTolerance_ = 1e-3f;
+    int   aerialAdaptiveMaxSteps_  = 128;
+
+    // aerial LUT jitter varies per frame and accumulates into a history,
+    // see AerialPerspectiveLUT::setTemporal
+    bool  enableTemporalAerial_ = false;
+    float temporalAerialBlend_  = 0.1f;
+
     int   sunDiskSegments_ = 32;
     float sunDiskSize_     = 0.004649f;
 
@@ -45,13 +65,95 @@ private:
     bool enableSunDisk_      = true;
     bool enableMultiScatter_ = true;
 
-    int skyMarchStepCount_ = 40;
+    int  skyMarchStepCount_ = 40;
+    bool enableSkyAtlas_    = false;
+
+    QuadratureScheme skyQuadrature_ = QuadratureScheme::Midpoint;
+
+    // error-driven step counts, see SkyLUT::setAdaptiveRayMarching
+    bool  enableAdaptiveSky_    = false;
+    float skyAdaptiveTolerance_ = 1e-3f;
+    int   skyAdaptiveMaxSteps_  = 64;
+
+    // sky view and aerial LUTs refresh a few rows per frame, see
+    // AmortizedSchedule
+    bool                    enableAmortizedLUTs_ = false;
+    AmortizedUpdateSettings amortizedLUTSettings_;
 
     Int2 transLUTRes_  = { 256, 256 };
     Int2 msLUTRes_     = { 256, 256 };
     Int2 skyLUTRes_    = { 64, 64 };
     Int3 aerialLUTRes_ = { 200, 150, 32 };
 
+    bool analyticTransmittance_ = false;
+
+    // sample placement of the transmittance and multi-scattering bakes
+    QuadratureScheme transQuadrature_ = QuadratureScheme::Midpoint;
+    QuadratureScheme msQuadrature_    = QuadratureScheme::Midpoint;
+
+    uint32_t msDirSampleSeed_ = 0;
+    Float3   msTerrainAlbedo_ = Float3(0.3f);
+
+    LUTCache lutCache_{ "./cache/lut" };
+
+    LUTGraph         lutGraph_;
+    LUTGraph::NodeID transNode_    = 0;
+    LUTGraph::NodeID msNode_       = 0;
+    LUTGraph::NodeID shadowNode_   = 0;
+    LUTGraph::NodeID skyAtlasNode_ = 0;
+    LUTGraph::NodeID skyNode_      = 0;
+    LUTGraph::NodeID aerialNode_   = 0;
+
+    Float3 sunDirection_;
+    Float3 sunRadiance_;
+    Mat4   sunViewProj_;
+
+    // per-frame stages skip input changes within these, see ToleranceFilter
+    float sunDirectionTolerance_ = 1e-4f;
+    float skyEyeTolerance_       = 1e-3f; // km
+    float aerialCameraTolerance_ = 1e-4f;
+
+    // the camera the aerial LUT is built with. viewProj is held along with
+    // the rest so that temporal mode reprojects with the same camera.
+    struct AerialCamera
+    {
+        Float3                    position;
+        Camera::FrustumDirections frustumDirs;
+        Mat4                      viewProj;
+    };
+
+    ToleranceFilter<Float3>       sunDirectionFilter_;
+    ToleranceFilter<Float3>       skyEyeFilter_;
+    ToleranceFilter<AerialCamera> aerialCameraFilter_;
+
+    struct PendingLUTBuild
+    {
+        uint64_t generation = 0;
+        uint64_t transHash  = 0;
+        uint64_t msHash     = 0;
+        bool     storeTrans = false;
+
+        // bakes the sky view atlas alone, from the current tables
+        bool skyAtlas = false;
+    };
+
+    // transmittance of the current graph pass when found in the cache.
+    // kept on the CPU so the multi-scattering bake can reuse it.
+    std::shared_ptr<const Table2D<Float4>> cachedTrans_;
+
+    // multi-scattering counterpart, for the sky view atlas
+    std::shared_ptr<const Table2D<Float4>> cachedMS_;
+
+    // baked by asyncLUTBuilder_. sampled into skyAtlasTable_ and uploaded
+    // to the dynamic skyAtlasSRV_ in place of the sky view ray march.
+    std::shared_ptr<const CPUSkyViewAtlas> skyAtlas_;
+    Table2D<Float4>                        skyAtlasTable_;
+    ComPtr<ID3D11ShaderResourceView>       skyAtlasSRV_;
+    Int2                                   skyAtlasSRVRes_;
+
+    AsyncLUTBuilder asyncLUTBuilder_;
+    PendingLUTBuild pendingLUTBuild_;
+
     AtmosphereProperties atmos_;
     AtmosphereProperties stdUnitAtmos_;
 
@@ -68,15 +170,14 @@ private:
 
     std::vector<Mesh> meshes_;
 
+    std::string traceExportStatus_;
+
     void initialize() override
     {
         window_->setMaximized();
 
-        stdUnitAtmos_ = atmos_.toStdUnit();
-
-        transLUT_.generate(transLUTRes_, stdUnitAtmos_);
-        msLUT_.generate(
-            msLUTRes_, transLUT_.getSRV(), Float3(0.3f), stdUnitAtmos_);
+        PoissonDiskSampleCache::getInstance().setPersistentFile(
+            "./cache/poisson_disk_samples.bin");
 
         shadowMap_.initialize({ 2048, 2048 });
 
@@ -89,6 +190,8 @@ private:
 
         sunRenderer_.setSunDiskSegments(sunDiskSegments_);
 
+        initializeLUTGraph();
+
         loadMesh("./asset/terrain.obj", Float3(0.1f), Trans4::translate(0, 1, 0));
 
         camera_.setPosition({ 4.087f, 3.6999f, 3.957f });
@@ -103,6 +206,10 @@ private:
 
     void frame() override
     {
+        // statistics cover every frame up to the previous one
+        Profiler::getInstance().update();
+        ProfileZone zone("frame");
+
         if(keyboard_->isDown(KEY_ESCAPE))
             window_->setCloseFlag(true);
 
@@ -117,24 +224,18 @@ private:
 
         updateCamera();
 
-        const float sunRadX = agz::math::deg2rad(sunAngleX_);
-        const float sunRadY = agz::math::deg2rad(-sunAngleY_);
-        const Float3 sunDirection = Float3(
-            cos(sunRadX) * cos(sunRadY),
-            sin(sunRadY),
-            sin(sunRadX) * cos(sunRadY)).normalize();
+        const Float3 sunDirection = computeSunDirection(sunAngleX_, sunAngleY_);
+        const Float3 sunRadiance  = sunIntensity_ * sunColor_;
 
-        const Float3 sunRadiance = sunIntensity_ * sunColor_;
+        // the shadow map, the LUTs and everything lit by the sun follow it
+        // once it moved enough
+        sunDirection_ = sunDirectionFilter_.update(
+            sunDirection, sunDirectionTolerance_);
+        sunRadiance_  = sunRadiance;
+        sunViewProj_  = computeSunViewProj(sunDirection_);
 
-        const Mat4 sunViewProj =
-            Trans4::look_at(-sunDirection * 20, { 0, 0, 0 }, { 0, 1, 0 }) *
-            Trans4::orthographic(-10, 10, 10, -10, 0.1f, 80);
-
-        buildShadowMap(sunViewProj);
-
-        buildSkyLUT(sunDirection, sunRadiance);
-
-        buildAerialLUT(sunDirection, sunViewProj);
+        stdUnitAtmos_ = atmos_.toStdUnit();
+        updateLUTs();
 
         window_->useDefaultRTVAndDSV();
         window_->useDefaultViewport();
@@ -142,17 +243,19 @@ private:
         window_->clearDefaultRenderTarget({ 0, 0, 0, 0 });
 
         if(enableTerrain_)
-            renderMeshes(sunDirection, sunRadiance, sunViewProj);
+            renderMeshes(sunDirection_, sunRadiance, sunViewProj_);
 
         if(enableSky_)
             renderSky();
 
         if(enableSunDisk_)
-            renderSunDisk(sunDirection, sunRadiance);
+            renderSunDisk(sunDirection_, sunRadiance);
     }
 
     void showGUI()
     {
+        ProfileZone zone("showGUI");
+
         AGZ_SCOPE_GUARD({ ImGui::End(); });
         if(!ImGui::Begin("Settings", nullptr, ImGuiWindowFlags_AlwaysAutoResize))
             return;
@@ -168,30 +271,35 @@ private:
         ImGui::SetNextTreeNodeOpen(false, ImGuiCond_Once);
         if(ImGui::TreeNode("Atmosphere"))
         {
-            bool changed = false;
-            changed |= ImGui::InputFloat ("Planet Radius         (km)   ", &atmos_.planetRadius);
-            changed |= ImGui::InputFloat ("Atmosphere Radius     (km)   ", &atmos_.atmosphereRadius);
-            changed |= ImGui::InputFloat3("Rayleight Scattering  (um^-1)", &atmos_.scatterRayleigh.x);
-            changed |= ImGui::InputFloat ("Rayleight Density H   (km)   ", &atmos_.hDensityRayleigh);
-            changed |= ImGui::InputFloat ("Mie Scatter           (um^-1)", &atmos_.scatterMie);
-            changed |= ImGui::InputFloat ("Mie Absorb            (um^-1)", &atmos_.absorbMie);
-            changed |= ImGui::InputFloat ("Mie Density H         (km)   ", &atmos_.hDensityMie);
-            changed |= ImGui::InputFloat ("Mie Scatter Asymmetry        ", &atmos_.asymmetryMie);
-            changed |= ImGui::InputFloat3("Ozone Absorb          (um^-1)", &atmos_.absorbOzone.x);
-            changed |= ImGui::InputFloat ("Ozone Center Height   (km)   ", &atmos_.ozoneCenterHeight);
-            changed |= ImGui::InputFloat ("Ozone Thickness       (km)   ", &atmos_.ozoneThickness);
-
-            changed |= ImGui::InputInt2("Transmittance LUT Resolution", &transLUTRes_.x);
-            changed |= ImGui::InputInt2("Multi Scattering LUT Resolution", &msLUTRes_.x);
-
-            if(changed)
+            ImGui::InputFloat ("Planet Radius         (km)   ", &atmos_.planetRadius);
+            ImGui::InputFloat ("Atmosphere Radius     (km)   ", &atmos_.atmosphereRadius);
+            ImGui::InputFloat3("Rayleight Scattering  (um^-1)", &atmos_.scatterRayleigh.x);
+            ImGui::InputFloat ("Rayleight Density H   (km)   ", &atmos_.hDensityRayleigh);
+            ImGui::InputFloat ("Mie Scatter           (um^-1)", &atmos_.scatterMie);
+            ImGui::InputFloat ("Mie Absorb            (um^-1)", &atmos_.absorbMie);
+            ImGui::InputFloat ("Mie Density H         (km)   ", &atmos_.hDensityMie);
+            ImGui::InputFloat ("Mie Scatter Asymmetry        ", &atmos_.asymmetryMie);
+            ImGui::InputFloat3("Ozone Absorb          (um^-1)", &atmos_.absorbOzone.x);
+            ImGui::InputFloat ("Ozone Center Height   (km)   ", &atmos_.ozoneCenterHeight);
+            ImGui::InputFloat ("Ozone Thickness       (km)   ", &atmos_.ozoneThickness);
+
+            if(ImGui::InputInt2("Transmittance LUT Resolution", &transLUTRes_.x))
+                transLUTRes_ = transLUTRes_.clamp_low(1);
+            ImGui::Checkbox("Analytic Transmittance", &analyticTransmittance_);
+            if(!analyticTransmittance_)
+                showQuadratureCombo("Transmittance Quadrature", transQuadrature_);
+
+            bool horizonTransmittance = atmos_.transmittanceParam ==
+                                        TransmittanceParameterization::Horizon;
+            if(ImGui::Checkbox("Horizon-Aware Transmittance UV", &horizonTransmittance))
             {
-                stdUnitAtmos_ = atmos_.toStdUnit();
-
-                transLUT_.generate(transLUTRes_, stdUnitAtmos_);
-                msLUT_.generate(
-                    msLUTRes_, transLUT_.getSRV(), Float3(0.3f), stdUnitAtmos_);
+                atmos_.transmittanceParam = horizonTransmittance ?
+                    TransmittanceParameterization::Horizon :
+                    TransmittanceParameterization::Linear;
             }
+            if(ImGui::InputInt2("Multi Scattering LUT Resolution", &msLUTRes_.x))
+                msLUTRes_ = msLUTRes_.clamp_low(1);
+            showQuadratureCombo("Multi Scattering Quadrature", msQuadrature_);
 
             ImGui::TreePop();
         }
@@ -221,6 +329,19 @@ private:
                 skyLUT_.resize(skyLUTRes_);
             }
             ImGui::InputInt("Ray March Steps", &skyMarchStepCount_);
+            showQuadratureCombo("Sky Quadrature", skyQuadrature_);
+            ImGui::Checkbox("Adaptive Sky March", &enableAdaptiveSky_);
+            if(enableAdaptiveSky_)
+            {
+                if(ImGui::InputFloat("Sky Tolerance", &skyAdaptiveTolerance_, 0, 0, 6))
+                {
+                    skyAdaptiveTolerance_ =
+                        (std::max)(skyAdaptiveTolerance_, 1e-6f);
+                }
+                if(ImGui::InputInt("Sky Max Steps", &skyAdaptiveMaxSteps_))
+                    skyAdaptiveMaxSteps_ = (std::max)(skyAdaptiveMaxSteps_, 1);
+            }
+            ImGui::Checkbox("Precomputed Sky Atlas", &enableSkyAtlas_);
             ImGui::TreePop();
         }
 
@@ -234,13 +355,430 @@ private:
                 aerialLUT_.resize(aerialLUTRes_);
             }
             ImGui::InputInt("Aerial March Steps", &aerialPerSliceMarchCount_);
+            showQuadratureCombo("Aerial Quadrature", aerialQuadrature_);
+            ImGui::Checkbox("Adaptive Aerial March", &enableAdaptiveAerial_);
+            if(enableAdaptiveAerial_)
+            {
+                if(ImGui::InputFloat("Aerial Tolerance", &aerialAdaptiveTolerance_, 0, 0, 6))
+                {
+                    aerialAdaptiveTolerance_ =
+                        (std::max)(aerialAdaptiveTolerance_, 1e-6f);
+                }
+                if(ImGui::InputInt("Aerial Max Steps", &aerialAdaptiveMaxSteps_))
+                    aerialAdaptiveMaxSteps_ = (std::max)(aerialAdaptiveMaxSteps_, 1);
+            }
+            if(ImGui::InputFloat("Aerial Slice Exponent", &aerialSliceExponent_))
+                aerialSliceExponent_ = (std::max)(aerialSliceExponent_, 1.0f);
             ImGui::InputFloat("Aerial Jitter Radius", &apJitterRadius_);
+            ImGui::Checkbox("Temporal Accumulation", &enableTemporalAerial_);
+            if(ImGui::InputFloat("Temporal Blend", &temporalAerialBlend_))
+            {
+                temporalAerialBlend_ =
+                    (std::clamp)(temporalAerialBlend_, 0.01f, 1.0f);
+            }
+            ImGui::TreePop();
+        }
+
+        ImGui::SetNextTreeNodeOpen(false, ImGuiCond_Once);
+        if(ImGui::TreeNode("Amortized LUT Updates"))
+        {
+            ImGui::Checkbox("Enable Amortized Updates", &enableAmortizedLUTs_);
+
+            bool priority = amortizedLUTSettings_.order == AmortizedOrder::Priority;
+            if(ImGui::Checkbox("Horizon First", &priority))
+            {
+                amortizedLUTSettings_.order = priority ?
+                    AmortizedOrder::Priority : AmortizedOrder::RoundRobin;
+            }
+
+            if(ImGui::InputInt("Max Stale Frames", &amortizedLUTSettings_.maxStaleFrames))
+            {
+                amortizedLUTSettings_.maxStaleFrames =
+                    (std::max)(amortizedLUTSettings_.maxStaleFrames, 1);
+            }
+
+            ImGui::Text(
+                "sky staleness %d, aerial staleness %d",
+                skyLUT_.getSchedule().getMaxStaleness(),
+                aerialLUT_.getSchedule().getMaxStaleness());
+            ImGui::TreePop();
+        }
+
+        ImGui::SetNextTreeNodeOpen(false, ImGuiCond_Once);
+        if(ImGui::TreeNode("Dirty Tracking"))
+        {
+            ImGui::InputFloat("Sun Direction Tolerance", &sunDirectionTolerance_, 0, 0, 6);
+            ImGui::InputFloat("Sky Eye Tolerance (km)",  &skyEyeTolerance_,       0, 0, 6);
+            ImGui::InputFloat("Aerial Camera Tolerance", &aerialCameraTolerance_, 0, 0, 6);
+            showLUTGraphCounters();
+            ImGui::TreePop();
+        }
+
+        ImGui::SetNextTreeNodeOpen(false, ImGuiCond_Once);
+        if(ImGui::TreeNode("Profiler"))
+        {
+            showProfilerGUI();
             ImGui::TreePop();
         }
+
+        ImGui::Text("LUTs %s", lutGraph_.formatLastReport().c_str());
+    }
+
+    // lists the schemes the shaders support, see QuadratureRule
+    static void showQuadratureCombo(const char *label, QuadratureScheme &scheme)
+    {
+        constexpr QuadratureScheme SCHEMES[] = {
+            QuadratureScheme::Midpoint,
+            QuadratureScheme::Simpson,
+            QuadratureScheme::GaussLegendre,
+            QuadratureScheme::Exponential
+        };
+
+        if(!ImGui::BeginCombo(label, getQuadratureSchemeName(scheme)))
+            return;
+        for(QuadratureScheme s : SCHEMES)
+        {
+            if(ImGui::Selectable(getQuadratureSchemeName(s), s == scheme))
+                scheme = s;
+        }
+        ImGui::EndCombo();
+    }
+
+    void showLUTGraphCounters()
+    {
+        ImGui::Text("%-16s %9s %9s", "stage", "built", "skipped");
+        for(LUTGraph::NodeID id = 0; id < lutGraph_.getNodeCount(); ++id)
+        {
+            ImGui::Text(
+                "%-16s %9llu %9llu", lutGraph_.getName(id).c_str(),
+                static_cast<unsigned long long>(lutGraph_.getBuildCount(id)),
+                static_cast<unsigned long long>(lutGraph_.getSkipCount(id)));
+        }
+    }
+
+    // zones around D3D11 calls time their submission, not the GPU work
+    void showProfilerGUI()
+    {
+        Profiler &profiler = Profiler::getInstance();
+
+        bool enabled = profiler.isEnabled();
+        if(ImGui::Checkbox("Enable Profiler", &enabled))
+            profiler.setEnabled(enabled);
+
+        ImGui::Text(
+            "%-36s %9s %9s %9s %9s", "zone", "last ms", "mean ms", "min ms", "max ms");
+        for(auto &[name, stats] : profiler.getStats())
+        {
+            ImGui::Text(
+                "%-36s %9.3f %9.3f %9.3f %9.3f", name.c_str(),
+                stats.lastMs, stats.meanMs, stats.minMs, stats.maxMs);
+        }
+
+        if(ImGui::Button("Export Chrome Trace"))
+        {
+            const std::string filename = "./profile.json";
+            traceExportStatus_ = profiler.exportChromeTrace(filename) ?
+                "written to " + filename : "failed to write " + filename;
+        }
+        if(!traceExportStatus_.empty())
+            ImGui::Text("%s", traceExportStatus_.c_str());
+    }
+
+    void initializeLUTGraph()
+    {
+        transNode_ = lutGraph_.addNode(
+            "transmittance", {},
+            [&]
+            {
+                return hashTransmittanceInputs(
+                    stdUnitAtmos_, transLUTRes_, getTransmittanceMode(),
+                    TransmittanceLUT::STEP_COUNT, transQuadrature_);
+            },
+            [&](uint64_t hash) { buildTransmittanceLUT(hash); });
+
+        msNode_ = lutGraph_.addNode(
+            "multiscatter", { transNode_ },
+            [&]
+            {
+                return hashMultiScatteringInputs(
+                    stdUnitAtmos_, msLUTRes_,
+                    MultiScatteringLUT::RAY_MARCH_STEP_COUNT,
+                    msQuadrature_,
+                    MultiScatteringLUT::DIR_SAMPLE_COUNT,
+                    msDirSampleSeed_, msTerrainAlbedo_,
+                    lutGraph_.getFingerprint(transNode_));
+            },
+            [&](uint64_t hash) { buildMultiScatteringLUT(hash); });
+
+        shadowNode_ = lutGraph_.addNode(
+            "shadow", {},
+            [&]
+            {
+                LUTHasher hasher;
+                hasher.add(sunViewProj_);
+                return hasher.getHash();
+            },
+            [&](uint64_t) { buildShadowMap(sunViewProj_); });
+
+        skyAtlasNode_ = lutGraph_.addNode(
+            "skyAtlas", { transNode_, msNode_ },
+            [&]
+            {
+                LUTHasher hasher;
+                hasher.add(enableSkyAtlas_);
+                hasher.add(skyLUTRes_);
+                hasher.add(skyMarchStepCount_);
+                hasher.add(enableMultiScatter_);
+                return hasher.getHash();
+            },
+            [&](uint64_t) { buildSkyAtlas(); });
+
+        skyNode_ = lutGraph_.addNode(
+            "sky", { transNode_, msNode_, skyAtlasNode_ },
+            [&]
+            {
+                LUTHasher hasher;
+                hasher.add(skyLUTRes_);
+                hasher.add(skyMarchStepCount_);
+                hasher.add(skyQuadrature_);
+                hasher.add(enableAdaptiveSky_);
+                hasher.add(skyAdaptiveTolerance_);
+                hasher.add(skyAdaptiveMaxSteps_);
+                hasher.add(enableMultiScatter_);
+                hasher.add(enableSkyAtlas_);
+                hasher.add(enableAmortizedLUTs_);
+                hasher.add(sunDirection_);
+                hasher.add(sunRadiance_);
+                hasher.add(skyEyeFilter_.update(
+                    worldScale_ * camera_.getPosition(), skyEyeTolerance_));
+                return hasher.getHash();
+            },
+            [&](uint64_t) { buildSkyLUT(sunDirection_, sunRadiance_); });
+
+        aerialNode_ = lutGraph_.addNode(
+            "aerial", { transNode_, msNode_, shadowNode_ },
+            [&]
+            {
+                LUTHasher hasher;
+                hasher.add(aerialLUTRes_);
+                hasher.add(aerialPerSliceMarchCount_);
+                hasher.add(aerialQuadrature_);
+                hasher.add(enableAdaptiveAerial_);
+                hasher.add(aerialAdaptiveTolerance_);
+                hasher.add(aerialAdaptiveMaxSteps_);
+                hasher.add(aerialSliceExponent_);
+                hasher.add(maxAerialDistance_);
+                hasher.add(enableMultiScatter_);
+                hasher.add(enableShadow_);
+                hasher.add(enableAmortizedLUTs_);
+                hasher.add(enableTemporalAerial_);
+                hasher.add(temporalAerialBlend_);
+                hasher.add(worldScale_);
+                hasher.add(sunDirection_);
+                hasher.add(sunViewProj_);
+                const AerialCamera camera = {
+                    camera_.getPosition(),
+                    camera_.getFrustumDirections(),
+                    camera_.getViewProj()
+                };
+                hasher.add(aerialCameraFilter_.update(
+                    camera, aerialCameraTolerance_));
+                return hasher.getHash();
+            },
+            [&](uint64_t) { buildAerialLUT(sunDirection_, sunViewProj_); });
+    }
+
+    // stdUnitAtmos_ for the shaders reading transLUT_, which may still
+    // hold a table of another resolution than transLUTRes_
+    AtmosphereProperties getShaderAtmosphere() const
+    {
+        AtmosphereProperties result = stdUnitAtmos_;
+        result.transmittanceRes = {
+            static_cast<float>(transLUT_.getResolution().x),
+            static_cast<float>(transLUT_.getResolution().y)
+        };
+        return result;
+    }
+
+    TransmittanceMode getTransmittanceMode() const
+    {
+        return analyticTransmittance_ ? TransmittanceMode::Analytic
+                                      : TransmittanceMode::RayMarch;
+    }
+
+    // only looks up the cache. uploading is left to the multi-scattering
+    // node, which always follows, so that both tables are swapped together.
+    void buildTransmittanceLUT(uint64_t hash)
+    {
+        ProfileZone zone("buildTransmittanceLUT");
+
+        cachedTrans_.reset();
+        if(auto T = lutCache_.load(LUTKind::Transmittance, hash, transLUTRes_))
+        {
+            cachedTrans_ = std::make_shared<Table2D<Float4>>(
+                T->findTable(LUTKind::Transmittance)->decode());
+        }
+    }
+
+    void buildMultiScatteringLUT(uint64_t hash)
+    {
+        ProfileZone zone("buildMultiScatteringLUT");
+
+        if(cachedTrans_)
+        {
+            if(auto M = lutCache_.load(LUTKind::MultiScattering, hash, msLUTRes_))
+            {
+                asyncLUTBuilder_.cancel();
+                pendingLUTBuild_ = {};
+                transLUT_.upload(*cachedTrans_);
+                msLUT_.upload(*M->findTable(LUTKind::MultiScattering));
+                cachedMS_ = std::make_shared<Table2D<Float4>>(
+                    M->findTable(LUTKind::MultiScattering)->decode());
+                return;
+            }
+        }
+
+        // nothing to render with before the first set, which is baked on the
+        // GPU instead of waiting for the CPU. the async bake below still
+        // fills the cache and replaces it with the CPU tables once done.
+        if(!msLUT_.getSRV())
+        {
+            ProfileZone gpuZone("bakeFirstLUTsOnGPU");
+
+            if(cachedTrans_)
+                transLUT_.upload(*cachedTrans_);
+            else
+            {
+                transLUT_.setQuadrature(transQuadrature_);
+                transLUT_.generate(transLUTRes_, stdUnitAtmos_);
+            }
+            msLUT_.setRayMarchQuadrature(msQuadrature_);
+            msLUT_.generate(
+                msLUTRes_, transLUT_.getSRV(), msTerrainAlbedo_,
+                getShaderAtmosphere(), msDirSampleSeed_);
+        }
+
+        LUTBuildRequest request;
+        request.atmos                             = stdUnitAtmos_;
+        request.transmittanceRes                  = transLUTRes_;
+        request.transmittanceMode                 = getTransmittanceMode();
+        request.transmittanceStepCount            = TransmittanceLUT::STEP_COUNT;
+        request.transmittanceQuadrature           = transQuadrature_;
+        request.multiScatteringRes                = msLUTRes_;
+        request.multiScatteringRayMarchStepCount  = MultiScatteringLUT::RAY_MARCH_STEP_COUNT;
+        request.multiScatteringRayMarchQuadrature = msQuadrature_;
+        request.dirSampleCount                    = MultiScatteringLUT::DIR_SAMPLE_COUNT;
+        request.dirSampleSeed                     = msDirSampleSeed_;
+        request.terrainAlbedo                     = msTerrainAlbedo_;
+        request.transmittance                     = cachedTrans_;
+
+        pendingLUTBuild_.generation = asyncLUTBuilder_.request(std::move(request));
+        pendingLUTBuild_.transHash  = lutGraph_.getFingerprint(transNode_);
+        pendingLUTBuild_.msHash     = hash;
+        pendingLUTBuild_.storeTrans = !cachedTrans_;
+        pendingLUTBuild_.skyAtlas   = false;
+    }
+
+    void updateLUTs()
+    {
+        ProfileZone zone("updateLUTs");
+
+        // edits keep rendering with the previous tables until their async
+        // bake is published
+        consumeAsyncLUTs();
+        lutGraph_.update();
+
+        continueAmortizedLUTs();
+        continueTemporalAerialLUT();
+    }
+
+    bool wasRebuilt(LUTGraph::NodeID node) const
+    {
+        auto &rebuilt = lutGraph_.getLastReport().rebuilt;
+        return std::find(rebuilt.begin(), rebuilt.end(), node) != rebuilt.end();
+    }
+
+    // once their inputs settle, amortized LUTs aren't rebuilt by the graph
+    // but still hold stale rows, which keep being refreshed without the
+    // setters that would mark all rows stale again
+    void continueAmortizedLUTs()
+    {
+        if(!enableAmortizedLUTs_)
+            return;
+
+        ProfileZone zone("continueAmortizedLUTs");
+
+        if(!skyAtlas_ && !wasRebuilt(skyNode_) &&
+           !skyLUT_.getSchedule().isConverged())
+        {
+            skyLUT_.update(amortizedLUTSettings_);
+        }
+
+        if(!wasRebuilt(aerialNode_) && !aerialLUT_.getSchedule().isConverged())
+            aerialLUT_.update(amortizedLUTSettings_);
+    }
+
+    // likewise, a temporal aerial LUT keeps accumulating new jitter offsets
+    // until its history settles
+    void continueTemporalAerialLUT()
+    {
+        if(wasRebuilt(aerialNode_) || aerialLUT_.isTemporalConverged())
+            return;
+
+        ProfileZone zone("continueTemporalAerialLUT");
+        aerialLUT_.render();
+    }
+
+    void consumeAsyncLUTs()
+    {
+        ProfileZone zone("consumeAsyncLUTs");
+
+        if(!pendingLUTBuild_.generation)
+            return;
+
+        auto set = asyncLUTBuilder_.getLatest();
+        if(!set || set->generation != pendingLUTBuild_.generation)
+            return;
+
+        if(pendingLUTBuild_.skyAtlas)
+        {
+            pendingLUTBuild_ = {};
+            skyAtlas_ = std::shared_ptr<const CPUSkyViewAtlas>(set, &set->skyAtlas);
+            lutGraph_.invalidate(skyNode_);
+            return;
+        }
+
+        transLUT_.upload(set->transmittance);
+        msLUT_.upload(set->multiScattering);
+
+        if(pendingLUTBuild_.storeTrans)
+        {
+            lutCache_.store(
+                LUTKind::Transmittance, pendingLUTBuild_.transHash,
+                set->transmittance);
+        }
+        lutCache_.store(
+            LUTKind::MultiScattering, pendingLUTBuild_.msHash,
+            set->multiScattering);
+
+        pendingLUTBuild_ = {};
+
+        // lets a later multi-scattering-only change skip the transmittance bake
+        cachedTrans_ = std::shared_ptr<const Table2D<Float4>>(
+            set, &set->transmittance);
+        cachedMS_ = std::shared_ptr<const Table2D<Float4>>(
+            set, &set->multiScattering);
+
+        // all were last rendered with the previous tables
+        lutGraph_.invalidate(skyAtlasNode_);
+        lutGraph_.invalidate(skyNode_);
+        lutGraph_.invalidate(aerialNode_);
     }
 
     void updateCamera()
     {
+        ProfileZone zone("updateCamera");
+
         camera_.setWOverH(window_->getClientWOverH());
         if(!mouse_->isVisible())
         {
@@ -260,6 +798,8 @@ private:
 
     void buildShadowMap(const Mat4 &sunViewProj)
     {
+        ProfileZone zone("buildShadowMap");
+
         shadowMap_.setSun(sunViewProj);
 
         shadowMap_.begin();
@@ -268,30 +808,91 @@ private:
         shadowMap_.end();
     }
 
+    // baked by the async builder from the CPU tables of the current graph
+    // pass, after a pending bake of those tables, which invalidates this
+    // node once consumed. the sky view is ray marched until it's done.
+    void buildSkyAtlas()
+    {
+        ProfileZone zone("buildSkyAtlas");
+
+        skyAtlas_.reset();
+        if(pendingLUTBuild_.skyAtlas)
+        {
+            asyncLUTBuilder_.cancel();
+            pendingLUTBuild_ = {};
+        }
+
+        if(!enableSkyAtlas_ || pendingLUTBuild_.generation ||
+           !cachedTrans_ || !cachedMS_)
+            return;
+
+        LUTBuildRequest request;
+        request.atmos                         = stdUnitAtmos_;
+        request.transmittance                 = cachedTrans_;
+        request.multiScattering               = cachedMS_;
+        request.skyAtlas                      = true;
+        request.skyAtlasRes                   = skyLUTRes_;
+        request.skyAtlasStepCount             = skyMarchStepCount_;
+        request.skyAtlasEnableMultiScattering = enableMultiScatter_;
+
+        pendingLUTBuild_.generation = asyncLUTBuilder_.request(std::move(request));
+        pendingLUTBuild_.skyAtlas   = true;
+    }
+
     void buildSkyLUT(
         const Float3 &sunDirection,
         const Float3 &sunRadiance)
     {
-        skyLUT_.setAtmosphere(stdUnitAtmos_);
+        ProfileZone zone("buildSkyLUT");
+
+        if(skyAtlas_)
+        {
+            // a few lerps per texel and an upload, in place of the ray march
+            skyAtlas_->sample(
+                skyEyeFilter_.get().y, sunDirection, sunRadiance,
+                skyAtlasTable_);
+
+            const Int2 &res = skyAtlasTable_.getResolution();
+            if(!skyAtlasSRV_ || res.x != skyAtlasSRVRes_.x ||
+                                res.y != skyAtlasSRVRes_.y)
+            {
+                skyAtlasSRV_    = createDynamicFloat4Texture2DSRV(res);
+                skyAtlasSRVRes_ = res;
+            }
+            updateDynamicFloat4Texture2D(skyAtlasSRV_, skyAtlasTable_.data());
+            return;
+        }
+
+        skyLUT_.setAtmosphere(getShaderAtmosphere());
         skyLUT_.setSun(sunDirection, sunRadiance);
         skyLUT_.setTransmittance(transLUT_.getSRV());
         skyLUT_.setMultiScattering(enableMultiScatter_, msLUT_.getSRV());
         skyLUT_.setRayMarching(skyMarchStepCount_);
-        skyLUT_.setCamera(worldScale_ * camera_.getPosition());
-
-        skyLUT_.generate();
+        skyLUT_.setQuadrature(skyQuadrature_);
+        skyLUT_.setAdaptiveRayMarching(
+            enableAdaptiveSky_, skyAdaptiveTolerance_, skyAdaptiveMaxSteps_);
+        skyLUT_.setCamera(skyEyeFilter_.get());
+
+        if(enableAmortizedLUTs_)
+            skyLUT_.update(amortizedLUTSettings_);
+        else
+            skyLUT_.generate();
     }
 
     void buildAerialLUT(
         const Float3 &sunDirection,
         const Mat4   &sunViewProj)
     {
-        const float atmosEyeHeight = worldScale_ * camera_.getPosition().y;
+        ProfileZone zone("buildAerialLUT");
+
+        // the camera the fingerprint was taken of, within tolerance of the
+        // current one
+        const AerialCamera &camera         = aerialCameraFilter_.get();
+        const float         atmosEyeHeight = worldScale_ * camera.position.y;
         aerialLUT_.setCamera(
-            camera_.getPosition(), atmosEyeHeight,
-            camera_.getFrustumDirections());
+            camera.position, atmosEyeHeight, camera.frustumDirs);
         aerialLUT_.setWorldScale(worldScale_);
-        aerialLUT_.setAtmosphere(stdUnitAtmos_);
+        aerialLUT_.setAtmosphere(getShaderAtmosphere());
 
         aerialLUT_.setSun(sunDirection);
         aerialLUT_.setShadow(
@@ -299,11 +900,22 @@ private:
 
         aerialLUT_.setMarchingParams(
             maxAerialDistance_, aerialPerSliceMarchCount_);
+        aerialLUT_.setSliceDistribution(aerialSliceExponent_);
+        aerialLUT_.setQuadrature(aerialQuadrature_);
+        aerialLUT_.setAdaptiveMarching(
+            enableAdaptiveAerial_, aerialAdaptiveTolerance_,
+            aerialAdaptiveMaxSteps_);
 
         aerialLUT_.setMultiScatterLUT(enableMultiScatter_, msLUT_.getSRV());
         aerialLUT_.setTransmittanceLUT(transLUT_.getSRV());
 
-        aerialLUT_.render();
+        aerialLUT_.setTemporal(
+            enableTemporalAerial_, temporalAerialBlend_, camera.viewProj);
+
+        if(enableAmortizedLUTs_)
+            aerialLUT_.update(amortizedLUTSettings_);
+        else
+            aerialLUT_.render();
     }
 
     void renderMeshes(
@@ -311,11 +923,13 @@ private:
         const Float3 &sunRadiance,
         const Mat4   &sunViewProj)
     {
+        ProfileZone zone("renderMeshes");
+
         meshRenderer_.setAtmosphere(
-            stdUnitAtmos_,
+            getShaderAtmosphere(),
             transLUT_.getSRV(),
             aerialLUT_.getOutput(),
-            apJitterRadius_, maxAerialDistance_);
+            apJitterRadius_, maxAerialDistance_, aerialSliceExponent_);
 
         meshRenderer_.setRenderTarget(window_->getClientSize());
         meshRenderer_.setCamera(camera_.getPosition(), camera_.getViewProj());
@@ -332,15 +946,19 @@ private:
 
     void renderSky()
     {
+        ProfileZone zone("renderSky");
+
         skyRenderer_.setCamera(camera_.getFrustumDirections());
-        skyRenderer_.render(skyLUT_.getLUT());
+        skyRenderer_.render(skyAtlas_ ? skyAtlasSRV_ : skyLUT_.getLUT());
     }
 
     void renderSunDisk(const Float3 &direction, const Float3 &radiance)
     {
+        ProfileZone zone("renderSunDisk");
+
         sunRenderer_.setWorldScale(worldScale_);
         sunRenderer_.setCamera(camera_.getPosition(), camera_.getViewProj());
-        sunRenderer_.setAtmosphere(stdUnitAtmos_);
+        sunRenderer_.setAtmosphere(getShaderAtmosphere());
         sunRenderer_.setSun(sunDiskSize_, direction, radiance);
         sunRenderer_.setTransmittance(transLUT_.getSRV());
         sunRenderer_.render();
@@ -1,6 +1,31 @@
 #pragma once
 
-#include "./common.h"
+#include <cstdint>
+
+#include "./common_math.h"
+
+// structure-of-arrays view of count Float3 values
+struct Float3Batch
+{
+    float *r = nullptr;
+    float *g = nullptr;
+    float *b = nullptr;
+};
+
+// out[i] = exp(x[i]) through the same SIMD kernels as the batched medium
+// evaluation below. accurate to a few ulps for x in [-88, 88].
+void expBatch(int count, const float *x, float *out);
+
+// texel layout of the transmittance LUT, see encodeTransmittanceUV in
+// cpu/transmittance.h and asset/medium.hlsl
+enum class TransmittanceParameterization : int32_t
+{
+    // u linear in the height, v linear in sinTheta
+    Linear  = 0,
+    // u and v linear in the distances of Bruneton's r / mu mapping, which
+    // concentrate texels near the ground and on both sides of the horizon
+    Horizon = 1
+};
 
 struct AtmosphereProperties
 {
@@ -18,7 +43,19 @@ struct AtmosphereProperties
     float  ozoneThickness   = 30;
     float  planetRadius     = 6360;
     float  atmosphereRadius = 6460;
+
+    // not a property of the medium, but every shader reading the
+    // transmittance LUT binds this buffer. fills the last 4 bytes of the
+    // row above.
+    TransmittanceParameterization transmittanceParam =
+        TransmittanceParameterization::Linear;
+
+    // likewise, the resolution of the bound transmittance LUT, which the
+    // Horizon parameterization reads instead of querying the texture on
+    // every lookup. the CPU backends take it from their tables.
+    Float2 transmittanceRes = { 256, 256 };
     float  pad0             = 0;
+    float  pad1             = 0;
 
     AtmosphereProperties toStdUnit() const;
 
@@ -27,4 +64,19 @@ struct AtmosphereProperties
     Float3 getSigmaT(float h) const;
 
     Float3 evalPhaseFunction(float h, float u) const;
+
+    // batched variants, see medium_batch.cpp. h and u hold count values.
+
+    void getSigmaS(int count, const float *h, const Float3Batch &out) const;
+
+    void getSigmaT(int count, const float *h, const Float3Batch &out) const;
+
+    void getSigmaST(
+        int                count,
+        const float       *h,
+        const Float3Batch &outS,
+        const Float3Batch &outT) const;
+
+    void evalPhaseFunction(
+        int count, const float *h, const float *u, const Float3Batch &out) const;
 };
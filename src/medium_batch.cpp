@@ -0,0 +1,392 @@
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || \
+      (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MEDIUM_BATCH_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "./medium.h"
+
+namespace
+{
+
+    // Cephes-style expf: range reduction to [-ln2/2, ln2/2] followed by a
+    // degree-5 polynomial, then scaling by 2^n through the exponent bits.
+    // Inputs are clamped to keep 2^n a normal number.
+
+    constexpr float EXP_HI  = 88.3762626647949f;
+    constexpr float EXP_LO  = -87.3365447505531f;
+    constexpr float LOG2E   = 1.44269504088896341f;
+    constexpr float EXP_C1  = 0.693359375f;
+    constexpr float EXP_C2  = -2.12194440e-4f;
+    constexpr float EXP_P0  = 1.9875691500e-4f;
+    constexpr float EXP_P1  = 1.3981999507e-3f;
+    constexpr float EXP_P2  = 8.3334519073e-3f;
+    constexpr float EXP_P3  = 4.1665795894e-2f;
+    constexpr float EXP_P4  = 1.6666665459e-1f;
+    constexpr float EXP_P5  = 5.0000001201e-1f;
+
+#if defined(__AVX2__)
+
+    struct Pack
+    {
+        static constexpr int WIDTH = 8;
+
+        __m256 v;
+
+        static Pack load(const float *p) { return { _mm256_loadu_ps(p) }; }
+        static Pack set1(float f)        { return { _mm256_set1_ps(f) }; }
+
+        void store(float *p) const { _mm256_storeu_ps(p, v); }
+    };
+
+    inline Pack operator+(Pack a, Pack b) { return { _mm256_add_ps(a.v, b.v) }; }
+    inline Pack operator-(Pack a, Pack b) { return { _mm256_sub_ps(a.v, b.v) }; }
+    inline Pack operator*(Pack a, Pack b) { return { _mm256_mul_ps(a.v, b.v) }; }
+    inline Pack operator/(Pack a, Pack b) { return { _mm256_div_ps(a.v, b.v) }; }
+
+    inline Pack max(Pack a, Pack b) { return { _mm256_max_ps(a.v, b.v) }; }
+    inline Pack min(Pack a, Pack b) { return { _mm256_min_ps(a.v, b.v) }; }
+    inline Pack sqrt(Pack a)        { return { _mm256_sqrt_ps(a.v) }; }
+
+    inline Pack abs(Pack a)
+    {
+        return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) };
+    }
+
+    // a > 0 ? b : 0
+    inline Pack selectPositive(Pack a, Pack b)
+    {
+        const __m256 mask = _mm256_cmp_ps(a.v, _mm256_setzero_ps(), _CMP_GT_OQ);
+        return { _mm256_and_ps(mask, b.v) };
+    }
+
+    inline Pack exp(Pack x)
+    {
+        x = min(max(x, Pack::set1(EXP_LO)), Pack::set1(EXP_HI));
+
+        Pack fx = x * Pack::set1(LOG2E) + Pack::set1(0.5f);
+        fx.v = _mm256_floor_ps(fx.v);
+
+        x = x - fx * Pack::set1(EXP_C1) - fx * Pack::set1(EXP_C2);
+
+        const Pack z = x * x;
+        Pack y = Pack::set1(EXP_P0);
+        y = y * x + Pack::set1(EXP_P1);
+        y = y * x + Pack::set1(EXP_P2);
+        y = y * x + Pack::set1(EXP_P3);
+        y = y * x + Pack::set1(EXP_P4);
+        y = y * x + Pack::set1(EXP_P5);
+        y = y * z + x + Pack::set1(1);
+
+        __m256i n = _mm256_cvttps_epi32(fx.v);
+        n = _mm256_add_epi32(n, _mm256_set1_epi32(127));
+        n = _mm256_slli_epi32(n, 23);
+
+        return y * Pack{ _mm256_castsi256_ps(n) };
+    }
+
+#elif defined(MEDIUM_BATCH_SSE2)
+
+    struct Pack
+    {
+        static constexpr int WIDTH = 4;
+
+        __m128 v;
+
+        static Pack load(const float *p) { return { _mm_loadu_ps(p) }; }
+        static Pack set1(float f)        { return { _mm_set1_ps(f) }; }
+
+        void store(float *p) const { _mm_storeu_ps(p, v); }
+    };
+
+    inline Pack operator+(Pack a, Pack b) { return { _mm_add_ps(a.v, b.v) }; }
+    inline Pack operator-(Pack a, Pack b) { return { _mm_sub_ps(a.v, b.v) }; }
+    inline Pack operator*(Pack a, Pack b) { return { _mm_mul_ps(a.v, b.v) }; }
+    inline Pack operator/(Pack a, Pack b) { return { _mm_div_ps(a.v, b.v) }; }
+
+    inline Pack max(Pack a, Pack b) { return { _mm_max_ps(a.v, b.v) }; }
+    inline Pack min(Pack a, Pack b) { return { _mm_min_ps(a.v, b.v) }; }
+    inline Pack sqrt(Pack a)        { return { _mm_sqrt_ps(a.v) }; }
+
+    inline Pack abs(Pack a)
+    {
+        return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) };
+    }
+
+    inline Pack selectPositive(Pack a, Pack b)
+    {
+        const __m128 mask = _mm_cmpgt_ps(a.v, _mm_setzero_ps());
+        return { _mm_and_ps(mask, b.v) };
+    }
+
+    inline Pack exp(Pack x)
+    {
+        x = min(max(x, Pack::set1(EXP_LO)), Pack::set1(EXP_HI));
+
+        Pack fx = x * Pack::set1(LOG2E) + Pack::set1(0.5f);
+
+        // floor without SSE4.1
+        const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx.v));
+        const __m128 needDec   = _mm_and_ps(
+            _mm_cmpgt_ps(truncated, fx.v), _mm_set1_ps(1));
+        fx.v = _mm_sub_ps(truncated, needDec);
+
+        x = x - fx * Pack::set1(EXP_C1) - fx * Pack::set1(EXP_C2);
+
+        const Pack z = x * x;
+        Pack y = Pack::set1(EXP_P0);
+        y = y * x + Pack::set1(EXP_P1);
+        y = y * x + Pack::set1(EXP_P2);
+        y = y * x + Pack::set1(EXP_P3);
+        y = y * x + Pack::set1(EXP_P4);
+        y = y * x + Pack::set1(EXP_P5);
+        y = y * z + x + Pack::set1(1);
+
+        __m128i n = _mm_cvttps_epi32(fx.v);
+        n = _mm_add_epi32(n, _mm_set1_epi32(127));
+        n = _mm_slli_epi32(n, 23);
+
+        return y * Pack{ _mm_castsi128_ps(n) };
+    }
+
+#else
+
+    struct Pack
+    {
+        static constexpr int WIDTH = 1;
+
+        float v;
+
+        static Pack load(const float *p) { return { *p }; }
+        static Pack set1(float f)        { return { f }; }
+
+        void store(float *p) const { *p = v; }
+    };
+
+    inline Pack operator+(Pack a, Pack b) { return { a.v + b.v }; }
+    inline Pack operator-(Pack a, Pack b) { return { a.v - b.v }; }
+    inline Pack operator*(Pack a, Pack b) { return { a.v * b.v }; }
+    inline Pack operator/(Pack a, Pack b) { return { a.v / b.v }; }
+
+    inline Pack max(Pack a, Pack b) { return { (std::max)(a.v, b.v) }; }
+    inline Pack min(Pack a, Pack b) { return { (std::min)(a.v, b.v) }; }
+    inline Pack sqrt(Pack a)        { return { std::sqrt(a.v) }; }
+    inline Pack abs(Pack a)         { return { std::abs(a.v) }; }
+    inline Pack exp(Pack a)         { return { std::exp(a.v) }; }
+
+    inline Pack selectPositive(Pack a, Pack b)
+    {
+        return { a.v > 0 ? b.v : 0.0f };
+    }
+
+#endif
+
+    // exponential density falloff. values below e^DENSITY_CUTOFF are flushed
+    // to zero: multiplied by the um^-1 scale coefficients they would become
+    // denormals, which are an order of magnitude slower on x86.
+    constexpr float DENSITY_CUTOFF = -60;
+
+    inline Pack density(Pack x)
+    {
+        return selectPositive(x - Pack::set1(DENSITY_CUTOFF), exp(x));
+    }
+
+    // runs kernel(const Pack *in, Pack *out) over count elements. the tail
+    // is padded through a local buffer so that every element goes through
+    // the same vector code.
+    template<int InputCount, int OutputCount, typename Kernel>
+    void runBatched(
+        int                 count,
+        const float *const (&inputs)[InputCount],
+        float *const       (&outputs)[OutputCount],
+        const Kernel       &kernel)
+    {
+        constexpr int W = Pack::WIDTH;
+
+        Pack in[InputCount], out[OutputCount];
+
+        int i = 0;
+        for(; i + W <= count; i += W)
+        {
+            for(int k = 0; k < InputCount; ++k)
+                in[k] = Pack::load(inputs[k] + i);
+
+            kernel(in, out);
+
+            for(int k = 0; k < OutputCount; ++k)
+                out[k].store(outputs[k] + i);
+        }
+
+        const int rest = count - i;
+        if(rest <= 0)
+            return;
+
+        float tmp[W];
+        for(int k = 0; k < InputCount; ++k)
+        {
+            for(int j = 0; j < W; ++j)
+                tmp[j] = j < rest ? inputs[k][i + j] : 0.0f;
+            in[k] = Pack::load(tmp);
+        }
+
+        kernel(in, out);
+
+        for(int k = 0; k < OutputCount; ++k)
+        {
+            out[k].store(tmp);
+            for(int j = 0; j < rest; ++j)
+                outputs[k][i + j] = tmp[j];
+        }
+    }
+
+} // namespace anonymous
+
+void expBatch(int count, const float *x, float *out)
+{
+    runBatched<1, 1>(count, { x }, { out },
+        [&](const Pack *in, Pack *o)
+    {
+        o[0] = exp(in[0]);
+    });
+}
+
+void AtmosphereProperties::getSigmaS(
+    int count, const float *h, const Float3Batch &out) const
+{
+    const Pack negInvHR = Pack::set1(-1 / hDensityRayleigh);
+    const Pack negInvHM = Pack::set1(-1 / hDensityMie);
+    const Pack sR[3] = {
+        Pack::set1(scatterRayleigh.x),
+        Pack::set1(scatterRayleigh.y),
+        Pack::set1(scatterRayleigh.z)
+    };
+    const Pack sM = Pack::set1(scatterMie);
+
+    runBatched<1, 3>(count, { h }, { out.r, out.g, out.b },
+        [&](const Pack *in, Pack *o)
+    {
+        const Pack rayleigh = density(in[0] * negInvHR);
+        const Pack mie      = sM * density(in[0] * negInvHM);
+        for(int c = 0; c < 3; ++c)
+            o[c] = sR[c] * rayleigh + mie;
+    });
+}
+
+void AtmosphereProperties::getSigmaT(
+    int count, const float *h, const Float3Batch &out) const
+{
+    const Pack negInvHR = Pack::set1(-1 / hDensityRayleigh);
+    const Pack negInvHM = Pack::set1(-1 / hDensityMie);
+    const Pack sR[3] = {
+        Pack::set1(scatterRayleigh.x),
+        Pack::set1(scatterRayleigh.y),
+        Pack::set1(scatterRayleigh.z)
+    };
+    const Pack tM = Pack::set1(scatterMie + absorbMie);
+    const Pack aO[3] = {
+        Pack::set1(absorbOzone.x),
+        Pack::set1(absorbOzone.y),
+        Pack::set1(absorbOzone.z)
+    };
+    const Pack ozoneCenter   = Pack::set1(ozoneCenterHeight);
+    const Pack ozoneHalfInvT = Pack::set1(0.5f / ozoneThickness);
+
+    runBatched<1, 3>(count, { h }, { out.r, out.g, out.b },
+        [&](const Pack *in, Pack *o)
+    {
+        const Pack rayleigh = density(in[0] * negInvHR);
+        const Pack mie      = tM * density(in[0] * negInvHM);
+        const Pack ozone    = max(
+            Pack::set1(0),
+            Pack::set1(1) - abs(in[0] - ozoneCenter) * ozoneHalfInvT);
+        for(int c = 0; c < 3; ++c)
+            o[c] = sR[c] * rayleigh + mie + aO[c] * ozone;
+    });
+}
+
+void AtmosphereProperties::getSigmaST(
+    int                count,
+    const float       *h,
+    const Float3Batch &outS,
+    const Float3Batch &outT) const
+{
+    const Pack negInvHR = Pack::set1(-1 / hDensityRayleigh);
+    const Pack negInvHM = Pack::set1(-1 / hDensityMie);
+    const Pack sR[3] = {
+        Pack::set1(scatterRayleigh.x),
+        Pack::set1(scatterRayleigh.y),
+        Pack::set1(scatterRayleigh.z)
+    };
+    const Pack sM = Pack::set1(scatterMie);
+    const Pack tM = Pack::set1(scatterMie + absorbMie);
+    const Pack aO[3] = {
+        Pack::set1(absorbOzone.x),
+        Pack::set1(absorbOzone.y),
+        Pack::set1(absorbOzone.z)
+    };
+    const Pack ozoneCenter   = Pack::set1(ozoneCenterHeight);
+    const Pack ozoneHalfInvT = Pack::set1(0.5f / ozoneThickness);
+
+    runBatched<1, 6>(
+        count, { h },
+        { outS.r, outS.g, outS.b, outT.r, outT.g, outT.b },
+        [&](const Pack *in, Pack *o)
+    {
+        const Pack rayleigh   = density(in[0] * negInvHR);
+        const Pack mieDensity = density(in[0] * negInvHM);
+        const Pack ozone      = max(
+            Pack::set1(0),
+            Pack::set1(1) - abs(in[0] - ozoneCenter) * ozoneHalfInvT);
+
+        const Pack mieS = sM * mieDensity;
+        const Pack mieT = tM * mieDensity;
+        for(int c = 0; c < 3; ++c)
+        {
+            const Pack r = sR[c] * rayleigh;
+            o[c]     = r + mieS;
+            o[c + 3] = r + mieT + aO[c] * ozone;
+        }
+    });
+}
+
+void AtmosphereProperties::evalPhaseFunction(
+    int count, const float *h, const float *u, const Float3Batch &out) const
+{
+    const Pack negInvHR = Pack::set1(-1 / hDensityRayleigh);
+    const Pack negInvHM = Pack::set1(-1 / hDensityMie);
+    const Pack sR[3] = {
+        Pack::set1(scatterRayleigh.x),
+        Pack::set1(scatterRayleigh.y),
+        Pack::set1(scatterRayleigh.z)
+    };
+    const Pack sM = Pack::set1(scatterMie);
+
+    const float g = asymmetryMie, g2 = g * g;
+    const Pack rayleighCoef = Pack::set1(3 / (16 * PI));
+    const Pack mieCoef      = Pack::set1(3 / (8 * PI) * (1 - g2) / (2 + g2));
+    const Pack mieM0        = Pack::set1(1 + g2);
+    const Pack mieM1        = Pack::set1(-2 * g);
+
+    runBatched<2, 3>(count, { h, u }, { out.r, out.g, out.b },
+        [&](const Pack *in, Pack *o)
+    {
+        const Pack rayleigh = density(in[0] * negInvHR);
+        const Pack sMie     = sM * density(in[0] * negInvHM);
+
+        const Pack u2 = Pack::set1(1) + in[1] * in[1];
+        const Pack pRayleigh = rayleighCoef * u2;
+
+        const Pack m    = mieM0 + mieM1 * in[1];
+        const Pack pMie = mieCoef * u2 / (m * sqrt(m));
+
+        for(int c = 0; c < 3; ++c)
+        {
+            const Pack sRayleigh = sR[c] * rayleigh;
+            const Pack s         = sRayleigh + sMie;
+            o[c] = selectPositive(
+                s, (pRayleigh * sRayleigh + pMie * sMie) / s);
+        }
+    });
+}
@@ -90,7 +90,8 @@ void MeshRenderer::setAtmosphere(
     ComPtr<ID3D11ShaderResourceView> trans,
     ComPtr<ID3D11ShaderResourceView> aerial,
     float                            aerialJitterRadius,
-    float                            maxAerialDistance)
+    float                            maxAerialDistance,
+    float                            aerialSliceExponent)
 {
     atmos_.update(atmos);
     TSlot_->setShaderResourceView(trans);
@@ -106,7 +107,8 @@ void MeshRenderer::setAtmosphere(
     psParamsData_.jitterFactor.x = aerialJitterRadius / aerialDesc.Width;
     psParamsData_.jitterFactor.y = aerialJitterRadius / aerialDesc.Height;
 
-    psParamsData_.maxAerialDistance = maxAerialDistance;
+    psParamsData_.maxAerialDistance      = maxAerialDistance;
+    psParamsData_.invAerialSliceExponent = 1 / aerialSliceExponent;
 }
 
 void MeshRenderer::setCamera(const Float3 &eye, const Mat4 &viewProj)
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "./common.h"
 #include "./medium.h"
 
 class MeshRenderer
@@ -13,7 +14,8 @@ public:
         ComPtr<ID3D11ShaderResourceView> trans,
         ComPtr<ID3D11ShaderResourceView> aerial,
         float                            aerialJitterRadius,
-        float                            maxAerialDistance);
+        float                            maxAerialDistance,
+        float                            aerialSliceExponent);
     
     void setCamera(const Float3 &eye, const Mat4 &viewProj);
 
@@ -47,6 +49,10 @@ private:
         Float3 eyePos;       float  worldScale;
         Mat4   shadowViewProj;
         Float2 jitterFactor; Float2 blueNoiseFactor;
+        float  invAerialSliceExponent;
+        float  pad0;
+        float  pad1;
+        float  pad2;
     };
 
     Shader<VS, PS>         shader_;
@@ -1,51 +1,18 @@
-#include <random>
-
-#include <cyPoint.h>
-#include <cySampleElim.h>
-
+#include "./cpu/dir_samples.h"
 #include "./multiscatter.h"
+#include "./texture_io.h"
 
-namespace
+void MultiScatteringLUT::setRayMarchQuadrature(QuadratureScheme scheme)
 {
-
-    std::vector<Float2> getPoissonDiskSamples(int count)
-    {
-        std::default_random_engine rng{ std::random_device()() };
-        std::uniform_real_distribution<float> dis(0, 1);
-
-        std::vector<cy::Point2f> rawPoints;
-        for(int i = 0; i < count * 10; ++i)
-        {
-            const float u = dis(rng);
-            const float v = dis(rng);
-            rawPoints.push_back({ u, v });
-        }
-
-        std::vector<cy::Point2f> outputPoints(count);
-
-        cy::WeightedSampleElimination<cy::Point2f, float, 2> wse;
-        wse.SetTiling(true);
-        wse.Eliminate(
-            rawPoints.data(),    rawPoints.size(),
-            outputPoints.data(), outputPoints.size());
-
-        std::vector<Float2> result;
-        for(auto &p : outputPoints)
-            result.push_back({ p.x, p.y });
-
-        return result;
-    }
-
-    constexpr int DIR_SAMPLE_COUNT     = 64;
-    constexpr int RAY_MARCH_STEP_COUNT = 256;
-
+    scheme_ = scheme;
 }
 
 void MultiScatteringLUT::generate(
     const Int2                      &res,
     ComPtr<ID3D11ShaderResourceView> transmittance,
     const Float3                    &terrainAlbedo,
-    const AtmosphereProperties      &atmos)
+    const AtmosphereProperties      &atmos,
+    uint32_t                         dirSampleSeed)
 {
     if(!shader_.isAllStageAvailable())
     {
@@ -54,7 +21,8 @@ void MultiScatteringLUT::generate(
     }
     auto shaderRscs = shader_.createResourceManager();
 
-    auto rawSamples = getPoissonDiskSamples(DIR_SAMPLE_COUNT);
+    auto rawSamples = generatePoissonDiskSamples(
+        DIR_SAMPLE_COUNT, dirSampleSeed);
 
     D3D11_BUFFER_DESC rawSamplesBufDesc;
     rawSamplesBufDesc.ByteWidth           = sizeof(Float2) * DIR_SAMPLE_COUNT;
@@ -125,15 +93,26 @@ void MultiScatteringLUT::generate(
 
         Float3 sunIntensity;
         int    rayMarchStepCount;
+
+        int   rayMarchQuadratureScheme;
+        float pad0;
+        float pad1;
+        float pad2;
     };
 
+    quadrature_.set(scheme_, RAY_MARCH_STEP_COUNT);
+
     ConstantBuffer<CSParams> csParams;
     csParams.initialize();
-    csParams.update(
-        { terrainAlbedo, DIR_SAMPLE_COUNT, Float3(1), RAY_MARCH_STEP_COUNT });
+    csParams.update({
+        terrainAlbedo, DIR_SAMPLE_COUNT, Float3(1),
+        quadrature_.getSampleCount(), quadrature_.getShaderScheme(), 0, 0, 0 });
     shaderRscs.getConstantBufferSlot<CS>("CSParams")
         ->setBuffer(csParams);
 
+    shaderRscs.getShaderResourceViewSlot<CS>("QuadratureRule")
+        ->setShaderResourceView(quadrature_.getSRV());
+
     shaderRscs.getShaderResourceViewSlot<CS>("Transmittance")
         ->setShaderResourceView(transmittance);
 
@@ -165,6 +144,21 @@ void MultiScatteringLUT::generate(
     srv_ = std::move(srv);
 }
 
+void MultiScatteringLUT::upload(const Table2D<Float4> &table)
+{
+    upload(table.getResolution(), table.data());
+}
+
+void MultiScatteringLUT::upload(const Int2 &res, const Float4 *texels)
+{
+    srv_ = createFloat4Texture2DSRV(res, texels);
+}
+
+void MultiScatteringLUT::upload(const LUTTableView &view)
+{
+    srv_ = createLUTTexture2DSRV(view);
+}
+
 ComPtr<ID3D11ShaderResourceView> MultiScatteringLUT::getSRV() const
 {
     return srv_;
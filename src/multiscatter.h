@@ -1,16 +1,34 @@
 #pragma once
 
+#include "./common.h"
+#include "./cpu/lut_file.h"
 #include "./medium.h"
+#include "./quadrature_rule.h"
 
 class MultiScatteringLUT
 {
 public:
 
+    static constexpr int DIR_SAMPLE_COUNT     = 64;
+    static constexpr int RAY_MARCH_STEP_COUNT = 256;
+
+    // sample placement of the ray march, Midpoint by default. see
+    // QuadratureRule for the schemes the shader supports.
+    void setRayMarchQuadrature(QuadratureScheme scheme);
+
     void generate(
         const Int2                      &res,
         ComPtr<ID3D11ShaderResourceView> transmittance,
         const Float3                    &terrainAlbedo,
-        const AtmosphereProperties      &atmos);
+        const AtmosphereProperties      &atmos,
+        uint32_t                         dirSampleSeed);
+
+    // use a table baked by CPUMultiScatteringLUT
+    void upload(const Table2D<Float4> &table);
+
+    void upload(const Int2 &res, const Float4 *texels);
+
+    void upload(const LUTTableView &view);
 
     ComPtr<ID3D11ShaderResourceView> getSRV() const;
 
@@ -18,4 +36,7 @@ private:
 
     Shader<CS>                       shader_;
     ComPtr<ID3D11ShaderResourceView> srv_;
+
+    QuadratureScheme scheme_ = QuadratureScheme::Midpoint;
+    QuadratureRule   quadrature_;
 };
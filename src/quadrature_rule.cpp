@@ -0,0 +1,77 @@
+#include <algorithm>
+
+#include "./quadrature_rule.h"
+
+void QuadratureRule::set(QuadratureScheme scheme, int sampleCount)
+{
+    if(scheme == QuadratureScheme::HeightAdaptive)
+        scheme = QuadratureScheme::Exponential;
+    sampleCount = (std::max)(sampleCount, 1);
+
+    // called along with every other setter of the luts
+    if(scheme == scheme_ && sampleCount == requestedCount_)
+        return;
+
+    scheme_         = scheme;
+    requestedCount_ = sampleCount;
+    srv_.Reset();
+
+    if(scheme != QuadratureScheme::Simpson &&
+       scheme != QuadratureScheme::GaussLegendre)
+    {
+        sampleCount_ = sampleCount;
+        return;
+    }
+
+    // Simpson rounds an even count up to the next odd one
+    const int maxCount = scheme == QuadratureScheme::Simpson ?
+        MAX_FIXED_SAMPLE_COUNT - 1 : MAX_FIXED_SAMPLE_COUNT;
+    const RayQuadrature quadrature(
+        scheme, (std::min)(sampleCount, maxCount), AtmosphereProperties{});
+    sampleCount_ = quadrature.getSampleCount();
+
+    const std::vector<float> cumulative = quadrature.getCumulativeWeights();
+
+    std::vector<float> data;
+    data.insert(data.end(), quadrature.getNodes().begin(), quadrature.getNodes().end());
+    data.insert(data.end(), quadrature.getWeights().begin(), quadrature.getWeights().end());
+    data.insert(data.end(), cumulative.begin(), cumulative.end());
+
+    D3D11_BUFFER_DESC bufDesc;
+    bufDesc.ByteWidth           = static_cast<UINT>(sizeof(float) * data.size());
+    bufDesc.Usage               = D3D11_USAGE_IMMUTABLE;
+    bufDesc.BindFlags           = D3D11_BIND_SHADER_RESOURCE;
+    bufDesc.CPUAccessFlags      = 0;
+    bufDesc.MiscFlags           = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+    bufDesc.StructureByteStride = sizeof(float);
+
+    D3D11_SUBRESOURCE_DATA bufSubrscData;
+    bufSubrscData.pSysMem          = data.data();
+    bufSubrscData.SysMemPitch      = 0;
+    bufSubrscData.SysMemSlicePitch = 0;
+
+    auto buf = device.createBuffer(bufDesc, &bufSubrscData);
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+    srvDesc.Format              = DXGI_FORMAT_UNKNOWN;
+    srvDesc.ViewDimension       = D3D11_SRV_DIMENSION_BUFFER;
+    srvDesc.Buffer.FirstElement = 0;
+    srvDesc.Buffer.NumElements  = static_cast<UINT>(data.size());
+
+    srv_ = device.createSRV(buf, srvDesc);
+}
+
+int QuadratureRule::getShaderScheme() const
+{
+    return static_cast<int>(scheme_);
+}
+
+int QuadratureRule::getSampleCount() const
+{
+    return sampleCount_;
+}
+
+ComPtr<ID3D11ShaderResourceView> QuadratureRule::getSRV() const
+{
+    return srv_;
+}
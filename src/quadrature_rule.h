@@ -0,0 +1,37 @@
+#pragma once
+
+#include "./common.h"
+#include "./cpu/quadrature.h"
+
+// sample placement of asset/quadrature.hlsl, shared by the transmittance,
+// multi-scattering, sky view and aerial perspective shaders. cell rules are
+// placed by the shader itself, while fixed rules read the nodes, weights and
+// running weights of a RayQuadrature from a structured buffer.
+class QuadratureRule
+{
+public:
+
+    // same as MAX_FIXED_QUADRATURE_SAMPLE_COUNT in asset/quadrature.hlsl
+    static constexpr int MAX_FIXED_SAMPLE_COUNT = 64;
+
+    // HeightAdaptive isn't ported to the shaders and runs as Exponential,
+    // the other density-following cell rule. fixed rules use at most
+    // MAX_FIXED_SAMPLE_COUNT samples.
+    void set(QuadratureScheme scheme, int sampleCount);
+
+    // QUADRATURE_* value of the shaders
+    int getShaderScheme() const;
+
+    int getSampleCount() const;
+
+    // nullptr for cell rules
+    ComPtr<ID3D11ShaderResourceView> getSRV() const;
+
+private:
+
+    QuadratureScheme scheme_         = QuadratureScheme::Midpoint;
+    int              requestedCount_ = 0;
+    int              sampleCount_    = 0;
+
+    ComPtr<ID3D11ShaderResourceView> srv_;
+};
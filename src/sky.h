@@ -1,6 +1,7 @@
 #pragma once
 
 #include "./camera.h"
+#include "./common.h"
 
 class SkyRenderer
 {
@@ -1,3 +1,6 @@
+#include <algorithm>
+
+#include "./cpu/sky_lut.h"
 #include "./sky_lut.h"
 
 void SkyLUT::initialize(const Int2 &res)
@@ -13,6 +16,8 @@ void SkyLUT::initialize(const Int2 &res)
         shaderRscs_.getShaderResourceViewSlot<PS>("Transmittance");
     multiScatterSlot_ =
         shaderRscs_.getShaderResourceViewSlot<PS>("MultiScattering");
+    quadratureSlot_ =
+        shaderRscs_.getShaderResourceViewSlot<PS>("QuadratureRule");
 
     resize(res);
 
@@ -31,6 +36,8 @@ void SkyLUT::initialize(const Int2 &res)
         D3D11_TEXTURE_ADDRESS_CLAMP);
     shaderRscs_.getSamplerSlot<PS>("MTSampler")
         ->setSampler(MTSampler);
+
+    updateQuadrature();
 }
 
 void SkyLUT::resize(const Int2 &res)
@@ -40,6 +47,11 @@ void SkyLUT::resize(const Int2 &res)
         DXGI_FORMAT_R32G32B32A32_FLOAT,
         DXGI_FORMAT_R32G32B32A32_FLOAT,
         DXGI_FORMAT_R32G32B32A32_FLOAT);
+    sampleCounts_ = createUIntTexture2D(res);
+    res_          = res;
+
+    // the new target holds nothing to amortize against
+    schedule_.reset(0);
 }
 
 ComPtr<ID3D11ShaderResourceView> SkyLUT::getLUT() const
@@ -50,41 +62,144 @@ ComPtr<ID3D11ShaderResourceView> SkyLUT::getLUT() const
 void SkyLUT::setCamera(const Float3 &atmosEyePos)
 {
     psParamsData_.atmosEyePosition = atmosEyePos;
+    inputsChanged_ = true;
 }
 
 void SkyLUT::setRayMarching(int stepCount)
 {
-    psParamsData_.lowResMarchStepCount = stepCount;
+    stepCount_ = stepCount;
+    updateQuadrature();
+    inputsChanged_ = true;
+}
+
+void SkyLUT::setQuadrature(QuadratureScheme scheme)
+{
+    scheme_ = scheme;
+    updateQuadrature();
+    inputsChanged_ = true;
+}
+
+void SkyLUT::setAdaptiveRayMarching(
+    bool enabled, float tolerance, int maxStepCount)
+{
+    psParamsData_.enableAdaptive       = enabled;
+    psParamsData_.adaptiveTolerance    = (std::max)(tolerance, 1e-6f);
+    psParamsData_.maxAdaptiveStepCount = (std::max)(maxStepCount, 1);
+    inputsChanged_ = true;
 }
 
 void SkyLUT::setAtmosphere(const AtmosphereProperties &atmos)
 {
     psAtmos_.update(atmos);
+    inputsChanged_ = true;
 }
 
 void SkyLUT::setSun(const Float3 &direction, const Float3 &intensity)
 {
     psParamsData_.sunDirection = direction;
     psParamsData_.sunIntensity = intensity;
+
+    inputsChanged_ = true;
 }
 
 void SkyLUT::setTransmittance(ComPtr<ID3D11ShaderResourceView> T)
 {
     transmittanceSlot_->setShaderResourceView(std::move(T));
+    inputsChanged_ = true;
 }
 
 void SkyLUT::setMultiScattering(bool enabled, ComPtr<ID3D11ShaderResourceView> M)
 {
     psParamsData_.enableMultiScattering = enabled;
     multiScatterSlot_->setShaderResourceView(std::move(M));
+    inputsChanged_ = true;
 }
 
 void SkyLUT::generate()
 {
+    renderRows(0, res_.y);
+
+    inputsChanged_ = false;
+    schedule_.reset(res_.y, computeSkyViewRowPriorities(res_.y));
+}
+
+void SkyLUT::update(const AmortizedUpdateSettings &settings)
+{
+    if(schedule_.getUnitCount() != res_.y)
+    {
+        generate();
+        return;
+    }
+
+    if(inputsChanged_)
+    {
+        schedule_.markAllStale();
+        inputsChanged_ = false;
+    }
+
+    // the gpu time of a row isn't known here, so only the required rows
+    // are rendered, as runs of adjacent rows
+    const std::vector<int> &order = schedule_.plan(settings);
+    std::vector<int> rows(
+        order.begin(), order.begin() + schedule_.getRequiredCount());
+    std::sort(rows.begin(), rows.end());
+
+    for(size_t i = 0; i < rows.size();)
+    {
+        size_t j = i + 1;
+        while(j < rows.size() && rows[j] == rows[j - 1] + 1)
+            ++j;
+        renderRows(rows[i], rows[j - 1] + 1);
+        i = j;
+    }
+
+    for(int y : rows)
+        schedule_.markFresh(y);
+    schedule_.advance();
+}
+
+const AmortizedSchedule &SkyLUT::getSchedule() const
+{
+    return schedule_;
+}
+
+ComPtr<ID3D11ShaderResourceView> SkyLUT::getSampleCounts() const
+{
+    return sampleCounts_.srv;
+}
+
+void SkyLUT::updateQuadrature()
+{
+    quadrature_.set(scheme_, stepCount_);
+    psParamsData_.lowResMarchStepCount = quadrature_.getSampleCount();
+    psParamsData_.quadratureScheme     = quadrature_.getShaderScheme();
+    quadratureSlot_->setShaderResourceView(quadrature_.getSRV());
+}
+
+void SkyLUT::renderRows(int rowBeg, int rowEnd)
+{
+    // the quad covers the viewport, so its texture coordinates are mapped
+    // back to the rows of the whole LUT
+    psParamsData_.vOffset = static_cast<float>(rowBeg) / res_.y;
+    psParamsData_.vScale  = static_cast<float>(rowEnd - rowBeg) / res_.y;
     psParams_.update(psParamsData_);
 
     LUT_.bind();
-    LUT_.useDefaultViewport();
+
+    // pixel shader UAVs follow the color buffer, see SampleCounts
+    ID3D11UnorderedAccessView *sampleCountUAV = sampleCounts_.uav.Get();
+    deviceContext->OMSetRenderTargetsAndUnorderedAccessViews(
+        D3D11_KEEP_RENDER_TARGETS_AND_DEPTH_STENCIL, nullptr, nullptr,
+        1, 1, &sampleCountUAV, nullptr);
+
+    D3D11_VIEWPORT viewport;
+    viewport.TopLeftX = 0;
+    viewport.TopLeftY = static_cast<float>(rowBeg);
+    viewport.Width    = static_cast<float>(res_.x);
+    viewport.Height   = static_cast<float>(rowEnd - rowBeg);
+    viewport.MinDepth = 0;
+    viewport.MaxDepth = 1;
+    deviceContext->RSSetViewports(1, &viewport);
 
     shader_.bind();
     shaderRscs_.bind();
@@ -95,5 +210,10 @@ void SkyLUT::generate()
     shaderRscs_.unbind();
     shader_.unbind();
 
+    ID3D11UnorderedAccessView *nullUAV = nullptr;
+    deviceContext->OMSetRenderTargetsAndUnorderedAccessViews(
+        D3D11_KEEP_RENDER_TARGETS_AND_DEPTH_STENCIL, nullptr, nullptr,
+        1, 1, &nullUAV, nullptr);
+
     LUT_.unbind();
 }
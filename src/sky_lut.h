@@ -1,6 +1,10 @@
 #pragma once
 
+#include "./common.h"
+#include "./cpu/amortized_update.h"
 #include "./medium.h"
+#include "./quadrature_rule.h"
+#include "./texture_io.h"
 
 class SkyLUT
 {
@@ -16,6 +20,16 @@ public:
 
     void setRayMarching(int stepCount);
 
+    // sample placement of the ray march, Midpoint by default. see
+    // QuadratureRule for the schemes the shader supports.
+    void setQuadrature(QuadratureScheme scheme);
+
+    // replaces the fixed steps and the quadrature with up to maxStepCount
+    // samples per texel, split among a few pilot cells by their estimated
+    // error, see asset/adaptive_march.hlsl. the GPU counterpart of
+    // CPUSkyLUT::setAdaptiveRayMarching.
+    void setAdaptiveRayMarching(bool enabled, float tolerance, int maxStepCount);
+
     void setAtmosphere(const AtmosphereProperties &atmos);
 
     void setSun(const Float3 &direction, const Float3 &intensity);
@@ -26,8 +40,26 @@ public:
 
     void generate();
 
+    // amortized alternative to generate(): renders only the rows an
+    // AmortizedSchedule requires for settings.maxStaleFrames, preferring
+    // the horizon with AmortizedOrder::Priority. any setter call since the
+    // last update marks all rows stale. renders the whole LUT after a
+    // resize.
+    void update(const AmortizedUpdateSettings &settings);
+
+    const AmortizedSchedule &getSchedule() const;
+
+    // R32_UINT texture with the samples each texel took when its row was
+    // last rendered, see readbackUIntTexture2D
+    ComPtr<ID3D11ShaderResourceView> getSampleCounts() const;
+
 private:
 
+    // rows [rowBeg, rowEnd) of the LUT
+    void renderRows(int rowBeg, int rowEnd);
+
+    void updateQuadrature();
+
     struct PSParams
     {
         Float3 atmosEyePosition;
@@ -37,7 +69,17 @@ private:
         int    enableMultiScattering;
 
         Float3 sunIntensity;
-        float  pad0;
+        float  vOffset;
+
+        float vScale;
+        int   quadratureScheme;
+        int   enableAdaptive;
+        float adaptiveTolerance;
+
+        int   maxAdaptiveStepCount;
+        float pad0;
+        float pad1;
+        float pad2;
     };
 
     Shader<VS, PS>         shader_;
@@ -45,11 +87,21 @@ private:
     
     ShaderResourceViewSlot<PS> *transmittanceSlot_ = nullptr;
     ShaderResourceViewSlot<PS> *multiScatterSlot_  = nullptr;
+    ShaderResourceViewSlot<PS> *quadratureSlot_    = nullptr;
 
-    RenderTarget LUT_;
+    RenderTarget  LUT_;
+    UIntTexture2D sampleCounts_;
+    Int2          res_;
 
     PSParams psParamsData_ = {};
 
+    int              stepCount_ = 40;
+    QuadratureScheme scheme_    = QuadratureScheme::Midpoint;
+    QuadratureRule   quadrature_;
+
     ConstantBuffer<AtmosphereProperties> psAtmos_;
     ConstantBuffer<PSParams>             psParams_;
+
+    bool              inputsChanged_ = true;
+    AmortizedSchedule schedule_;
 };
@@ -0,0 +1,293 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "./texture_io.h"
+
+ComPtr<ID3D11ShaderResourceView> createFloat4Texture2DSRV(
+    const Int2 &res, const Float4 *texels)
+{
+    D3D11_TEXTURE2D_DESC texDesc;
+    texDesc.Width          = static_cast<UINT>(res.x);
+    texDesc.Height         = static_cast<UINT>(res.y);
+    texDesc.MipLevels      = 1;
+    texDesc.ArraySize      = 1;
+    texDesc.Format         = DXGI_FORMAT_R32G32B32A32_FLOAT;
+    texDesc.SampleDesc     = { 1, 0 };
+    texDesc.Usage          = D3D11_USAGE_IMMUTABLE;
+    texDesc.BindFlags      = D3D11_BIND_SHADER_RESOURCE;
+    texDesc.CPUAccessFlags = 0;
+    texDesc.MiscFlags      = 0;
+
+    D3D11_SUBRESOURCE_DATA initData;
+    initData.pSysMem          = texels;
+    initData.SysMemPitch      = static_cast<UINT>(sizeof(Float4) * res.x);
+    initData.SysMemSlicePitch = 0;
+
+    auto tex = device.createTex2D(texDesc, &initData);
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+    srvDesc.Format                    = DXGI_FORMAT_R32G32B32A32_FLOAT;
+    srvDesc.ViewDimension             = D3D11_SRV_DIMENSION_TEXTURE2D;
+    srvDesc.Texture2D.MipLevels       = 1;
+    srvDesc.Texture2D.MostDetailedMip = 0;
+    return device.createSRV(tex, srvDesc);
+}
+
+ComPtr<ID3D11ShaderResourceView> createDynamicFloat4Texture2DSRV(const Int2 &res)
+{
+    D3D11_TEXTURE2D_DESC texDesc;
+    texDesc.Width          = static_cast<UINT>(res.x);
+    texDesc.Height         = static_cast<UINT>(res.y);
+    texDesc.MipLevels      = 1;
+    texDesc.ArraySize      = 1;
+    texDesc.Format         = DXGI_FORMAT_R32G32B32A32_FLOAT;
+    texDesc.SampleDesc     = { 1, 0 };
+    texDesc.Usage          = D3D11_USAGE_DYNAMIC;
+    texDesc.BindFlags      = D3D11_BIND_SHADER_RESOURCE;
+    texDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    texDesc.MiscFlags      = 0;
+    auto tex = device.createTex2D(texDesc);
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+    srvDesc.Format                    = DXGI_FORMAT_R32G32B32A32_FLOAT;
+    srvDesc.ViewDimension             = D3D11_SRV_DIMENSION_TEXTURE2D;
+    srvDesc.Texture2D.MipLevels       = 1;
+    srvDesc.Texture2D.MostDetailedMip = 0;
+    return device.createSRV(tex, srvDesc);
+}
+
+void updateDynamicFloat4Texture2D(
+    const ComPtr<ID3D11ShaderResourceView> &srv, const Float4 *texels)
+{
+    ComPtr<ID3D11Resource> rsc;
+    srv->GetResource(rsc.GetAddressOf());
+
+    ComPtr<ID3D11Texture2D> tex;
+    rsc->QueryInterface(tex.GetAddressOf());
+
+    D3D11_TEXTURE2D_DESC texDesc;
+    tex->GetDesc(&texDesc);
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if(FAILED(deviceContext->Map(
+        tex.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+        throw std::runtime_error("failed to map dynamic texture");
+
+    for(UINT y = 0; y < texDesc.Height; ++y)
+    {
+        std::memcpy(
+            static_cast<char *>(mapped.pData) + y * mapped.RowPitch,
+            texels + y * texDesc.Width,
+            sizeof(Float4) * texDesc.Width);
+    }
+
+    deviceContext->Unmap(tex.Get(), 0);
+}
+
+UIntTexture2D createUIntTexture2D(const Int2 &res)
+{
+    D3D11_TEXTURE2D_DESC texDesc;
+    texDesc.Width          = static_cast<UINT>(res.x);
+    texDesc.Height         = static_cast<UINT>(res.y);
+    texDesc.MipLevels      = 1;
+    texDesc.ArraySize      = 1;
+    texDesc.Format         = DXGI_FORMAT_R32_UINT;
+    texDesc.SampleDesc     = { 1, 0 };
+    texDesc.Usage          = D3D11_USAGE_DEFAULT;
+    texDesc.BindFlags      = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
+    texDesc.CPUAccessFlags = 0;
+    texDesc.MiscFlags      = 0;
+    auto tex = device.createTex2D(texDesc);
+
+    D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+    uavDesc.Format             = DXGI_FORMAT_R32_UINT;
+    uavDesc.ViewDimension      = D3D11_UAV_DIMENSION_TEXTURE2D;
+    uavDesc.Texture2D.MipSlice = 0;
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+    srvDesc.Format                    = DXGI_FORMAT_R32_UINT;
+    srvDesc.ViewDimension             = D3D11_SRV_DIMENSION_TEXTURE2D;
+    srvDesc.Texture2D.MipLevels       = 1;
+    srvDesc.Texture2D.MostDetailedMip = 0;
+
+    UIntTexture2D result;
+    result.uav = device.createUAV(tex, uavDesc);
+    result.srv = device.createSRV(tex, srvDesc);
+    return result;
+}
+
+DXGI_FORMAT getDXGIFormat(LUTTexelFormat format)
+{
+    switch(format)
+    {
+    case LUTTexelFormat::RGBA32F: return DXGI_FORMAT_R32G32B32A32_FLOAT;
+    case LUTTexelFormat::RGBA16F: return DXGI_FORMAT_R16G16B16A16_FLOAT;
+    case LUTTexelFormat::RGB9E5:  return DXGI_FORMAT_R9G9B9E5_SHAREDEXP;
+    }
+    return DXGI_FORMAT_UNKNOWN;
+}
+
+ComPtr<ID3D11ShaderResourceView> createLUTTexture2DSRV(const LUTTableView &view)
+{
+    if(view.getResolution().z != 1)
+        throw std::invalid_argument("lut table is not two-dimensional");
+
+    const DXGI_FORMAT format = getDXGIFormat(view.getFormat());
+    const int mipLevels = view.getMipLevels();
+
+    D3D11_TEXTURE2D_DESC texDesc;
+    texDesc.Width          = static_cast<UINT>(view.getResolution().x);
+    texDesc.Height         = static_cast<UINT>(view.getResolution().y);
+    texDesc.MipLevels      = static_cast<UINT>(mipLevels);
+    texDesc.ArraySize      = 1;
+    texDesc.Format         = format;
+    texDesc.SampleDesc     = { 1, 0 };
+    texDesc.Usage          = D3D11_USAGE_IMMUTABLE;
+    texDesc.BindFlags      = D3D11_BIND_SHADER_RESOURCE;
+    texDesc.CPUAccessFlags = 0;
+    texDesc.MiscFlags      = 0;
+
+    D3D11_SUBRESOURCE_DATA initData[LUT_FILE_MAX_MIP_LEVELS];
+    for(int level = 0; level < mipLevels; ++level)
+    {
+        initData[level].pSysMem          = view.getMipData(level);
+        initData[level].SysMemPitch      = static_cast<UINT>(view.getMipRowPitch(level));
+        initData[level].SysMemSlicePitch = 0;
+    }
+
+    auto tex = device.createTex2D(texDesc, initData);
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+    srvDesc.Format                    = format;
+    srvDesc.ViewDimension             = D3D11_SRV_DIMENSION_TEXTURE2D;
+    srvDesc.Texture2D.MipLevels       = static_cast<UINT>(mipLevels);
+    srvDesc.Texture2D.MostDetailedMip = 0;
+    return device.createSRV(tex, srvDesc);
+}
+
+Table2D<Float4> readbackFloat4Texture2D(
+    const ComPtr<ID3D11ShaderResourceView> &srv)
+{
+    ComPtr<ID3D11Resource> rsc;
+    srv->GetResource(rsc.GetAddressOf());
+
+    ComPtr<ID3D11Texture2D> tex;
+    rsc->QueryInterface(tex.GetAddressOf());
+
+    D3D11_TEXTURE2D_DESC texDesc;
+    tex->GetDesc(&texDesc);
+    if(texDesc.Format != DXGI_FORMAT_R32G32B32A32_FLOAT)
+        throw std::runtime_error("readback texture must be R32G32B32A32_FLOAT");
+
+    texDesc.Usage          = D3D11_USAGE_STAGING;
+    texDesc.BindFlags      = 0;
+    texDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+    texDesc.MiscFlags      = 0;
+    auto staging = device.createTex2D(texDesc);
+
+    deviceContext->CopyResource(staging.Get(), tex.Get());
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if(FAILED(deviceContext->Map(staging.Get(), 0, D3D11_MAP_READ, 0, &mapped)))
+        throw std::runtime_error("failed to map readback texture");
+
+    Table2D<Float4> result(
+        { static_cast<int>(texDesc.Width), static_cast<int>(texDesc.Height) });
+    for(int y = 0; y < result.getHeight(); ++y)
+    {
+        std::memcpy(
+            &result(0, y),
+            static_cast<const char *>(mapped.pData) + y * mapped.RowPitch,
+            sizeof(Float4) * result.getWidth());
+    }
+
+    deviceContext->Unmap(staging.Get(), 0);
+    return result;
+}
+
+Table2D<int> readbackUIntTexture2D(
+    const ComPtr<ID3D11ShaderResourceView> &srv)
+{
+    ComPtr<ID3D11Resource> rsc;
+    srv->GetResource(rsc.GetAddressOf());
+
+    ComPtr<ID3D11Texture2D> tex;
+    rsc->QueryInterface(tex.GetAddressOf());
+
+    D3D11_TEXTURE2D_DESC texDesc;
+    tex->GetDesc(&texDesc);
+    if(texDesc.Format != DXGI_FORMAT_R32_UINT)
+        throw std::runtime_error("readback texture must be R32_UINT");
+
+    texDesc.Usage          = D3D11_USAGE_STAGING;
+    texDesc.BindFlags      = 0;
+    texDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+    texDesc.MiscFlags      = 0;
+    auto staging = device.createTex2D(texDesc);
+
+    deviceContext->CopyResource(staging.Get(), tex.Get());
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if(FAILED(deviceContext->Map(staging.Get(), 0, D3D11_MAP_READ, 0, &mapped)))
+        throw std::runtime_error("failed to map readback texture");
+
+    Table2D<int> result(
+        { static_cast<int>(texDesc.Width), static_cast<int>(texDesc.Height) });
+    for(int y = 0; y < result.getHeight(); ++y)
+    {
+        std::memcpy(
+            &result(0, y),
+            static_cast<const char *>(mapped.pData) + y * mapped.RowPitch,
+            sizeof(int) * result.getWidth());
+    }
+
+    deviceContext->Unmap(staging.Get(), 0);
+    return result;
+}
+
+Table3D<Float4> readbackFloat4Texture3D(
+    const ComPtr<ID3D11ShaderResourceView> &srv)
+{
+    ComPtr<ID3D11Resource> rsc;
+    srv->GetResource(rsc.GetAddressOf());
+
+    ComPtr<ID3D11Texture3D> tex;
+    rsc->QueryInterface(tex.GetAddressOf());
+
+    D3D11_TEXTURE3D_DESC texDesc;
+    tex->GetDesc(&texDesc);
+    if(texDesc.Format != DXGI_FORMAT_R32G32B32A32_FLOAT)
+        throw std::runtime_error("readback texture must be R32G32B32A32_FLOAT");
+
+    texDesc.Usage          = D3D11_USAGE_STAGING;
+    texDesc.BindFlags      = 0;
+    texDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+    texDesc.MiscFlags      = 0;
+    auto staging = device.createTex3D(texDesc);
+
+    deviceContext->CopyResource(staging.Get(), tex.Get());
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if(FAILED(deviceContext->Map(staging.Get(), 0, D3D11_MAP_READ, 0, &mapped)))
+        throw std::runtime_error("failed to map readback texture");
+
+    Table3D<Float4> result({
+        static_cast<int>(texDesc.Width),
+        static_cast<int>(texDesc.Height),
+        static_cast<int>(texDesc.Depth)
+    });
+    for(int z = 0; z < result.getDepth(); ++z)
+    {
+        for(int y = 0; y < result.getHeight(); ++y)
+        {
+            std::memcpy(
+                &result(0, y, z),
+                static_cast<const char *>(mapped.pData) +
+                    z * mapped.DepthPitch + y * mapped.RowPitch,
+                sizeof(Float4) * result.getWidth());
+        }
+    }
+
+    deviceContext->Unmap(staging.Get(), 0);
+    return result;
+}
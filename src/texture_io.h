@@ -0,0 +1,45 @@
+#pragma once
+
+#include "./common.h"
+#include "./cpu/lut_file.h"
+
+// immutable R32G32B32A32_FLOAT texture initialized from res.x * res.y texels
+ComPtr<ID3D11ShaderResourceView> createFloat4Texture2DSRV(
+    const Int2 &res, const Float4 *texels);
+
+// dynamic R32G32B32A32_FLOAT texture, rewritten by the CPU through
+// updateDynamicFloat4Texture2D, e.g. once per frame
+ComPtr<ID3D11ShaderResourceView> createDynamicFloat4Texture2DSRV(const Int2 &res);
+
+// replaces all texels of a texture created by createDynamicFloat4Texture2DSRV
+void updateDynamicFloat4Texture2D(
+    const ComPtr<ID3D11ShaderResourceView> &srv, const Float4 *texels);
+
+// R32_UINT texture, written by a shader through uav and read through srv,
+// e.g. the sample counts of SkyLUT and AerialPerspectiveLUT
+struct UIntTexture2D
+{
+    ComPtr<ID3D11ShaderResourceView>  srv;
+    ComPtr<ID3D11UnorderedAccessView> uav;
+};
+
+UIntTexture2D createUIntTexture2D(const Int2 &res);
+
+DXGI_FORMAT getDXGIFormat(LUTTexelFormat format);
+
+// immutable texture with all mip levels of a 2d table, initialized directly
+// from the mapped file payload
+ComPtr<ID3D11ShaderResourceView> createLUTTexture2DSRV(const LUTTableView &view);
+
+// copy a R32G32B32A32_FLOAT texture back to the CPU through a staging copy
+Table2D<Float4> readbackFloat4Texture2D(
+    const ComPtr<ID3D11ShaderResourceView> &srv);
+
+// copy a R32_UINT texture back to the CPU through a staging copy
+Table2D<int> readbackUIntTexture2D(
+    const ComPtr<ID3D11ShaderResourceView> &srv);
+
+// copy a R32G32B32A32_FLOAT 3d texture back to the CPU, e.g. to compare the
+// aerial perspective volume with CPUAerialPerspectiveLUT
+Table3D<Float4> readbackFloat4Texture3D(
+    const ComPtr<ID3D11ShaderResourceView> &srv);
@@ -1,7 +1,13 @@
 #include <agz-utils/thread.h>
 
+#include "./texture_io.h"
 #include "./transmittance.h"
 
+void TransmittanceLUT::setQuadrature(QuadratureScheme scheme)
+{
+    scheme_ = scheme;
+}
+
 void TransmittanceLUT::generate(
     const Int2 &res, const AtmosphereProperties &atmos)
 {
@@ -47,6 +53,26 @@ void TransmittanceLUT::generate(
     shaderRscs.getConstantBufferSlot<CS>("AtmosphereParams")
         ->setBuffer(atmosConsts);
 
+    struct CSParams
+    {
+        int   stepCount;
+        int   quadratureScheme;
+        float pad0;
+        float pad1;
+    };
+
+    quadrature_.set(scheme_, STEP_COUNT);
+
+    ConstantBuffer<CSParams> csParams;
+    csParams.initialize();
+    csParams.update({
+        quadrature_.getSampleCount(), quadrature_.getShaderScheme(), 0, 0 });
+    shaderRscs.getConstantBufferSlot<CS>("CSParams")
+        ->setBuffer(csParams);
+
+    shaderRscs.getShaderResourceViewSlot<CS>("QuadratureRule")
+        ->setShaderResourceView(quadrature_.getSRV());
+
     shaderRscs.getUnorderedAccessViewSlot<CS>("Transmittance")
         ->setUnorderedAccessView(uav);
 
@@ -64,10 +90,33 @@ void TransmittanceLUT::generate(
     shader_.unbind();
     deviceContext->CopyResource(shaderResourceTex.Get(), shaderOutputTex.Get());
 
-    srv_  = std::move(srv);
+    srv_ = std::move(srv);
+    res_ = res;
+}
+
+void TransmittanceLUT::upload(const Table2D<Float4> &table)
+{
+    upload(table.getResolution(), table.data());
+}
+
+void TransmittanceLUT::upload(const Int2 &res, const Float4 *texels)
+{
+    srv_ = createFloat4Texture2DSRV(res, texels);
+    res_ = res;
+}
+
+void TransmittanceLUT::upload(const LUTTableView &view)
+{
+    srv_ = createLUTTexture2DSRV(view);
+    res_ = { view.getResolution().x, view.getResolution().y };
 }
 
 ComPtr<ID3D11ShaderResourceView> TransmittanceLUT::getSRV() const
 {
     return srv_;
 }
+
+const Int2 &TransmittanceLUT::getResolution() const
+{
+    return res_;
+}
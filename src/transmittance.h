@@ -1,17 +1,41 @@
 #pragma once
 
+#include "./common.h"
+#include "./cpu/lut_file.h"
 #include "./medium.h"
+#include "./quadrature_rule.h"
 
 class TransmittanceLUT
 {
 public:
 
+    // ray march steps of generate()
+    static constexpr int STEP_COUNT = 1000;
+
+    // sample placement of the ray march, Midpoint by default. see
+    // QuadratureRule for the schemes the shader supports.
+    void setQuadrature(QuadratureScheme scheme);
+
     void generate(const Int2 &res, const AtmosphereProperties &atmosphere);
 
+    // use a table baked by CPUTransmittanceLUT
+    void upload(const Table2D<Float4> &table);
+
+    void upload(const Int2 &res, const Float4 *texels);
+
+    void upload(const LUTTableView &view);
+
     ComPtr<ID3D11ShaderResourceView> getSRV() const;
 
+    // see AtmosphereProperties::transmittanceRes
+    const Int2 &getResolution() const;
+
 private:
 
     Shader<CS>                       shader_;
     ComPtr<ID3D11ShaderResourceView> srv_;
+    Int2                             res_;
+
+    QuadratureScheme scheme_ = QuadratureScheme::Midpoint;
+    QuadratureRule   quadrature_;
 };
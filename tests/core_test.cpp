@@ -0,0 +1,1018 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "../src/cpu/aerial_lut.h"
+#include "../src/cpu/amortized_update.h"
+#include "../src/cpu/async_lut_builder.h"
+#include "../src/cpu/dir_samples.h"
+#include "../src/cpu/lut_cache.h"
+#include "../src/cpu/lut_file.h"
+#include "../src/cpu/multiscatter.h"
+#include "../src/cpu/optical_depth.h"
+#include "../src/cpu/quadrature.h"
+#include "../src/cpu/sky_atlas.h"
+#include "../src/cpu/sky_lut.h"
+#include "../src/cpu/transmittance.h"
+#include "../src/lut_graph.h"
+#include "../src/medium.h"
+
+namespace
+{
+
+    int failureCount = 0;
+
+    void check(bool condition, const char *test, const char *what)
+    {
+        if(!condition)
+        {
+            std::printf("FAILED %s: %s\n", test, what);
+            ++failureCount;
+        }
+    }
+
+    float relativeError(float expected, float actual, float floor)
+    {
+        return std::abs(actual - expected) / (std::max)(std::abs(expected), floor);
+    }
+
+    // distance from the planet-relative oriR along dir to the ground, or to
+    // the top of the atmosphere when the ray misses the ground
+    float findRayEnd(const AtmosphereProperties &atmos, const Float3 &oriR, const Float3 &dir)
+    {
+        const float b = dot(oriR, dir);
+        const float c = dot(oriR, oriR);
+
+        const float groundDisc = b * b - c + atmos.planetRadius * atmos.planetRadius;
+        if(groundDisc >= 0 && -b - std::sqrt(groundDisc) > 0)
+            return -b - std::sqrt(groundDisc);
+        return -b + std::sqrt(b * b - c + atmos.atmosphereRadius * atmos.atmosphereRadius);
+    }
+
+    // single scattering over the first distance units of the ray from
+    // eyeHeight along dir, by a dense midpoint march whose transmittances
+    // are closed-form instead of LUT lookups
+    Float3 computeReferenceInScatter(
+        const AtmosphereProperties &atmos,
+        float                       eyeHeight,
+        const Float3               &dir,
+        const Float3               &sunDirection,
+        float                       distance,
+        int                         stepCount)
+    {
+        const Float3 oriR  = { 0, eyeHeight + atmos.planetRadius, 0 };
+        const Float3 toSun = -sunDirection;
+        const float  dt    = distance / stepCount;
+
+        Float3 result;
+        for(int i = 0; i < stepCount; ++i)
+        {
+            const float  t    = (i + 0.5f) * dt;
+            const Float3 posR = oriR + dir * t;
+            const float  r    = posR.length();
+            const float  h    = r - atmos.planetRadius;
+
+            const float b = dot(posR, toSun);
+            if(b < 0 && b * b - r * r + atmos.planetRadius * atmos.planetRadius > 0)
+                continue;
+
+            const Float3 depth    = computeOpticalDepth(atmos, eyeHeight, dir.y, t);
+            const Float3 eyeTrans = {
+                std::exp(-depth.x), std::exp(-depth.y), std::exp(-depth.z)
+            };
+            const Float3 sunTrans = computeTransmittance(
+                atmos, h, std::asin((std::clamp)(b / r, -1.0f, 1.0f)));
+
+            result += dt * eyeTrans * atmos.getSigmaS(h) *
+                      atmos.evalPhaseFunction(h, dot(sunDirection, -dir)) * sunTrans;
+        }
+        return result;
+    }
+
+    // two bakes of the same atmosphere and seed, with the direction samples
+    // eliminated anew and a different thread count each, must agree bit for
+    // bit
+    void testMultiScatteringDeterminism()
+    {
+        constexpr const char *TEST = "multi-scattering determinism";
+        constexpr uint32_t SEED = 7;
+
+        const AtmosphereProperties atmos = AtmosphereProperties().toStdUnit();
+
+        CPUTransmittanceLUT T;
+        T.setStepCount(200);
+        T.generate({ 32, 32 }, atmos);
+
+        auto bake = [&](int threadCount)
+        {
+            const std::vector<float> points = eliminatePoissonDiskSamples(64, 2, SEED);
+            std::vector<Float2> dirSamples(points.size() / 2);
+            for(size_t i = 0; i < dirSamples.size(); ++i)
+                dirSamples[i] = { points[2 * i], points[2 * i + 1] };
+
+            CPUMultiScatteringLUT M;
+            M.setRayMarchStepCount(64);
+            M.setThreadCount(threadCount);
+            M.generate({ 16, 16 }, T.getTable(), Float3(0.3f), atmos, dirSamples);
+            return M.getTable();
+        };
+
+        const Table2D<Float4> a = bake(1);
+        const Table2D<Float4> b = bake(4);
+        check(a.getTexelCount() == b.getTexelCount() &&
+              std::memcmp(a.data(), b.data(), sizeof(Float4) * a.getTexelCount()) == 0,
+              TEST, "bakes with different thread counts differ");
+    }
+
+    // sets survive a save and load, and a file whose counts disagree with
+    // its payload is rejected as a whole
+    void testPoissonDiskSampleCache()
+    {
+        constexpr const char *TEST = "poisson disk sample cache";
+
+        const auto dir = std::filesystem::temp_directory_path() / "atmosphere_core_test";
+        std::filesystem::create_directories(dir);
+        const std::string filename = (dir / "samples.bin").string();
+
+        PoissonDiskSampleCache saved;
+        const std::vector<float> a = saved.getSamples(32, 2, 3);
+        const std::vector<float> b = saved.getSamples(16, 3, 5);
+        check(saved.saveToFile(filename), TEST, "save failed");
+
+        PoissonDiskSampleCache loaded;
+        check(loaded.loadFromFile(filename), TEST, "load failed");
+        check(loaded.getSamples(32, 2, 3) == a && loaded.getSamples(16, 3, 5) == b,
+              TEST, "loaded sets differ");
+        check(loaded.getHitCount() == 2 && loaded.getMissCount() == 0,
+              TEST, "loaded sets not used");
+
+        // header of one set of count 2d points and the payload of
+        // pointCount points
+        auto loadsWith = [&](int32_t count, int pointCount)
+        {
+            const std::string corrupt = (dir / "corrupt_samples.bin").string();
+            {
+                std::ofstream fout(corrupt, std::ios::binary | std::ios::trunc);
+                const uint32_t header[] = { 0x43534450, 1, 1 };
+                const int32_t  key[]    = { count, 2, 3 };
+                fout.write(reinterpret_cast<const char *>(header), sizeof(header));
+                fout.write(reinterpret_cast<const char *>(key), sizeof(key));
+                fout.write(
+                    reinterpret_cast<const char *>(a.data()),
+                    static_cast<std::streamsize>(sizeof(float) * 2 * pointCount));
+            }
+            PoissonDiskSampleCache cache;
+            const bool result = cache.loadFromFile(corrupt);
+            cache.getSamples(count, 2, 3);
+            return result && cache.getMissCount() == 0;
+        };
+
+        check(loadsWith(32, 32), TEST, "well-formed set rejected");
+        check(!loadsWith(32, 31), TEST, "set with too few points accepted");
+        check(!loadsWith(31, 32), TEST, "set with too many points accepted");
+    }
+
+    // a request made while another is being built cancels that build, and
+    // only the set of the newer request is published
+    void testAsyncLUTBuilder()
+    {
+        constexpr const char *TEST = "async lut builder";
+
+        const AtmosphereProperties atmos = AtmosphereProperties().toStdUnit();
+
+        // takes far longer than the test, unless canceled
+        LUTBuildRequest slow;
+        slow.atmos                  = atmos;
+        slow.transmittanceRes       = { 256, 256 };
+        slow.transmittanceStepCount = 100000;
+
+        LUTBuildRequest fast;
+        fast.atmos                            = atmos;
+        fast.transmittanceRes                 = { 16, 16 };
+        fast.transmittanceStepCount           = 50;
+        fast.transmittanceQuadrature          = QuadratureScheme::GaussLegendre;
+        fast.multiScatteringRes               = { 8, 8 };
+        fast.multiScatteringRayMarchStepCount = 16;
+        fast.dirSampleCount                   = 16;
+
+        AsyncLUTBuilder builder(2);
+
+        const uint64_t slowGeneration = builder.request(slow);
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while(builder.getBuildingGeneration() != slowGeneration &&
+              std::chrono::steady_clock::now() < deadline)
+            std::this_thread::yield();
+        check(builder.getBuildingGeneration() == slowGeneration,
+              TEST, "first request never started building");
+
+        const uint64_t fastGeneration = builder.request(fast);
+        builder.wait();
+
+        check(fastGeneration > slowGeneration, TEST, "generation didn't increase");
+        check(builder.getCanceledCount() == 1, TEST, "first build wasn't canceled");
+
+        const auto latest = builder.getLatest();
+        check(latest && latest->generation == fastGeneration,
+              TEST, "published set isn't the second one");
+        check(latest && latest->multiScattering.getWidth() == 8,
+              TEST, "published set wasn't built from the second request");
+
+        CPUTransmittanceLUT T;
+        T.setStepCount(50);
+        T.setQuadrature(QuadratureScheme::GaussLegendre);
+        T.generate({ 16, 16 }, atmos);
+        check(latest && std::memcmp(
+                  latest->transmittance.data(), T.getTable().data(),
+                  sizeof(Float4) * T.getTable().getTexelCount()) == 0,
+              TEST, "transmittance wasn't baked with the requested quadrature");
+    }
+
+    // closed-form optical depth against a fine midpoint ray march, over the
+    // texels both tables share
+    void testAnalyticTransmittance()
+    {
+        constexpr const char *TEST = "analytic transmittance";
+
+        const AtmosphereProperties atmos = AtmosphereProperties().toStdUnit();
+        const Int2 res = { 64, 64 };
+
+        CPUTransmittanceLUT rayMarch;
+        rayMarch.setMode(TransmittanceMode::RayMarch);
+        rayMarch.setStepCount(4000);
+        rayMarch.generate(res, atmos);
+
+        CPUTransmittanceLUT analytic;
+        analytic.setMode(TransmittanceMode::Analytic);
+        analytic.generate(res, atmos);
+
+        float maxErr = 0;
+        for(size_t i = 0; i < rayMarch.getTable().getTexelCount(); ++i)
+        {
+            const Float4 &e = rayMarch.getTable().data()[i];
+            const Float4 &a = analytic.getTable().data()[i];
+            for(int c = 0; c < 3; ++c)
+                maxErr = (std::max)(maxErr, relativeError(e[c], a[c], 1e-3f));
+        }
+        check(maxErr < 1e-2f, TEST, "tables differ by more than 1%");
+    }
+
+    void testTransmittanceUV(TransmittanceParameterization param)
+    {
+        constexpr const char *TEST = "transmittance uv round trip";
+
+        AtmosphereProperties atmos = AtmosphereProperties().toStdUnit();
+        atmos.transmittanceParam = param;
+
+        const Int2  res       = { 256, 64 };
+        const float maxHeight = atmos.atmosphereRadius - atmos.planetRadius;
+
+        float maxHeightErr = 0, maxSinThetaErr = 0;
+        bool  inRange = true;
+        for(int i = 1; i < 32; ++i)
+        {
+            const float h = maxHeight * i / 32;
+
+            // rays leaving the atmosphere, above the local horizon
+            const float horizon = -std::sqrt(
+                1 - std::pow(atmos.planetRadius / (atmos.planetRadius + h), 2.0f));
+            for(int j = 1; j < 32; ++j)
+            {
+                const float sinTheta = horizon + (1 - horizon) * j / 32;
+
+                const Float2 uv = encodeTransmittanceUV(atmos, res, h, sinTheta);
+                inRange &= 0 <= uv.x && uv.x <= 1 && 0 <= uv.y && uv.y <= 1;
+
+                const Float2 decoded = decodeTransmittanceUV(atmos, res, uv);
+                maxHeightErr   = (std::max)(maxHeightErr, std::abs(decoded.x - h));
+                maxSinThetaErr = (std::max)(maxSinThetaErr, std::abs(decoded.y - sinTheta));
+            }
+        }
+
+        check(inRange, TEST, "uv out of [0, 1]");
+        check(maxHeightErr < 1e-3f * maxHeight, TEST, "height mismatch");
+        check(maxSinThetaErr < 1e-3f, TEST, "sinTheta mismatch");
+    }
+
+    void testLUTFile()
+    {
+        constexpr const char *TEST = "lut file";
+
+        const auto dir = std::filesystem::temp_directory_path() / "atmosphere_core_test";
+        std::filesystem::create_directories(dir);
+        const std::string filename = (dir / "test.lut").string();
+
+        Table2D<Float4> table({ 37, 21 });
+        for(int y = 0; y < table.getHeight(); ++y)
+        {
+            for(int x = 0; x < table.getWidth(); ++x)
+                table(x, y) = Float4(0.01f * x, 0.3f * y, std::exp(-0.2f * x), 1);
+        }
+
+        LUTFileWriter writer;
+        writer.addTable(LUTKind::Transmittance, 42, table, LUTTexelFormat::RGBA32F, 0);
+        writer.addTable(LUTKind::MultiScattering, 7, table, LUTTexelFormat::RGBA16F);
+        check(writer.write(filename), TEST, "write failed");
+
+        {
+            LUTFile file;
+            check(file.open(filename), TEST, "open failed");
+            check(file.getTableCount() == 2, TEST, "wrong table count");
+
+            const LUTTableView *T = file.findTable(LUTKind::Transmittance);
+            const LUTTableView *M = file.findTable(LUTKind::MultiScattering);
+            check(T && M, TEST, "table missing");
+            if(T && M)
+            {
+                check(T->getHash() == 42 && M->getHash() == 7, TEST, "wrong hash");
+                check(T->getMipLevels() == 6, TEST, "wrong mip count");
+
+                const Table2D<Float4> decodedT = T->decode();
+                const Table2D<Float4> decodedM = M->decode();
+                bool exact = true;
+                float maxHalfErr = 0;
+                for(size_t i = 0; i < table.getTexelCount(); ++i)
+                {
+                    for(int c = 0; c < 4; ++c)
+                    {
+                        exact &= decodedT.data()[i][c] == table.data()[i][c];
+                        maxHalfErr = (std::max)(maxHalfErr, relativeError(
+                            table.data()[i][c], decodedM.data()[i][c], 1e-3f));
+                    }
+                }
+                check(exact, TEST, "RGBA32F table changed");
+                check(maxHalfErr < 1e-3f, TEST, "RGBA16F table off by more than 0.1%");
+            }
+        }
+
+        std::vector<char> bytes(std::filesystem::file_size(filename));
+        std::ifstream(filename, std::ios::binary).read(bytes.data(), bytes.size());
+
+        auto opensWith = [&](const std::vector<char> &content)
+        {
+            const std::string corrupt = (dir / "corrupt.lut").string();
+            std::ofstream(corrupt, std::ios::binary | std::ios::trunc)
+                .write(content.data(), content.size());
+            LUTFile file;
+            return file.open(corrupt);
+        };
+
+        check(opensWith(bytes), TEST, "unmodified copy rejected");
+
+        auto badMagic = bytes;
+        badMagic[0] ^= 1;
+        check(!opensWith(badMagic), TEST, "bad magic accepted");
+
+        auto badVersion = bytes;
+        badVersion[4] ^= 1;
+        check(!opensWith(badVersion), TEST, "bad version accepted");
+
+        auto badTableCount = bytes;
+        badTableCount[8] = 100;
+        check(!opensWith(badTableCount), TEST, "bad table count accepted");
+
+        auto truncated = bytes;
+        truncated.resize(truncated.size() - 64);
+        check(!opensWith(truncated), TEST, "truncated file accepted");
+
+        // width of the first table descriptor
+        auto badResolution = bytes;
+        badResolution[LUT_FILE_ALIGNMENT + 16] = 0;
+        badResolution[LUT_FILE_ALIGNMENT + 17] = 1;
+        check(!opensWith(badResolution), TEST, "bad resolution accepted");
+
+        // the aerial volume keeps transmittance in alpha, which RGB9E5 drops
+        auto addsWith = [&](LUTKind kind, LUTTexelFormat format)
+        {
+            try
+            {
+                LUTFileWriter().addTable(kind, 0, table, format);
+                return true;
+            }
+            catch(const std::invalid_argument &)
+            {
+                return false;
+            }
+        };
+        check(!addsWith(LUTKind::AerialPerspective, LUTTexelFormat::RGB9E5),
+              TEST, "aerial table accepted without alpha");
+        check(addsWith(LUTKind::AerialPerspective, LUTTexelFormat::RGBA16F) &&
+              addsWith(LUTKind::SkyView, LUTTexelFormat::RGB9E5),
+              TEST, "table with a supported format rejected");
+
+        // a resolution whose texel count overflows 64 bits
+        auto hugeResolution = bytes;
+        for(int offset = 16; offset < 28; offset += 4)
+        {
+            const int32_t dim = 0x7fffffff;
+            std::memcpy(&hugeResolution[LUT_FILE_ALIGNMENT + offset], &dim, sizeof(dim));
+        }
+        check(!opensWith(hugeResolution), TEST, "overflowing resolution accepted");
+
+        // tables wide enough for more mip levels than a view holds
+        Table2D<Float4> wide({ 1 << 17, 1 });
+        for(size_t i = 0; i < wide.getTexelCount(); ++i)
+            wide.data()[i] = Float4(1, 2, 3, 4);
+
+        bool tooManyThrown = false;
+        try
+        {
+            LUTFileWriter().addTable(
+                LUTKind::SkyView, 0, wide, LUTTexelFormat::RGBA16F,
+                LUT_FILE_MAX_MIP_LEVELS + 1);
+        }
+        catch(const std::invalid_argument &)
+        {
+            tooManyThrown = true;
+        }
+        check(tooManyThrown, TEST, "writer accepted too many mip levels");
+
+        LUTFileWriter wideWriter;
+        wideWriter.addTable(LUTKind::SkyView, 0, wide, LUTTexelFormat::RGBA16F, 0);
+        check(wideWriter.write(filename), TEST, "wide write failed");
+        {
+            LUTFile file;
+            check(file.open(filename) &&
+                  file.getTable(0).getMipLevels() == LUT_FILE_MAX_MIP_LEVELS,
+                  TEST, "full chain of a wide table isn't capped");
+        }
+
+        std::vector<char> wideBytes(std::filesystem::file_size(filename));
+        std::ifstream(filename, std::ios::binary).read(wideBytes.data(), wideBytes.size());
+
+        const uint32_t badMipLevels = LUT_FILE_MAX_MIP_LEVELS + 1;
+        std::memcpy(
+            &wideBytes[LUT_FILE_ALIGNMENT + 28], &badMipLevels, sizeof(badMipLevels));
+        check(!opensWith(wideBytes), TEST, "too many mip levels accepted");
+
+        std::filesystem::remove_all(dir);
+    }
+
+    // everything that changes a cached table has to change its key
+    void testLUTCacheKeys()
+    {
+        constexpr const char *TEST = "lut cache keys";
+
+        const AtmosphereProperties atmos = AtmosphereProperties().toStdUnit();
+        const Int2 res = { 64, 64 };
+
+        auto transHash = [&](TransmittanceMode mode, QuadratureScheme scheme)
+        {
+            return hashTransmittanceInputs(atmos, res, mode, 100, scheme);
+        };
+        check(transHash(TransmittanceMode::RayMarch, QuadratureScheme::Midpoint) !=
+              transHash(TransmittanceMode::RayMarch, QuadratureScheme::Simpson),
+              TEST, "transmittance key ignores the quadrature");
+        check(transHash(TransmittanceMode::Analytic, QuadratureScheme::Midpoint) ==
+              transHash(TransmittanceMode::Analytic, QuadratureScheme::Simpson),
+              TEST, "analytic transmittance key depends on the quadrature");
+
+        auto msHash = [&](QuadratureScheme scheme)
+        {
+            return hashMultiScatteringInputs(
+                atmos, res, 64, scheme, 64, 0, Float3(0.3f), 1);
+        };
+        check(msHash(QuadratureScheme::Midpoint) != msHash(QuadratureScheme::Exponential),
+              TEST, "multi-scattering key ignores the quadrature");
+    }
+
+    void testLUTGraph()
+    {
+        constexpr const char *TEST = "lut graph";
+
+        float sunAngle = 0.3f;
+        float eyeHeight = 1;
+
+        ToleranceFilter<float> sunFilter;
+        constexpr float SUN_TOLERANCE = 1e-3f;
+
+        LUTGraph graph;
+        const auto sun = graph.addNode(
+            "sun", {},
+            [&]
+            {
+                LUTHasher hasher;
+                hasher.add(sunFilter.update(sunAngle, SUN_TOLERANCE));
+                return hasher.getHash();
+            },
+            [](uint64_t) { });
+        const auto sky = graph.addNode(
+            "sky", { sun },
+            [&]
+            {
+                LUTHasher hasher;
+                hasher.add(eyeHeight);
+                return hasher.getHash();
+            },
+            [](uint64_t) { });
+
+        graph.update();
+        check(graph.getBuildCount(sun) == 1 && graph.getBuildCount(sky) == 1,
+              TEST, "first update must build every node");
+
+        graph.update();
+        check(graph.getBuildCount(sun) == 1 && graph.getBuildCount(sky) == 1,
+              TEST, "unchanged inputs rebuilt");
+        check(graph.getSkipCount(sun) == 1 && graph.getSkipCount(sky) == 1,
+              TEST, "unchanged inputs not reported as skipped");
+
+        sunAngle += 0.5f * SUN_TOLERANCE;
+        graph.update();
+        check(graph.getBuildCount(sun) == 1, TEST, "change within tolerance rebuilt");
+        check(sunFilter.get() == 0.3f, TEST, "filter moved within tolerance");
+
+        sunAngle += 2 * SUN_TOLERANCE;
+        graph.update();
+        check(graph.getBuildCount(sun) == 2 && graph.getBuildCount(sky) == 2,
+              TEST, "change beyond tolerance must rebuild the node and its dependents");
+        check(sunFilter.get() == sunAngle, TEST, "filter didn't follow the input");
+
+        eyeHeight = 2;
+        graph.update();
+        check(graph.getBuildCount(sun) == 2 && graph.getBuildCount(sky) == 3,
+              TEST, "a dependent change must not rebuild its dependency");
+
+        graph.invalidate(sun);
+        graph.update();
+        check(graph.getBuildCount(sun) == 3 && graph.getBuildCount(sky) == 4,
+              TEST, "invalidated node must rebuild with its dependents");
+
+        ToleranceFilter<Float3> exactFilter;
+        exactFilter.update({ 1, 2, 3 }, 0);
+        check(exactFilter.update({ 1, 2, 3.0001f }, 0).z == 3.0001f,
+              TEST, "zero tolerance held a change");
+    }
+
+    // batched medium kernels against the scalar ones, over a count that
+    // isn't a multiple of any SIMD width
+    void testMediumBatch()
+    {
+        constexpr const char *TEST = "medium batch";
+        constexpr int COUNT = 1003;
+
+        const AtmosphereProperties atmos = AtmosphereProperties().toStdUnit();
+        const float maxHeight = atmos.atmosphereRadius - atmos.planetRadius;
+
+        std::default_random_engine rng{ 42 };
+        std::uniform_real_distribution<float> heightDis(0, maxHeight);
+        std::uniform_real_distribution<float> cosDis(-1, 1);
+
+        std::vector<float> h(COUNT), u(COUNT);
+        for(int i = 0; i < COUNT; ++i)
+        {
+            h[i] = heightDis(rng);
+            u[i] = cosDis(rng);
+        }
+
+        std::vector<float> s[3], t[3], p[3], st[3], ts[3];
+        for(int c = 0; c < 3; ++c)
+        {
+            s[c].resize(COUNT);
+            t[c].resize(COUNT);
+            p[c].resize(COUNT);
+            st[c].resize(COUNT);
+            ts[c].resize(COUNT);
+        }
+        auto batch = [](std::vector<float> (&v)[3])
+        {
+            return Float3Batch{ v[0].data(), v[1].data(), v[2].data() };
+        };
+
+        atmos.getSigmaS(COUNT, h.data(), batch(s));
+        atmos.getSigmaT(COUNT, h.data(), batch(t));
+        atmos.evalPhaseFunction(COUNT, h.data(), u.data(), batch(p));
+        atmos.getSigmaST(COUNT, h.data(), batch(st), batch(ts));
+
+        float maxErr = 0;
+        bool  fusedMatches = true;
+        for(int i = 0; i < COUNT; ++i)
+        {
+            const Float3 es = atmos.getSigmaS(h[i]);
+            const Float3 et = atmos.getSigmaT(h[i]);
+            const Float3 ep = atmos.evalPhaseFunction(h[i], u[i]);
+            for(int c = 0; c < 3; ++c)
+            {
+                maxErr = (std::max)(maxErr, relativeError(es[c], s[c][i], 1e-12f));
+                maxErr = (std::max)(maxErr, relativeError(et[c], t[c][i], 1e-12f));
+                maxErr = (std::max)(maxErr, relativeError(ep[c], p[c][i], 1e-12f));
+                fusedMatches &= st[c][i] == s[c][i] && ts[c][i] == t[c][i];
+            }
+        }
+        check(maxErr < 1e-5f, TEST, "batched kernels differ from the scalar ones");
+        check(fusedMatches, TEST, "getSigmaST differs from getSigmaS / getSigmaT");
+
+        std::vector<float> x(COUNT), e(COUNT);
+        for(int i = 0; i < COUNT; ++i)
+            x[i] = -80 + 160.0f * i / COUNT;
+        expBatch(COUNT, x.data(), e.data());
+
+        float maxExpErr = 0;
+        for(int i = 0; i < COUNT; ++i)
+            maxExpErr = (std::max)(maxExpErr, relativeError(std::exp(x[i]), e[i], 1e-30f));
+        check(maxExpErr < 1e-6f, TEST, "expBatch off by more than a few ulps");
+    }
+
+    // running integrals of the fixed rules against closed forms: a single
+    // Gauss-Legendre panel interpolates polynomials of degree n - 1, and the
+    // composite Simpson ones are exact for quadratics
+    void testQuadrature()
+    {
+        constexpr const char *TEST = "quadrature";
+
+        const AtmosphereProperties atmos = AtmosphereProperties().toStdUnit();
+
+        auto maxRunningError = [&](
+            QuadratureScheme scheme, int sampleCount, int degree)
+        {
+            const RayQuadrature quadrature(scheme, sampleCount, atmos);
+            const int n = quadrature.getSampleCount();
+
+            std::vector<float> t(n), w(n), sigma(n), depth(n);
+            quadrature.place(atmos.planetRadius, 1, 0, 2, t.data(), w.data());
+            for(int i = 0; i < n; ++i)
+                sigma[i] = std::pow(t[i], static_cast<float>(degree));
+
+            const float total = quadrature.accumulate(
+                w.data(), sigma.data(), 1, depth.data());
+
+            auto integral = [&](float x)
+            {
+                return 1 + std::pow(x, static_cast<float>(degree + 1)) / (degree + 1);
+            };
+
+            float maxErr = relativeError(integral(2), total, 1e-3f);
+            for(int i = 0; i < n; ++i)
+                maxErr = (std::max)(maxErr, relativeError(integral(t[i]), depth[i], 1e-3f));
+            return maxErr;
+        };
+
+        check(maxRunningError(QuadratureScheme::GaussLegendre, 8, 7) < 1e-5f,
+              TEST, "gauss-legendre running integrals aren't interpolatory");
+        check(maxRunningError(QuadratureScheme::GaussLegendre, 64, 3) < 1e-5f,
+              TEST, "gauss-legendre running integrals of 64 nodes are off");
+        check(maxRunningError(QuadratureScheme::Simpson, 7, 2) < 1e-5f,
+              TEST, "simpson running integrals aren't exact for quadratics");
+        check(maxRunningError(QuadratureScheme::Simpson, 1001, 2) < 1e-4f,
+              TEST, "simpson running integrals of 1001 nodes are off");
+
+        check(RayQuadrature(QuadratureScheme::GaussLegendre, 1000, atmos)
+                .getSampleCount() == MAX_GAUSS_LEGENDRE_SAMPLE_COUNT,
+              TEST, "gauss-legendre sample count isn't clamped");
+
+        const std::vector<float> cumulative =
+            RayQuadrature(QuadratureScheme::Simpson, 5, atmos).getCumulativeWeights();
+        const float expected[] = { 5.0f / 48, 1.0f / 6, -1.0f / 48, 0, 0 };
+        bool rowMatches = cumulative.size() == 25;
+        for(int k = 0; rowMatches && k < 5; ++k)
+            rowMatches = std::abs(cumulative[5 + k] - expected[k]) < 1e-6f;
+        check(rowMatches, TEST, "simpson running weights of an odd node are off");
+    }
+
+    // single scattering of every other texel against a dense march, see
+    // CPUSkyLUT::computeRow for the parameterization. the adaptive march
+    // must come as close within its sample budget.
+    void testSkyLUT()
+    {
+        constexpr const char *TEST = "sky lut";
+
+        const AtmosphereProperties atmos = AtmosphereProperties().toStdUnit();
+        const Int2   res          = { 32, 32 };
+        const float  eyeHeight    = 1000;
+        const Float3 sunDirection = Float3(0.3f, -0.5f, 0.8f).normalize();
+
+        CPUTransmittanceLUT T;
+        T.setMode(TransmittanceMode::Analytic);
+        T.generate({ 256, 256 }, atmos);
+
+        const Float3 oriR = { 0, eyeHeight + atmos.planetRadius, 0 };
+
+        Table2D<Float3> expected({ res.x / 2, res.y / 2 });
+        for(int y = 0; y < res.y; y += 2)
+        {
+            const float vm    = 2 * (y + 0.5f) / res.y - 1;
+            const float theta = (vm < 0 ? -1.0f : 1.0f) * (PI / 2) * vm * vm;
+
+            for(int x = 0; x < res.x; x += 2)
+            {
+                const float  phi = 2 * PI * (x + 0.5f) / res.x;
+                const Float3 dir = {
+                    std::cos(phi) * std::cos(theta), std::sin(theta),
+                    std::sin(phi) * std::cos(theta)
+                };
+                expected(x / 2, y / 2) = computeReferenceInScatter(
+                    atmos, eyeHeight, dir, sunDirection, findRayEnd(atmos, oriR, dir), 2000);
+            }
+        }
+
+        auto maxError = [&](bool adaptive, int stepCount)
+        {
+            CPUSkyLUT sky;
+            sky.setCamera({ 0, eyeHeight, 0 });
+            sky.setRayMarching(stepCount);
+            sky.setAdaptiveRayMarching(adaptive, 1e-3f, stepCount);
+            sky.setAtmosphere(atmos);
+            sky.setSun(sunDirection, Float3(1));
+            sky.setTransmittance(&T.getTable());
+            sky.setMultiScattering(false, nullptr);
+            sky.generate(res);
+
+            float result = 0;
+            for(int y = 0; y < res.y; y += 2)
+            {
+                for(int x = 0; x < res.x; x += 2)
+                {
+                    const Float3 &e = expected(x / 2, y / 2);
+                    const Float4 &a = sky.getTable()(x, y);
+                    for(int c = 0; c < 3; ++c)
+                        result = (std::max)(result, relativeError(e[c], a[c], 1e-3f));
+                }
+            }
+
+            int maxSampleCount = 0;
+            for(size_t i = 0; i < sky.getSampleCounts().getTexelCount(); ++i)
+                maxSampleCount = (std::max)(maxSampleCount, sky.getSampleCounts().data()[i]);
+            check(maxSampleCount <= stepCount, TEST, "sample budget exceeded");
+
+            return result;
+        };
+
+        const float fixedErr    = maxError(false, 200);
+        const float uniformErr  = maxError(false, 64);
+        const float adaptiveErr = maxError(true, 64);
+        check(fixedErr < 1e-2f, TEST, "texels off the reference by more than 1%");
+        check(adaptiveErr < 1e-2f && adaptiveErr < uniformErr,
+              TEST, "adaptive march no closer than uniform steps of the same budget");
+    }
+
+    // in-scattering and transmittance of every other froxel column against
+    // a dense march to the froxel centers, see
+    // CPUAerialPerspectiveLUT::computeColumn for the parameterization
+    void testAerialPerspectiveLUT()
+    {
+        constexpr const char *TEST = "aerial perspective lut";
+
+        const AtmosphereProperties atmos = AtmosphereProperties().toStdUnit();
+        const Int3   res          = { 8, 8, 16 };
+        const float  eyeHeight    = 1000;
+        const float  maxDistance  = 32000;
+        const Float3 sunDirection = Float3(0.3f, -0.5f, 0.8f).normalize();
+
+        const Camera::FrustumDirections frustumDirs = {
+            { -1, 0.3f, 1 }, { 1, 0.3f, 1 }, { -1, -0.1f, 1 }, { 1, -0.1f, 1 }
+        };
+
+        CPUTransmittanceLUT T;
+        T.setMode(TransmittanceMode::Analytic);
+        T.generate({ 256, 256 }, atmos);
+
+        CPUAerialPerspectiveLUT aerial;
+        aerial.setCamera({ 0, 0, 0 }, eyeHeight, frustumDirs);
+        aerial.setSun(sunDirection);
+        aerial.setAtmosphere(atmos);
+        aerial.setMarchingParams(maxDistance, 16);
+        aerial.setSliceDistribution(2);
+        aerial.setTransmittanceLUT(&T.getTable());
+        aerial.setMultiScatterLUT(false, nullptr);
+        aerial.generate(res);
+
+        auto lerp = [](const Float3 &a, const Float3 &b, float t)
+        {
+            return a + t * (b - a);
+        };
+
+        float maxErr = 0, maxAlphaErr = 0;
+        for(int y = 0; y < res.y; y += 2)
+        {
+            for(int x = 0; x < res.x; x += 2)
+            {
+                const float  xf  = (x + 0.5f) / res.x;
+                const float  yf  = (y + 0.5f) / res.y;
+                const Float3 dir = lerp(
+                    lerp(frustumDirs.frustumA, frustumDirs.frustumB, xf),
+                    lerp(frustumDirs.frustumC, frustumDirs.frustumD, xf), yf).normalize();
+
+                for(int z = 0; z < res.z; ++z)
+                {
+                    const float distance = decodeAerialSliceDistance(
+                        (z + 0.5f) / res.z, maxDistance, 2);
+
+                    const Float3 expected = computeReferenceInScatter(
+                        atmos, eyeHeight, dir, sunDirection, distance, 1000);
+                    const Float4 &actual = aerial.getVolume()(x, y, z);
+                    for(int c = 0; c < 3; ++c)
+                        maxErr = (std::max)(maxErr, relativeError(expected[c], actual[c], 1e-4f));
+
+                    const Float3 depth = computeOpticalDepth(atmos, eyeHeight, dir.y, distance);
+                    const float  trans = 0.2126f * std::exp(-depth.x) +
+                                         0.7152f * std::exp(-depth.y) +
+                                         0.0722f * std::exp(-depth.z);
+                    maxAlphaErr = (std::max)(maxAlphaErr, std::abs(actual.w - trans));
+                }
+            }
+        }
+        check(maxErr < 1e-2f, TEST, "in-scattering off the reference by more than 1%");
+        check(maxAlphaErr < 1e-3f, TEST, "transmittance off the reference");
+    }
+
+    // on a node of the grid the atlas must reproduce CPUSkyLUT::generate,
+    // at any sun azimuth, and in between interpolate it closely
+    void testSkyViewAtlas()
+    {
+        constexpr const char *TEST = "sky view atlas";
+
+        const AtmosphereProperties atmos = AtmosphereProperties().toStdUnit();
+        const Int2  res       = { 16, 16 };
+        const float maxHeight = atmos.atmosphereRadius - atmos.planetRadius;
+
+        CPUTransmittanceLUT T;
+        T.setMode(TransmittanceMode::Analytic);
+        T.generate({ 64, 64 }, atmos);
+
+        CPUSkyViewAtlas atlas;
+        atlas.setAtmosphere(atmos);
+        atlas.setTransmittance(&T.getTable());
+        atlas.setMultiScattering(false, nullptr);
+        check(atlas.bake(res), TEST, "bake failed");
+
+        auto maxError = [&](float eyeHeight, const Float3 &sunDirection)
+        {
+            CPUSkyLUT sky;
+            sky.setAtmosphere(atmos);
+            sky.setTransmittance(&T.getTable());
+            sky.setMultiScattering(false, nullptr);
+            sky.setCamera({ 0, eyeHeight, 0 });
+            sky.setSun(sunDirection, Float3(2));
+            sky.generate(res);
+
+            Table2D<Float4> sampled;
+            atlas.sample(eyeHeight, sunDirection, Float3(2), sampled);
+
+            float result = 0;
+            for(size_t i = 0; i < sampled.getTexelCount(); ++i)
+            {
+                for(int c = 0; c < 3; ++c)
+                {
+                    result = (std::max)(result, relativeError(
+                        sky.getTable().data()[i][c], sampled.data()[i][c], 1e-3f));
+                }
+            }
+            return result;
+        };
+
+        // height node 6 and elevation node 24 of the default grid, i.e.
+        // PI / 2 * (1 / 2)^2
+        const float nodeHeight = maxHeight * 36 / 225;
+        const float nodeAlpha  = PI / 8;
+        const float azimuth    = 2 * PI * 5 / res.x;
+
+        const float nodeErr = maxError(
+            nodeHeight, { std::cos(nodeAlpha), -std::sin(nodeAlpha), 0 });
+        const float turnedErr = maxError(nodeHeight, {
+            std::cos(azimuth) * std::cos(nodeAlpha), -std::sin(nodeAlpha),
+            std::sin(azimuth) * std::cos(nodeAlpha)
+        });
+        const float betweenErr = maxError(
+            5000, Float3(0.3f, -0.5f, 0.8f).normalize());
+
+        check(nodeErr < 1e-4f, TEST, "sample on a grid node differs from the sky lut");
+        check(turnedErr < 1e-3f, TEST, "sample of a turned sun differs from the sky lut");
+        check(betweenErr < 5e-2f, TEST, "sample between nodes off by more than 5%");
+    }
+
+    // units must be refreshed within maxStaleFrames updates of their inputs
+    // changing, even without any time budget and with zero weights, and a
+    // schedule whose inputs stop changing converges
+    void testAmortizedSchedule()
+    {
+        constexpr const char *TEST = "amortized schedule";
+        constexpr int UNIT_COUNT = 37;
+
+        std::vector<float> weights(UNIT_COUNT);
+        for(int i = 0; i < UNIT_COUNT; ++i)
+            weights[i] = static_cast<float>(i % 5);
+
+        std::mt19937 rng(3);
+        bool withinLimit = true, converged = true;
+
+        for(auto order : { AmortizedOrder::RoundRobin, AmortizedOrder::Priority })
+        {
+            for(int maxStaleFrames : { 1, 3, 4 })
+            {
+                AmortizedUpdateSettings settings;
+                settings.order          = order;
+                settings.maxStaleFrames = maxStaleFrames;
+                settings.budgetUs       = 0;
+
+                AmortizedSchedule schedule;
+                schedule.reset(UNIT_COUNT, weights);
+
+                // update in which each unit became stale, -1 when fresh
+                std::vector<int> staleSince(UNIT_COUNT, -1);
+
+                for(int frame = 0; frame < 64; ++frame)
+                {
+                    // inputs change on most of the first frames
+                    if(frame < 48 && rng() % 4 != 0)
+                    {
+                        schedule.markAllStale();
+                        for(int &since : staleSince)
+                        {
+                            if(since < 0)
+                                since = frame;
+                        }
+                    }
+
+                    std::vector<char> refreshed(UNIT_COUNT, 0);
+                    schedule.run(settings, 4, [&](int unit) { refreshed[unit] = 1; });
+
+                    for(int i = 0; i < UNIT_COUNT; ++i)
+                    {
+                        if(refreshed[i])
+                            staleSince[i] = -1;
+                        else if(staleSince[i] >= 0 && frame - staleSince[i] + 1 >= maxStaleFrames)
+                            withinLimit = false;
+                    }
+                    withinLimit &= schedule.getMaxStaleness() < maxStaleFrames;
+                }
+
+                converged &= schedule.isConverged();
+            }
+        }
+
+        check(withinLimit, TEST, "unit stale for more than maxStaleFrames updates");
+        check(converged, TEST, "schedule didn't converge");
+    }
+
+    // the slice mapping and its inverse round trip for any exponent
+    void testAerialSliceDistribution()
+    {
+        constexpr const char *TEST = "aerial slice distribution";
+        constexpr float MAX_DISTANCE = 32000;
+
+        float maxDepthErr = 0, maxDistanceErr = 0;
+        bool  monotonic = true;
+        for(float exponent : { 1.0f, 2.0f, 3.5f })
+        {
+            float lastDistance = -1;
+            for(int i = 0; i <= 64; ++i)
+            {
+                const float w        = i / 64.0f;
+                const float distance = decodeAerialSliceDistance(w, MAX_DISTANCE, exponent);
+                const float depth    = encodeAerialSliceDepth(distance, MAX_DISTANCE, exponent);
+
+                maxDepthErr = (std::max)(maxDepthErr, std::abs(depth - w));
+                monotonic &= distance > lastDistance;
+                lastDistance = distance;
+
+                const float d = MAX_DISTANCE * i / 64;
+                maxDistanceErr = (std::max)(maxDistanceErr, relativeError(
+                    d, decodeAerialSliceDistance(
+                        encodeAerialSliceDepth(d, MAX_DISTANCE, exponent),
+                        MAX_DISTANCE, exponent), 1));
+            }
+        }
+
+        check(maxDepthErr < 1e-5f, TEST, "depth round trip off");
+        check(maxDistanceErr < 1e-5f, TEST, "distance round trip off");
+        check(monotonic, TEST, "slice distances not increasing");
+        check(decodeAerialSliceDistance(0.5f, MAX_DISTANCE, 1) == MAX_DISTANCE / 2 &&
+              decodeAerialSliceDistance(0.5f, MAX_DISTANCE, 2) == MAX_DISTANCE / 4,
+              TEST, "slice distances don't follow w^exponent");
+    }
+
+} // namespace anonymous
+
+int main()
+{
+    testAnalyticTransmittance();
+    testMultiScatteringDeterminism();
+    testPoissonDiskSampleCache();
+    testAsyncLUTBuilder();
+    testTransmittanceUV(TransmittanceParameterization::Linear);
+    testTransmittanceUV(TransmittanceParameterization::Horizon);
+    testLUTFile();
+    testLUTCacheKeys();
+    testLUTGraph();
+    testMediumBatch();
+    testQuadrature();
+    testSkyLUT();
+    testAerialPerspectiveLUT();
+    testSkyViewAtlas();
+    testAmortizedSchedule();
+    testAerialSliceDistribution();
+
+    if(failureCount)
+    {
+        std::printf("%d check(s) failed\n", failureCount);
+        return 1;
+    }
+    std::printf("all checks passed\n");
+    return 0;
+}
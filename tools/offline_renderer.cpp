@@ -0,0 +1,584 @@
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <agz-utils/mesh.h>
+
+#include "../src/cpu/async_lut_builder.h"
+#include "../src/cpu/frame_batch.h"
+#include "../src/cpu/frame_renderer.h"
+#include "../src/cpu/image_io.h"
+#include "../src/cpu/lut_cache.h"
+#include "../src/cpu/profiler.h"
+
+namespace
+{
+
+    using Clock = std::chrono::steady_clock;
+
+    // demo defaults, see TransmittanceLUT, MultiScatteringLUT and main.cpp
+    constexpr int TRANSMITTANCE_STEP_COUNT = 1000;
+    constexpr int MS_RAY_MARCH_STEP_COUNT  = 256;
+    constexpr int MS_DIR_SAMPLE_COUNT      = 64;
+    constexpr int SKY_STEP_COUNT           = 40;
+    constexpr int AERIAL_STEPS_PER_SLICE   = 1;
+
+    constexpr QuadratureScheme TRANSMITTANCE_QUADRATURE = QuadratureScheme::Midpoint;
+    constexpr QuadratureScheme MS_RAY_MARCH_QUADRATURE  = QuadratureScheme::Midpoint;
+
+    constexpr uint32_t MS_DIR_SAMPLE_SEED = 0;
+
+    constexpr float MAX_AERIAL_DISTANCE = 2000;
+    constexpr float SUN_DISK_SIZE       = 0.004649f;
+
+    const Int2 TRANSMITTANCE_RES = { 256, 256 };
+    const Int2 MS_RES            = { 256, 256 };
+    const Int2 SKY_RES           = { 64, 64 };
+    const Int3 AERIAL_RES        = { 200, 150, 32 };
+
+    const Float3 MS_TERRAIN_ALBEDO = Float3(0.3f);
+    const Float3 MESH_ALBEDO       = Float3(0.1f);
+
+    struct Options
+    {
+        std::string objFilename   = "./asset/terrain.obj";
+        std::string outFilename   = "./frame.pfm";
+        std::string cacheDir      = "./cache/lut";
+        std::string traceFilename;
+        std::string sunListFilename;
+
+        Int2   res          = { 640, 480 };
+        Float3 cameraPos    = { 4.087f, 3.6999f, 3.957f };
+        Float2 cameraDir    = { 3.687f, 0 };
+        float  fovDeg       = 60;
+        Float2 sunAngles    = { 0, 11.6f };
+        float  sunIntensity = 10;
+        float  worldScale   = 200;
+
+        std::string atmosphere = "earth";
+
+        bool enableShadow = true;
+        Int2 shadowRes    = { 2048, 2048 };
+
+        bool enableSkyAtlas = false;
+
+        int   amortizeFrameCount = 0;
+        float lutBudgetUs        = 2000;
+
+        int   aerialStepsPerSlice = AERIAL_STEPS_PER_SLICE;
+        int   aerialSliceCount    = AERIAL_RES.z;
+        float aerialSliceExponent = 1;
+        float temporalAerialBlend = 0;
+
+        int dayCycleFrameCount = 0;
+        int slotCount          = 0;
+        int threadCount        = 0;
+    };
+
+    void printUsage()
+    {
+        std::fprintf(stderr,
+            "usage: OfflineRenderer [options]\n"
+            "  --obj FILE           mesh to render (default ./asset/terrain.obj)\n"
+            "  --out FILE           output PFM image (default ./frame.pfm). batch\n"
+            "                       frames get their index appended to the name.\n"
+            "  --size WxH           image resolution (default 640x480)\n"
+            "  --camera X,Y,Z       camera position (default 4.087,3.6999,3.957)\n"
+            "  --direction H,V      camera direction in radians (default 3.687,0)\n"
+            "  --fov DEG            vertical field of view (default 60)\n"
+            "  --sun X,Y            sun angles in degrees (default 0,11.6)\n"
+            "  --sun-intensity I    sun radiance (default 10)\n"
+            "  --sun-list FILE      batch mode, one frame per 'X,Y' line of sun\n"
+            "                       angles in FILE\n"
+            "  --day-cycle N        batch mode, N frames of a day starting at\n"
+            "                       sunrise. the sun turns once around and peaks\n"
+            "                       at an elevation of 60 degrees.\n"
+            "  --slots N            frames in flight in batch mode (default\n"
+            "                       the thread count)\n"
+            "  --atmosphere NAME    earth, hazy or clear (default earth)\n"
+            "  --world-scale S      atmosphere km per world unit (default 200)\n"
+            "  --no-shadow          disable the terrain shadow map\n"
+            "  --shadow-res N       shadow map resolution (default 2048)\n"
+            "  --sky-atlas          bake a sky view atlas over eye heights and\n"
+            "                       sun elevations once, and interpolate the sky\n"
+            "                       view of every frame from it\n"
+            "  --amortize N         batch mode, refresh the sky view and aerial\n"
+            "                       LUTs of a slot's consecutive frames in\n"
+            "                       place, with no texel older than N frames.\n"
+            "                       frame i runs in slot i %% slots, so use\n"
+            "                       --slots 1 for a continuous sequence\n"
+            "  --lut-budget US      time per amortized LUT update before it\n"
+            "                       stops at the required rows (default 2000)\n"
+            "  --aerial-steps N     ray march steps per aerial slice (default 1)\n"
+            "  --aerial-slices N    depth slices of the aerial volume (default 32)\n"
+            "  --aerial-exponent K  aerial slice distances grow as w^K over the\n"
+            "                       depth coordinate w, 1 is linear (default 1)\n"
+            "  --temporal-aerial B  batch mode, jitter the aerial march per frame\n"
+            "                       and blend each slot's consecutive volumes\n"
+            "                       with weight B, e.g. 0.1. see --amortize\n"
+            "  --threads N          worker threads (default all hardware threads)\n"
+            "  --cache DIR          transmittance / multi-scattering LUT cache\n"
+            "                       shared with the demo (default ./cache/lut)\n"
+            "  --trace FILE         write a chrome trace of the stages to FILE\n");
+    }
+
+    // parses count comma-separated floats
+    bool parseFloats(const char *str, int count, float *output)
+    {
+        for(int i = 0; i < count; ++i)
+        {
+            char *end;
+            output[i] = std::strtof(str, &end);
+            if(end == str)
+                return false;
+            str = end;
+            if(i + 1 < count)
+            {
+                if(*str != ',')
+                    return false;
+                ++str;
+            }
+        }
+        return *str == '\0';
+    }
+
+    bool parseOptions(int argc, char *argv[], Options &options)
+    {
+        for(int i = 1; i < argc; ++i)
+        {
+            const char *arg   = argv[i];
+            const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+            if(!std::strcmp(arg, "--no-shadow"))
+            {
+                options.enableShadow = false;
+                continue;
+            }
+
+            if(!std::strcmp(arg, "--sky-atlas"))
+            {
+                options.enableSkyAtlas = true;
+                continue;
+            }
+
+            if(!value)
+                return false;
+            ++i;
+
+            if(!std::strcmp(arg, "--obj"))
+                options.objFilename = value;
+            else if(!std::strcmp(arg, "--out"))
+                options.outFilename = value;
+            else if(!std::strcmp(arg, "--cache"))
+                options.cacheDir = value;
+            else if(!std::strcmp(arg, "--trace"))
+                options.traceFilename = value;
+            else if(!std::strcmp(arg, "--sun-list"))
+                options.sunListFilename = value;
+            else if(!std::strcmp(arg, "--atmosphere"))
+                options.atmosphere = value;
+            else if(!std::strcmp(arg, "--size"))
+            {
+                if(std::sscanf(value, "%dx%d", &options.res.x, &options.res.y) != 2 ||
+                   options.res.x <= 0 || options.res.y <= 0)
+                    return false;
+            }
+            else if(!std::strcmp(arg, "--camera"))
+            {
+                if(!parseFloats(value, 3, &options.cameraPos.x))
+                    return false;
+            }
+            else if(!std::strcmp(arg, "--direction"))
+            {
+                if(!parseFloats(value, 2, &options.cameraDir.x))
+                    return false;
+            }
+            else if(!std::strcmp(arg, "--sun"))
+            {
+                if(!parseFloats(value, 2, &options.sunAngles.x))
+                    return false;
+            }
+            else if(!std::strcmp(arg, "--fov"))
+                options.fovDeg = std::strtof(value, nullptr);
+            else if(!std::strcmp(arg, "--sun-intensity"))
+                options.sunIntensity = std::strtof(value, nullptr);
+            else if(!std::strcmp(arg, "--world-scale"))
+                options.worldScale = std::strtof(value, nullptr);
+            else if(!std::strcmp(arg, "--shadow-res"))
+            {
+                const int res = (std::max)(std::atoi(value), 1);
+                options.shadowRes = { res, res };
+            }
+            else if(!std::strcmp(arg, "--day-cycle"))
+                options.dayCycleFrameCount = (std::max)(std::atoi(value), 1);
+            else if(!std::strcmp(arg, "--amortize"))
+                options.amortizeFrameCount = (std::max)(std::atoi(value), 1);
+            else if(!std::strcmp(arg, "--lut-budget"))
+                options.lutBudgetUs = std::strtof(value, nullptr);
+            else if(!std::strcmp(arg, "--aerial-steps"))
+                options.aerialStepsPerSlice = (std::max)(std::atoi(value), 1);
+            else if(!std::strcmp(arg, "--aerial-slices"))
+                options.aerialSliceCount = (std::max)(std::atoi(value), 1);
+            else if(!std::strcmp(arg, "--aerial-exponent"))
+                options.aerialSliceExponent = std::strtof(value, nullptr);
+            else if(!std::strcmp(arg, "--temporal-aerial"))
+                options.temporalAerialBlend = std::strtof(value, nullptr);
+            else if(!std::strcmp(arg, "--slots"))
+                options.slotCount = (std::max)(std::atoi(value), 1);
+            else if(!std::strcmp(arg, "--threads"))
+                options.threadCount = (std::max)(std::atoi(value), 1);
+            else
+                return false;
+        }
+
+        return true;
+    }
+
+    // presets only differ in the amount of aerosols
+    bool getAtmosphere(const std::string &name, AtmosphereProperties &atmos)
+    {
+        atmos = AtmosphereProperties();
+        if(name == "earth")
+            return true;
+        if(name == "hazy")
+        {
+            atmos.scatterMie *= 4;
+            atmos.absorbMie  *= 4;
+            atmos.hDensityMie = 2;
+            return true;
+        }
+        if(name == "clear")
+        {
+            atmos.scatterMie *= 0.25f;
+            atmos.absorbMie  *= 0.25f;
+            return true;
+        }
+        return false;
+    }
+
+    bool isBatch(const Options &options)
+    {
+        return !options.sunListFilename.empty() || options.dayCycleFrameCount > 0;
+    }
+
+    // empty when the sun list can't be read
+    std::vector<Float2> getSunAngles(const Options &options)
+    {
+        std::vector<Float2> result;
+        if(!options.sunListFilename.empty())
+        {
+            FILE *file = std::fopen(options.sunListFilename.c_str(), "r");
+            if(!file)
+                return {};
+
+            Float2 angles;
+            while(std::fscanf(file, " %f , %f", &angles.x, &angles.y) == 2)
+                result.push_back(angles);
+            std::fclose(file);
+            return result;
+        }
+
+        if(options.dayCycleFrameCount > 0)
+        {
+            for(int i = 0; i < options.dayCycleFrameCount; ++i)
+            {
+                const float t = static_cast<float>(i) / options.dayCycleFrameCount;
+                result.push_back({ 360 * t, 60 * std::sin(2 * PI * t) });
+            }
+            return result;
+        }
+
+        return { options.sunAngles };
+    }
+
+    // frame.pfm -> frame_0042.pfm
+    std::string getFrameFilename(const Options &options, int frameIndex)
+    {
+        char suffix[16];
+        std::snprintf(suffix, sizeof(suffix), "_%04d", frameIndex);
+
+        const std::string &filename = options.outFilename;
+        const size_t dot   = filename.find_last_of('.');
+        const size_t slash = filename.find_last_of("/\\");
+        if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            return filename + suffix;
+        return filename.substr(0, dot) + suffix + filename.substr(dot);
+    }
+
+    double getMs(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // loads both tables from the cache, baking and storing the missing ones
+    // with the same keys as the demo
+    bool loadLUTs(
+        const Options              &options,
+        const AtmosphereProperties &stdUnitAtmos,
+        Table2D<Float4>            &T,
+        Table2D<Float4>            &M)
+    {
+        const LUTCache cache(options.cacheDir);
+
+        const uint64_t transHash = hashTransmittanceInputs(
+            stdUnitAtmos, TRANSMITTANCE_RES, TransmittanceMode::RayMarch,
+            TRANSMITTANCE_STEP_COUNT, TRANSMITTANCE_QUADRATURE);
+        const uint64_t msHash = hashMultiScatteringInputs(
+            stdUnitAtmos, MS_RES, MS_RAY_MARCH_STEP_COUNT,
+            MS_RAY_MARCH_QUADRATURE, MS_DIR_SAMPLE_COUNT,
+            MS_DIR_SAMPLE_SEED, MS_TERRAIN_ALBEDO, transHash);
+
+        auto cachedT = cache.load(LUTKind::Transmittance, transHash, TRANSMITTANCE_RES);
+        auto cachedM = cache.load(LUTKind::MultiScattering, msHash, MS_RES);
+        if(cachedT && cachedM)
+        {
+            T = cachedT->findTable(LUTKind::Transmittance)->decode();
+            M = cachedM->findTable(LUTKind::MultiScattering)->decode();
+            std::printf("transmittance and multi-scattering LUTs loaded from cache\n");
+            return true;
+        }
+
+        LUTBuildRequest request;
+        request.atmos                             = stdUnitAtmos;
+        request.transmittanceRes                  = TRANSMITTANCE_RES;
+        request.transmittanceMode                 = TransmittanceMode::RayMarch;
+        request.transmittanceStepCount            = TRANSMITTANCE_STEP_COUNT;
+        request.transmittanceQuadrature           = TRANSMITTANCE_QUADRATURE;
+        request.multiScatteringRes                = MS_RES;
+        request.multiScatteringRayMarchStepCount  = MS_RAY_MARCH_STEP_COUNT;
+        request.multiScatteringRayMarchQuadrature = MS_RAY_MARCH_QUADRATURE;
+        request.dirSampleCount                    = MS_DIR_SAMPLE_COUNT;
+        request.dirSampleSeed                     = MS_DIR_SAMPLE_SEED;
+        request.terrainAlbedo                     = MS_TERRAIN_ALBEDO;
+        if(cachedT)
+        {
+            request.transmittance = std::make_shared<Table2D<Float4>>(
+                cachedT->findTable(LUTKind::Transmittance)->decode());
+        }
+
+        const auto start = Clock::now();
+
+        AsyncLUTBuilder builder(options.threadCount);
+        builder.request(std::move(request));
+        builder.wait();
+
+        auto set = builder.getLatest();
+        if(!set)
+            return false;
+
+        std::printf(
+            "transmittance and multi-scattering LUTs baked in %.1f ms\n",
+            getMs(start));
+
+        T = set->transmittance;
+        M = set->multiScattering;
+
+        if(!cachedT)
+            cache.store(LUTKind::Transmittance, transHash, T);
+        cache.store(LUTKind::MultiScattering, msHash, M);
+        return true;
+    }
+
+    bool loadScene(const Options &options, CPUMeshScene &scene)
+    {
+        std::vector<CPUMeshScene::Vertex> vertices;
+        try
+        {
+            for(auto &t : agz::mesh::load_from_file(options.objFilename))
+            {
+                for(auto &v : t.vertices)
+                    vertices.push_back({ v.position, v.normal, MESH_ALBEDO / PI });
+            }
+        }
+        catch(const std::exception &e)
+        {
+            std::fprintf(stderr, "%s\n", e.what());
+            return false;
+        }
+
+        scene.addMesh(vertices, Trans4::translate(0, 1, 0));
+        scene.build();
+        return true;
+    }
+
+} // namespace anonymous
+
+// usage: OfflineRenderer [options], see printUsage
+// renders one frame of the demo on the CPU and writes it as a linear HDR
+// image, without tonemapping or dithering. the defaults match the demo's
+// initial view. in batch mode, one frame per sun is rendered through
+// CPUFrameBatchRenderer, sharing every stage that doesn't depend on the sun.
+int main(int argc, char *argv[])
+{
+    Options options;
+    if(!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    AtmosphereProperties atmos;
+    if(!getAtmosphere(options.atmosphere, atmos))
+    {
+        std::fprintf(stderr, "unknown atmosphere: %s\n", options.atmosphere.c_str());
+        return 1;
+    }
+    const AtmosphereProperties stdUnitAtmos = atmos.toStdUnit();
+
+    const auto sceneStart = Clock::now();
+    CPUMeshScene scene;
+    if(!loadScene(options, scene))
+    {
+        std::fprintf(stderr, "failed to load %s\n", options.objFilename.c_str());
+        return 1;
+    }
+    std::printf(
+        "%zu triangles loaded in %.1f ms\n",
+        scene.getTriangleCount(), getMs(sceneStart));
+
+    Table2D<Float4> T, M;
+    if(!loadLUTs(options, stdUnitAtmos, T, M))
+    {
+        std::fprintf(stderr, "failed to bake the LUTs\n");
+        return 1;
+    }
+
+    Camera camera;
+    camera.setPosition(options.cameraPos);
+    camera.setDirection(options.cameraDir.x, options.cameraDir.y);
+    camera.setPerspective(options.fovDeg, 0.1f, 100.0f);
+    camera.setWOverH(static_cast<float>(options.res.x) / options.res.y);
+    camera.recalculateMatrics();
+
+    const std::vector<Float2> sunAngles = getSunAngles(options);
+    if(sunAngles.empty())
+    {
+        std::fprintf(stderr, "failed to read %s\n", options.sunListFilename.c_str());
+        return 1;
+    }
+
+    CPUFrameRenderer renderer;
+    renderer.setThreadCount(options.threadCount);
+    renderer.setAtmosphere(stdUnitAtmos);
+    renderer.setLUTs(&T, true, &M);
+    renderer.setCamera(camera);
+    renderer.setWorldScale(options.worldScale);
+    renderer.setSkyLUT(SKY_RES, SKY_STEP_COUNT);
+    renderer.setAerialLUT(
+        { AERIAL_RES.x, AERIAL_RES.y, options.aerialSliceCount },
+        MAX_AERIAL_DISTANCE, options.aerialStepsPerSlice, options.aerialSliceExponent);
+    renderer.setScene(&scene);
+
+    if(options.amortizeFrameCount > 0)
+    {
+        AmortizedUpdateSettings amortized;
+        amortized.order          = AmortizedOrder::Priority;
+        amortized.maxStaleFrames = options.amortizeFrameCount;
+        amortized.budgetUs       = options.lutBudgetUs;
+        renderer.setAmortizedLUTs(true, amortized);
+    }
+
+    if(options.temporalAerialBlend > 0)
+        renderer.setTemporalAerial(true, options.temporalAerialBlend);
+
+    CPUSkyViewAtlas skyAtlas;
+    if(options.enableSkyAtlas)
+    {
+        const auto atlasStart = Clock::now();
+        skyAtlas.setAtmosphere(stdUnitAtmos);
+        skyAtlas.setRayMarching(SKY_STEP_COUNT);
+        skyAtlas.setTransmittance(&T);
+        skyAtlas.setMultiScattering(true, &M);
+        skyAtlas.setThreadCount(options.threadCount);
+        skyAtlas.bake(SKY_RES);
+        renderer.setSkyAtlas(&skyAtlas);
+        std::printf("sky view atlas baked in %.1f ms\n", getMs(atlasStart));
+    }
+
+    auto setSun = [&](const Float2 &angles, CPUFrameRenderer &frameRenderer)
+    {
+        const Float3 sunDirection = computeSunDirection(angles.x, angles.y);
+        frameRenderer.setSun(
+            sunDirection, Float3(options.sunIntensity), SUN_DISK_SIZE);
+        frameRenderer.setShadow(
+            options.enableShadow, computeSunViewProj(sunDirection),
+            options.shadowRes);
+    };
+
+    const auto renderStart = Clock::now();
+    bool saved = true;
+
+    if(!isBatch(options))
+    {
+        setSun(sunAngles[0], renderer);
+        renderer.render(options.res);
+        saved = savePFM(options.outFilename, renderer.getImage());
+        if(!saved)
+            std::fprintf(stderr, "failed to write %s\n", options.outFilename.c_str());
+    }
+    else
+    {
+        // primary rays only depend on the camera, trace them once for all
+        CPUFrameRenderer::Visibility visibility;
+        renderer.traceVisibility(options.res, visibility);
+        renderer.setVisibility(&visibility);
+
+        std::mutex saveMutex;
+
+        CPUFrameBatchRenderer batch;
+        batch.setThreadCount(options.threadCount);
+        batch.setSlotCount(options.slotCount);
+        batch.render(
+            renderer, static_cast<int>(sunAngles.size()),
+            [&](int frameIndex, CPUFrameRenderer &frameRenderer)
+        {
+            setSun(sunAngles[frameIndex], frameRenderer);
+        },
+            [&](int frameIndex, const Table2D<Float3> &image)
+        {
+            const std::string filename = getFrameFilename(options, frameIndex);
+            if(!savePFM(filename, image))
+            {
+                std::lock_guard lk(saveMutex);
+                std::fprintf(stderr, "failed to write %s\n", filename.c_str());
+                saved = false;
+            }
+        });
+    }
+
+    const double renderMs = getMs(renderStart);
+    std::printf(
+        "%zu %dx%d frame(s) rendered in %.1f ms, %.1f ms per frame\n",
+        sunAngles.size(), options.res.x, options.res.y, renderMs,
+        renderMs / sunAngles.size());
+
+    Profiler &profiler = Profiler::getInstance();
+    profiler.update();
+    std::printf("  %-40s %6s %10s\n", "zone", "count", "mean ms");
+    for(auto &[name, stats] : profiler.getStats())
+    {
+        if(name.starts_with("CPU"))
+        {
+            std::printf(
+                "  %-40s %6d %10.2f\n", name.c_str(), stats.count, stats.meanMs);
+        }
+    }
+
+    if(!options.traceFilename.empty() &&
+       !profiler.exportChromeTrace(options.traceFilename))
+    {
+        std::fprintf(stderr, "failed to write %s\n", options.traceFilename.c_str());
+    }
+
+    if(!saved)
+        return 1;
+
+    return 0;
+}